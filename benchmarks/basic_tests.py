@@ -133,6 +133,92 @@ def basic_test(model_d="ies_10par_xsec"):
                            slave_root=model_d,local=local,port=port)
 
 
+def read_dense(filename):
+    """read a dense binary ensemble file: char[8] magic, int64 n_real, int64 n_var, int64 offset
+    of the names, the values column-major, then the real and var names (int32 length + chars)
+    """
+    with open(filename,'rb') as f:
+        magic = f.read(8)
+        assert magic == b"PSTDENS1",magic
+        n_real,n_var,offset = np.fromfile(f,dtype=np.int64,count=3)
+        vals = np.fromfile(f,dtype=np.float64,count=n_real * n_var).reshape((n_var,n_real)).transpose()
+        f.seek(offset)
+        names = []
+        for _ in range(n_real + n_var):
+            n = np.fromfile(f,dtype=np.int32,count=1)[0]
+            names.append(f.read(n).decode().lower())
+    return pd.DataFrame(vals,index=names[:n_real],columns=names[n_real:])
+
+
+def ies_dense_test():
+    """write the initial par ensemble with ies_save_dense, read it back as the par ensemble
+    (all reals and the first few) and check a corrupted dense file is rejected
+    """
+    model_d = "ies_10par_xsec"
+    local=True
+    if "linux" in platform.platform().lower() and "10par" in model_d:
+        #print("travis_prep")
+        #prep_for_travis(model_d)
+        local=False
+
+    t_d = os.path.join(model_d,"template")
+    pst = pyemu.Pst(os.path.join(t_d,"pest.pst"))
+    pe = pyemu.ParameterEnsemble.from_uniform_draw(pst,num_reals=num_reals)
+    pe.index = ["r{0}".format(i) for i in range(num_reals)]
+    pe.to_csv(os.path.join(t_d,"par.csv"))
+    # just evaluate the initial ensemble
+    pst.control_data.noptmax = -1
+
+    def run(tag,par_file,options):
+        m_d = os.path.join(model_d,"master_ies_dense_{0}".format(tag))
+        if os.path.exists(m_d):
+            shutil.rmtree(m_d)
+        pst.pestpp_options = {"ies_parameter_ensemble":par_file,"ies_include_base":False,
+                              "ies_csv_by_reals":True}
+        pst.pestpp_options.update(options)
+        pst_name = "pest_dense_{0}.pst".format(tag)
+        pst.write(os.path.join(t_d,pst_name))
+        pyemu.os_utils.start_slaves(t_d, exe_path, pst_name, 5, master_dir=m_d,
+                               slave_root=model_d,local=local,port=port)
+        return os.path.join(m_d,pst_name.replace(".pst",""))
+
+    # write
+    base = run("write","par.csv",{"ies_num_reals":num_reals,"ies_save_dense":True})
+    df_dense = read_dense(base+".0.par.bin")
+    df_csv = pd.read_csv(os.path.join(t_d,"par.csv"),index_col=0)
+    df_csv.columns = df_csv.columns.str.lower()
+    assert list(df_dense.index) == list(df_csv.index)
+    d = np.abs(df_dense.loc[:,df_csv.columns].values - df_csv.values).max()
+    print(d)
+    assert d < 1.0e-10 * max(1.0,np.abs(df_csv.values).max()),d
+    shutil.copy2(base+".0.par.bin",os.path.join(t_d,"par_dense.bin"))
+
+    # read all the reals and then just the first few
+    for tag,n in [("read",num_reals),("read_subset",5)]:
+        base = run(tag,"par_dense.bin",{"ies_num_reals":n})
+        df = pd.read_csv(base+".0.par.csv",index_col=0)
+        df.index = df.index.map(str)
+        assert list(df.index) == list(df_dense.index[:n]),df.index
+        d = np.abs(df.loc[:,df_dense.columns].values - df_dense.iloc[:n,:].values).max()
+        print(tag,d)
+        assert d < 1.0e-5 * max(1.0,np.abs(df_dense.values).max()),d
+
+    # corrupt the magic and then the number of reals in the header
+    with open(os.path.join(t_d,"par_dense.bin"),'rb') as f:
+        b = f.read()
+    for tag,bad in [("bad_magic",b"XXXXXXXX" + b[8:]),
+                    ("bad_header",b[:8] + np.array([num_reals * 1000],dtype=np.int64).tobytes() + b[16:])]:
+        with open(os.path.join(t_d,"par_{0}.bin".format(tag)),'wb') as f:
+            f.write(bad)
+        try:
+            base = run(tag,"par_{0}.bin".format(tag),{})
+        except Exception as e:
+            print(tag,str(e))
+            base = os.path.join(model_d,"master_ies_dense_{0}".format(tag),"pest_dense_{0}".format(tag))
+        with open(base+".rec",'r') as f:
+            assert "error processing par ensemble dense binary file" in f.read(),tag
+
+
 
 def glm_save_binary_test():
     model_d = "ies_10par_xsec"
@@ -255,6 +341,162 @@ def tie_by_group_test():
 
 
 
+def glm_lsqr_test():
+    """compare the phi of the matrix-free LSQR upgrade with the default JtQJ upgrade
+    """
+    model_d = "ies_10par_xsec"
+    local=True
+    if "linux" in platform.platform().lower() and "10par" in model_d:
+        #print("travis_prep")
+        #prep_for_travis(model_d)
+        local=False
+
+    t_d = os.path.join(model_d,"template")
+    pst = pyemu.Pst(os.path.join(t_d,"pest.pst"))
+    pst.control_data.noptmax = 3
+    phis = {}
+    for mat_inv in ["jtqj","lsqr"]:
+        m_d = os.path.join(model_d,"master_mat_inv_{0}".format(mat_inv))
+        if os.path.exists(m_d):
+            shutil.rmtree(m_d)
+        pst.pestpp_options = {"mat_inv":mat_inv}
+        pst_name = "pest_{0}.pst".format(mat_inv)
+        pst.write(os.path.join(t_d,pst_name))
+        pyemu.os_utils.start_slaves(t_d, exe_path.replace("-ies","-glm"), pst_name, 10, master_dir=m_d,
+                               slave_root=model_d,local=local,port=port)
+        df = pd.read_csv(os.path.join(m_d,pst_name.replace(".pst",".iobj")),index_col=0)
+        phis[mat_inv] = df.loc[:,"total_phi"]
+        print(mat_inv,phis[mat_inv])
+    d = np.abs(phis["lsqr"].iloc[-1] - phis["jtqj"].iloc[-1])
+    print(d)
+    assert d < 1.0e-2 * max(1.0,phis["jtqj"].iloc[-1]),d
+
+
+def glm_broyden_test():
+    """compare the phi of Broyden jacobian updates between iterations with recomputing the
+    jacobian every iteration and check the jco still holds the finite-difference jacobian
+    """
+    model_d = "ies_10par_xsec"
+    local=True
+    if "linux" in platform.platform().lower() and "10par" in model_d:
+        #print("travis_prep")
+        #prep_for_travis(model_d)
+        local=False
+
+    t_d = os.path.join(model_d,"template")
+    pst = pyemu.Pst(os.path.join(t_d,"pest.pst"))
+    # any phi reduction allows an update, so the first iteration always triggers one
+    pst.control_data.phiredswh = 0.0
+    phis = {}
+    m_ds = {}
+    for tag,noptmax,broyden_iters in [("fd",4,0),("broyden",4,2),("fd_1",1,0),("broyden_1",2,1)]:
+        m_d = os.path.join(model_d,"master_broyden_{0}".format(tag))
+        if os.path.exists(m_d):
+            shutil.rmtree(m_d)
+        pst.control_data.noptmax = noptmax
+        pst.pestpp_options = {}
+        if broyden_iters > 0:
+            pst.pestpp_options["jac_broyden_iters"] = broyden_iters
+        pst_name = "pest_broyden_{0}.pst".format(tag)
+        pst.write(os.path.join(t_d,pst_name))
+        pyemu.os_utils.start_slaves(t_d, exe_path.replace("-ies","-glm"), pst_name, 10, master_dir=m_d,
+                               slave_root=model_d,local=local,port=port)
+        df = pd.read_csv(os.path.join(m_d,pst_name.replace(".pst",".iobj")),index_col=0)
+        phis[tag] = df.loc[:,"total_phi"]
+        m_ds[tag] = os.path.join(m_d,pst_name.replace(".pst",""))
+        print(tag,phis[tag])
+    d = np.abs(phis["broyden"].iloc[-1] - phis["fd"].iloc[-1])
+    print(d)
+    assert d < 1.0e-1 * max(1.0,phis["fd"].iloc[-1]),d
+
+    # the second iteration used the updated jacobian:  the jco must still be the finite-difference
+    # jacobian of the first iteration, while the jcb holds the updated one
+    with open(m_ds["broyden_1"]+".rec",'r') as f:
+        assert "updated by Broyden" in f.read()
+    jco_fd = pyemu.Jco.from_binary(m_ds["fd_1"]+".jco").to_dataframe()
+    jco = pyemu.Jco.from_binary(m_ds["broyden_1"]+".jco").to_dataframe()
+    jcb = pyemu.Jco.from_binary(m_ds["broyden_1"]+".jcb").to_dataframe()
+    d = np.abs(jco - jco_fd).values.max()
+    print(d)
+    assert d == 0.0,d
+    d = np.abs(jcb - jco).values.max()
+    print(d)
+    assert d > 0.0,d
+
+
+def tplins_test():
+    """write and read back the parameter values through a template file and several
+    instruction files that use markers, line advances, whitespace, fixed and semi-fixed
+    columns and dum observations"""
+    model_d = "ies_10par_xsec"
+    local=True
+    if "linux" in platform.platform().lower() and "10par" in model_d:
+        #print("travis_prep")
+        #prep_for_travis(model_d)
+        local=False
+
+    t_d = os.path.join(model_d,"template")
+    m_d = os.path.join(model_d,"master_tplins")
+    if os.path.exists(m_d):
+        shutil.rmtree(m_d)
+    pst = pyemu.Pst(os.path.join(t_d,"pest.pst"))
+    par = pst.parameter_data
+    # give every par a different value (inside all the bounds) so a misread shows up
+    par.loc[:,"parval1"] = np.linspace(0.25,3.0,pst.npar)
+    par.loc[:,"scale"] = 1.0
+    par.loc[:,"offset"] = 0.0
+
+    # each par on its own line: "pvNNN: <20 char field> 9.5", the value field is columns 8-27
+    out_file = "tplins.dat"
+    with open(os.path.join(t_d,out_file+".tpl"),'w') as f:
+        f.write("ptf ~\n")
+        f.write("tplins test file\n")
+        for i,pname in enumerate(pst.par_names):
+            f.write("pv{0:03d}: ~{1:^18s}~ 9.5\n".format(i,pname))
+
+    # primary markers and whitespace
+    with open(os.path.join(t_d,"tplins_a.dat.ins"),'w') as f:
+        f.write("pif @\n")
+        for i in range(pst.npar):
+            f.write("@pv{0:03d}:@ !tia_{0:03d}!\n".format(i))
+    # line advance and fixed columns
+    with open(os.path.join(t_d,"tplins_b.dat.ins"),'w') as f:
+        f.write("pif @\n")
+        f.write("l2 [tib_000]8:27\n")
+        for i in range(1,pst.npar):
+            f.write("l1 [tib_{0:03d}]8:27\n".format(i))
+    # whitespace, semi-fixed columns and dum observations, every other line
+    with open(os.path.join(t_d,"tplins_c.dat.ins"),'w') as f:
+        f.write("pif @\n")
+        for i in range(0,pst.npar,2):
+            if i % 4 == 0:
+                f.write("l2 w !tic_{0:03d}! !dum!\n".format(i))
+            else:
+                f.write("l2 (tic_{0:03d})8:27 !dum!\n".format(i))
+
+    pst.template_files.append(out_file+".tpl")
+    pst.input_files.append(out_file)
+    for ins_file in ["tplins_a.dat.ins","tplins_b.dat.ins","tplins_c.dat.ins"]:
+        pst.add_observations(os.path.join(t_d,ins_file),out_file=os.path.join(t_d,out_file),
+                             pst_path=".",inschek=False)
+    pst.control_data.noptmax = 0
+    pst.pestpp_options = {}
+    pst.write(os.path.join(t_d,"pest_tplins.pst"))
+    pyemu.os_utils.start_slaves(t_d, exe_path.replace("-ies","-glm"), "pest_tplins.pst", 1, master_dir=m_d,
+                           slave_root=model_d,local=local,port=port)
+
+    res = pyemu.pst_utils.read_resfile(os.path.join(m_d,"pest_tplins.rei"))
+    res.index = res.name.str.lower()
+    for i,pname in enumerate(pst.par_names):
+        names = ["tia_{0:03d}".format(i),"tib_{0:03d}".format(i)]
+        if i % 2 == 0:
+            names.append("tic_{0:03d}".format(i))
+        for oname in names:
+            d = np.abs(res.loc[oname,"modelled"] - par.loc[pname,"parval1"])
+            print(oname,pname,d)
+            assert d < 1.0e-6 * max(1.0,np.abs(par.loc[pname,"parval1"])),oname
+
+
 
 if __name__ == "__main__":
     #basic_test("ies_10par_xsec")
@@ -262,3 +504,7 @@ if __name__ == "__main__":
     #sweep_forgive_test()
     #inv_regul_test()
     #tie_by_group_test()
+    #tplins_test()
+    #glm_lsqr_test()
+    #glm_broyden_test()
+    #ies_dense_test()
@@ -232,7 +232,7 @@ int  NetPackage::recv(int sockfd)
 			// is use to represent a standard char
 			for (int i = 0; i < DESC_LEN; ++i)
 			{
-				if (!allowable_ascii_char(header_buf[i_start + 1]))
+				if (!allowable_ascii_char(header_buf[i_start + i]))
 				{
 					corrupt_desc = true;
 					n = -2;
@@ -240,7 +240,7 @@ int  NetPackage::recv(int sockfd)
 				}
 				else
 				{
-					desc[i] = header_buf[i_start + 1];
+					desc[i] = header_buf[i_start + i];
 				}
 			}
 			i_start += sizeof(desc);
@@ -273,6 +273,11 @@ int  NetPackage::recv(int sockfd)
 	return n;  // -2 on corrupt read, -1 on failure, 0 on a close connection or 1 on success
 }
 
+string NetPackage::get_desc() const
+{
+	return string((const char*)desc, strnlen((const char*)desc, DESC_LEN));
+}
+
 void NetPackage::print_header(std::ostream &fout)
 {
 	fout << "NetPackage: type = " << int(type) <<", group = " << group << ", run_id = " << run_id << ", description = " << desc <<
@@ -19,7 +19,8 @@ public:
 	static std::vector<int8_t> pack_string(InputIterator first, InputIterator last);
 	enum class PackType :uint32_t {
 		UNKN, OK, CONFIRM_OK, READY, REQ_RUNDIR, RUNDIR, REQ_LINPACK, LINPACK, PAR_NAMES, OBS_NAMES,
-		START_RUN, RUN_FINISHED, RUN_FAILED, RUN_KILLED, TERMINATE,PING,REQ_KILL,IO_ERROR,CORRUPT_MESG};
+		START_RUN, RUN_FINISHED, RUN_FAILED, RUN_KILLED, TERMINATE,PING,REQ_KILL,IO_ERROR,CORRUPT_MESG,
+		REQ_COMPRESSION, RUN_FINISHED_COMPRESSED, REQ_BATCH_RUNS, BATCH_RUNS_OK, START_RUNS, SLOTS};
 	static int get_new_group_id();
 	NetPackage(PackType _type=PackType::UNKN, int _group=-1, int _run_id=-1, const std::string &desc_str="");
 	~NetPackage(){}
@@ -30,6 +31,7 @@ public:
 	PackType get_type() const {return type;}
 	int64_t get_run_id() const { return run_id; }
 	int64_t get_group_id() const { return group; }
+	std::string get_desc() const;
 	const std::vector<int8_t> &get_data(){ return data; }
 	void print_header(std::ostream &fout);
 
@@ -123,14 +123,15 @@ bool OperSys::double_is_invalid(double x)
 
 
 #ifdef OS_WIN
-PROCESS_INFORMATION start(string &cmd_string)
+PROCESS_INFORMATION start(string &cmd_string, const string &run_dir)
 {
 	char* cmd_line = _strdup(cmd_string.c_str());
 	STARTUPINFO si;
 	PROCESS_INFORMATION pi;
 	ZeroMemory(&si, sizeof(si));
 	ZeroMemory(&pi, sizeof(pi));
-	if (!CreateProcess(NULL, cmd_line, NULL, NULL, false, 0, NULL, NULL, &si, &pi))
+	const char *cur_dir = run_dir.empty() ? NULL : run_dir.c_str();
+	if (!CreateProcess(NULL, cmd_line, NULL, NULL, false, 0, NULL, cur_dir, &si, &pi))
 	{
 		std::string cmd_string(cmd_line);
 		throw std::runtime_error("CreateProcess() failed for command: " + cmd_string);
@@ -141,7 +142,7 @@ PROCESS_INFORMATION start(string &cmd_string)
 
 
 #ifdef OS_LINUX
-int start(string &cmd_string)
+int start(string &cmd_string, const string &run_dir)
 {
 	//split cmd_string on whitespaces
 	stringstream cmd_ss(cmd_string);
@@ -166,15 +167,23 @@ int start(string &cmd_string)
 	//argv[cmds.size() + 1] = NULL; //last arg must be NULL
 
 	arg_v.push_back(NULL);
+	//the child can only safely use async-signal-safe calls, so build the messages here
+	string chdir_msg = "chdir() failed for run directory: " + run_dir + "\n";
+	string exec_msg = "execv() failed for command: " + cmd_string + "\n";
 	pid_t pid = fork();
 	if (pid == 0)
 	{
+		//this is the forked child - don't throw (it would unwind a copy of the parent),
+		//just report and exit
 		setpgid(0, 0);
-		int success = execvp(arg_v[0], const_cast<char* const*>(&(arg_v[0])));
-		if (success == -1)
+		if (!run_dir.empty() && ::chdir(run_dir.c_str()) != 0)
 		{
-			throw std::runtime_error("execv() failed for command: " + cmd_string);
+			write(STDERR_FILENO, chdir_msg.data(), chdir_msg.size());
+			_exit(127);
 		}
+		execvp(arg_v[0], const_cast<char* const*>(&(arg_v[0])));
+		write(STDERR_FILENO, exec_msg.data(), exec_msg.size());
+		_exit(127);
 	}
 	else
 	{
@@ -36,12 +36,13 @@ public:
 	static bool double_is_invalid(double x);
 };
 
+//run_dir is the working directory of the new process (the current directory if empty)
 #ifdef OS_WIN
 #include <Windows.h>
-PROCESS_INFORMATION start(std::string &cmd_string);
+PROCESS_INFORMATION start(std::string &cmd_string, const std::string &run_dir = std::string());
 #endif
 #ifdef OS_LINUX
-int start(std::string &cmd_string);
+int start(std::string &cmd_string, const std::string &run_dir = std::string());
 #endif
 
 
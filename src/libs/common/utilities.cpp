@@ -11,6 +11,11 @@
 #include <cassert>
 #include <mutex>
 #include "config_os.h"
+#ifdef OS_LINUX
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "Transformable.h"
 #include "network_package.h"
 #include <Eigen/Dense>
@@ -307,6 +312,131 @@ void copyfile(const string &from_file, const string &to_file)
     dest.close();
 }
 
+void copy_dir(const string &src_dir, const string &dest_dir, const string &skip_prefix,
+	const std::function<bool(const string&)> &skip_top)
+{
+#ifdef OS_WIN
+	CreateDirectory(dest_dir.c_str(), NULL);
+	WIN32_FIND_DATA find_data;
+	HANDLE h_find = FindFirstFile((src_dir + "\\*").c_str(), &find_data);
+	if (h_find == INVALID_HANDLE_VALUE)
+	{
+		throw PestError("copy_dir(): unable to read directory: " + src_dir);
+	}
+	do
+	{
+		string name(find_data.cFileName);
+		if (name == "." || name == "..") continue;
+		if (!skip_prefix.empty() && name.compare(0, skip_prefix.size(), skip_prefix) == 0) continue;
+		if (skip_top && skip_top(name)) continue;
+		string src = src_dir + "\\" + name;
+		string dest = dest_dir + "\\" + name;
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			copy_dir(src, dest, skip_prefix);
+		}
+		else if (!CopyFile(src.c_str(), dest.c_str(), false))
+		{
+			FindClose(h_find);
+			throw PestError("copy_dir(): unable to copy file: " + src);
+		}
+	} while (FindNextFile(h_find, &find_data) != 0);
+	FindClose(h_find);
+#endif
+#ifdef OS_LINUX
+	struct stat src_stat;
+	if (stat(src_dir.c_str(), &src_stat) != 0)
+	{
+		throw PestError("copy_dir(): unable to read directory: " + src_dir);
+	}
+	mkdir(dest_dir.c_str(), src_stat.st_mode & 0777);
+	DIR *dir = opendir(src_dir.c_str());
+	if (dir == NULL)
+	{
+		throw PestError("copy_dir(): unable to read directory: " + src_dir);
+	}
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		string name(entry->d_name);
+		if (name == "." || name == "..") continue;
+		if (!skip_prefix.empty() && name.compare(0, skip_prefix.size(), skip_prefix) == 0) continue;
+		if (skip_top && skip_top(name)) continue;
+		string src = src_dir + "/" + name;
+		string dest = dest_dir + "/" + name;
+		struct stat entry_stat;
+		if (stat(src.c_str(), &entry_stat) != 0) continue;
+		if (S_ISDIR(entry_stat.st_mode))
+		{
+			copy_dir(src, dest, skip_prefix);
+		}
+		else if (S_ISREG(entry_stat.st_mode))
+		{
+			ifstream source(src, ios::binary);
+			ofstream target(dest, ios::binary | ios::trunc);
+			if ((!source) || (!target))
+			{
+				closedir(dir);
+				throw PestError("copy_dir(): unable to copy file: " + src);
+			}
+			target << source.rdbuf();
+			target.close();
+			//keep the permissions so that scripts and executables can still be run
+			chmod(dest.c_str(), entry_stat.st_mode & 0777);
+		}
+	}
+	closedir(dir);
+#endif
+}
+
+bool remove_dir(const string &dir)
+{
+	bool success = true;
+#ifdef OS_WIN
+	WIN32_FIND_DATA find_data;
+	HANDLE h_find = FindFirstFile((dir + "\\*").c_str(), &find_data);
+	if (h_find != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			string name(find_data.cFileName);
+			if (name == "." || name == "..") continue;
+			string path = dir + "\\" + name;
+			if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				success = remove_dir(path) && success;
+			else if (!DeleteFile(path.c_str()))
+				success = false;
+		} while (FindNextFile(h_find, &find_data) != 0);
+		FindClose(h_find);
+	}
+	if (!RemoveDirectory(dir.c_str()))
+		success = false;
+#endif
+#ifdef OS_LINUX
+	DIR *d = opendir(dir.c_str());
+	if (d != NULL)
+	{
+		struct dirent *entry;
+		while ((entry = readdir(d)) != NULL)
+		{
+			string name(entry->d_name);
+			if (name == "." || name == "..") continue;
+			string path = dir + "/" + name;
+			struct stat entry_stat;
+			//lstat so that a link to a directory is removed, not followed
+			if ((lstat(path.c_str(), &entry_stat) == 0) && (S_ISDIR(entry_stat.st_mode)))
+				success = remove_dir(path) && success;
+			else if (unlink(path.c_str()) != 0)
+				success = false;
+		}
+		closedir(d);
+	}
+	if (rmdir(dir.c_str()) != 0)
+		success = false;
+#endif
+	return success;
+}
+
 template <class keyType, class dataType>
 vector<keyType> get_map_keys(const map<keyType,dataType> &my_map)
 {
@@ -15,6 +15,7 @@
 #include <set>
 #include <mutex>
 #include <exception>
+#include <functional>
 #include "pest_error.h"
 #include "Transformable.h"
 #include "network_package.h"
@@ -217,6 +218,15 @@ class CompareItemInSet
 
 void copyfile(const string &from_file, const string &to_file);
 
+//recursively copies the contents of src_dir into dest_dir (created if needed).
+//Entries whose name starts with skip_prefix are not copied, nor are the top-level
+//entries of src_dir for which skip_top (if given) returns true.
+void copy_dir(const string &src_dir, const string &dest_dir, const string &skip_prefix = "",
+	const std::function<bool(const string&)> &skip_top = nullptr);
+
+//recursively removes dir and everything in it.  Returns false if anything could not be removed
+bool remove_dir(const string &dir);
+
 std::string fortran_str_2_string(char *fstr, int str_len);
 
 std::vector<std::string> fortran_str_array_2_vec(char *fstr, int str_len, int fstr_len);
@@ -2,6 +2,12 @@
 #include <iomanip>
 #include <unordered_set>
 #include <iterator>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
 #include "Ensemble.h"
 #include "RestartController.h"
 #include "utilities.h"
@@ -11,8 +17,16 @@
 #include "covariance.h"
 #include "PerformanceLog.h"
 #include "system_variables.h"
+#include "config_os.h"
+#ifdef OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 mt19937_64 Ensemble::rand_engine = mt19937_64(1);
+const size_t Ensemble::max_draw_values = 250000000;
 
 Ensemble::Ensemble(Pest *_pest_scenario_ptr): pest_scenario_ptr(_pest_scenario_ptr)
 {
@@ -111,6 +125,123 @@ void Ensemble::add_2_cols_ip(Ensemble &other)
 
 }
 
+//Philox4x32-10 (Salmon et al., 2011): a counter-based generator, the output for a given key
+//and counter is always the same no matter which thread asks for it or in what order
+static void philox4x32(uint32_t ctr[4], const uint32_t _key[2])
+{
+	const uint64_t m0 = 0xD2511F53, m1 = 0xCD9E8D57;
+	uint32_t key[2] = { _key[0], _key[1] };
+	for (int round = 0; round < 10; round++)
+	{
+		uint64_t p0 = m0 * ctr[0], p1 = m1 * ctr[2];
+		uint32_t c0 = uint32_t(p1 >> 32) ^ ctr[1] ^ key[0];
+		uint32_t c2 = uint32_t(p0 >> 32) ^ ctr[3] ^ key[1];
+		ctr[1] = uint32_t(p1);
+		ctr[3] = uint32_t(p0);
+		ctr[0] = c0;
+		ctr[2] = c2;
+		key[0] += 0x9E3779B9;
+		key[1] += 0xBB67AE85;
+	}
+}
+
+void Ensemble::fill_standard_normal(Eigen::MatrixXd &mat, uint64_t seed, int num_threads)
+{
+	//each pair of values in a row comes from one counter (row, pair index), so the
+	//deviates only depend on the seed and the shape, not on the number of threads
+	const uint32_t key[2] = { uint32_t(seed), uint32_t(seed >> 32) };
+	const double two_pi = 6.283185307179586476925286766559;
+	const double to_unit = 1.0 / 9007199254740992.0; //2^-53
+	int n_rows = mat.rows(), n_cols = mat.cols();
+	auto fill_rows = [&](int row_start, int row_end)
+	{
+		uint32_t ctr[4];
+		double u1, u2, len;
+		for (int i = row_start; i < row_end; i++)
+		{
+			for (int j = 0; j < n_cols; j += 2)
+			{
+				ctr[0] = uint32_t(i);
+				ctr[1] = uint32_t(j / 2);
+				ctr[2] = 0;
+				ctr[3] = 0;
+				philox4x32(ctr, key);
+				//53-bit uniforms on (0,1), then Box-Muller
+				u1 = ((((uint64_t(ctr[0]) << 32) | ctr[1]) >> 11) + 0.5) * to_unit;
+				u2 = ((((uint64_t(ctr[2]) << 32) | ctr[3]) >> 11) + 0.5) * to_unit;
+				len = sqrt(-2.0 * log(u1));
+				mat(i, j) = len * cos(two_pi * u2);
+				if (j + 1 < n_cols)
+					mat(i, j + 1) = len * sin(two_pi * u2);
+			}
+		}
+	};
+	num_threads = max(1, min(num_threads, n_rows));
+	int chunk = (n_rows + num_threads - 1) / max(1, num_threads);
+	vector<thread> threads;
+	for (int row_start = chunk; row_start < n_rows; row_start += chunk)
+		threads.push_back(thread(fill_rows, row_start, min(n_rows, row_start + chunk)));
+	fill_rows(0, min(n_rows, chunk));
+	for (auto &t : threads)
+		t.join();
+}
+
+void Ensemble::project_draws(Covariance &cov, Eigen::MatrixXd &draws, const string &name, PerformanceLog *plog, int level, mutex &log_lock)
+{
+	//replace the standard normal draws (one row per realization) with draws from cov, using
+	//the Cholesky factor if cov is positive definite and an eigen decomposition otherwise
+	stringstream ss;
+	int n = cov.get_col_names().size();
+	Eigen::MatrixXd proj;
+	bool chol_success = false;
+	{
+		//scoped so the dense factor is released before the eigen fallback
+		Eigen::LLT<Eigen::MatrixXd> llt(cov.e_ptr()->toDense());
+		if (llt.info() == Eigen::Success)
+		{
+			ss << "Cholesky factorization of full cov for " << name << " with " << n << " elements";
+			{
+				lock_guard<mutex> g(log_lock);
+				plog->log_event(ss.str());
+			}
+			proj = llt.matrixL();
+			chol_success = true;
+		}
+	}
+	if (!chol_success)
+	{
+		double fac = cov.e_ptr()->diagonal().minCoeff();
+		ss << "cov for " << name << " not positive definite, min variance: " << fac << ", randomized Eigen decomposition of full cov for " << n << " elements";
+		{
+			lock_guard<mutex> g(log_lock);
+			plog->log_event(ss.str());
+		}
+		RedSVD::RedSymEigen<Eigen::SparseMatrix<double>> eig(*cov.e_ptr() * (1.0 / fac), n);
+		proj = (eig.eigenvectors() * (fac * eig.eigenvalues()).cwiseSqrt().asDiagonal());
+		if (level > 2)
+		{
+			ofstream f(name + "_evec.dat");
+			f << eig.eigenvectors() << endl;
+			f.close();
+			f.open(name + "_sqrt_evals.dat");
+			f << (fac * eig.eigenvalues()).cwiseSqrt() << endl;
+			f.close();
+		}
+	}
+	if (level > 2)
+	{
+		cov.to_ascii(name + "_cov.dat");
+		ofstream f(name + "_proj.dat");
+		f << proj << endl;
+		f.close();
+	}
+	{
+		lock_guard<mutex> g(log_lock);
+		plog->log_event("projecting " + name + " block");
+	}
+	draws = draws * proj.transpose();
+}
+
 void Ensemble::draw(int num_reals, Covariance cov, Transformable &tran, const vector<string> &draw_names,
 	const map<string, vector<string>> &grouper, PerformanceLog *plog, int level)
 {
@@ -127,9 +258,15 @@ void Ensemble::draw(int num_reals, Covariance cov, Transformable &tran, const ve
 	if (cov.get_col_names() != draw_names)
 		cov = cov.get(draw_names);
 
+	//ies_num_threads if it was set, otherwise one per hardware thread
+	int num_threads = pest_scenario_ptr->get_pestpp_options().get_ies_num_threads();
+	if (num_threads < 1)
+		num_threads = int(thread::hardware_concurrency());
+	num_threads = max(1, num_threads);
+
 	//make standard normal draws
 	plog->log_event("making standard normal draws");
-	RedSVD::sample_gaussian(draws);
+	fill_standard_normal(draws, rand_engine(), num_threads);
 	if (level > 2)
 	{
 		ofstream f("standard_normal_draws.dat");
@@ -149,22 +286,21 @@ void Ensemble::draw(int num_reals, Covariance cov, Transformable &tran, const ve
 			draws.col(j) *= std(j);
 		}
 	}
-	//if not diagonal, eigen decomp of cov then project the standard normal draws
+	//if not diagonal, factor the cov then project the standard normal draws
 	else
 	{
-
+		mutex log_lock;
 		if (grouper.size() > 0)
 		{
 			cout << "...drawing by group" << endl;
-			Covariance gcov;
 			stringstream ss;
-			RedSVD::RedSymEigen<Eigen::SparseMatrix<double>> eig;
-
-			Eigen::MatrixXd proj;
 			map<string, int> idx_map;
 			vector<int> idx;
 			for (int i = 0; i < var_names.size(); i++)
 				idx_map[var_names[i]] = i;
+			//the groups are independent of each other, so the multi-element groups are
+			//factored and projected concurrently.  Each one writes its own block of draws
+			vector<pair<string, pair<int, int>>> group_blocks;
 			for (auto &gi : grouper)
 			{
 				ss.str("");
@@ -183,93 +319,75 @@ void Ensemble::draw(int num_reals, Covariance cov, Transformable &tran, const ve
 					continue;
 				}
 
-				gcov = cov.get(gi.second);
-				if (level > 2)
-				{
-					gcov.to_ascii(gi.first + "_cov.dat");
-				}
-
 				idx.clear();
 				for (auto n : gi.second)
 					idx.push_back(idx_map[n]);
 				if (idx.size() != idx[idx.size() - 1] - idx[0] + 1)
 					throw_ensemble_error("Ensemble:: draw() error in full cov group draw: idx out of order");
+				group_blocks.push_back(pair<string, pair<int, int>>(gi.first, pair<int, int>(idx[0], idx.size())));
+			}
 
-				//cout << var_names[idx[0]] << "," << var_names[idx.size() - idx[0]] << endl;
-				//cout << idx[0] << ',' << idx[idx.size()-1] << ',' <<  idx.size() << " , " << idx[idx.size()-1] - idx[0] <<  endl;
-
-				double fac = gcov.e_ptr()->diagonal().minCoeff();
-				ss.str("");
-				ss << "min variance for group " << gi.first << ": " << fac;
-				plog->log_event(ss.str());
-				Eigen::MatrixXd block = draws.block(0, idx[0], num_reals, idx.size());
-				ss.str("");
-				ss << "Randomized Eigen decomposition of full cov for " << gi.second.size() << " element matrix" << endl;
-				plog->log_event(ss.str());
-				eig.compute(*gcov.e_ptr() * (1.0/fac), gi.second.size());
-				//RedSVD::RedSVD<Eigen::SparseMatrix<double>> svd;
-				//svd.compute(*gcov.e_ptr(),gcov.get_col_names().size());// , gi.second.size());
-				//cout << svd.singularValues() << endl;
-				//Eigen::JacobiSVD<Eigen::MatrixXd> svd(gcov.e_ptr()->toDense(), Eigen::ComputeFullU);
-				//svd.computeU();
-
-				proj = (eig.eigenvectors() * (fac *eig.eigenvalues()).cwiseSqrt().asDiagonal());
-				//proj = (svd.matrixU() * svd.singularValues().asDiagonal());
-
-				if (level > 2)
+			//the name sets are built once here so the threads only read cov
+			cov.update_sets();
+			atomic<int> next(0);
+			vector<exception_ptr> thread_exceptions(min(num_threads, int(group_blocks.size())));
+			//each group needs its dense cov, the factor and the projection (about 3 n^2 doubles), so a thread
+			//waits until that fits under max_draw_values with the groups already in flight (or none are)
+			mutex mem_lock;
+			condition_variable mem_cv;
+			size_t values_in_flight = 0;
+			auto release_values = [&](size_t &n_values)
+			{
 				{
-					ofstream f(gi.first + "_evec.dat");
-					f << eig.eigenvectors() << endl;
-					//f << svd.matrixU() << endl;
-					f.close();
-					ofstream ff(gi.first + "_sqrt_evals.dat");
-					ff << (fac * eig.eigenvalues()).cwiseSqrt() << endl;
-					//ff << svd.singularValues() << endl;
-					ff.close();
-					ofstream fff(gi.first+"_proj.dat");
-					fff << proj << endl;
-					fff.close();
+					lock_guard<mutex> g(mem_lock);
+					values_in_flight -= n_values;
 				}
-				//cout << "block " << block.rows() << " , " << block.cols() << endl;
-				//cout << " proj " << proj.rows() << " , " << proj.cols() << endl;
-				plog->log_event("projecting group block");
-				draws.block(0, idx[0], num_reals, idx.size()) = (proj * block.transpose()).transpose();
-
-			}
+				n_values = 0;
+				mem_cv.notify_all();
+			};
+			auto project_groups = [&](int thread_id)
+			{
+				size_t n_values = 0;
+				try
+				{
+					int i;
+					while ((i = next.fetch_add(1)) < group_blocks.size())
+					{
+						const string &name = group_blocks[i].first;
+						size_t n = group_blocks[i].second.second;
+						{
+							unique_lock<mutex> g(mem_lock);
+							mem_cv.wait(g, [&]() { return (values_in_flight == 0) || (values_in_flight + 3 * n * n <= max_draw_values); });
+							n_values = 3 * n * n;
+							values_in_flight += n_values;
+						}
+						Covariance gcov = cov.get(grouper.at(name), false);
+						Eigen::MatrixXd block = draws.block(0, group_blocks[i].second.first, num_reals, group_blocks[i].second.second);
+						project_draws(gcov, block, name, plog, level, log_lock);
+						draws.block(0, group_blocks[i].second.first, num_reals, group_blocks[i].second.second) = block;
+						gcov = Covariance();
+						release_values(n_values);
+					}
+				}
+				catch (...)
+				{
+					if (n_values > 0)
+						release_values(n_values);
+					thread_exceptions[thread_id] = current_exception();
+				}
+			};
+			vector<thread> threads;
+			for (int i = 0; i < thread_exceptions.size(); i++)
+				threads.push_back(thread(project_groups, i));
+			for (auto &t : threads)
+				t.join();
+			for (auto &eptr : thread_exceptions)
+				if (eptr)
+					rethrow_exception(eptr);
 		}
 		else
 		{
-			int ncomps = draw_names.size();
-			stringstream ss;
-			ss << "Randomized Eigen decomposition of full cov using " << ncomps << " components";
-			plog->log_event(ss.str());
-			double fac = cov.e_ptr()->diagonal().minCoeff();
-			ss.str("");
-			ss << "min variance: " << fac;
-			RedSVD::RedSymEigen<Eigen::SparseMatrix<double>> eig(*cov.e_ptr() * (1.0/fac), ncomps);
-			Eigen::MatrixXd proj = (eig.eigenvectors() * (fac * eig.eigenvalues()).cwiseSqrt().asDiagonal());
-
-			if (level > 2)
-			{
-				ofstream f("cov_eigenvectors.dat");
-				f << eig.eigenvectors() << endl;
-				f.close();
-				f.open("cov_sqrt_evals.dat");
-				f << (fac * eig.eigenvalues()).cwiseSqrt() << endl;
-				f.close();
-				f.open("cov_projection_matrix.dat");
-				f << proj << endl;
-				f.close();
-			}
-
-			//project each standard normal draw in place
-			plog->log_event("projecting realizations");
-			/*for (int i = 0; i < num_reals; i++)
-			{
-				draws.row(i) = proj * draws.row(i).transpose();
-			}*/
-			draws = proj * draws.transpose();
-			draws.transposeInPlace();
+			project_draws(cov, draws, "cov", plog, level, log_lock);
 		}
 	}
 
@@ -1221,6 +1339,30 @@ map<string, int> Ensemble::from_binary(string file_name, vector<string> &names,
 }
 
 
+void Ensemble::to_dense(string file_name)
+{
+	EnsembleStore store(file_name);
+	store.from_ensemble(*this);
+}
+
+map<string, int> Ensemble::from_dense(string file_name, const vector<string> &_real_names)
+{
+	//load all the vars for all the realizations or just _real_names from a dense binary ensemble file
+	EnsembleStore store(file_name);
+	store.load_index(true);
+	var_names = store.get_var_names();
+	if (_real_names.size() == 0)
+		real_names = store.get_real_names();
+	else
+		real_names = _real_names;
+	reals = store.get_eigen(vector<string>(), _real_names);
+	map<string, int> header_info;
+	for (int i = 0; i < var_names.size(); i++)
+		header_info[var_names.at(i)] = i;
+	org_real_names = real_names;
+	return header_info;
+}
+
 map<string,int> Ensemble::from_binary_old(string file_name, vector<string> &names, bool transposed)
 {
 	//load an ensemble from a binary jco-type file.  if transposed=true, reals is transposed and row/col names are swapped for var/real names.
@@ -1739,6 +1881,51 @@ void ParameterEnsemble::from_binary(string file_name)
 
 }
 
+void ParameterEnsemble::from_dense(string file_name, const vector<string> &_real_names)
+{
+	map<string, int> header_info = Ensemble::from_dense(file_name, _real_names);
+	ParameterInfo pi = pest_scenario_ptr->get_ctl_parameter_info();
+	ParameterRec::TRAN_TYPE ft = ParameterRec::TRAN_TYPE::FIXED;
+	for (auto &name : var_names)
+	{
+		if (pi.get_parameter_rec_ptr(name)->tranform_type == ft)
+		{
+			fixed_names.push_back(name);
+		}
+	}
+	save_fixed();
+	fill_fixed(header_info);
+	save_fixed();
+	tstat = transStatus::CTL;
+}
+
+ParameterEnsemble ParameterEnsemble::get_new(const vector<int> &real_idxs)
+{
+	//copy everything but the realizations so the full reals matrix is never duplicated
+	ParameterEnsemble new_pe;
+	new_pe.pest_scenario_ptr = pest_scenario_ptr;
+	new_pe.base_name = base_name;
+	new_pe.var_names = var_names;
+	new_pe.org_real_names = org_real_names;
+	new_pe.var_map = var_map;
+	new_pe.par_transform = par_transform;
+	new_pe.tstat = tstat;
+	new_pe.fixed_names = fixed_names;
+	new_pe.fixed_map = fixed_map;
+	if (real_idxs.size() == 0)
+	{
+		new_pe.real_names = real_names;
+		new_pe.reals = reals;
+		return new_pe;
+	}
+	vector<int>::const_iterator start = real_idxs.begin(), end = real_idxs.end();
+	for (int ireal = 0; ireal < real_names.size(); ireal++)
+		if (find(start, end, ireal) != end)
+			new_pe.real_names.push_back(real_names[ireal]);
+	new_pe.reals = get_eigen(new_pe.real_names, vector<string>());
+	return new_pe;
+}
+
 //ParameterEnsemble ParameterEnsemble::get_new(const vector<string> &_real_names, const vector<string> &_var_names)
 //{
 //	
@@ -2009,6 +2196,27 @@ void ParameterEnsemble::to_binary(string file_name)
 }
 
 
+void ParameterEnsemble::to_dense(string file_name)
+{
+	//same values as to_binary(): transformed back to CTL status with the fixed and tied pars filled in
+	vector<string> vnames = pest_scenario_ptr->get_ctl_ordered_par_names();
+	Eigen::MatrixXd ctl_reals(real_names.size(), vnames.size());
+	Parameters pars;
+	for (int irow = 0; irow < real_names.size(); ++irow)
+	{
+		pars.update_without_clear(var_names, reals.row(irow));
+		if (tstat == transStatus::MODEL)
+			par_transform.model2ctl_ip(pars);
+		else if (tstat == transStatus::NUM)
+			par_transform.numeric2ctl_ip(pars);
+		replace_fixed(real_names[irow], pars);
+		ctl_reals.row(irow) = pars.get_data_eigen_vec(vnames);
+	}
+	Ensemble ctl_en(pest_scenario_ptr);
+	ctl_en.from_eigen_mat(ctl_reals, real_names, vnames);
+	ctl_en.to_dense(file_name);
+}
+
 void ParameterEnsemble::to_csv(string file_name)
 {
 	//write the par ensemble to csv file - transformed back to CTL status
@@ -2242,27 +2450,24 @@ void ObservationEnsemble::update_from_obs(string real_name, Observations &obs)
 vector<int> ObservationEnsemble::update_from_runs(map<int,int> &real_run_ids, RunManagerAbstract *run_mgr_ptr)
 {
 	//update the obs ensemble in place from the run manager
-	set<int> failed_runs = run_mgr_ptr->get_failed_run_ids();
 	vector<int> failed_real_idxs;
-	Parameters pars = pest_scenario_ptr->get_ctl_parameters();
-	Observations obs = pest_scenario_ptr->get_ctl_observations();
-	string real_name;
-	int ireal = 0;
+	vector<int> run_ids;
+	run_ids.reserve(real_run_ids.size());
+	for (auto &real_run_id : real_run_ids)
+		run_ids.push_back(real_run_id.second);
+	Eigen::MatrixXd obs_mat;
+	vector<bool> failed_mask;
+	run_mgr_ptr->get_runs(run_ids, var_names, obs_mat, failed_mask);
+	int i = 0;
 	for (auto &real_run_id : real_run_ids)
 	{
-		if (failed_runs.find(real_run_id.second) != failed_runs.end())
-		{
+		if ((real_run_id.first < 0) || (size_t(real_run_id.first) >= real_names.size()))
+			throw_ensemble_error("ObservationEnsemble.update_from_runs() real index out of range");
+		if (failed_mask[i])
 			failed_real_idxs.push_back(real_run_id.first);
-			//failed_real_idxs.push_back(ireal);
-		}
-
 		else
-		{
-			run_mgr_ptr->get_run(real_run_id.second, pars, obs);
-			//real_name = real_names[real_run_id.first];
-			update_from_obs(real_run_id.first, obs);
-			//update_from_obs(ireal, obs);
-		}
+			reals.row(real_run_id.first) = obs_mat.row(i);
+		i++;
 	}
 	return failed_real_idxs;
 }
@@ -2274,6 +2479,11 @@ void ObservationEnsemble::from_binary(string file_name)
 	Ensemble::from_binary(file_name, names, true);
 }
 
+void ObservationEnsemble::from_dense(string file_name, const vector<string> &_real_names)
+{
+	Ensemble::from_dense(file_name, _real_names);
+}
+
 void ObservationEnsemble::from_csv(string file_name)
 {
 	//load the obs en from a csv file
@@ -2319,3 +2529,461 @@ void ObservationEnsemble::from_eigen_mat(Eigen::MatrixXd mat, const vector<strin
 		throw_ensemble_error("ObservationEnsemble.from_eigen_mat() the following obs names no found: ", missing);
 	Ensemble::from_eigen_mat(mat, _real_names, _var_names);
 }
+
+
+const char EnsembleStore::magic[8] = { 'P', 'S', 'T', 'D', 'E', 'N', 'S', '1' };
+const int EnsembleStore::header_bytes = sizeof(EnsembleStore::magic) + 3 * sizeof(std::int64_t);
+
+EnsembleStore::EnsembleStore(const string &_filename, int _block_cols) : filename(_filename),
+	block_cols(max(1, _block_cols)), map_ptr(nullptr), map_size(0), read_only(false)
+{
+}
+
+EnsembleStore::~EnsembleStore()
+{
+	close_file();
+}
+
+void EnsembleStore::open_file(size_t n_bytes, bool truncate)
+{
+	close_file();
+#ifdef OS_LINUX
+	int flags = O_RDWR | O_CREAT;
+	if (read_only)
+		flags = O_RDONLY;
+	else if (truncate)
+		flags = flags | O_TRUNC;
+	int fd = open(filename.c_str(), flags, 0644);
+	if (fd < 0)
+		throw_store_error("error opening file " + filename);
+	if ((!read_only) && (ftruncate(fd, n_bytes) != 0))
+	{
+		close(fd);
+		throw_store_error("error resizing file " + filename);
+	}
+	int prot = (read_only) ? PROT_READ : PROT_READ | PROT_WRITE;
+	void *ptr = mmap(nullptr, n_bytes, prot, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED)
+		throw_store_error("error mapping file " + filename);
+	map_ptr = static_cast<char*>(ptr);
+	map_size = n_bytes;
+#else
+	//no mapping, the blocks go through a file stream.  The file is never shrunk, the
+	//header records how much of it is in use
+	ios_base::openmode mode = ios::in | ios::out | ios::binary;
+	if (read_only)
+		mode = ios::in | ios::binary;
+	else if (truncate)
+		mode = mode | ios::trunc;
+	else
+	{
+		ofstream touch(filename, ios::binary | ios::app);
+	}
+	f_stream.open(filename, mode);
+	if (!f_stream.good())
+		throw_store_error("error opening file " + filename);
+	f_stream.seekg(0, ios::end);
+	size_t cur_size = f_stream.tellg();
+	if (read_only)
+		n_bytes = min(n_bytes, cur_size);
+	else if (cur_size < n_bytes)
+	{
+		vector<char> zeros(min(n_bytes - cur_size, size_t(1 << 20)), 0);
+		while (cur_size < n_bytes)
+		{
+			size_t n = min(n_bytes - cur_size, zeros.size());
+			f_stream.write(zeros.data(), n);
+			cur_size += n;
+		}
+	}
+	if (!f_stream.good())
+		throw_store_error("error resizing file " + filename);
+	map_size = n_bytes;
+#endif
+}
+
+void EnsembleStore::close_file()
+{
+#ifdef OS_LINUX
+	if (map_ptr != nullptr)
+		munmap(map_ptr, map_size);
+#endif
+	if (f_stream.is_open())
+		f_stream.close();
+	map_ptr = nullptr;
+	map_size = 0;
+}
+
+void EnsembleStore::raw_read(size_t offset, char *dest, size_t n_bytes)
+{
+	if (offset + n_bytes > map_size)
+		throw_store_error("read past the end of " + filename);
+	if (map_ptr != nullptr)
+	{
+		memcpy(dest, map_ptr + offset, n_bytes);
+		return;
+	}
+	f_stream.seekg(offset, ios::beg);
+	f_stream.read(dest, n_bytes);
+	if (!f_stream.good())
+		throw_store_error("error reading from " + filename);
+}
+
+void EnsembleStore::raw_write(size_t offset, const char *src, size_t n_bytes)
+{
+	if (read_only)
+		throw_store_error("write to read-only " + filename);
+	if (offset + n_bytes > map_size)
+		throw_store_error("write past the end of " + filename);
+	if (map_ptr != nullptr)
+	{
+		memcpy(map_ptr + offset, src, n_bytes);
+		return;
+	}
+	f_stream.seekp(offset, ios::beg);
+	f_stream.write(src, n_bytes);
+	if (!f_stream.good())
+		throw_store_error("error writing to " + filename);
+}
+
+size_t EnsembleStore::get_index_bytes() const
+{
+	size_t n_bytes = 0;
+	for (auto &name : real_names)
+		n_bytes += sizeof(std::int32_t) + name.size();
+	for (auto &name : var_names)
+		n_bytes += sizeof(std::int32_t) + name.size();
+	return n_bytes;
+}
+
+void EnsembleStore::write_index()
+{
+	//the file has to already be sized for the values and the name index
+	std::int64_t dims[3] = { std::int64_t(real_names.size()), std::int64_t(var_names.size()), std::int64_t(col_offset(var_names.size())) };
+	raw_write(0, magic, sizeof(magic));
+	raw_write(sizeof(magic), (char*)dims, sizeof(dims));
+	vector<char> buf;
+	buf.reserve(get_index_bytes());
+	std::int32_t len;
+	for (auto names : { &real_names, &var_names })
+	{
+		for (auto &name : *names)
+		{
+			len = name.size();
+			buf.insert(buf.end(), (char*)&len, (char*)&len + sizeof(len));
+			buf.insert(buf.end(), name.begin(), name.end());
+		}
+	}
+	raw_write(dims[2], buf.data(), buf.size());
+}
+
+bool EnsembleStore::is_dense_file(const string &file_name)
+{
+	ifstream in(file_name, ios::binary);
+	char buf[sizeof(magic)];
+	in.read(buf, sizeof(magic));
+	return (in.good()) && (memcmp(buf, magic, sizeof(magic)) == 0);
+}
+
+void EnsembleStore::load_index(bool _read_only)
+{
+	close_file();
+	ifstream in(filename, ios::binary);
+	if (!in.good())
+		throw_store_error("error opening dense ensemble file " + filename);
+	in.seekg(0, ios::end);
+	std::int64_t file_bytes = in.tellg();
+	in.seekg(0, ios::beg);
+	char buf[sizeof(magic)];
+	std::int64_t dims[3];
+	in.read(buf, sizeof(magic));
+	in.read((char*)dims, sizeof(dims));
+	if ((!in.good()) || (memcmp(buf, magic, sizeof(magic)) != 0))
+		throw_store_error(filename + " is not a dense binary ensemble file");
+	//check the header against the size of the file before anything is allocated or mapped:  the values
+	//and at least a length for every name have to fit
+	std::int64_t value_bytes = file_bytes - header_bytes;
+	if ((dims[0] < 0) || (dims[1] < 0) || (dims[0] > numeric_limits<int>::max()) || (dims[1] > numeric_limits<int>::max()) ||
+		((dims[1] > 0) && (dims[0] > value_bytes / std::int64_t(sizeof(double)) / dims[1])))
+		throw_store_error("invalid dimensions in dense ensemble file header " + filename);
+	if ((dims[2] != header_bytes + dims[0] * dims[1] * std::int64_t(sizeof(double))) ||
+		(dims[2] > file_bytes) || ((dims[0] + dims[1]) > (file_bytes - dims[2]) / std::int64_t(sizeof(std::int32_t))))
+		throw_store_error("inconsistent header in dense ensemble file " + filename);
+	real_names.clear();
+	var_names.clear();
+	real_names.resize(dims[0]);
+	var_names.resize(dims[1]);
+	in.seekg(dims[2], ios::beg);
+	std::int32_t len;
+	for (auto names : { &real_names, &var_names })
+	{
+		for (auto &name : *names)
+		{
+			in.read((char*)&len, sizeof(len));
+			if ((!in.good()) || (len < 0) || (len > file_bytes - std::int64_t(in.tellg())))
+				throw_store_error("error reading names from dense ensemble file " + filename);
+			name.resize(len);
+			in.read(&name[0], len);
+		}
+	}
+	if (!in.good())
+		throw_store_error("error reading names from dense ensemble file " + filename);
+	size_t n_bytes = in.tellg();
+	in.close();
+
+	var_map.clear();
+	for (int i = 0; i < var_names.size(); i++)
+		var_map[var_names[i]] = i;
+	read_only = _read_only;
+	open_file(n_bytes, false);
+}
+
+void EnsembleStore::read_cols(int start, int n_cols, Eigen::MatrixXd &block)
+{
+	//the columns are contiguous, so a block of them is one read
+	block.resize(real_names.size(), n_cols);
+	raw_read(col_offset(start), (char*)block.data(), block.size() * sizeof(double));
+}
+
+void EnsembleStore::write_cols(int start, const Eigen::MatrixXd &block)
+{
+	if (block.rows() != real_names.size())
+		throw_store_error("EnsembleStore::write_cols(): block rows != real_names.size");
+	if (start + block.cols() > var_names.size())
+		throw_store_error("EnsembleStore::write_cols(): block extends past the last var");
+	raw_write(col_offset(start), (const char*)block.data(), block.size() * sizeof(double));
+}
+
+void EnsembleStore::create(const vector<string> &_real_names, const vector<string> &_var_names)
+{
+	real_names = _real_names;
+	var_names = _var_names;
+	var_map.clear();
+	for (int i = 0; i < var_names.size(); i++)
+		var_map[var_names[i]] = i;
+	read_only = false;
+	open_file(col_offset(var_names.size()) + get_index_bytes(), true);
+	write_index();
+}
+
+void EnsembleStore::from_ensemble(Ensemble &en)
+{
+	create(en.get_real_names(), en.get_var_names());
+	const Eigen::MatrixXd *reals = en.get_eigen_ptr();
+	for (int start = 0; start < var_names.size(); start += block_cols)
+		write_cols(start, reals->middleCols(start, min(block_cols, int(var_names.size()) - start)));
+}
+
+void EnsembleStore::to_binary(string file_name)
+{
+	//the same format as Ensemble::to_binary(), but the records are written one block of columns at a time
+	ofstream fout(file_name, ios::binary);
+	if (!fout.good())
+		throw_store_error("error opening file for binary ensemble: " + file_name);
+	int n_var = var_names.size();
+	int n_real = real_names.size();
+	int n = n_var * n_real;
+	fout.write((char*)&n_var, sizeof(n_var));
+	fout.write((char*)&n_real, sizeof(n_real));
+	fout.write((char*)&n, sizeof(n));
+
+	Eigen::MatrixXd block;
+	double data;
+	for (int start = 0; start < n_var; start += block_cols)
+	{
+		read_cols(start, min(block_cols, n_var - start), block);
+		for (int j = 0; j < block.cols(); j++)
+		{
+			int jcol = start + j;
+			for (int irow = 0; irow < n_real; irow++)
+			{
+				data = block(irow, j);
+				fout.write((char*)&irow, sizeof(irow));
+				fout.write((char*)&jcol, sizeof(jcol));
+				fout.write((char*)&data, sizeof(data));
+			}
+		}
+	}
+
+	char name[200];
+	for (auto &vname : var_names)
+	{
+		string l = pest_utils::lower_cp(vname);
+		pest_utils::string_to_fortran_char(l, name, 200);
+		fout.write(name, 200);
+	}
+	for (auto &rname : real_names)
+	{
+		string l = pest_utils::lower_cp(rname);
+		pest_utils::string_to_fortran_char(l, name, 200);
+		fout.write(name, 200);
+	}
+	fout.close();
+}
+
+vector<int> EnsembleStore::get_col_idxs(const vector<string> &_var_names)
+{
+	vector<int> idxs;
+	vector<string> missing;
+	unordered_map<string, int>::iterator end = var_map.end();
+	for (auto &name : _var_names)
+	{
+		unordered_map<string, int>::iterator it = var_map.find(name);
+		if (it == end)
+			missing.push_back(name);
+		else
+			idxs.push_back(it->second);
+	}
+	if (missing.size() > 0)
+		throw_store_error("the following var names were not found: ", missing);
+	return idxs;
+}
+
+Eigen::MatrixXd EnsembleStore::get_eigen(const vector<string> &_var_names, const vector<string> &_real_names)
+{
+	Eigen::MatrixXd mat;
+	vector<int> col_idxs;
+	if (_var_names.size() == 0)
+	{
+		if (_real_names.size() == 0)
+		{
+			mat.resize(real_names.size(), var_names.size());
+			raw_read(col_offset(0), (char*)mat.data(), mat.size() * sizeof(double));
+			return mat;
+		}
+		for (int j = 0; j < var_names.size(); j++)
+			col_idxs.push_back(j);
+	}
+	else
+		col_idxs = get_col_idxs(_var_names);
+	if (_real_names.size() == 0)
+	{
+		mat.resize(real_names.size(), col_idxs.size());
+		for (int j = 0; j < col_idxs.size(); j++)
+			raw_read(col_offset(col_idxs[j]), (char*)mat.col(j).data(), real_names.size() * sizeof(double));
+		return mat;
+	}
+
+	unordered_map<string, int> real_map;
+	for (int i = 0; i < real_names.size(); i++)
+		real_map[real_names[i]] = i;
+	vector<int> row_idxs;
+	vector<string> missing;
+	for (auto &name : _real_names)
+	{
+		unordered_map<string, int>::iterator it = real_map.find(name);
+		if (it == real_map.end())
+			missing.push_back(name);
+		else
+			row_idxs.push_back(it->second);
+	}
+	if (missing.size() > 0)
+		throw_store_error("the following real names were not found: ", missing);
+	//each column is read once and the rows are gathered from it
+	mat.resize(row_idxs.size(), col_idxs.size());
+	Eigen::VectorXd col(real_names.size());
+	size_t n_bytes = real_names.size() * sizeof(double);
+	for (int j = 0; j < col_idxs.size(); j++)
+	{
+		raw_read(col_offset(col_idxs[j]), (char*)col.data(), n_bytes);
+		for (int i = 0; i < row_idxs.size(); i++)
+			mat(i, j) = col[row_idxs[i]];
+	}
+	return mat;
+}
+
+Eigen::MatrixXd EnsembleStore::get_eigen_mean_diff(const vector<string> &_var_names)
+{
+	vector<int> idxs;
+	if (_var_names.size() == 0)
+	{
+		for (int j = 0; j < var_names.size(); j++)
+			idxs.push_back(j);
+	}
+	else
+		idxs = get_col_idxs(_var_names);
+	//the columns are read and centered block_cols at a time
+	Eigen::MatrixXd mat(real_names.size(), idxs.size());
+	size_t n_bytes = real_names.size() * sizeof(double);
+	for (int start = 0; start < idxs.size(); start += block_cols)
+	{
+		int n_cols = min(block_cols, int(idxs.size()) - start);
+		for (int j = start; j < start + n_cols; j++)
+			raw_read(col_offset(idxs[j]), (char*)mat.col(j).data(), n_bytes);
+		Eigen::RowVectorXd mean = mat.middleCols(start, n_cols).colwise().mean();
+		mat.middleCols(start, n_cols).rowwise() -= mean;
+	}
+	return mat;
+}
+
+void EnsembleStore::add_2_cols_ip(const vector<string> &other_var_names, const Eigen::MatrixXd &mat)
+{
+	if (real_names.size() != mat.rows())
+		throw_store_error("EnsembleStore::add_2_cols_ip(): first dimensions don't match");
+	if (other_var_names.size() != mat.cols())
+		throw_store_error("EnsembleStore::add_2_cols_ip(): other_var_names.size() != mat.cols()");
+	vector<int> idxs = get_col_idxs(other_var_names);
+	Eigen::VectorXd col(real_names.size());
+	size_t n_bytes = real_names.size() * sizeof(double);
+	for (int j = 0; j < idxs.size(); j++)
+	{
+		raw_read(col_offset(idxs[j]), (char*)col.data(), n_bytes);
+		col += mat.col(j);
+		raw_write(col_offset(idxs[j]), (char*)col.data(), n_bytes);
+	}
+}
+
+void EnsembleStore::drop_rows(const vector<int> &row_idxs)
+{
+	set<int> drop(row_idxs.begin(), row_idxs.end());
+	vector<int> keep;
+	vector<string> keep_names;
+	for (int i = 0; i < real_names.size(); i++)
+	{
+		if (drop.find(i) == drop.end())
+		{
+			keep.push_back(i);
+			keep_names.push_back(real_names[i]);
+		}
+	}
+	if (keep.size() == real_names.size())
+		return;
+
+	//compact the columns in place: each block is read whole before its (shorter) columns are written,
+	//and the new location of a block never reaches past the old location of the next one
+	int n_var = var_names.size();
+	Eigen::MatrixXd block, kept_block(keep.size(), 0);
+	size_t new_offset = header_bytes;
+	for (int start = 0; start < n_var; start += block_cols)
+	{
+		read_cols(start, min(block_cols, n_var - start), block);
+		kept_block.resize(keep.size(), block.cols());
+		for (int i = 0; i < keep.size(); i++)
+			kept_block.row(i) = block.row(keep[i]);
+		raw_write(new_offset, (char*)kept_block.data(), kept_block.size() * sizeof(double));
+		new_offset += kept_block.size() * sizeof(double);
+	}
+	real_names = keep_names;
+	open_file(col_offset(n_var) + get_index_bytes(), false);
+	write_index();
+}
+
+void EnsembleStore::drop_rows(const vector<string> &drop_names)
+{
+	set<string> drop(drop_names.begin(), drop_names.end());
+	vector<int> row_idxs;
+	for (int i = 0; i < real_names.size(); i++)
+		if (drop.find(real_names[i]) != drop.end())
+			row_idxs.push_back(i);
+	drop_rows(row_idxs);
+}
+
+void EnsembleStore::throw_store_error(string message, const vector<string> &vec)
+{
+	stringstream ss;
+	ss << "EnsembleStore Error: " << message;
+	for (auto &v : vec)
+		ss << v << ',';
+	throw runtime_error(ss.str());
+}
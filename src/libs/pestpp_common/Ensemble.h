@@ -2,7 +2,11 @@
 #define ENSEMBLE_H_
 
 #include <map>
+#include <unordered_map>
 #include <random>
+#include <fstream>
+#include <cstdint>
+#include <mutex>
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 #include "FileManager.h"
@@ -30,6 +34,7 @@ public:
 	void to_csv(string file_name);
 	void to_binary_old(string file_name, bool transposed=false);
 	void to_binary(string file_name, bool transposed=false);
+	void to_dense(string file_name);
 	void from_eigen_mat(Eigen::MatrixXd mat, const vector<string> &_real_names, const vector<string> &_var_names);
 	pair<int, int> shape() { return pair<int, int>(reals.rows(), reals.cols()); }
 	void throw_ensemble_error(string message);
@@ -52,6 +57,7 @@ public:
 	Eigen::MatrixXd get_eigen(vector<string> row_names, vector<string> col_names, bool update_vmap=true);
 	const Eigen::MatrixXd get_eigen() const { return reals; }
 	const Eigen::MatrixXd* get_eigen_ptr() const { return &reals; }
+	Eigen::MatrixXd* get_eigen_ptr_4_mod() { return &reals; }
 	void set_eigen(Eigen::MatrixXd _reals);
 
 	Eigen::MatrixXd get_eigen_mean_diff();
@@ -96,9 +102,14 @@ protected:
 	void read_csv_by_vars(int num_reals, ifstream &csv, map<string, int> &header_info, map<string, int> &index_info);
 	map<string,int> from_binary_old(string file_name, vector<string> &names,  bool transposed);
 	map<string, int> from_binary(string file_name, vector<string> &names, bool transposed);
+	map<string, int> from_dense(string file_name, const vector<string> &_real_names);
 	pair<map<string, int>, map<string, int>> prepare_csv(const vector<string> &names, ifstream &csv, bool forgive);
 	void to_csv_by_reals(ofstream &csv);
 	void to_csv_by_vars(ofstream &csv);
+	void fill_standard_normal(Eigen::MatrixXd &mat, uint64_t seed, int num_threads);
+	void project_draws(Covariance &cov, Eigen::MatrixXd &draws, const string &name, PerformanceLog *plog, int level, mutex &log_lock);
+	//the group covs factored at the same time in draw() are limited to about this many doubles in total
+	static const size_t max_draw_values;
 };
 
 class ParameterEnsemble : public Ensemble
@@ -117,10 +128,14 @@ public:
 	ParameterEnsemble zeros_like();
 	void set_zeros();
 	//ParameterEnsemble get_new(const vector<string> &_real_names, const vector<string> &_var_names);
+	//a copy holding only the realizations in real_idxs (all of them if real_idxs is empty)
+	ParameterEnsemble get_new(const vector<int> &real_idxs);
 
 	//void from_csv(string file_name,const vector<string> &ordered_names);
 	void from_csv(string file_name);
 	void from_binary(string file_name);
+	//load all the realizations, or just _real_names, from a dense binary ensemble file
+	void from_dense(string file_name, const vector<string> &_real_names = vector<string>());
 
 	void from_eigen_mat(Eigen::MatrixXd mat, const vector<string> &_real_names, const vector<string> &_var_names,
 		transStatus _tstat = transStatus::NUM);
@@ -139,6 +154,8 @@ public:
 	void draw(int num_reals, Parameters par, Covariance &cov, PerformanceLog *plog, int level);
 	Covariance get_diagonal_cov_matrix();
 	void to_binary(string filename);
+	//write a dense binary ensemble file of the CTL values of all the ctl pars (including fixed and tied)
+	void to_dense(string file_name);
 
 private:
 	ParamTransformSeq par_transform;
@@ -167,11 +184,75 @@ public:
 	void from_csv(string file_name);
 	void from_eigen_mat(Eigen::MatrixXd mat, const vector<string> &_real_names, const vector<string> &_var_names);
 	void from_binary(string file_name);// { Ensemble::from_binary(file_name, true); }
+	void from_dense(string file_name, const vector<string> &_real_names = vector<string>());
 	vector<int> update_from_runs(map<int,int> &real_run_ids, RunManagerAbstract *run_mgr_ptr);
 	void draw(int num_reals, Covariance &cov, PerformanceLog *plog, int level);
 
 	//ObservationEnsemble get_mean_diff();
 };
 
+//an out-of-core ensemble for ensembles too big to hold in memory.  The values are kept on disk
+//column-major (each var is a contiguous column of n_real doubles) and the file is memory-mapped
+//where the OS supports it.  The column-wise operations stream through the file block_cols columns
+//at a time, so only one block is ever held in memory.
+//The file is also the dense binary ensemble format (Ensemble::to_dense()/from_dense()):
+//	char[8] magic, int64 n_real, int64 n_var, int64 offset of the name index,
+//	the n_real x n_var values column-major, then the real and var names (int32 length + chars each).
+//Since the offset of every column is known from the header, a slice by real and/or var name
+//only touches the columns it needs
+class EnsembleStore
+{
+public:
+	EnsembleStore(const string &_filename, int _block_cols = 1000);
+	EnsembleStore(const EnsembleStore &other) = delete;
+	EnsembleStore& operator=(const EnsembleStore &other) = delete;
+	~EnsembleStore();
+
+	void create(const vector<string> &_real_names, const vector<string> &_var_names);
+	//attach to an existing dense binary ensemble file
+	void load_index(bool _read_only = false);
+	static bool is_dense_file(const string &file_name);
+	void from_ensemble(Ensemble &en);
+	//stream the store out in the format of Ensemble::to_binary()
+	void to_binary(string file_name);
+
+	pair<int, int> shape() const { return pair<int, int>(real_names.size(), var_names.size()); }
+	const vector<string> get_var_names() const { return var_names; }
+	const vector<string> get_real_names() const { return real_names; }
+	string get_filename() const { return filename; }
+
+	//dense copies of (a subset of) the vars for all of the realizations, or for _real_names in that order
+	Eigen::MatrixXd get_eigen(const vector<string> &_var_names = vector<string>(), const vector<string> &_real_names = vector<string>());
+	Eigen::MatrixXd get_eigen_mean_diff(const vector<string> &_var_names = vector<string>());
+
+	void add_2_cols_ip(const vector<string> &other_var_names, const Eigen::MatrixXd &mat);
+	void drop_rows(const vector<int> &row_idxs);
+	void drop_rows(const vector<string> &drop_names);
+
+private:
+	static const int header_bytes;
+	static const char magic[8];
+	string filename;
+	int block_cols;
+	vector<string> real_names;
+	vector<string> var_names;
+	unordered_map<string, int> var_map;
+	char *map_ptr;
+	size_t map_size;
+	bool read_only;
+	fstream f_stream;
+
+	void open_file(size_t n_bytes, bool truncate);
+	void close_file();
+	void raw_read(size_t offset, char *dest, size_t n_bytes);
+	void raw_write(size_t offset, const char *src, size_t n_bytes);
+	size_t col_offset(int jcol) const { return header_bytes + size_t(jcol) * real_names.size() * sizeof(double); }
+	void read_cols(int start, int n_cols, Eigen::MatrixXd &block);
+	void write_cols(int start, const Eigen::MatrixXd &block);
+	void write_index();
+	size_t get_index_bytes() const;
+	vector<int> get_col_idxs(const vector<string> &_var_names);
+	void throw_store_error(string message, const vector<string> &vec = vector<string>());
+};
 
 #endif
@@ -3,6 +3,7 @@
 #include <iomanip>
 #include <mutex>
 #include <thread>
+#include <unordered_set>
 #include "Ensemble.h"
 #include "RestartController.h"
 #include "utilities.h"
@@ -46,37 +47,20 @@ PhiHandler::PhiHandler(Pest *_pest_scenario, FileManager *_file_manager,
 	}
 
 
-	//build up obs group and par group idx maps for group reporting
-	vector<string> nnz_obs = oe_base->get_var_names();
+	//build up obs group and par group indicator matrices for group reporting
+	vector<string> groups;
 	ObservationInfo oinfo = pest_scenario->get_ctl_observation_info();
-	vector<int> idx;
-	for (auto &og : pest_scenario->get_ctl_ordered_obs_group_names())
-	{
-		idx.clear();
-		for (int i = 0; i < nnz_obs.size(); i++)
-		{
-			if (oinfo.get_group(nnz_obs[i]) == og)
-			{
-				idx.push_back(i);
-			}
-		}
-		if (idx.size() > 0)
-			obs_group_idx_map[og] = idx;
-	}
+	for (auto &oname : oe_base->get_var_names())
+		groups.push_back(oinfo.get_group(oname));
+	obs_group_names = pest_scenario->get_ctl_ordered_obs_group_names();
+	obs_group_ind = get_group_indicator(groups, obs_group_names);
 
-	vector<string> pars = pe_base->get_var_names();
+	groups.clear();
 	ParameterInfo pi = pest_scenario->get_ctl_parameter_info();
-	for (auto &pg : pest_scenario->get_ctl_ordered_par_group_names())
-	{
-		idx.clear();
-		for (int i = 0; i < pars.size(); i++)
-		{
-			if (pi.get_parameter_rec_ptr(pars[i])->group == pg)
-				idx.push_back(i);
-		}
-		if (idx.size() > 0)
-			par_group_idx_map[pg] = idx;
-	}
+	for (auto &pname : pe_base->get_var_names())
+		groups.push_back(pi.get_parameter_rec_ptr(pname)->group);
+	par_group_names = pest_scenario->get_ctl_ordered_par_group_names();
+	par_group_ind = get_group_indicator(groups, par_group_names);
 
 
 	reg_factor = _reg_factor;
@@ -137,14 +121,9 @@ Eigen::MatrixXd PhiHandler::get_actual_obs_resid(ObservationEnsemble &oe)
 {
 	//vector<string> act_obs_names = pest_scenario->get_ctl_ordered_nz_obs_names();
 	vector<string> act_obs_names = oe_base->get_var_names();
-	Eigen::MatrixXd resid(oe.shape().first, act_obs_names.size());
-	resid.setZero();
 	Observations obs = pest_scenario->get_ctl_observations();
-	Eigen::MatrixXd oe_vals = oe.get_eigen(vector<string>(), act_obs_names);
-	Eigen::MatrixXd ovals = obs.get_data_eigen_vec(act_obs_names);
-	ovals.transposeInPlace();
-	for (int i = 0; i < resid.rows(); i++)
-		resid.row(i) = oe_vals.row(i) - ovals;
+	Eigen::VectorXd ovals = obs.get_data_eigen_vec(act_obs_names);
+	Eigen::MatrixXd resid = oe.get_eigen(vector<string>(), act_obs_names).rowwise() - ovals.transpose();
 	apply_ineq_constraints(resid, act_obs_names);
 	return resid;
 }
@@ -167,33 +146,57 @@ Eigen::VectorXd PhiHandler::get_q_vector()
 	return q;
 }
 
-map<string, double> PhiHandler::get_obs_group_contrib(Eigen::VectorXd &phi_vec)
+Eigen::SparseMatrix<double> PhiHandler::get_group_indicator(const vector<string> &var_groups, vector<string> &group_names)
 {
-	map<string, double> group_phi_map;
-	double sum;
-	for (auto &og : obs_group_idx_map)
-	{
-		sum = 0.0;
-		for (auto i : og.second)
-			sum += phi_vec[i];
-		group_phi_map[og.first] = sum;
-	}
-
-	return group_phi_map;
+	//group_names is trimmed to the groups that have at least one var
+	map<string, int> group_idx;
+	for (int i = 0; i < group_names.size(); i++)
+		group_idx[group_names[i]] = i;
+	vector<vector<int>> group_vars(group_names.size());
+	for (int i = 0; i < var_groups.size(); i++)
+	{
+		auto gi = group_idx.find(var_groups[i]);
+		if (gi != group_idx.end())
+			group_vars[gi->second].push_back(i);
+	}
+	vector<string> nz_group_names;
+	vector<Eigen::Triplet<double>> triplets;
+	for (int i = 0; i < group_names.size(); i++)
+	{
+		if (group_vars[i].size() == 0)
+			continue;
+		for (auto j : group_vars[i])
+			triplets.push_back(Eigen::Triplet<double>(j, nz_group_names.size(), 1.0));
+		nz_group_names.push_back(group_names[i]);
+	}
+	Eigen::SparseMatrix<double> group_ind(var_groups.size(), nz_group_names.size());
+	group_ind.setFromTriplets(triplets.begin(), triplets.end());
+	group_names = nz_group_names;
+	return group_ind;
 }
 
-map<string, double> PhiHandler::get_par_group_contrib(Eigen::VectorXd &phi_vec)
+void PhiHandler::update_group_phi_map(const Eigen::MatrixXd &phi_mat, const vector<string> &real_names, const vector<int> &rows,
+	const Eigen::SparseMatrix<double> &group_ind, const vector<string> &group_names, map<string, map<string, double>> &group_phi_map)
 {
-	map<string, double> group_phi_map;
-	double sum;
-	for (auto &pg : par_group_idx_map)
+	Eigen::MatrixXd group_phi = phi_mat * group_ind;
+	for (auto i : rows)
 	{
-		sum = 0.0;
-		for (auto i : pg.second)
-			sum += phi_vec[i];
-		group_phi_map[pg.first] = sum;
+		map<string, double> &real_map = group_phi_map[real_names[i]];
+		for (int j = 0; j < group_names.size(); j++)
+			real_map[group_names[j]] = group_phi(i, j);
 	}
-	return group_phi_map;
+}
+
+vector<int> PhiHandler::get_base_rows(ObservationEnsemble &oe)
+{
+	vector<string> base_real_names = oe_base->get_real_names(), oe_real_names = oe.get_real_names();
+	unordered_set<string> base_names(base_real_names.begin(), base_real_names.end());
+	unordered_set<string>::iterator end = base_names.end();
+	vector<int> rows;
+	for (int i = 0; i < oe_real_names.size(); i++)
+		if (base_names.find(oe_real_names[i]) != end)
+			rows.push_back(i);
+	return rows;
 }
 
 void PhiHandler::update(ObservationEnsemble & oe, ParameterEnsemble & pe, bool include_regul)
@@ -202,12 +205,11 @@ void PhiHandler::update(ObservationEnsemble & oe, ParameterEnsemble & pe, bool i
 	meas.clear();
 	obs_group_phi_map.clear();
 	Eigen::VectorXd q = get_q_vector();
-	map<string, Eigen::VectorXd> meas_map = calc_meas(oe, q);
-	for (auto &pv : meas_map)
-	{
-		meas[pv.first] = pv.second.sum();
-
-	}
+	vector<int> base_rows = get_base_rows(oe);
+	vector<string> oe_real_names = oe.get_real_names();
+	Eigen::VectorXd phi_vec = calc_meas(oe, q).rowwise().sum();
+	for (auto i : base_rows)
+		meas[oe_real_names[i]] = phi_vec[i];
 	/*if (pest_scenario->get_control_info().pestmode == ControlInfo::PestMode::PARETO)
 	{
 		meas_map.clear();
@@ -221,19 +223,17 @@ void PhiHandler::update(ObservationEnsemble & oe, ParameterEnsemble & pe, bool i
 	if (include_regul)
 	{
 		regul.clear();
-		map<string, Eigen::VectorXd> reg_map = calc_regul(pe);//, *reg_factor);
-		//for (auto &pv : calc_regul(pe))
-		string name;
+		Eigen::MatrixXd reg_mat = calc_regul(pe);//, *reg_factor);
+		vector<string> pe_real_names = pe.get_real_names();
 		//big assumption - if oe is a diff shape, then this
 		//must be a subset, so just use the first X rows of pe
+		vector<int> rows;
 		for (int i = 0; i < oe.shape().first; i++)
-		{
-			//name = preal_names[i];
-			name = pe.get_real_names()[i];
-			//cout << name << endl;
-			regul[name] = reg_map[name].sum();
-			par_group_phi_map[name] = get_par_group_contrib(reg_map[name]);
-		}
+			rows.push_back(i);
+		phi_vec = reg_mat.rowwise().sum();
+		for (auto i : rows)
+			regul[pe_real_names[i]] = phi_vec[i];
+		update_group_phi_map(reg_mat, pe_real_names, rows, par_group_ind, par_group_names, par_group_phi_map);
 	}
 
 	/*if (pest_scenario->get_control_info().pestmode == ControlInfo::PestMode::PARETO)
@@ -249,11 +249,11 @@ void PhiHandler::update(ObservationEnsemble & oe, ParameterEnsemble & pe, bool i
 	}*/
 
 	actual.clear();
-	for (auto &pv : calc_actual(oe, q))
-	{
-		actual[pv.first] = pv.second.sum();
-		obs_group_phi_map[pv.first] = get_obs_group_contrib(pv.second);
-	}
+	Eigen::MatrixXd act_mat = calc_actual(oe, q);
+	phi_vec = act_mat.rowwise().sum();
+	for (auto i : base_rows)
+		actual[oe_real_names[i]] = phi_vec[i];
+	update_group_phi_map(act_mat, oe_real_names, base_rows, obs_group_ind, obs_group_names, obs_group_phi_map);
  	composite.clear();
 	composite = calc_composite(meas, regul);
 }
@@ -526,78 +526,36 @@ vector<int> PhiHandler::get_idxs_greater_than(double bad_phi, double bad_phi_sig
 {
 	map<string, double> _meas;
 	Eigen::VectorXd q = get_q_vector();
-	for (auto &pv : calc_meas(oe, q))
-		_meas[pv.first] = pv.second.sum();
+	vector<int> base_rows = get_base_rows(oe);
+	vector<string> names = oe.get_real_names();
+	Eigen::VectorXd phi_vec = calc_meas(oe, q).rowwise().sum();
+	for (auto i : base_rows)
+		_meas[names[i]] = phi_vec[i];
 	double mean = calc_mean(&_meas);
 	double std = calc_std(&_meas);
 	vector<int> idxs;
-	vector<string> names = oe.get_real_names();
-	for (int i=0;i<names.size();i++)
-		if ((_meas[names[i]] > bad_phi) || (_meas[names[i]] > mean + (std * bad_phi_sigma)))
+	for (auto i : base_rows)
+		if ((phi_vec[i] > bad_phi) || (phi_vec[i] > mean + (std * bad_phi_sigma)))
 			idxs.push_back(i);
 	return idxs;
 }
 
-map<string, Eigen::VectorXd> PhiHandler::calc_meas(ObservationEnsemble & oe, Eigen::VectorXd &q_vec)
+Eigen::MatrixXd PhiHandler::calc_meas(ObservationEnsemble & oe, Eigen::VectorXd &q_vec)
 {
-	map<string, Eigen::VectorXd> phi_map;
-	Eigen::VectorXd oe_base_vec, oe_vec, diff,w_vec;
-	//Eigen::VectorXd q = get_q_vector();
-	vector<string> act_obs_names = pest_scenario->get_ctl_ordered_nz_obs_names();
-	vector<string> base_real_names = oe_base->get_real_names(), oe_real_names = oe.get_real_names();
-	vector<string>::iterator start = base_real_names.begin(), end = base_real_names.end();
-
-	Eigen::MatrixXd w_mat;
-	if (weights->shape().first > 0)
-		w_mat = weights->get_eigen(vector<string>(), oe_base->get_var_names());
-	double phi;
-	string rname;
-
 	Eigen::MatrixXd resid = get_obs_resid(oe);
-	assert(oe_real_names.size() == resid.rows());
-	for (int i = 0; i<resid.rows(); i++)
-	{
-		rname = oe_real_names[i];
-		if (find(start, end, rname) == end)
-			continue;
-		diff = resid.row(i);
-
-		if (weights->shape().first == 0)
-			diff = diff.cwiseProduct(q_vec);
-		else
-		{
-			w_vec = w_mat.row(i);
-			diff = diff.cwiseProduct(w_vec);
-		}
-		phi = (diff.cwiseProduct(diff)).sum();
-		phi_map[rname] = diff.cwiseProduct(diff);
-	}
-	return phi_map;
+	if (weights->shape().first == 0)
+		resid = resid * q_vec.asDiagonal();
+	else
+		resid = resid.cwiseProduct(weights->get_eigen(vector<string>(), oe_base->get_var_names()).topRows(resid.rows()));
+	return resid.cwiseAbs2();
 }
 
-map<string, Eigen::VectorXd> PhiHandler::calc_regul(ParameterEnsemble & pe)
+Eigen::MatrixXd PhiHandler::calc_regul(ParameterEnsemble & pe)
 {
-	map<string, Eigen::VectorXd> phi_map;
-	vector<string> real_names = pe.get_real_names();
 	pe_base->transform_ip(ParameterEnsemble::transStatus::NUM);
 	pe.transform_ip(ParameterEnsemble::transStatus::NUM);
 	Eigen::MatrixXd diff_mat = get_par_resid(pe);
-
-
-	Eigen::VectorXd diff;
-	for (int i = 0; i < real_names.size(); i++)
-	{
-		diff = diff_mat.row(i);
-		diff = diff.cwiseProduct(diff);
-		//cout << diff << endl;
-		diff = diff.cwiseProduct(parcov_inv_diag);
-		//cout << diff << endl;
-		//cout << parcov_inv_diag << endl;
-		//phi_map[real_names[i]] = _reg_fac * diff;
-		phi_map[real_names[i]] = diff;
-		
-	}
-	return phi_map;
+	return diff_mat.cwiseAbs2() * parcov_inv_diag.asDiagonal();
 }
 
 
@@ -623,58 +581,18 @@ void PhiHandler::apply_ineq_constraints(Eigen::MatrixXd &resid, vector<string> &
 	//	idxs[act_obs_names[i]] = i;
 	for (int i = 0; i < names.size(); i++)
 		idxs[names[i]] = i;
-	int idx;
-	double val;
-	Eigen::VectorXd col;
-
 	for (auto iv : lt_vals)
-	{
-		idx = idxs[iv.first];
-		col = resid.col(idx);
-		val = iv.second;
-		//cout << resid.col(idx) << endl;
-		for (int i = 0; i < resid.rows(); i++)
-			col(i) = (col(i) < 0.0) ? 0.0 : col(i);
-		//cout << resid.col(idx) << endl;
-		resid.col(idx) = col;
-		//cout << resid.col(idx) << endl;
-	}
+		resid.col(idxs[iv.first]) = resid.col(idxs[iv.first]).cwiseMax(0.0);
 
 	for (auto iv : gt_vals)
-	{
-		idx = idxs[iv.first];
-		col = resid.col(idx);
-		val = iv.second;
-		for (int i = 0; i < resid.rows(); i++)
-			col(i) = (col(i) > 0.0) ? 0.0 : col(i);
-		resid.col(idx) = col;
-	}
+		resid.col(idxs[iv.first]) = resid.col(idxs[iv.first]).cwiseMin(0.0);
 }
 
 
-map<string, Eigen::VectorXd> PhiHandler::calc_actual(ObservationEnsemble & oe, Eigen::VectorXd &q_vec)
+Eigen::MatrixXd PhiHandler::calc_actual(ObservationEnsemble & oe, Eigen::VectorXd &q_vec)
 {
-	map<string, Eigen::VectorXd> phi_map;
-	Eigen::MatrixXd resid = get_actual_obs_resid(oe);
-	vector<string> base_real_names = oe_base->get_real_names(), oe_real_names = oe.get_real_names();
-	vector<string>::iterator start = base_real_names.begin(), end = base_real_names.end();
-	double phi;
-	string rname;
-
-	Eigen::MatrixXd oe_reals = oe.get_eigen(vector<string>(), oe_base->get_var_names());
-	Eigen::VectorXd diff;
-	for (int i = 0; i<oe.shape().first; i++)
-	{
-		rname = oe_real_names[i];
-		if (find(start, end, rname) == end)
-			continue;
-		//diff = (oe_vec - obs_val_vec).cwiseProduct(q);
-		diff = resid.row(i);
-		diff = diff.cwiseProduct(q_vec);
-		//phi = (diff.cwiseProduct(diff)).sum();
-		phi_map[rname] = diff.cwiseProduct(diff);
-	}
-	return phi_map;
+	Eigen::MatrixXd resid = get_actual_obs_resid(oe) * q_vec.asDiagonal();
+	return resid.cwiseAbs2();
 }
 
 
@@ -869,9 +787,29 @@ bool IterEnsembleSmoother::initialize_pe(Covariance &cov)
 				throw_ies_error(string("error processing par jcb"));
 			}
 		}
+		else if (par_ext.compare("bin") == 0)
+		{
+			message(1, "loading par ensemble from dense binary file", par_csv);
+			try
+			{
+				vector<string> keep_names;
+				if (pp_args.find("IES_NUM_REALS") != pp_args.end())
+					keep_names = get_dense_keep_names(par_csv, "parameter");
+				pe.from_dense(par_csv, keep_names);
+			}
+			catch (const exception &e)
+			{
+				ss << "error processing par ensemble dense binary file: " << e.what();
+				throw_ies_error(ss.str());
+			}
+			catch (...)
+			{
+				throw_ies_error(string("error processing par ensemble dense binary file"));
+			}
+		}
 		else
 		{
-			ss << "unrecognized par csv extension " << par_ext << ", looking for csv, jcb, or jco";
+			ss << "unrecognized par csv extension " << par_ext << ", looking for csv, jcb, jco, or bin";
 			throw_ies_error(ss.str());
 		}
 
@@ -1093,9 +1031,29 @@ bool IterEnsembleSmoother::initialize_oe(Covariance &cov)
 				throw_ies_error(string("error processing obs binary file"));
 			}
 		}
+		else if (obs_ext.compare("bin") == 0)
+		{
+			message(1, "loading obs ensemble from dense binary file", obs_csv);
+			try
+			{
+				vector<string> keep_names;
+				if (pp_args.find("IES_NUM_REALS") != pp_args.end())
+					keep_names = get_dense_keep_names(obs_csv, "observation");
+				oe.from_dense(obs_csv, keep_names);
+			}
+			catch (const exception &e)
+			{
+				ss << "error processing obs ensemble dense binary file: " << e.what();
+				throw_ies_error(ss.str());
+			}
+			catch (...)
+			{
+				throw_ies_error(string("error processing obs ensemble dense binary file"));
+			}
+		}
 		else
 		{
-			ss << "unrecognized obs ensemble extension " << obs_ext << ", looing for csv, jcb, or jco";
+			ss << "unrecognized obs ensemble extension " << obs_ext << ", looing for csv, jcb, jco, or bin";
 			throw_ies_error(ss.str());
 		}
 		if (pp_args.find("IES_NUM_REALS") != pp_args.end())
@@ -1251,6 +1209,8 @@ void IterEnsembleSmoother::sanity_checks()
 	}
 	if (ppo->get_ies_reg_factor() < 0.0)
 		errors.push_back("ies_reg_factor < 0.0 - WRONG!");
+	if ((ppo->get_ies_race_lambdas()) && (ppo->get_ies_race_sigma() <= 0.0))
+		errors.push_back("ies_race_sigma <= 0.0, every lambda would be dropped as soon as it has two runs");
 	//if (ppo->get_ies_reg_factor() > 1.0)
 	//	errors.push_back("ies_reg_factor > 1.0 - nope");
 	if ((par_csv.size() == 0) && (ppo->get_ies_subset_size() < 10000000) && (ppo->get_ies_num_reals() < ppo->get_ies_subset_size() * 2))
@@ -1282,8 +1242,7 @@ void IterEnsembleSmoother::sanity_checks()
 
 	if ((ppo->get_ies_num_threads() > 0) && (!use_localizer))
 	{
-		warnings.push_back("'ies_num_threads > 0 but no localization, resetting 'ies_num_threads' = 0");
-		ppo->set_ies_num_threads(-1);
+		warnings.push_back("'ies_num_threads > 0 but no localization, only using 'ies_num_threads' to draw the realizations");
 		num_threads = -1;
 	}
 
@@ -1349,9 +1308,26 @@ void IterEnsembleSmoother::initialize_restart()
 			throw_ies_error(string("error processing restart obs binary file"));
 		}
 	}
+	else if (obs_ext.compare("bin") == 0)
+	{
+		message(1, "loading restart obs ensemble from dense binary file", obs_restart_csv);
+		try
+		{
+			oe.from_dense(obs_restart_csv);
+		}
+		catch (const exception &e)
+		{
+			ss << "error processing restart obs ensemble dense binary file: " << e.what();
+			throw_ies_error(ss.str());
+		}
+		catch (...)
+		{
+			throw_ies_error(string("error processing restart obs ensemble dense binary file"));
+		}
+	}
 	else
 	{
-		ss << "unrecognized restart obs ensemble extension " << obs_ext << ", looing for csv, jcb, or jco";
+		ss << "unrecognized restart obs ensemble extension " << obs_ext << ", looing for csv, jcb, jco, or bin";
 		throw_ies_error(ss.str());
 	}
 	if (par_restart_csv.size() > 0)
@@ -1391,9 +1367,26 @@ void IterEnsembleSmoother::initialize_restart()
 				throw_ies_error(string("error processing restart par binary file"));
 			}
 		}
+		else if (par_ext.compare("bin") == 0)
+		{
+			message(1, "loading restart par ensemble from dense binary file", par_restart_csv);
+			try
+			{
+				pe.from_dense(par_restart_csv);
+			}
+			catch (const exception &e)
+			{
+				ss << "error processing restart par ensemble dense binary file: " << e.what();
+				throw_ies_error(ss.str());
+			}
+			catch (...)
+			{
+				throw_ies_error(string("error processing restart par ensemble dense binary file"));
+			}
+		}
 		else
 		{
-			ss << "unrecognized restart par ensemble extension " << par_ext << ", looing for csv, jcb, or jco";
+			ss << "unrecognized restart par ensemble extension " << par_ext << ", looing for csv, jcb, jco, or bin";
 			throw_ies_error(ss.str());
 		}
 		if (pe.shape().first != oe.shape().first)
@@ -1615,9 +1608,26 @@ void IterEnsembleSmoother::initialize_weights()
 			throw_ies_error(string("error processing weights binary file"));
 		}
 	}
+	else if (obs_ext.compare("bin") == 0)
+	{
+		message(1, "loading weights ensemble from dense binary file", weights_csv);
+		try
+		{
+			weights.from_dense(weights_csv);
+		}
+		catch (const exception &e)
+		{
+			ss << "error processing weights ensemble dense binary file: " << e.what();
+			throw_ies_error(ss.str());
+		}
+		catch (...)
+		{
+			throw_ies_error(string("error processing weights ensemble dense binary file"));
+		}
+	}
 	else
 	{
-		ss << "unrecognized weights ensemble extension " << obs_ext << ", looking for csv, jcb, or jco";
+		ss << "unrecognized weights ensemble extension " << obs_ext << ", looking for csv, jcb, jco, or bin";
 		throw_ies_error(ss.str());
 	}
 
@@ -1851,6 +1861,9 @@ void IterEnsembleSmoother::initialize()
 	}
 
 	num_threads = pest_scenario.get_pestpp_options().get_ies_num_threads();
+	use_ensemble_store = pest_scenario.get_pestpp_options().get_ies_ensemble_store();
+	if (use_ensemble_store)
+		message(1, "keeping the upgrade and lambda ensembles in ensemble store files");
 	
 	iter = 0;
 	//ofstream &frec = file_manager.rec_ofstream();
@@ -1923,6 +1936,8 @@ void IterEnsembleSmoother::initialize()
 	double dec_fac = pest_scenario.get_pestpp_options().get_ies_lambda_dec_fac();
 	message(1, "lambda decrease factor: ", dec_fac);
 	message(1, "max run fail: ", ppo->get_max_run_fail());
+	if (ppo->get_ies_race_lambdas())
+		message(1, "racing lambda ensembles, standard errors used to drop a lambda: ", ppo->get_ies_race_sigma());
 
 	sanity_checks();
 
@@ -2073,7 +2088,12 @@ void IterEnsembleSmoother::initialize()
 			add_bases();
 
 	ss.str("");
-	if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+	if (pest_scenario.get_pestpp_options().get_ies_save_dense())
+	{
+		ss << file_manager.get_base_filename() << ".0.par.bin";
+		pe.to_dense(ss.str());
+	}
+	else if (pest_scenario.get_pestpp_options().get_ies_save_binary())
 	{
 		ss << file_manager.get_base_filename() << ".0.par.jcb";
 		pe.to_binary(ss.str());
@@ -2086,7 +2106,12 @@ void IterEnsembleSmoother::initialize()
 	message(1, "saved initial parameter ensemble to ", ss.str());
 
 	ss.str("");
-	if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+	if (pest_scenario.get_pestpp_options().get_ies_save_dense())
+	{
+		ss << file_manager.get_base_filename() << ".base.obs.bin";
+		oe.to_dense(ss.str());
+	}
+	else if (pest_scenario.get_pestpp_options().get_ies_save_binary())
 	{
 		ss << file_manager.get_base_filename() << ".base.obs.jcb";
 		oe.to_binary(ss.str());
@@ -2199,7 +2224,12 @@ void IterEnsembleSmoother::initialize()
 	}
 	
 	ss.str("");
-	if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+	if (pest_scenario.get_pestpp_options().get_ies_save_dense())
+	{
+		ss << file_manager.get_base_filename() << ".0.obs.bin";
+		oe.to_dense(ss.str());
+	}
+	else if (pest_scenario.get_pestpp_options().get_ies_save_binary())
 	{
 		ss << file_manager.get_base_filename() << ".0.obs.jcb";
 		oe.to_binary(ss.str());
@@ -2636,18 +2666,21 @@ bool IterEnsembleSmoother::should_terminate()
 
 
 
-LocalUpgradeThread::LocalUpgradeThread(PerformanceLog *_performance_log, unordered_map<string, Eigen::VectorXd> &_par_resid_map, unordered_map<string, Eigen::VectorXd> &_par_diff_map,
-	unordered_map<string, Eigen::VectorXd> &_obs_resid_map, unordered_map<string, Eigen::VectorXd> &_obs_diff_map,
-	Localizer &_localizer, unordered_map<string, double> &_parcov_inv_map, unordered_map<string, double> &_weight_map,
-	ParameterEnsemble &_pe_upgrade, unordered_map<string,pair<vector<string>,vector<string>>> &_cases,
-	unordered_map<string, Eigen::VectorXd> &_Am_map, Localizer::How &_how): par_resid_map(_par_resid_map),
-	par_diff_map(_par_diff_map), obs_resid_map(_obs_resid_map),obs_diff_map(_obs_diff_map),localizer(_localizer),
-	pe_upgrade(_pe_upgrade),cases(_cases), parcov_inv_map(_parcov_inv_map), weight_map(_weight_map), Am_map(_Am_map)
+LocalUpgradeThread::LocalUpgradeThread(PerformanceLog *_performance_log, Pest *_pest_scenario_ptr, int _num_reals,
+	Eigen::MatrixXd &_par_resid, Eigen::MatrixXd &_par_diff,
+	Eigen::MatrixXd &_obs_resid, Eigen::MatrixXd &_obs_diff,
+	Eigen::VectorXd &_parcov_inv, Eigen::VectorXd &_weights, vector<ParameterEnsemble> &_pe_upgrades,
+	unordered_map<string,pair<vector<string>,vector<string>>> &_cases,
+	unordered_map<string, pair<vector<int>, vector<int>>> &_case_idxs, Eigen::MatrixXd &_Am): par_resid_mat(_par_resid),
+	par_diff_mat(_par_diff), obs_resid_mat(_obs_resid),obs_diff_mat(_obs_diff),
+	pe_upgrades(_pe_upgrades),cases(_cases), case_idxs(_case_idxs), parcov_inv_vec(_parcov_inv), weight_vec(_weights), Am_mat(_Am)
 {
 	performance_log = _performance_log;
-	how = _how;
-	parcov_inv_map = _parcov_inv_map;
-	weight_map = _weight_map;
+	pest_scenario_ptr = _pest_scenario_ptr;
+	num_reals = _num_reals;
+	par_store = nullptr;
+	par_resid_store = nullptr;
+	upgrade_stores = nullptr;
 	count = 0;
 
 	for (auto &c : cases)
@@ -2658,37 +2691,50 @@ LocalUpgradeThread::LocalUpgradeThread(PerformanceLog *_performance_log, unorder
 	total = keys.size();
 	//random_shuffle(keys.begin(), keys.end());
 
+	//the pars that are in more than one part are added under the column locks
+	vector<int> part_counts(parcov_inv_vec.size(), 0);
+	for (auto &c : case_idxs)
+		for (auto jpar : c.second.second)
+			part_counts[jpar]++;
+	shared.assign(part_counts.size(), false);
+	for (int i = 0; i < part_counts.size(); i++)
+		shared[i] = (part_counts[i] > 1);
 }
 
+void LocalUpgradeThread::set_stores(EnsembleStore *_par_store, EnsembleStore *_par_resid_store, vector<unique_ptr<EnsembleStore>> *_upgrade_stores)
+{
+	par_store = _par_store;
+	par_resid_store = _par_resid_store;
+	upgrade_stores = _upgrade_stores;
+}
 
-void LocalUpgradeThread::work(int thread_id, int iter, double cur_lam)
+
+void LocalUpgradeThread::work(int thread_id, int iter, vector<double> cur_lams)
 {
 	class local_utils
 	{
 	public:
-		static Eigen::DiagonalMatrix<double, Eigen::Dynamic> get_matrix_from_map(vector<string> &names, unordered_map<string, double> &dmap)
+		static Eigen::DiagonalMatrix<double, Eigen::Dynamic> get_diagonal(const vector<int> &idxs, const Eigen::VectorXd &vec)
 		{
-			Eigen::VectorXd vec(names.size());
-			int i = 0;
-			for (auto name : names)
-			{
-				vec[i] = dmap.at(name);
-				++i;
-			}
-			Eigen::DiagonalMatrix<double, Eigen::Dynamic> m = vec.asDiagonal();
+			Eigen::VectorXd part(idxs.size());
+			for (int i = 0; i < idxs.size(); i++)
+				part[i] = vec[idxs[i]];
+			Eigen::DiagonalMatrix<double, Eigen::Dynamic> m = part.asDiagonal();
 			return m;
 		}
-		static Eigen::MatrixXd get_matrix_from_map(int num_reals, vector<string> &names, unordered_map<string, Eigen::VectorXd> &emap)
+		static Eigen::MatrixXd get_cols(const vector<int> &idxs, const Eigen::MatrixXd &mat)
 		{
-			Eigen::MatrixXd mat(num_reals, names.size());
-			mat.setZero();
-
-			for (int j = 0; j < names.size(); j++)
-			{
-				mat.col(j) = emap[names[j]];
-			}
-
-			return mat;
+			Eigen::MatrixXd part(mat.rows(), idxs.size());
+			for (int j = 0; j < idxs.size(); j++)
+				part.col(j) = mat.col(idxs[j]);
+			return part;
+		}
+		static Eigen::MatrixXd get_rows(const vector<int> &idxs, const Eigen::MatrixXd &mat)
+		{
+			Eigen::MatrixXd part(idxs.size(), mat.cols());
+			for (int i = 0; i < idxs.size(); i++)
+				part.row(i) = mat.row(idxs[i]);
+			return part;
 		}
 		static void save_mat(int verbose_level, int tid, int iter, int t_count, string prefix, Eigen::MatrixXd &mat)
 		{
@@ -2724,31 +2770,20 @@ void LocalUpgradeThread::work(int thread_id, int iter, double cur_lam)
 	stringstream ss;
 	
 	
-	unique_lock<mutex> ctrl_guard(ctrl_lock, defer_lock);
-	int maxsing, num_reals, verbose_level, pcount=0,t_count;
+	int maxsing, verbose_level, pcount=0,t_count;
 	double eigthresh;
 	bool use_approx;
 	bool use_prior_scaling;
-	bool use_localizer = false;
-	bool loc_by_obs = true;
+	bool use_propack = false;
+
+	maxsing = pest_scenario_ptr->get_svd_info().maxsing;
+	eigthresh = pest_scenario_ptr->get_svd_info().eigthresh;
+	use_approx = pest_scenario_ptr->get_pestpp_options().get_ies_use_approx();
+	use_prior_scaling = pest_scenario_ptr->get_pestpp_options().get_ies_use_prior_scaling();
+	verbose_level = pest_scenario_ptr->get_pestpp_options().get_ies_verbose_level();
+	if (pest_scenario_ptr->get_pestpp_options().get_svd_pack() == PestppOptions::SVD_PACK::PROPACK)
+		use_propack = true;
 
-	while (true)
-	{
-		if (ctrl_guard.try_lock())
-		{
-			maxsing = pe_upgrade.get_pest_scenario_ptr()->get_svd_info().maxsing;
-			eigthresh = pe_upgrade.get_pest_scenario_ptr()->get_svd_info().eigthresh;
-			use_approx = pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_use_approx();
-			use_prior_scaling = pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_use_prior_scaling();
-			num_reals = pe_upgrade.shape().first;
-			verbose_level = pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_verbose_level();
-			ctrl_guard.unlock();
-			//if (pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_localize_how()[0] == 'P')
-			if (how == Localizer::How::PARAMETERS)
-				loc_by_obs = false;
-			break;
-		}
-	}
 	ofstream f_thread;
 	if (verbose_level > 2)
 	{
@@ -2758,61 +2793,44 @@ void LocalUpgradeThread::work(int thread_id, int iter, double cur_lam)
 		ss.str("");
 	}
 	Eigen::MatrixXd par_resid, par_diff, Am;
-	Eigen::MatrixXd obs_resid, obs_diff, loc;
+	Eigen::MatrixXd obs_resid, obs_diff;
 	Eigen::DiagonalMatrix<double, Eigen::Dynamic> weights, parcov_inv;
 	vector<string> par_names, obs_names;
 	while (true)
 	{
-		unique_lock<mutex> next_guard(next_lock, defer_lock);
 		par_names.clear();
 		obs_names.clear();
-		use_localizer = false;
-		//the end condition
 		//the end condition
-		while (true)
-		{	
-			if (next_guard.try_lock())
+		int ipart = count.fetch_add(1);
+		if (ipart >= total)
+		{
+			if (verbose_level > 1)
 			{
-				if (count == keys.size())
-				{
-					if (verbose_level > 1)
-					{
-						cout << "upgrade thread: " << thread_id << " processed " << pcount << " upgrade parts" << endl;
-					}
-					if (f_thread.good())
-						f_thread.close();
-					return;
-				}
-				string k = keys[count];
-				pair<vector<string>, vector<string>> p = cases.at(k);
-				par_names = p.second;
-				obs_names = p.first;
-				if (localizer.get_use())
-				{
-					if ((loc_by_obs) && (par_names.size() == 1) && (k == par_names[0]))
-						use_localizer = true;
-					else if ((!loc_by_obs) && (obs_names.size() == 1) && (k == obs_names[0]))
-					{
-						use_localizer = true;
-						//loc_by_obs = false;
-					}
-				}
-				if (count % 1000 == 0)
-				{
-					ss.str("");
-					ss << "upgrade thread progress: " << count << " of " << total << " parts done";
-					if (verbose_level > 1)
-						cout << ss.str() << endl;
-					performance_log->log_event(ss.str());
-				}
-				count++;
-				t_count = count;
-				pcount++;
-				next_guard.unlock();
-				break;
+				lock_guard<mutex> log_guard(log_lock);
+				cout << "upgrade thread: " << thread_id << " processed " << pcount << " upgrade parts" << endl;
 			}
+			if (f_thread.good())
+				f_thread.close();
+			return;
 		}
-		
+		string k = keys[ipart];
+		const pair<vector<string>, vector<string>> &p = cases.at(k);
+		par_names = p.second;
+		obs_names = p.first;
+		//the column indices of the part were compiled with the localizer map
+		const pair<vector<int>, vector<int>> &idxs = case_idxs.at(k);
+		const vector<int> &obs_idxs = idxs.first, &par_idxs = idxs.second;
+		if (ipart % 1000 == 0)
+		{
+			lock_guard<mutex> log_guard(log_lock);
+			ss.str("");
+			ss << "upgrade thread progress: " << ipart << " of " << total << " parts done";
+			if (verbose_level > 1)
+				cout << ss.str() << endl;
+			performance_log->log_event(ss.str());
+		}
+		t_count = ipart + 1;
+		pcount++;
 
 		if (verbose_level > 2)
 		{
@@ -2824,93 +2842,25 @@ void LocalUpgradeThread::work(int thread_id, int iter, double cur_lam)
 			f_thread << endl;
 		}
 
-		par_resid.resize(0, 0);
-		par_diff.resize(0, 0);
-		obs_resid.resize(0, 0);
-		obs_diff.resize(0, 0);
-		loc.resize(0, 0);
-		Am.resize(0, 0);
-		weights.resize(0);
-		parcov_inv.resize(0);
+		//the matrices are not changed while the threads are running so no locking is needed here
 		Am.resize(0, 0);
-
-		unique_lock<mutex> obs_diff_guard(obs_diff_lock, defer_lock);
-		unique_lock<mutex> obs_resid_guard(obs_resid_lock, defer_lock);
-		unique_lock<mutex> par_diff_guard(par_diff_lock, defer_lock);
-		unique_lock<mutex> par_resid_guard(par_resid_lock, defer_lock);
-		unique_lock<mutex> loc_guard(loc_lock, defer_lock);
-		unique_lock<mutex> weight_guard(weight_lock, defer_lock);
-		unique_lock<mutex> parcov_guard(parcov_lock, defer_lock);
-		unique_lock<mutex> am_guard(am_lock, defer_lock);
-
-		bool use_propack = false;
-
-		while (true)
-		{
-			if (((use_approx) || (par_resid.rows() > 0)) &&
-				(weights.size() > 0) &&
-				(parcov_inv.size() > 0) &&
-				(par_diff.rows() > 0) &&
-				(obs_resid.rows() > 0) &&
-				(obs_diff.rows() > 0) &&
-				((!use_localizer) || (loc.rows() > 0)) && 
-				((use_approx) || (Am.rows() > 0)))
-				break;
-			if ((use_localizer) && (loc.rows() == 0) && (loc_guard.try_lock()))
-			{
-				if (loc_by_obs)
-					loc = localizer.get_localizing_par_hadamard_matrix(num_reals, obs_names[0], par_names);
-				else
-					loc = localizer.get_localizing_obs_hadamard_matrix(num_reals, par_names[0], obs_names);
-				loc_guard.unlock();
-			}
-			if ((obs_diff.rows() == 0) && (obs_diff_guard.try_lock()))
-			{
-				//piggy back here for thread safety
-				if (pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_svd_pack() == PestppOptions::SVD_PACK::PROPACK)
-					use_propack = true;
-				obs_diff = local_utils::get_matrix_from_map(num_reals, obs_names, obs_diff_map);
-				obs_diff_guard.unlock();
-			}
-			if ((obs_resid.rows() == 0) && (obs_resid_guard.try_lock()))
-			{
-				obs_resid = local_utils::get_matrix_from_map(num_reals, obs_names, obs_resid_map);
-				obs_resid_guard.unlock();
-			}
-			if ((par_diff.rows() == 0) && (par_diff_guard.try_lock()))
-			{
-				par_diff = local_utils::get_matrix_from_map(num_reals, par_names, par_diff_map);
-				par_diff_guard.unlock();
-			}
-			if ((par_resid.rows() == 0) && (par_resid_guard.try_lock()))
-			{
-				par_resid = local_utils::get_matrix_from_map(num_reals, par_names, par_resid_map);
-				par_resid_guard.unlock();
-			}
-			if ((weights.rows() == 0) && (weight_guard.try_lock()))
-			{
-				weights = local_utils::get_matrix_from_map(obs_names, weight_map);
-				weight_guard.unlock();
-			}
-			if ((parcov_inv.rows() == 0) && (parcov_guard.try_lock()))
-			{
-				parcov_inv = local_utils::get_matrix_from_map(par_names, parcov_inv_map);
-				parcov_guard.unlock();
-			}
-			if ((!use_approx) && (Am.rows() == 0) && (am_guard.try_lock()))
-			{
-				//Am = local_utils::get_matrix_from_map(num_reals, par_names, Am_map).transpose();
-				int am_cols = Am_map[par_names[0]].size();
-				Am.resize(par_names.size(),am_cols);
-				Am.setZero();
-
-				for (int j = 0; j < par_names.size(); j++)
-				{
-					Am.row(j) = Am_map[par_names[j]];
-				}
-				am_guard.unlock();
-			}
+		obs_diff = local_utils::get_cols(obs_idxs, obs_diff_mat);
+		obs_resid = local_utils::get_cols(obs_idxs, obs_resid_mat);
+		if (par_store != nullptr)
+		{
+			lock_guard<mutex> guard(store_lock);
+			par_diff = par_store->get_eigen_mean_diff(par_names);
+			par_resid = par_resid_store->get_eigen(par_names);
+		}
+		else
+		{
+			par_diff = local_utils::get_cols(par_idxs, par_diff_mat);
+			par_resid = local_utils::get_cols(par_idxs, par_resid_mat);
 		}
+		weights = local_utils::get_diagonal(obs_idxs, weight_vec);
+		parcov_inv = local_utils::get_diagonal(par_idxs, parcov_inv_vec);
+		if (!use_approx)
+			Am = local_utils::get_rows(par_idxs, Am_mat);
 		
 		par_diff.transposeInPlace();
 		obs_diff.transposeInPlace();
@@ -2941,17 +2891,6 @@ void LocalUpgradeThread::work(int thread_id, int iter, double cur_lam)
 		double scale = (1.0 / (sqrt(double(num_reals - 1))));
 		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "obs_diff", obs_diff);
 
-		if (use_localizer)
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "loc", loc);
-		if (use_localizer)
-		{
-			if (loc_by_obs)
-				par_diff = par_diff.cwiseProduct(loc);
-			else	
-				obs_diff = obs_diff.cwiseProduct(loc);
-
-		}
-		
 		obs_diff = scale * (weights * obs_diff);
 		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "par_diff", par_diff);
 		if (use_prior_scaling)
@@ -2982,32 +2921,11 @@ void LocalUpgradeThread::work(int thread_id, int iter, double cur_lam)
 
 		Eigen::MatrixXd s2 = s.cwiseProduct(s);
 
-		ivec = ((Eigen::VectorXd::Ones(s2.size()) * (cur_lam + 1.0)) + s2).asDiagonal().inverse();
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "ivec", ivec);
+		//everything up to here, and the products below that do not involve ivec, is the same for all lambdas
 		Eigen::MatrixXd X1 = Ut * scaled_residual;
 		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X1", X1);
-		Eigen::MatrixXd X2 = ivec * X1;
-		X1.resize(0, 0);
-
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X2", X2);
-		Eigen::MatrixXd X3 = V * s.asDiagonal() * X2;
-		X2.resize(0, 0);
-
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X3", X3);
-		if (use_prior_scaling)
-		{
-			upgrade_1 = -1.0 * parcov_inv * par_diff * X3;
-		}
-		else
-		{
-			upgrade_1 = -1.0 * par_diff * X3;
-		}
-		upgrade_1.transposeInPlace();
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_1",upgrade_1);
-		X3.resize(0, 0);
 
-
-		Eigen::MatrixXd upgrade_2;
+		Eigen::MatrixXd x6;
 		if ((!use_approx) && (iter > 1))
 		{
 			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "Am",Am);
@@ -3021,38 +2939,78 @@ void LocalUpgradeThread::work(int thread_id, int iter, double cur_lam)
 			Am.resize(0, 0);
 
 			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X5", x5);
-			Eigen::MatrixXd x6 = par_diff.transpose() * x5;
+			x6 = par_diff.transpose() * x5;
 			x5.resize(0, 0);
 
 			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X6", x6);
-			Eigen::MatrixXd x7 = V * ivec *V.transpose() * x6;
-			x6.resize(0, 0);
+		}
+
+		vector<Eigen::MatrixXd> upgrades;
+		for (int ilam = 0; ilam < cur_lams.size(); ilam++)
+		{
+			double cur_lam = cur_lams[ilam];
+			string lam_tag = ".lam_" + to_string(ilam);
+			ivec = ((Eigen::VectorXd::Ones(s2.size()) * (cur_lam + 1.0)) + s2).asDiagonal().inverse();
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "ivec" + lam_tag, ivec);
+			Eigen::MatrixXd X2 = ivec * X1;
 
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X2" + lam_tag, X2);
+			Eigen::MatrixXd X3 = V * s.asDiagonal() * X2;
+			X2.resize(0, 0);
+
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X3" + lam_tag, X3);
 			if (use_prior_scaling)
 			{
-				upgrade_2 = -1.0 * parcov_inv * par_diff * x7;
+				upgrade_1 = -1.0 * parcov_inv * par_diff * X3;
 			}
 			else
 			{
-				upgrade_2 = -1.0 * (par_diff * x7);
+				upgrade_1 = -1.0 * par_diff * X3;
 			}
-			x7.resize(0, 0);
+			upgrade_1.transposeInPlace();
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_1" + lam_tag, upgrade_1);
+			X3.resize(0, 0);
+
+			Eigen::MatrixXd upgrade_2;
+			if ((!use_approx) && (iter > 1))
+			{
+				Eigen::MatrixXd x7 = V * ivec *V.transpose() * x6;
+
+				if (use_prior_scaling)
+				{
+					upgrade_2 = -1.0 * parcov_inv * par_diff * x7;
+				}
+				else
+				{
+					upgrade_2 = -1.0 * (par_diff * x7);
+				}
+				x7.resize(0, 0);
 
-			upgrade_1 = upgrade_1 + upgrade_2.transpose();
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_2", upgrade_2);
-			upgrade_2.resize(0, 0);
+				upgrade_1 = upgrade_1 + upgrade_2.transpose();
+				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_2" + lam_tag, upgrade_2);
+				upgrade_2.resize(0, 0);
 
+			}
+			upgrades.push_back(upgrade_1);
 		}
 		
-		unique_lock<mutex> put_guard(put_lock, defer_lock);
-		while (true)
+		if (upgrade_stores != nullptr)
 		{
-			if (put_guard.try_lock())
-			{
-				pe_upgrade.add_2_cols_ip(par_names, upgrade_1);
-				put_guard.unlock();
-				break;
-			}
+			//the shared pars are summed in the files too, since each add reads and writes under the lock
+			lock_guard<mutex> guard(store_lock);
+			for (int ilam = 0; ilam < upgrades.size(); ilam++)
+				(*upgrade_stores)[ilam]->add_2_cols_ip(par_names, upgrades[ilam]);
+			continue;
+		}
+		//only this part writes the columns of the pars that are in no other part
+		for (int j = 0; j < par_idxs.size(); j++)
+		{
+			int jpar = par_idxs[j];
+			unique_lock<mutex> col_guard(col_locks[jpar % n_col_locks], defer_lock);
+			if (shared[jpar])
+				col_guard.lock();
+			for (int ilam = 0; ilam < upgrades.size(); ilam++)
+				pe_upgrades[ilam].get_eigen_ptr_4_mod()->col(jpar) += upgrades[ilam].col(j);
 		}
 	}
 
@@ -3060,11 +3018,11 @@ void LocalUpgradeThread::work(int thread_id, int iter, double cur_lam)
 
 
 
-void upgrade_thread_function(int id, int iter,double cur_lam, LocalUpgradeThread &worker, exception_ptr &eptr)
+void upgrade_thread_function(int id, int iter, vector<double> cur_lams, LocalUpgradeThread &worker, exception_ptr &eptr)
 {
 	try
 	{
-		worker.work(id, iter, cur_lam);
+		worker.work(id, iter, cur_lams);
 	}
 	catch (...)
 	{
@@ -3075,31 +3033,20 @@ void upgrade_thread_function(int id, int iter,double cur_lam, LocalUpgradeThread
 }
 
 
-ParameterEnsemble IterEnsembleSmoother::calc_localized_upgrade_threaded(double cur_lam, unordered_map<string, pair<vector<string>, vector<string>>> &loc_map)
+vector<ParameterEnsemble> IterEnsembleSmoother::calc_localized_upgrade_threaded(vector<double> cur_lams, unordered_map<string, pair<vector<string>, vector<string>>> &loc_map,
+	unordered_map<string, pair<vector<int>, vector<int>>> &loc_idx_map)
 {
 	stringstream ss;
 	
 	ObservationEnsemble oe_upgrade(oe.get_pest_scenario_ptr(), oe.get_eigen(vector<string>(), act_obs_names, false), oe.get_real_names(), act_obs_names);
-	ParameterEnsemble pe_upgrade(pe.get_pest_scenario_ptr(), pe.get_eigen(vector<string>(), act_par_names, false), pe.get_real_names(), act_par_names);
+	vector<string> par_names = act_par_names;
+	vector<string> real_names = pe.get_real_names();
 	
-	//this copy of the localizer map will be consumed by the worker threads
-	//unordered_map<string, pair<vector<string>, vector<string>>> loc_map;
-	if (use_localizer)
-	{
-		
-		loc_map = localizer.get_localizer_map(iter, oe, pe, performance_log);
-		//localizer.report(file_manager.rec_ofstream());
-	}
-	else
-	{
-		pair<vector<string>, vector<string>> p(act_obs_names, act_par_names);
-		loc_map["all"] = p;
-	}
+	//loc_map and loc_idx_map are built once by the caller and shared by the worker threads,
+	//the index lists are columns of the matrices below
 	
-	//prep the fast look par cov info
-	message(2, "preparing fast-look containers for threaded localization solve");
-	unordered_map<string, double> parcov_inv_map;
-	parcov_inv_map.reserve(pe_upgrade.shape().second);
+	//prep the par cov info
+	message(2, "preparing containers for threaded localization solve");
 	Eigen::VectorXd parcov_inv;// = parcov.get(par_names).inv().e_ptr()->toDense().cwiseSqrt().asDiagonal();
 	if (parcov.isdiagonal())
 		parcov_inv = parcov.inv().get_matrix().diagonal().cwiseSqrt();
@@ -3110,73 +3057,63 @@ ParameterEnsemble IterEnsembleSmoother::calc_localized_upgrade_threaded(double c
 		parcov_diag.from_diagonal(parcov);
 		parcov_inv = parcov_diag.inv().get_matrix().diagonal().cwiseSqrt();
 	}
-	vector<string> par_names = pe_upgrade.get_var_names();
-	for (int i = 0; i < parcov_inv.size(); i++)
-		parcov_inv_map[par_names[i]] = parcov_inv[i];
-
 
-	//prep the fast lookup weights info
-	unordered_map<string, double> weight_map;
-	weight_map.reserve(oe_upgrade.shape().second);
+	//prep the weights info
 	vector<string> obs_names = oe_upgrade.get_var_names();
-	double w;
+	Eigen::VectorXd weights(obs_names.size());
 	for (int i = 0; i < obs_names.size(); i++)
 	{
-		w = pest_scenario.get_observation_info_ptr()->get_weight(obs_names[i]);
 		//don't want to filter on weight here - might be changing weights, etc...
-		//if (w == 0.0)
-		//	continue;
-		weight_map[obs_names[i]] = w;
+		weights[i] = pest_scenario.get_observation_info_ptr()->get_weight(obs_names[i]);
 	}
 	
-	//prep a fast look for obs, par and resid matrices - stored as column vectors in a map
-	unordered_map<string, Eigen::VectorXd> par_resid_map, obs_resid_map, Am_map;
-	unordered_map<string, Eigen::VectorXd> par_diff_map, obs_diff_map;
-	par_resid_map.reserve(par_names.size());
-	par_diff_map.reserve(par_names.size());
-	Am_map.reserve(par_names.size());
-	obs_resid_map.reserve(obs_names.size());
-	obs_diff_map.reserve(obs_names.size());
-
-	Eigen::MatrixXd mat = ph.get_obs_resid_subset(oe_upgrade);
-	for (int i = 0; i < obs_names.size(); i++)
-	{
-		obs_resid_map[obs_names[i]] = mat.col(i);
-	}
-	mat = oe_upgrade.get_eigen_mean_diff();
-	for (int i = 0; i < obs_names.size(); i++)
-	{
-		obs_diff_map[obs_names[i]] = mat.col(i);
+	//the obs, par and resid matrices that the parts are gathered from
+	Eigen::MatrixXd par_resid, par_diff, Am;
+	Eigen::MatrixXd obs_resid = ph.get_obs_resid_subset(oe_upgrade);
+	Eigen::MatrixXd obs_diff = oe_upgrade.get_eigen_mean_diff();
+	vector<ParameterEnsemble> pe_upgrades;
+	if (use_ensemble_store)
+	{
+		//the par residuals and anomalies are read from disk by each local part, and the upgrades are
+		//added to one file per lambda, so no nreal x npar par matrix is formed here
+		message(2, "writing par ensemble and residuals to ensemble store files");
+		par_store.reset(new EnsembleStore(get_store_filename("par")));
+		par_store->from_ensemble(pe);
+		par_resid_store.reset(new EnsembleStore(get_store_filename("par_resid")));
+		par_resid_store->create(real_names, par_names);
+		int block_cols = 1000;
+		for (int start = 0; start < par_names.size(); start += block_cols)
+		{
+			vector<string> names(par_names.begin() + start, par_names.begin() + min(start + block_cols, int(par_names.size())));
+			par_resid_store->add_2_cols_ip(names, pe.get_eigen(vector<string>(), names, false) - pe_base.get_eigen(real_names, names, false));
+		}
+		upgrade_stores.clear();
+		for (int ilam = 0; ilam < cur_lams.size(); ilam++)
+		{
+			upgrade_stores.push_back(unique_ptr<EnsembleStore>(new EnsembleStore(get_store_filename("upgrade", ilam))));
+			upgrade_stores[ilam]->create(real_names, par_names);
+		}
 	}
-	mat = ph.get_par_resid_subset(pe_upgrade);
-	for (int i = 0; i <par_names.size(); i++)
-	{
-		par_resid_map[par_names[i]] = mat.col(i);
-	}	
-	mat = pe_upgrade.get_eigen_mean_diff();
-	for (int i = 0; i <par_names.size(); i++)
+	else
 	{
-		par_diff_map[par_names[i]] = mat.col(i);
+		ParameterEnsemble pe_upgrade(pe.get_pest_scenario_ptr(), pe.get_eigen(vector<string>(), act_par_names, false), real_names, act_par_names);
+		par_resid = ph.get_par_resid_subset(pe_upgrade);
+		par_diff = pe_upgrade.get_eigen_mean_diff();
+		// clear the upgrade ensemble - one for each lambda
+		pe_upgrade.set_zeros();
+		pe_upgrades.resize(cur_lams.size(), pe_upgrade);
 	}
 	if (!pest_scenario.get_pestpp_options().get_ies_use_approx())
-	{
-		mat = get_Am(pe_upgrade.get_real_names(), pe_upgrade.get_var_names());
-		for (int i = 0; i < par_names.size(); i++)
-		{
-			Am_map[par_names[i]] = mat.row(i);
-		}
-	}
-	mat.resize(0, 0);
-	// clear the upgrade ensemble
-	pe_upgrade.set_zeros();
-	Localizer::How _how = localizer.get_how();
-	LocalUpgradeThread worker(performance_log, par_resid_map, par_diff_map, obs_resid_map, obs_diff_map,
-		localizer, parcov_inv_map, weight_map, pe_upgrade, loc_map, Am_map, _how);
+		Am = get_Am(real_names, par_names);
+	LocalUpgradeThread worker(performance_log, &pest_scenario, real_names.size(), par_resid, par_diff,
+		obs_resid, obs_diff, parcov_inv, weights, pe_upgrades, loc_map, loc_idx_map, Am);
+	if (use_ensemble_store)
+		worker.set_stores(par_store.get(), par_resid_store.get(), &upgrade_stores);
 
 	//if ((num_threads < 1) || (loc_map.size() == 1))
 	if (num_threads < 1)
 	{
-		worker.work(0, iter, cur_lam);
+		worker.work(0, iter, cur_lams);
 	}
 	else
 	{
@@ -3194,7 +3131,7 @@ ParameterEnsemble IterEnsembleSmoother::calc_localized_upgrade_threaded(double c
 		{
 			//threads.push_back(thread(&LocalUpgradeThread::work, &worker, i, iter, cur_lam));
 			
-			threads.push_back(thread(upgrade_thread_function, i, iter, cur_lam, std::ref(worker),std::ref( exception_ptrs[i])));
+			threads.push_back(thread(upgrade_thread_function, i, iter, cur_lams, std::ref(worker),std::ref( exception_ptrs[i])));
 			
 		}
 		message(2, "waiting to join threads");
@@ -3219,8 +3156,17 @@ ParameterEnsemble IterEnsembleSmoother::calc_localized_upgrade_threaded(double c
 		}
 		message(2, "threaded localized upgrade calculation done");
 	}
+	if (use_ensemble_store)
+	{
+		//only the upgrade stores are needed from here on
+		vector<string> files{ par_store->get_filename(), par_resid_store->get_filename() };
+		par_store.reset();
+		par_resid_store.reset();
+		for (auto &f : files)
+			remove(f.c_str());
+	}
 	
-	return pe_upgrade;
+	return pe_upgrades;
 }
 
 
@@ -3329,48 +3275,59 @@ bool IterEnsembleSmoother::solve_new()
 
 	vector<ParameterEnsemble> pe_lams;
 	vector<double> lam_vals, scale_vals;
+	vector<int> upgrade_idxs;
 	//update all the fast-lookup structures
 	oe.update_var_map();
 	pe.update_var_map();
 	parcov.update_sets();
 	obscov.update_sets();
-	unordered_map<string, pair<vector<string>, vector<string>>> loc_map;
+	//the localizer map is held by the localizer across iterations, so it is not copied here
+	unordered_map<string, pair<vector<string>, vector<string>>> all_map;
+	unordered_map<string, pair<vector<string>, vector<string>>> *loc_map = &all_map;
+	unordered_map<string, pair<vector<int>, vector<int>>> all_idx_map;
+	unordered_map<string, pair<vector<int>, vector<int>>> *loc_idx_map = &all_idx_map;
 	if (use_localizer)
 	{
 
-		loc_map = localizer.get_localizer_map(iter, oe, pe, performance_log);
+		loc_map = &localizer.get_localizer_map(iter, oe, pe, performance_log);
+		loc_idx_map = &localizer.get_localizer_index_map(act_obs_names, act_par_names);
 		//localizer.report(file_manager.rec_ofstream());
 	}
 	else
 	{
 		pair<vector<string>, vector<string>> p(act_obs_names, act_par_names);
-		loc_map["all"] = p;
+		all_map["all"] = p;
+		pair<vector<int>, vector<int>> &idxs = all_idx_map["all"];
+		for (int i = 0; i < act_obs_names.size(); i++)
+			idxs.first.push_back(i);
+		for (int i = 0; i < act_par_names.size(); i++)
+			idxs.second.push_back(i);
 	}
 
 
+	//the upgrades for all the lambdas are calculated together so each local
+	//factorization is only done once
+	vector<double> cur_lams;
 	for (auto &lam_mult : lam_mults)
+		cur_lams.push_back(last_best_lam * lam_mult);
+	message(1, "starting upgrade calcs for lambdas: ", cur_lams);
+	message(2, "see .pfm file for more details");
+	vector<ParameterEnsemble> pe_upgrades = calc_localized_upgrade_threaded(cur_lams, *loc_map, *loc_idx_map);
+
+	for (int ilam = 0; ilam < cur_lams.size(); ilam++)
 	{
-		ss.str("");
-		double cur_lam = last_best_lam * lam_mult;
-		ss << "starting calcs for lambda" << cur_lam;
-		message(1, "starting lambda calcs for lambda", cur_lam);
-		message(2, "see .pfm file for more details");
-		ParameterEnsemble pe_upgrade;
-		
-		pe_upgrade = calc_localized_upgrade_threaded(cur_lam, loc_map);
+		double cur_lam = cur_lams[ilam];
 
 		for (auto sf : pest_scenario.get_pestpp_options().get_lambda_scale_vec())
 		{
-
-			ParameterEnsemble pe_lam_scale = pe;
-			pe_lam_scale.set_eigen(*pe_lam_scale.get_eigen_ptr() + (*pe_upgrade.get_eigen_ptr() * sf));
-			if (pest_scenario.get_pestpp_options().get_ies_enforce_bounds())
-				pe_lam_scale.enforce_bounds();
-			pe_lams.push_back(pe_lam_scale);
+			//the lambda, scale ensembles are not formed until their runs are queued
+			upgrade_idxs.push_back(ilam);
 			lam_vals.push_back(cur_lam);
 			scale_vals.push_back(sf);
-			if (!pest_scenario.get_pestpp_options().get_ies_save_lambda_en())
+			//with ies_ensemble_store, the lambda ensembles are saved as their runs are queued
+			if ((!pest_scenario.get_pestpp_options().get_ies_save_lambda_en()) || (use_ensemble_store))
 				continue;
+			ParameterEnsemble pe_lam_scale = get_lambda_ensemble(pe_upgrades, ilam, sf);
 			ss.str("");
 			ss << file_manager.get_base_filename() << "." << iter << "." << cur_lam << ".lambda." << sf << ".scale.par";
 
@@ -3405,7 +3362,7 @@ bool IterEnsembleSmoother::solve_new()
 	double mean, std;
 
 	message(0, "running lambda ensembles");
-	vector<ObservationEnsemble> oe_lams = run_lambda_ensembles(pe_lams, lam_vals, scale_vals);
+	vector<ObservationEnsemble> oe_lams = run_lambda_ensembles(pe_upgrades, upgrade_idxs, lam_vals, scale_vals, pe_lams);
 
 	message(0, "evaluting lambda ensembles");
 	message(1, "last mean: ", last_best_mean);
@@ -3419,6 +3376,8 @@ bool IterEnsembleSmoother::solve_new()
 	{
 		if (oe_lams[i].shape().first == 0)
 			continue;
+		//only this lambda ensemble and the best one so far are in memory
+		load_lambda_ensemble(pe_lams[i], i, pe_upgrades, upgrade_idxs[i], scale_vals[i]);
 		vector<double> vals({ lam_vals[i],scale_vals[i] });
 		if (pest_scenario.get_pestpp_options().get_ies_save_lambda_en())
 			
@@ -3455,16 +3414,21 @@ bool IterEnsembleSmoother::solve_new()
 		std = ph.get_std(PhiHandler::phiType::COMPOSITE);
 		if (mean < best_mean)
 		{
+			if (best_idx != -1)
+				pe_lams[best_idx] = ParameterEnsemble();
 			oe_lam_best = oe_lams[i];
 			best_mean = mean;
 			best_std = std;
 			best_idx = i;
 		}
+		else
+			pe_lams[i] = ParameterEnsemble();
 	}
 	if (best_idx == -1)
 	{
 		message(0, "WARNING:  unsuccessful lambda testing, resetting lambda to 10000.0");
 		last_best_lam = 10000.0;
+		clear_stores();
 		return false;
 
 	}
@@ -3493,6 +3457,7 @@ bool IterEnsembleSmoother::solve_new()
 			message(1, "updating realizations with reduced phi");
 			update_reals_by_phi(pe_lams[best_idx], oe_lams[best_idx]);
 			message(1, "returing to lambda calculations...");
+			clear_stores();
 			return false;
 		}
 
@@ -3505,11 +3470,11 @@ bool IterEnsembleSmoother::solve_new()
 		}
 		//need to work out which par and obs en real names to run - some may have failed during subset testing...
 		ObservationEnsemble remaining_oe_lam = oe;//copy
-		ParameterEnsemble remaining_pe_lam = pe_lams[best_idx];
 		vector<string> pe_keep_names, oe_keep_names;
 		vector<string> pe_names = pe.get_real_names(), oe_names = oe.get_real_names();
 
 		vector<string> org_pe_idxs,org_oe_idxs;
+		vector<int> remaining_idxs;
 		set<string> ssub;
 		for (auto &i : subset_idxs)
 			ssub.emplace(pe_names[i]);
@@ -3517,6 +3482,7 @@ bool IterEnsembleSmoother::solve_new()
 			if (ssub.find(pe_names[i]) == ssub.end())
 			{
 				pe_keep_names.push_back(pe_names[i]);
+				remaining_idxs.push_back(i);
 				//oe_keep_names.push_back(oe_names[i]);
 			}
 		ssub.clear();
@@ -3533,8 +3499,10 @@ bool IterEnsembleSmoother::solve_new()
 		message(0, "running remaining realizations for best lambda, scale:", vector<double>({ lam_vals[best_idx],scale_vals[best_idx] }));
 
 		//pe_keep_names and oe_keep_names are names of the remaining reals to eval
-		performance_log->log_event("dropping subset idxs from remaining_pe_lam");
-		remaining_pe_lam.keep_rows(pe_keep_names);
+		performance_log->log_event("forming remaining_pe_lam");
+		ParameterEnsemble remaining_pe_lam = get_lambda_ensemble(pe_upgrades, upgrade_idxs[best_idx], scale_vals[best_idx], remaining_idxs);
+		pe_upgrades.clear();
+		clear_stores();
 		performance_log->log_event("dropping subset idxs from remaining_oe_lam");
 		remaining_oe_lam.keep_rows(oe_keep_names);
 		//save these names for later
@@ -3573,9 +3541,8 @@ bool IterEnsembleSmoother::solve_new()
 			remaining_pe_lam.keep_rows(new_pe_idxs);
 
 		}
-		//drop the remaining runs from the par en then append the remaining par runs (in case some failed)
+		//the best lambda ensemble only holds the subset reals, so just append the remaining par runs (in case some failed)
 		performance_log->log_event("assembling ensembles");
-		pe_lams[best_idx].drop_rows(pe_keep_names);
 		pe_lams[best_idx].append_other_rows(remaining_pe_lam);
 		//append the remaining obs en
 		oe_lam_best.append_other_rows(remaining_oe_lam);
@@ -3641,6 +3608,7 @@ bool IterEnsembleSmoother::solve_new()
 		message(0, "incresing lambda to: ", new_lam);
 		last_best_lam = new_lam;
 	}
+	clear_stores();
 	//report_and_save();
 	return true;
 }
@@ -3659,7 +3627,12 @@ void IterEnsembleSmoother::report_and_save()
 	cout << "   number of model runs:            " << run_mgr_ptr->get_total_runs() << endl;
 
 	stringstream ss;
-	if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+	if (pest_scenario.get_pestpp_options().get_ies_save_dense())
+	{
+		ss << file_manager.get_base_filename() << "." << iter << ".obs.bin";
+		oe.to_dense(ss.str());
+	}
+	else if (pest_scenario.get_pestpp_options().get_ies_save_binary())
 	{
 		ss << file_manager.get_base_filename() << "." << iter << ".obs.jcb";
 		oe.to_binary(ss.str());
@@ -3672,7 +3645,12 @@ void IterEnsembleSmoother::report_and_save()
 	frec << "      current obs ensemble saved to " << ss.str() << endl;
 	cout << "      current obs ensemble saved to " << ss.str() << endl;
 	ss.str("");
-	if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+	if (pest_scenario.get_pestpp_options().get_ies_save_dense())
+	{
+		ss << file_manager.get_base_filename() << "." << iter << ".par.bin";
+		pe.to_dense(ss.str());
+	}
+	else if (pest_scenario.get_pestpp_options().get_ies_save_binary())
 	{
 		ss << file_manager.get_base_filename() << "." << iter << ".par.jcb";
 		pe.to_binary(ss.str());
@@ -3833,23 +3811,185 @@ void IterEnsembleSmoother::set_subset_idx(int size)
 	//return subset_idx_map;
 }
 
-vector<ObservationEnsemble> IterEnsembleSmoother::run_lambda_ensembles(vector<ParameterEnsemble> &pe_lams, vector<double> &lam_vals, vector<double> &scale_vals)
+ParameterEnsemble IterEnsembleSmoother::get_lambda_ensemble(vector<ParameterEnsemble> &pe_upgrades, int ilam, double scale_fac, const vector<int> &real_idxs)
+{
+	ParameterEnsemble pe_lam_scale = pe.get_new(real_idxs);
+	if (use_ensemble_store)
+	{
+		//only the rows that are needed are read from the upgrade file
+		vector<string> names;
+		if (real_idxs.size() > 0)
+			names = pe_lam_scale.get_real_names();
+		pe_lam_scale.set_eigen(*pe_lam_scale.get_eigen_ptr() + (upgrade_stores[ilam]->get_eigen(vector<string>(), names) * scale_fac));
+	}
+	else if (real_idxs.size() == 0)
+		pe_lam_scale.set_eigen(*pe_lam_scale.get_eigen_ptr() + (*pe_upgrades[ilam].get_eigen_ptr() * scale_fac));
+	else
+		pe_lam_scale.set_eigen(*pe_lam_scale.get_eigen_ptr() + (pe_upgrades[ilam].get_eigen(pe_lam_scale.get_real_names(), vector<string>()) * scale_fac));
+	if (pest_scenario.get_pestpp_options().get_ies_enforce_bounds())
+		pe_lam_scale.enforce_bounds();
+	return pe_lam_scale;
+}
+
+string IterEnsembleSmoother::get_store_filename(const string &tag, int idx)
+{
+	stringstream ss;
+	ss << file_manager.get_base_filename() << "." << tag << "." << idx << ".store.bin";
+	return ss.str();
+}
+
+vector<string> IterEnsembleSmoother::get_dense_keep_names(const string &file_name, const string &tag)
+{
+	EnsembleStore store(file_name);
+	store.load_index(true);
+	vector<string> real_names = store.get_real_names(), keep_names;
+	int num_reals = pest_scenario.get_pestpp_options().get_ies_num_reals();
+	if (num_reals < real_names.size())
+	{
+		message(1, "ies_num_reals arg passed, truncated " + tag + " ensemble to ", num_reals);
+		keep_names.insert(keep_names.end(), real_names.begin(), real_names.begin() + num_reals);
+	}
+	return keep_names;
+}
+
+void IterEnsembleSmoother::spill_lambda_ensemble(ParameterEnsemble &pe_lam, int idx)
+{
+	if (lam_stores.size() <= idx)
+		lam_stores.resize(idx + 1);
+	lam_stores[idx].reset(new EnsembleStore(get_store_filename("lambda", idx)));
+	lam_stores[idx]->from_ensemble(pe_lam);
+	pe_lam.get_eigen_ptr_4_mod()->resize(0, 0);
+}
+
+ParameterEnsemble IterEnsembleSmoother::get_lambda_reals(ParameterEnsemble &pe_lam, int idx, vector<ParameterEnsemble> &pe_upgrades,
+	int ilam, double scale_fac, const vector<int> &real_idxs)
+{
+	//the rows of pe_lam at real_idxs (all of them if empty)
+	vector<int> idxs = real_idxs;
+	vector<string> names = (idxs.size() > 0) ? pe_lam.get_real_names(idxs) : pe_lam.get_real_names();
+	if (use_ensemble_store)
+	{
+		ParameterEnsemble pe_part = pe_lam.get_new(vector<int>());
+		pe_part.from_eigen_mat(lam_stores[idx]->get_eigen(vector<string>(), names), names,
+			lam_stores[idx]->get_var_names(), pe_lam.get_trans_status());
+		return pe_part;
+	}
+	//the realizations of pe_lam are named after the rows of pe they were formed from
+	map<string, int> pe_map;
+	vector<string> pe_names = pe.get_real_names();
+	for (int i = 0; i < pe_names.size(); i++)
+		pe_map[pe_names[i]] = i;
+	vector<int> pe_idxs;
+	for (auto &name : names)
+		pe_idxs.push_back(pe_map.at(name));
+	return get_lambda_ensemble(pe_upgrades, ilam, scale_fac, pe_idxs);
+}
+
+void IterEnsembleSmoother::load_lambda_ensemble(ParameterEnsemble &pe_lam, int idx, vector<ParameterEnsemble> &pe_upgrades, int ilam, double scale_fac)
+{
+	if (!use_ensemble_store)
+	{
+		pe_lam = get_lambda_reals(pe_lam, idx, pe_upgrades, ilam, scale_fac);
+		if (lam_failed_names[idx].size() > 0)
+			pe_lam.drop_rows(lam_failed_names[idx]);
+		return;
+	}
+	//the store file is not needed once the realizations are back in memory
+	EnsembleStore &store = *lam_stores[idx];
+	//the shell still has all of the real names (and the org real names of the full ensemble), so fill its rows
+	//in place and drop the reals that failed and were dropped from the store
+	vector<string> names = pe_lam.get_real_names(), store_names = store.get_real_names(), dropped;
+	set<string> sset(store_names.begin(), store_names.end());
+	Eigen::MatrixXd block = store.get_eigen();
+	Eigen::MatrixXd &reals = *pe_lam.get_eigen_ptr_4_mod();
+	reals.setZero(names.size(), block.cols());
+	int irow = 0;
+	for (int i = 0; i < names.size(); i++)
+	{
+		if (sset.find(names[i]) == sset.end())
+			dropped.push_back(names[i]);
+		else
+			reals.row(i) = block.row(irow++);
+	}
+	if (dropped.size() > 0)
+		pe_lam.drop_rows(dropped);
+	string filename = store.get_filename();
+	lam_stores[idx].reset();
+	remove(filename.c_str());
+}
+
+void IterEnsembleSmoother::clear_stores()
+{
+	vector<string> files;
+	for (auto stores : { &upgrade_stores, &lam_stores })
+	{
+		for (auto &store : *stores)
+			if (store)
+				files.push_back(store->get_filename());
+		stores->clear();
+	}
+	for (auto &f : files)
+		remove(f.c_str());
+}
+
+vector<ObservationEnsemble> IterEnsembleSmoother::run_lambda_ensembles(vector<ParameterEnsemble> &pe_upgrades, vector<int> &upgrade_idxs, 
+	vector<double> &lam_vals, vector<double> &scale_vals, vector<ParameterEnsemble> &pe_lams)
 {
 	ofstream &frec = file_manager.rec_ofstream();
 	stringstream ss;
-	ss << "queuing " << pe_lams.size() << " ensembles";
+	ss << "queuing " << upgrade_idxs.size() << " ensembles";
 	performance_log->log_event(ss.str());
 	run_mgr_ptr->reinitialize();
 	
-	set_subset_idx(pe_lams[0].shape().first);
+	set_subset_idx(pe.shape().first);
+	bool is_subset = subset_idxs.size() < pe.shape().first;
+	bool race = (pest_scenario.get_pestpp_options().get_ies_race_lambdas()) && (upgrade_idxs.size() > 1);
 	vector<map<int, int>> real_run_ids_vec;
-	//ParameterEnsemble pe_lam;
-	//for (int i=0;i<pe_lams.size();i++)
-	for (auto &pe_lam : pe_lams)
+	pe_lams.clear();
+	lam_failed_names.assign(upgrade_idxs.size(), vector<string>());
+	//each lambda ensemble is formed when its runs are queued and released right after, so only one is in memory
+	//at a time.  With ies_ensemble_store it is moved to disk instead.  If the lambda ensembles are being saved,
+	//that is done first, while the pars can still be written in control file space
+	auto release_lambda = [&](int i)
+	{
+		if (!use_ensemble_store)
+		{
+			pe_lams[i].get_eigen_ptr_4_mod()->resize(0, 0);
+			return;
+		}
+		if (pest_scenario.get_pestpp_options().get_ies_save_lambda_en())
+		{
+			ss.str("");
+			ss << file_manager.get_base_filename() << "." << iter << "." << lam_vals[i] << ".lambda." << scale_vals[i] << ".scale.par";
+			if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+			{
+				ss << ".jcb";
+				pe_lams[i].to_binary(ss.str());
+			}
+			else
+			{
+				ss << ".csv";
+				pe_lams[i].to_csv(ss.str());
+			}
+			frec << "lambda, scale value " << lam_vals[i] << ',' << scale_vals[i] << " pars saved to " << ss.str() << endl;
+		}
+		spill_lambda_ensemble(pe_lams[i], i);
+	};
+	for (int i = 0; i < upgrade_idxs.size(); i++)
 	{
 		try
 		{
-			real_run_ids_vec.push_back(pe_lam.add_runs(run_mgr_ptr,subset_idxs));
+			//only the subset reals are formed, so every real in pe_lam is run
+			if (is_subset)
+				pe_lams.push_back(get_lambda_ensemble(pe_upgrades, upgrade_idxs[i], scale_vals[i], subset_idxs));
+			else
+				pe_lams.push_back(get_lambda_ensemble(pe_upgrades, upgrade_idxs[i], scale_vals[i]));
+			//when racing, the runs are queued realization by realization below so all the lambdas progress together
+			if (race)
+				real_run_ids_vec.push_back(map<int, int>());
+			else
+				real_run_ids_vec.push_back(pe_lams[i].add_runs(run_mgr_ptr));
+			release_lambda(i);
 		}
 		catch (const exception &e)
 		{
@@ -3862,50 +4002,74 @@ vector<ObservationEnsemble> IterEnsembleSmoother::run_lambda_ensembles(vector<Pa
 			throw_ies_error(string("run_ensembles() error queueing runs"));
 		}
 	}
-	performance_log->log_event("making runs");
-	try
+	if (race)
 	{
-
-		run_mgr_ptr->run();
-	}
-	catch (const exception &e)
-	{
-		stringstream ss;
-		ss << "error running ensembles: " << e.what();
-		throw_ies_error(ss.str());
+		try
+		{
+			//the rows are formed again (or read back) a block at a time, so the lambda ensembles are never
+			//all in memory together
+			int n_real = pe_lams[0].get_real_names().size();
+			int block_size = max(1, n_real / 10);
+			for (int start = 0; start < n_real; start += block_size)
+			{
+				vector<int> block_idxs;
+				for (int ireal = start; ireal < min(n_real, start + block_size); ireal++)
+					block_idxs.push_back(ireal);
+				vector<ParameterEnsemble> pe_blocks;
+				for (int i = 0; i < pe_lams.size(); i++)
+					pe_blocks.push_back(get_lambda_reals(pe_lams[i], i, pe_upgrades, upgrade_idxs[i], scale_vals[i], block_idxs));
+				for (int j = 0; j < block_idxs.size(); j++)
+				{
+					for (int i = 0; i < pe_lams.size(); i++)
+					{
+						map<int, int> rri = pe_blocks[i].add_runs(run_mgr_ptr, vector<int>{ j });
+						real_run_ids_vec[i][block_idxs[j]] = rri.at(j);
+					}
+				}
+			}
+		}
+		catch (const exception &e)
+		{
+			stringstream ss;
+			ss << "run_ensemble() error queueing runs: " << e.what();
+			throw_ies_error(ss.str());
+		}
+		catch (...)
+		{
+			throw_ies_error(string("run_ensembles() error queueing runs"));
+		}
 	}
-	catch (...)
+	//track which lambda ensemble each run belongs to so that each one can be processed
+	//as soon as all of its runs are done, while the runs for the others are still going
+	map<int, int> run_id_to_lam;
+	map<int, int> run_id_to_real;
+	vector<int> n_outstanding(pe_lams.size(), 0);
+	for (int i = 0; i < real_run_ids_vec.size(); i++)
 	{
-		throw_ies_error(string("error running ensembles"));
+		for (auto &rri : real_run_ids_vec[i])
+		{
+			run_id_to_lam[rri.second] = i;
+			run_id_to_real[rri.second] = rri.first;
+		}
+		n_outstanding[i] = real_run_ids_vec[i].size();
 	}
+	//the obs ensembles only hold the reals that are run - these are formed as each lambda is processed
+	ObservationEnsemble oe_subset = oe;
+	if (is_subset)
+		oe_subset.keep_rows(subset_idxs);
+	vector<ObservationEnsemble> obs_lams(pe_lams.size());
+	vector<bool> processed(pe_lams.size(), false);
 
-	performance_log->log_event("processing runs");
-	vector<int> failed_real_indices;
-	vector<ObservationEnsemble> obs_lams;
-	//ObservationEnsemble _oe = oe;//copy
-	//if (subset_size < pe_lams[0].shape().first)
-	//	_oe.keep_rows(subset_idxs);
-	map<int, int> real_run_ids;
-	//for (auto &real_run_ids : real_run_ids_vec)
-	for (int i=0;i<pe_lams.size();i++)
+	auto process_lambda_runs = [&](int i)
 	{
-		ObservationEnsemble _oe = oe;//copy
+		ss.str("");
+		ss << "processing runs for lambda,scale: " << lam_vals[i] << ',' << scale_vals[i];
+		performance_log->log_event(ss.str());
+		vector<int> failed_real_indices;
+		obs_lams[i] = oe_subset;
+		ObservationEnsemble &_oe = obs_lams[i];
 		vector<double> rep_vals{ lam_vals[i],scale_vals[i] };
-		real_run_ids = real_run_ids_vec[i];
-		//if using subset, reset the real_idx in real_run_ids to be just simple counter
-		if (subset_size < pe_lams[0].shape().first)
-		{
-			_oe.keep_rows(subset_idxs);
-			int ireal = 0;
-			map<int, int> temp;
-			for (auto &rri : real_run_ids)
-			{
-				temp[ireal] = rri.second;
-				ireal++;
-			}
-
-			real_run_ids = temp;
-		}
+		map<int, int> real_run_ids = real_run_ids_vec[i];
 
 		try
 		{
@@ -3930,15 +4094,16 @@ vector<ObservationEnsemble> IterEnsembleSmoother::run_lambda_ensembles(vector<Pa
 		if (failed_real_indices.size() > 0)
 		{
 			stringstream ss;
-			vector<string> par_real_names = pe.get_real_names();
-			vector<string> obs_real_names = oe.get_real_names();
+			//the rows of pe_lams[i] and _oe line up with the runs
+			vector<string> par_real_names = pe_lams[i].get_real_names();
+			vector<string> obs_real_names = _oe.get_real_names();
 			vector<string> failed_par_names, failed_obs_names;
 			string oname, pname;
 			ss << "the following par:obs realization runs failed for lambda,scale " << lam_vals[i] << ',' << scale_vals[i] << "-->";
 			for (auto &i : failed_real_indices)
 			{
-				pname = par_real_names[subset_idxs[i]];
-				oname = obs_real_names[subset_idxs[i]];
+				pname = par_real_names[i];
+				oname = obs_real_names[i];
 				failed_par_names.push_back(pname);
 				failed_obs_names.push_back(oname);
 				ss << pname << ":" << oname << ',';
@@ -3957,11 +4122,123 @@ vector<ObservationEnsemble> IterEnsembleSmoother::run_lambda_ensembles(vector<Pa
 				//_oe.drop_rows(failed_real_indices);
 				//pe_lams[i].drop_rows(failed_real_indices);
 				_oe.drop_rows(failed_obs_names);
-				pe_lams[i].drop_rows(failed_par_names);
+				//pe_lams[i] has been released, so the failed reals are dropped when it is formed again
+				lam_failed_names[i] = failed_par_names;
+				if (use_ensemble_store)
+					lam_stores[i]->drop_rows(failed_par_names);
 			}
 
 		}
-		obs_lams.push_back(_oe);
+		processed[i] = true;
+	};
+
+	//racing: the composite phi of each lambda's realizations is tracked as their runs come back.  Once a lambda's
+	//mean phi is more than ies_race_sigma standard errors worse than the leading lambda, its remaining runs are canceled
+	vector<map<string, double>> race_phis(pe_lams.size());
+	double race_sigma = pest_scenario.get_pestpp_options().get_ies_race_sigma();
+	auto race_lambda_runs = [&](map<int, vector<int>> &new_run_ids)
+	{
+		for (auto &nri : new_run_ids)
+		{
+			int i = nri.first;
+			vector<int> real_idxs;
+			for (auto run_id : nri.second)
+				real_idxs.push_back(run_id_to_real.at(run_id));
+			//the rows of the partial ensembles are in realization order
+			sort(real_idxs.begin(), real_idxs.end());
+			map<int, int> real_run_ids;
+			for (int j = 0; j < real_idxs.size(); j++)
+				real_run_ids[j] = real_run_ids_vec[i].at(real_idxs[j]);
+			vector<string> names = oe_subset.get_real_names(real_idxs);
+			ObservationEnsemble oe_part(&pest_scenario, oe_subset.get_eigen(names, vector<string>()), names, oe_subset.get_var_names());
+			ParameterEnsemble pe_part = get_lambda_reals(pe_lams[i], i, pe_upgrades, upgrade_idxs[i], scale_vals[i], real_idxs);
+			vector<int> failed = oe_part.update_from_runs(real_run_ids, run_mgr_ptr);
+			if (failed.size() > 0)
+			{
+				oe_part.drop_rows(failed);
+				pe_part.drop_rows(failed);
+			}
+			if (oe_part.shape().first == 0)
+				continue;
+			ph.update(oe_part, pe_part);
+			PhiHandler::phiType pt = PhiHandler::phiType::COMPOSITE;
+			for (auto &phi : *ph.get_phi_map(pt))
+				race_phis[i][phi.first] = phi.second;
+		}
+		int leader = -1;
+		double leader_bound = 0.0;
+		vector<double> means(pe_lams.size()), ses(pe_lams.size());
+		for (int i = 0; i < pe_lams.size(); i++)
+		{
+			if ((race_phis[i].size() < 2) || ((processed[i]) && (obs_lams[i].shape().first == 0)))
+				continue;
+			means[i] = ph.calc_mean(&race_phis[i]);
+			ses[i] = ph.calc_std(&race_phis[i]) / sqrt(double(race_phis[i].size()));
+			if ((leader == -1) || (means[i] < means[leader]))
+				leader = i;
+		}
+		if (leader == -1)
+			return;
+		leader_bound = means[leader] + (race_sigma * ses[leader]);
+		for (int i = 0; i < pe_lams.size(); i++)
+		{
+			if ((i == leader) || (processed[i]) || (race_phis[i].size() < 2))
+				continue;
+			if (means[i] - (race_sigma * ses[i]) <= leader_bound)
+				continue;
+			ss.str("");
+			ss << "dropping lambda,scale " << lam_vals[i] << ',' << scale_vals[i] << " from the race, mean phi " << means[i] <<
+				" vs " << means[leader] << " for lambda,scale " << lam_vals[leader] << ',' << scale_vals[leader] <<
+				", canceling " << n_outstanding[i] << " runs";
+			message(1, ss.str());
+			for (auto &rri : real_run_ids_vec[i])
+				run_mgr_ptr->cancel_run(rri.second);
+			obs_lams[i] = ObservationEnsemble();
+			processed[i] = true;
+		}
+	};
+
+	performance_log->log_event("making runs");
+	try
+	{
+		RunManagerAbstract::RUN_UNTIL_COND cond = RunManagerAbstract::RUN_UNTIL_COND::TIME;
+		while (cond != RunManagerAbstract::RUN_UNTIL_COND::NORMAL)
+		{
+			cond = run_mgr_ptr->run_until(RunManagerAbstract::RUN_UNTIL_COND::TIME, 0, 1.0);
+			map<int, vector<int>> new_run_ids;
+			for (int run_id : run_mgr_ptr->pop_completed_runs())
+			{
+				auto it = run_id_to_lam.find(run_id);
+				if ((it == run_id_to_lam.end()) || (processed[it->second]))
+					continue;
+				--n_outstanding[it->second];
+				new_run_ids[it->second].push_back(run_id);
+			}
+			if ((race) && (new_run_ids.size() > 0))
+				race_lambda_runs(new_run_ids);
+			for (auto &nri : new_run_ids)
+			{
+				if ((!processed[nri.first]) && (n_outstanding[nri.first] == 0))
+					process_lambda_runs(nri.first);
+			}
+		}
+	}
+	catch (const exception &e)
+	{
+		stringstream ss;
+		ss << "error running ensembles: " << e.what();
+		throw_ies_error(ss.str());
+	}
+	catch (...)
+	{
+		throw_ies_error(string("error running ensembles"));
+	}
+
+	performance_log->log_event("processing runs");
+	for (int i = 0; i < pe_lams.size(); i++)
+	{
+		if (!processed[i])
+			process_lambda_runs(i);
 	}
 	return obs_lams;
 }
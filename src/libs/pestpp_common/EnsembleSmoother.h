@@ -5,6 +5,8 @@
 #include <random>
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <memory>
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 #include "FileManager.h"
@@ -61,9 +63,12 @@ private:
 	void prepare_csv(ofstream &csv,vector<string> &names);
 	void prepare_group_csv(ofstream &csv, vector<string> extra = vector<string>());
 
-	map<string, Eigen::VectorXd> calc_meas(ObservationEnsemble &oe, Eigen::VectorXd &_q_vec);
-	map<string, Eigen::VectorXd> calc_regul(ParameterEnsemble &pe);// , double _reg_fac);
-	map<string, Eigen::VectorXd> calc_actual(ObservationEnsemble &oe, Eigen::VectorXd &_q_vec);
+	//the calc_ functions return the phi contribution of each var (column) for each realization (row)
+	Eigen::MatrixXd calc_meas(ObservationEnsemble &oe, Eigen::VectorXd &_q_vec);
+	Eigen::MatrixXd calc_regul(ParameterEnsemble &pe);// , double _reg_fac);
+	Eigen::MatrixXd calc_actual(ObservationEnsemble &oe, Eigen::VectorXd &_q_vec);
+	//the rows of oe that are also in oe_base
+	vector<int> get_base_rows(ObservationEnsemble &oe);
 	map<string, double> calc_composite(map<string,double> &_meas, map<string,double> &_regul);
 	//map<string, double>* get_phi_map(PhiHandler::phiType &pt);
 	void write_csv(int iter_num, int total_runs,ofstream &csv, phiType pt,
@@ -90,12 +95,15 @@ private:
 	vector<string> lt_obs_names;
 	vector<string> gt_obs_names;
 
-	map<string, vector<int>> obs_group_idx_map;
-	map<string, vector<int>> par_group_idx_map;
+	//var-by-group indicator matrices, so the group contributions of all the realizations
+	//are just the phi contribution matrix times the indicator
+	vector<string> obs_group_names, par_group_names;
+	Eigen::SparseMatrix<double> obs_group_ind, par_group_ind;
 	map<string, map<string, double>> obs_group_phi_map, par_group_phi_map;
 
-	map<string, double> get_obs_group_contrib(Eigen::VectorXd &phi_vec);
-	map<string, double> get_par_group_contrib(Eigen::VectorXd &phi_vec);
+	Eigen::SparseMatrix<double> get_group_indicator(const vector<string> &var_groups, vector<string> &group_names);
+	void update_group_phi_map(const Eigen::MatrixXd &phi_mat, const vector<string> &real_names, const vector<int> &rows,
+		const Eigen::SparseMatrix<double> &group_ind, const vector<string> &group_names, map<string, map<string, double>> &group_phi_map);
 
 };
 
@@ -120,44 +128,62 @@ class LocalUpgradeThread
 {
 public:
 
-	LocalUpgradeThread(PerformanceLog *_performance_log, unordered_map<string, Eigen::VectorXd> &_par_resid_map, unordered_map<string, Eigen::VectorXd> &_par_diff_map,
-		unordered_map<string, Eigen::VectorXd> &_obs_resid_map, unordered_map<string, Eigen::VectorXd> &_obs_diff_map,
-		Localizer &_localizer, unordered_map<string, double> &_parcov_inv_map,
-		unordered_map<string, double> &_weight_map, ParameterEnsemble &_pe_upgrade,
+	//the part matrices are gathered from the full (nreals x nobs, nreals x npar) matrices and the
+	//(npar x nreals) Am by the (obs, par) index lists in _case_idxs
+	LocalUpgradeThread(PerformanceLog *_performance_log, Pest *_pest_scenario_ptr, int _num_reals,
+		Eigen::MatrixXd &_par_resid, Eigen::MatrixXd &_par_diff,
+		Eigen::MatrixXd &_obs_resid, Eigen::MatrixXd &_obs_diff,
+		Eigen::VectorXd &_parcov_inv, Eigen::VectorXd &_weights, vector<ParameterEnsemble> &_pe_upgrades,
 		unordered_map<string, pair<vector<string>, vector<string>>> &_cases,
-		unordered_map<string, Eigen::VectorXd> &_Am_map, Localizer::How &_how);
+		unordered_map<string, pair<vector<int>, vector<int>>> &_case_idxs, Eigen::MatrixXd &_Am);
 
 	//Eigen::DiagonalMatrix<double, Eigen::Dynamic> get_matrix_from_map(vector<string> &names, map<string, double> &dmap);	
 	//Eigen::MatrixXd get_matrix_from_map(int num_reals, vector<string> &names, map<string, Eigen::VectorXd> &emap);
 
 
-	void work(int thread_id, int iter, double cur_lam);
+	//the factorization of each local part is shared by all the lambdas: the upgrade for
+	//cur_lams[i] is added to pe_upgrades[i]
+	void work(int thread_id, int iter, vector<double> cur_lams);
+	//read the par residuals and anomalies of each part from par_resid_store and par_store, and add the
+	//upgrades to upgrade_stores instead of pe_upgrades (ies_ensemble_store)
+	void set_stores(EnsembleStore *_par_store, EnsembleStore *_par_resid_store, vector<unique_ptr<EnsembleStore>> *_upgrade_stores);
 
 
 private:
 	PerformanceLog * performance_log;
-	Localizer::How how;
 	vector<string> keys;
-	int count, total;
+	//index of the next part to process
+	atomic<int> count;
+	int total;
+	//the columns of the pars that are in only one part are added straight into pe_upgrades without
+	//locking.  The columns of the pars that are in more than one part (shared) are added under the
+	//col_locks stripe of the column, so no thread holds its own copy of them
+	static const int n_col_locks = 64;
+	vector<bool> shared;
+	mutex col_locks[n_col_locks];
+	Pest *pest_scenario_ptr;
+	int num_reals;
+	EnsembleStore *par_store, *par_resid_store;
+	vector<unique_ptr<EnsembleStore>> *upgrade_stores;
+	//the store reads and writes are serialized, the file may not be memory-mapped
+	mutex store_lock;
 	//double eigthresh, cur_lam;
 	//int maxsing, num_reals,iter, thread_id;
 	//bool use_approx, use_prior_scaling;
 
 	unordered_map<string, pair<vector<string>, vector<string>>> &cases;
+	unordered_map<string, pair<vector<int>, vector<int>>> &case_idxs;
 
-	ParameterEnsemble &pe_upgrade;
+	vector<ParameterEnsemble> &pe_upgrades;
 	//PhiHandler &ph;
-	Localizer &localizer;
-	unordered_map<string, double> &parcov_inv_map;
-	unordered_map<string, double> &weight_map;
+	Eigen::VectorXd &parcov_inv_vec;
+	Eigen::VectorXd &weight_vec;
 
-	unordered_map<string, Eigen::VectorXd> &par_resid_map, &par_diff_map, &Am_map;
-	unordered_map<string, Eigen::VectorXd> &obs_resid_map, &obs_diff_map;
+	Eigen::MatrixXd &par_resid_mat, &par_diff_mat, &Am_mat;
+	Eigen::MatrixXd &obs_resid_mat, &obs_diff_mat;
 
-	mutex ctrl_lock, weight_lock, loc_lock, parcov_lock;
-	mutex obs_resid_lock, obs_diff_lock, par_resid_lock;
-	mutex par_diff_lock, am_lock, put_lock;
-	mutex next_lock;
+	//guards the progress reporting, the matrices above are read-only while the threads run
+	mutex log_lock;
 	
 };
 
@@ -229,11 +255,38 @@ private:
 	//ParameterEnsemble calc_upgrade(vector<string> &obs_names, vector<string> &par_names,double lamb, int num_reals);
 
 	//ParameterEnsemble calc_localized_upgrade(double cur_lam);
-	ParameterEnsemble calc_localized_upgrade_threaded(double cur_lam, unordered_map<string, pair<vector<string>, vector<string>>> &loc_map);
+	//with ies_ensemble_store, the par ensemble and residuals used by the upgrade calcs, the upgrade for each
+	//lambda and the lambda ensembles are kept on disk and only read back a part or an ensemble at a time
+	bool use_ensemble_store;
+	unique_ptr<EnsembleStore> par_store, par_resid_store;
+	vector<unique_ptr<EnsembleStore>> upgrade_stores, lam_stores;
+	string get_store_filename(const string &tag, int idx = 0);
+	//the lambda ensembles are released once their runs are queued (and written to lam_stores with
+	//ies_ensemble_store).  pe_lam keeps the names and transform info, and its realizations are read back
+	//from the store or formed again from the upgrade when they are needed
+	void spill_lambda_ensemble(ParameterEnsemble &pe_lam, int idx);
+	ParameterEnsemble get_lambda_reals(ParameterEnsemble &pe_lam, int idx, vector<ParameterEnsemble> &pe_upgrades, int ilam,
+		double scale_fac, const vector<int> &real_idxs = vector<int>());
+	void load_lambda_ensemble(ParameterEnsemble &pe_lam, int idx, vector<ParameterEnsemble> &pe_upgrades, int ilam, double scale_fac);
+	//the par realizations whose runs failed, for each lambda ensemble
+	vector<vector<string>> lam_failed_names;
+	//close and remove the store files
+	void clear_stores();
+	//the names of the first ies_num_reals realizations in a dense binary ensemble file (empty for all of them),
+	//read from the name index so only those rows are loaded
+	vector<string> get_dense_keep_names(const string &file_name, const string &tag);
+	//one upgrade per lambda, in upgrade_stores (and an empty vector returned) with ies_ensemble_store
+	vector<ParameterEnsemble> calc_localized_upgrade_threaded(vector<double> cur_lams, unordered_map<string, pair<vector<string>, vector<string>>> &loc_map,
+		unordered_map<string, pair<vector<int>, vector<int>>> &loc_idx_map);
 
 	//EnsemblePair run_ensemble(ParameterEnsemble &_pe, ObservationEnsemble &_oe);
 	vector<int> run_ensemble(ParameterEnsemble &_pe, ObservationEnsemble &_oe, const vector<int> &real_idxs=vector<int>());
-	vector<ObservationEnsemble> run_lambda_ensembles(vector<ParameterEnsemble> &pe_lams, vector<double> &lam_vals, vector<double> &scale_vals);
+	//pe plus scale_fac times the upgrade for lambda ilam, for only the realizations in real_idxs (all of them if real_idxs is empty)
+	ParameterEnsemble get_lambda_ensemble(vector<ParameterEnsemble> &pe_upgrades, int ilam, double scale_fac, const vector<int> &real_idxs = vector<int>());
+	//each lambda, scale ensemble is built from pe_upgrades[upgrade_idxs[i]] as its runs are queued and holds
+	//only the realizations that are run.  These are returned in pe_lams
+	vector<ObservationEnsemble> run_lambda_ensembles(vector<ParameterEnsemble> &pe_upgrades, vector<int> &upgrade_idxs,
+		vector<double> &lam_vals, vector<double> &scale_vals, vector<ParameterEnsemble> &pe_lams);
 	//map<string, double> get_phi_vec_stats(map<string,PhiComponets> &phi_info);
 	//map<string,PhiComponets> get_phi_info(ObservationEnsemble &_oe);
 	void report_and_save();
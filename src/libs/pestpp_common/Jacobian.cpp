@@ -21,6 +21,8 @@
 #include <vector>
 #include <fstream>
 #include <iomanip>
+#include <atomic>
+#include <exception>
 #include "Jacobian.h"
 #include "Transformable.h"
 #include "ParamTransformSeq.h"
@@ -39,7 +41,9 @@ using namespace std;
 using namespace pest_utils;
 using namespace Eigen;
 
-Jacobian::Jacobian(FileManager &_file_manager) : file_manager(_file_manager)
+const size_t Jacobian::max_pending_bytes = 256 * 1024 * 1024;
+
+Jacobian::Jacobian(FileManager &_file_manager) : file_manager(_file_manager), drop_tol(0.0), num_threads(0), pending_bytes(0), n_matrix_cols(0)
 {
 }
 
@@ -291,7 +295,6 @@ bool Jacobian::process_runs(ParamTransformSeq &par_transform,
   base_sim_obs_names = run_manager.get_obs_name_vec();
 	vector<string> prior_info_name = prior_info.get_keys();
 	base_sim_obs_names.insert(base_sim_obs_names.end(), prior_info_name.begin(), prior_info_name.end());
-	std::vector<Eigen::Triplet<double> > triplet_list;
 
 	JacobianRun base_run;
 	int i_run = 0;
@@ -319,6 +322,8 @@ bool Jacobian::process_runs(ParamTransformSeq &par_transform,
 	double cur_numeric_par_value;
 	list<JacobianRun> run_list;
 	base_numeric_par_names.clear();
+	// there is at most one column per perturbation run
+	begin_matrix(base_sim_obs_names.size(), nruns - 1);
 	for(; i_run<nruns; ++i_run)
 	{
 		run_list.push_back(JacobianRun());
@@ -349,8 +354,7 @@ bool Jacobian::process_runs(ParamTransformSeq &par_transform,
 				double base_numeric_par_value = base_numeric_parameters.get_rec(cur_par_name);
 				base_run.numeric_derivative_par = base_numeric_par_value;
 				run_list.push_front(base_run);
-				std::vector<Eigen::Triplet<double> > tmp_triplet_vec = calc_derivative(cur_par_name, base_numeric_par_value, icol, run_list, group_info, prior_info, splitswh_flag);
-				triplet_list.insert(triplet_list.end(), tmp_triplet_vec.begin(), tmp_triplet_vec.end());
+				add_column(cur_par_name, base_numeric_par_value, run_list, group_info, prior_info, splitswh_flag);
 				icol++;
 				run_list.clear();
 			}
@@ -362,14 +366,113 @@ bool Jacobian::process_runs(ParamTransformSeq &par_transform,
 			}
 		}
 	}
-	matrix.resize(base_sim_obs_names.size(), base_numeric_par_names.size());
-	matrix.setZero();
-	matrix.setFromTriplets(triplet_list.begin(), triplet_list.end());
+	end_matrix(group_info, prior_info, splitswh_flag);
 	// clean up
 	run_manager.free_memory();
 	return true;
 }
 
+void Jacobian::begin_matrix(int nrows, int max_ncols)
+{
+	matrix.resize(nrows, max(0, max_ncols));
+	pending_columns.clear();
+	pending_bytes = 0;
+	n_matrix_cols = 0;
+}
+
+void Jacobian::add_column(const string &par_name, double base_numeric_par_value, list<JacobianRun> &run_list,
+	const ParameterGroupInfo &group_info, const PriorInformation &prior_info, bool splitswh_flag)
+{
+	pending_columns.push_back(JacobianColumn());
+	JacobianColumn &column = pending_columns.back();
+	column.par_name = par_name;
+	column.base_numeric_par_value = base_numeric_par_value;
+	column.run_list.swap(run_list);
+	// the ctl pars of the runs (including the copy of the base run) are only needed for the
+	// prior information derivatives
+	for (auto &run : column.run_list)
+	{
+		if (prior_info.size() == 0)
+			run.ctl_pars = Parameters();
+		pending_bytes += get_run_bytes(run);
+	}
+	if (pending_bytes >= max_pending_bytes)
+		flush_columns(group_info, prior_info, splitswh_flag);
+}
+
+size_t Jacobian::get_run_bytes(const JacobianRun &run)
+{
+	// each ctl par is an unordered_map node (the name, the value, the next pointer and the cached
+	// hash) plus a bucket pointer, and a long name has its own heap block
+	size_t bytes = sizeof(JacobianRun) + run.obs_vec.capacity() * sizeof(double);
+	for (auto &par : run.ctl_pars)
+		bytes += sizeof(pair<const string, double>) + 3 * sizeof(void*) + par.first.size();
+	return bytes;
+}
+
+void Jacobian::flush_columns(const ParameterGroupInfo &group_info, const PriorInformation &prior_info, bool splitswh_flag)
+{
+	int ncols = pending_columns.size();
+	if (ncols == 0)
+		return;
+	// the columns are independent, so the derivatives are calculated in parallel into each
+	// column's own buffers and then appended to the matrix in order
+	atomic<int> next_col(0);
+	vector<exception_ptr> thread_exceptions;
+	auto calc_columns = [&](int ithread)
+	{
+		try
+		{
+			int icol;
+			while ((icol = next_col.fetch_add(1)) < ncols)
+				calc_derivative(pending_columns[icol], group_info, prior_info, splitswh_flag);
+		}
+		catch (...)
+		{
+			thread_exceptions[ithread] = current_exception();
+		}
+	};
+	int n_threads = (num_threads > 0) ? num_threads : int(thread::hardware_concurrency());
+	n_threads = max(1, min(ncols, n_threads));
+	thread_exceptions.resize(n_threads);
+	vector<thread> threads;
+	for (int i = 1; i < n_threads; i++)
+		threads.push_back(thread(calc_columns, i));
+	calc_columns(0);
+	for (auto &t : threads)
+		t.join();
+	for (auto &eptr : thread_exceptions)
+	{
+		if (eptr)
+			rethrow_exception(eptr);
+	}
+
+	for (auto &column : pending_columns)
+	{
+		if (n_matrix_cols == 0)
+		{
+			// size the storage from the fill of the first column (and the number of runs it took)
+			// so the rest of the columns can be appended without reallocating
+			int nruns_col = max(1, int(column.run_list.size()) - 1);
+			matrix.reserve(column.rows.size() * (matrix.outerSize() / nruns_col));
+		}
+		matrix.startVec(n_matrix_cols);
+		for (size_t i = 0; i < column.rows.size(); i++)
+			matrix.insertBack(column.rows[i], n_matrix_cols) = column.values[i];
+		n_matrix_cols++;
+	}
+	pending_columns.clear();
+	pending_bytes = 0;
+}
+
+void Jacobian::end_matrix(const ParameterGroupInfo &group_info, const PriorInformation &prior_info, bool splitswh_flag)
+{
+	flush_columns(group_info, prior_info, splitswh_flag);
+	matrix.finalize();
+	matrix.conservativeResize(matrix.rows(), base_numeric_par_names.size());
+	matrix.data().squeeze();
+}
+
 bool Jacobian::get_derivative_parameters(const string &par_name, Parameters &numeric_pars, ParamTransformSeq &par_transform, const ParameterGroupInfo &group_info, const ParameterInfo &ctl_par_info,
 		vector<double> &delta_numeric_par_vec, bool phiredswh_flag, set<string> &out_of_bound_par)
 {
@@ -411,8 +514,8 @@ bool Jacobian::get_derivative_parameters(const string &par_name, Parameters &num
 }
 
 
-std::vector<Eigen::Triplet<double> >  Jacobian::calc_derivative(const string &numeric_par_name, double base_numeric_par_value, int jcol, list<JacobianRun> &run_list,
-	const ParameterGroupInfo &group_info, const PriorInformation &prior_info, bool splitswh_flag)
+void Jacobian::calc_derivative(JacobianColumn &column, const ParameterGroupInfo &group_info,
+	const PriorInformation &prior_info, bool splitswh_flag) const
 {
 	const ParameterGroupRec *g_rec;
 	double del_par;
@@ -420,7 +523,20 @@ std::vector<Eigen::Triplet<double> >  Jacobian::calc_derivative(const string &nu
 	double der;
 	int irow;
 	Parameters::const_iterator par_iter;
-	std::vector<Eigen::Triplet<double> > triplet_list;
+	const string &numeric_par_name = column.par_name;
+	double base_numeric_par_value = column.base_numeric_par_value;
+	list<JacobianRun> &run_list = column.run_list;
+	column.rows.clear();
+	column.values.clear();
+	// the values are stored in increasing row order, ready to be appended to the matrix
+	auto store = [&](int row, double value)
+	{
+		if (!(abs(value) <= drop_tol))
+		{
+			column.rows.push_back(row);
+			column.values.push_back(value);
+		}
+	};
 
 	// sort run_list the parameter numeric_par_name;
 	auto compare = [](const JacobianRun &a, const JacobianRun &b)
@@ -462,10 +578,7 @@ std::vector<Eigen::Triplet<double> >  Jacobian::calc_derivative(const string &nu
 					abs(sen_vec.back() - sen_vec.front()) / sen_vec.front() > splitreldiff )
 				{
 					success = true;
-					if (sen_vec.front() != 0)
-					{
-						triplet_list.push_back(Eigen::Triplet<double>(irow, jcol, sen_vec.front() ));
-					}
+					store(irow, sen_vec.front());
 				}
 			}
 
@@ -495,20 +608,14 @@ std::vector<Eigen::Triplet<double> >  Jacobian::calc_derivative(const string &nu
 				c = a_mat.colPivHouseholderQr().solve(y);
 				//derivative is calculated around "base_numeric_par_value"
 				der = 2.0 * c(0) *  base_numeric_par_value + c(1);
-				if (der != 0)
-				{
-					triplet_list.push_back(Eigen::Triplet<double>(irow, jcol, der));
-				}
+				store(irow, der);
 			}
 			else if (!success)
 			{
 				// Forward Difference and Central Difference Outer
 				del_par = run_last.numeric_derivative_par - run_first.numeric_derivative_par;
 				del_obs = run_last.obs_vec[irow] - run_first.obs_vec[irow];
-				if (del_obs != 0)
-				{
-					triplet_list.push_back(Eigen::Triplet<double>(irow, jcol, del_obs / del_par));
-				}
+				store(irow, del_obs / del_par);
 			}
 		}
 		else
@@ -525,14 +632,11 @@ std::vector<Eigen::Triplet<double> >  Jacobian::calc_derivative(const string &nu
 			{
 				pi_rec = &(prior_info_it->second);
 				del_prior_info = pi_rec->calc_residual(ctl_pars_2) - pi_rec->calc_residual(ctl_pars_1);
-				if (del_prior_info != 0) {
-					triplet_list.push_back(Eigen::Triplet<double>(irow, jcol, del_prior_info / del_par));
-				}
+				store(irow, del_prior_info / del_par);
 			}
 		}
 		++irow;
 	}
-	return triplet_list;
 }
 
 
@@ -686,8 +790,71 @@ Jacobian& Jacobian::operator=(const Jacobian &rhs)
 	base_sim_observations = rhs.base_sim_observations;
 	matrix = rhs.matrix;
 	file_manager = rhs.file_manager;
+	drop_tol = rhs.drop_tol;
+	num_threads = rhs.num_threads;
 	return *this;
 }
+int Jacobian::broyden_update(const ParamTransformSeq &par_transform, const ModelRun &base_run, const ModelRun &new_run, const PriorInformation &prior_info)
+{
+	// Broyden's update J += (y - J s) s^T / (s^T s) fills in the whole matrix, so Schubert's sparse form is
+	// used instead: each row is corrected along s restricted to the row's nonzero pattern.  This satisfies the
+	// secant condition J s = y for every row with at least one nonzero and never adds new nonzeros
+	Parameters base_numeric_pars = par_transform.ctl2numeric_cp(base_run.get_ctl_pars());
+	Parameters new_numeric_pars = par_transform.ctl2numeric_cp(new_run.get_ctl_pars());
+	int npar = base_numeric_par_names.size();
+	int nrow = base_sim_obs_names.size();
+	if ((npar != matrix.cols()) || (nrow != matrix.rows()))
+		throw PestError("Jacobian::broyden_update() error: jacobian matrix does not match its parameter and observation names");
+
+	Eigen::VectorXd s(npar);
+	for (int j = 0; j < npar; j++)
+	{
+		const double *base_ptr = base_numeric_pars.get_rec_ptr(base_numeric_par_names[j]);
+		const double *new_ptr = new_numeric_pars.get_rec_ptr(base_numeric_par_names[j]);
+		s[j] = ((base_ptr) && (new_ptr)) ? *new_ptr - *base_ptr : 0.0;
+	}
+	if (s.squaredNorm() == 0.0)
+		return 0;
+
+	// y is the change in the simulated values and prior information residuals
+	Eigen::VectorXd y(nrow);
+	const Observations &base_obs = base_run.get_obs();
+	const Observations &new_obs = new_run.get_obs();
+	const Parameters &base_ctl_pars = base_run.get_ctl_pars();
+	const Parameters &new_ctl_pars = new_run.get_ctl_pars();
+	for (int i = 0; i < nrow; i++)
+	{
+		const string &name = base_sim_obs_names[i];
+		const auto prior_info_it = prior_info.find(name);
+		if (prior_info_it != prior_info.end())
+			y[i] = prior_info_it->second.calc_residual(new_ctl_pars) - prior_info_it->second.calc_residual(base_ctl_pars);
+		else
+			y[i] = new_obs.get_rec(name) - base_obs.get_rec(name);
+	}
+
+	Eigen::VectorXd r = y - matrix * s;
+	Eigen::VectorXd d = Eigen::VectorXd::Zero(nrow);
+	for (int j = 0; j < matrix.outerSize(); ++j)
+		for (Eigen::SparseMatrix<double>::InnerIterator it(matrix, j); it; ++it)
+			d[it.row()] += s[j] * s[j];
+	for (int j = 0; j < matrix.outerSize(); ++j)
+		for (Eigen::SparseMatrix<double>::InnerIterator it(matrix, j); it; ++it)
+		{
+			if (d[it.row()] > 0.0)
+				it.valueRef() += r[it.row()] * s[j] / d[it.row()];
+		}
+	//the updated jacobian is taken to be at the new run, like one calculated there
+	base_numeric_parameters = new_numeric_pars;
+	base_sim_observations = new_run.get_obs();
+	int n_updated = 0;
+	for (int i = 0; i < nrow; i++)
+	{
+		if (d[i] > 0.0)
+			n_updated++;
+	}
+	return n_updated;
+}
+
 void Jacobian::transform(const ParamTransformSeq &par_trans, void(ParamTransformSeq::*meth_prt)(Jacobian &jac) const)
 {
 	(par_trans.*meth_prt)(*this);
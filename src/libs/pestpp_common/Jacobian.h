@@ -24,6 +24,7 @@
 #include<vector>
 #include<set>
 #include<list>
+#include<thread>
 #include<Eigen/Dense>
 #include<Eigen/Sparse>
 #include "Transformable.h"
@@ -47,6 +48,16 @@ public:
 	double numeric_derivative_par;
 };
 
+//the runs for one column of the jacobian and, once calc_derivative() is done, its nonzero derivatives
+class JacobianColumn{
+public:
+	string par_name;
+	double base_numeric_par_value;
+	list<JacobianRun> run_list;
+	vector<int> rows;
+	vector<double> values;
+};
+
 class Jacobian {
 public:
 	friend void TranOffset::jacobian_forward(Jacobian &jac);
@@ -91,6 +102,10 @@ public:
 	virtual void remove_cols(std::set<string> &rm_parameter_names);
 	virtual void add_cols(set<string> &new_pars_names);
 	virtual void transform(const ParamTransformSeq &par_trans, void(ParamTransformSeq::*meth_prt)(Jacobian &jac) const);
+	//update the jacobian along the step from base_run to new_run (Schubert's sparse Broyden update) instead of
+	//recomputing it.  The base parameters and simulated values become those of new_run.
+	//Returns the number of rows that were updated
+	int broyden_update(const ParamTransformSeq &par_transform, const ModelRun &base_run, const ModelRun &new_run, const PriorInformation &prior_info);
 	Jacobian& operator=(const Jacobian &rhs);
 	virtual const std::set<std::string>&  failed_runs_par_names(){ return  failed_parameter_names; }
 	virtual ~Jacobian();
@@ -103,6 +118,12 @@ public:
 
 	void set_base_numeric_pars(Parameters _base_numeric_pars);
 	void set_base_sim_obs(Observations _base_sim_obs);
+	//derivatives with an absolute value at or below drop_tol are not stored when the jacobian is built
+	void set_drop_tol(double _drop_tol) { drop_tol = _drop_tol; }
+	double get_drop_tol() const { return drop_tol; }
+	//number of threads used to calculate the derivatives, 0 for one per hardware thread
+	void set_num_threads(int _num_threads) { num_threads = _num_threads; }
+	int get_num_threads() const { return num_threads; }
 
 protected:
 	vector<string> base_numeric_par_names;  //ordered names of base parameters used to calculate the jacobian
@@ -115,9 +136,26 @@ protected:
 	//const vector<string> &ctl_file_ordered_pi_names;
 	Eigen::SparseMatrix<double> matrix;
 	FileManager &file_manager;  // filemanger used to get name of jaobian file
-
-	virtual std::vector<Eigen::Triplet<double> > calc_derivative(const string &numeric_par_name, double base_numeric_par_value, int jcol, list<JacobianRun> &run_list, const ParameterGroupInfo &group_info,
-		const PriorInformation &prior_info, bool splitswh_flag);
+	double drop_tol;
+	int num_threads;
+	//the columns waiting for their derivatives to be calculated
+	vector<JacobianColumn> pending_columns;
+	size_t pending_bytes;
+	int n_matrix_cols;
+	static const size_t max_pending_bytes;
+
+	//the derivatives are streamed straight into the column-compressed matrix one column at a time
+	//(in increasing column and row order) so no triplet list is ever formed.  The columns are
+	//batched (up to max_pending_bytes held in their runs) and their derivatives calculated in parallel
+	void begin_matrix(int nrows, int max_ncols);
+	void add_column(const string &par_name, double base_numeric_par_value, list<JacobianRun> &run_list,
+		const ParameterGroupInfo &group_info, const PriorInformation &prior_info, bool splitswh_flag);
+	void flush_columns(const ParameterGroupInfo &group_info, const PriorInformation &prior_info, bool splitswh_flag);
+	//the memory held by a run: its obs values and its ctl pars
+	static size_t get_run_bytes(const JacobianRun &run);
+	void end_matrix(const ParameterGroupInfo &group_info, const PriorInformation &prior_info, bool splitswh_flag);
+	virtual void calc_derivative(JacobianColumn &column, const ParameterGroupInfo &group_info,
+		const PriorInformation &prior_info, bool splitswh_flag) const;
 	virtual bool forward_diff(const string &par_name, const Parameters &pest_parameters,
 		const ParameterGroupInfo &group_info, const ParameterInfo &ctl_par_info, const ParamTransformSeq &par_trans,
 		double &new_par, set<string> &out_of_bound_par);
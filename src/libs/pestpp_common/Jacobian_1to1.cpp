@@ -220,7 +220,6 @@ bool Jacobian_1to1::process_runs(ParamTransformSeq &par_transform,
        base_sim_obs_names = run_manager.get_obs_name_vec();
 	vector<string> prior_info_name = prior_info.get_keys();
 	base_sim_obs_names.insert(base_sim_obs_names.end(), prior_info_name.begin(), prior_info_name.end());
-	std::vector<Eigen::Triplet<double> > triplet_list;
 
 	unordered_map<string, int> par2col_map = get_par2col_map();
 	unordered_map<string, int>::iterator found;
@@ -252,6 +251,8 @@ bool Jacobian_1to1::process_runs(ParamTransformSeq &par_transform,
 	double cur_numeric_par_value;
 
 	list<JacobianRun> run_list;
+	// there is at most one column per perturbation run
+	begin_matrix(base_sim_obs_names.size(), nruns - 1);
 	for(; i_run<nruns; ++i_run)
 	{
 		run_list.push_back(JacobianRun());
@@ -289,8 +290,7 @@ bool Jacobian_1to1::process_runs(ParamTransformSeq &par_transform,
 				base_run.numeric_derivative_par = base_numeric_parameters.get_rec(cur_par_name);
 				double cur_numeric_value = base_run.numeric_derivative_par;
 				run_list.push_front(base_run);
-				std::vector<Eigen::Triplet<double> > tmp_triplet_vec = calc_derivative(cur_par_name, cur_numeric_value, icol, run_list, group_info, prior_info, splitswh_flag);
-				triplet_list.insert( triplet_list.end(), tmp_triplet_vec.begin(), tmp_triplet_vec.end() );
+				add_column(cur_par_name, cur_numeric_value, run_list, group_info, prior_info, splitswh_flag);
 				icol++;
 			}
 			else
@@ -301,9 +301,7 @@ bool Jacobian_1to1::process_runs(ParamTransformSeq &par_transform,
 			run_list.clear();
 		}
 	}
-	matrix.resize(base_sim_obs_names.size(), base_numeric_par_names.size());
-	matrix.setZero();
-	matrix.setFromTriplets(triplet_list.begin(), triplet_list.end());
+	end_matrix(group_info, prior_info, splitswh_flag);
 	// clean up
 	ofstream &fout_restart = file_manager.get_ofstream("rst");
 	run_manager.free_memory();
@@ -368,7 +368,7 @@ void Localizer::report(ofstream &f_rec)
 
 }
 
-unordered_map<string, pair<vector<string>, vector<string>>> Localizer::get_localizer_map(int iter, ObservationEnsemble &oe, ParameterEnsemble &pe, PerformanceLog *performance_log)
+unordered_map<string, pair<vector<string>, vector<string>>>& Localizer::get_localizer_map(int iter, ObservationEnsemble &oe, ParameterEnsemble &pe, PerformanceLog *performance_log)
 {
 	if (!autoadaloc)
 		return localizer_map;
@@ -423,12 +423,27 @@ unordered_map<string, pair<vector<string>, vector<string>>> Localizer::get_local
 		f_out << endl;
 	}
 
-	//here we go...
-	vector<int> par_indices;
+	//standardize the diffs, dropping the pars and obs with no spread since they
+	//can not be correlated with anything
+	performance_log->log_event("autoadaloc: standardizing par and obs diffs");
+	vector<int> par_indices, obs_indices;
 	for (int jpar = 0; jpar < npar; jpar++)
-		par_indices.push_back(jpar);
+		if (par_std[jpar] != 0.0)
+			par_indices.push_back(jpar);
+	for (int iobs = 0; iobs < nobs; iobs++)
+		if (obs_std[iobs] != 0.0)
+			obs_indices.push_back(iobs);
+	Eigen::MatrixXd pe_ss(nreals, par_indices.size()), oe_ss(nreals, obs_indices.size());
+	for (int j = 0; j < par_indices.size(); j++)
+		pe_ss.col(j) = pe_diff.col(par_indices[j]) * (1.0 / par_std[par_indices[j]]);
+	pe_diff.resize(0, 0);
+	for (int j = 0; j < obs_indices.size(); j++)
+		oe_ss.col(j) = oe_diff.col(obs_indices[j]) * (1.0 / obs_std[obs_indices[j]]);
+	oe_diff.resize(0, 0);
+
+	//here we go...
 	vector<Eigen::Triplet<double>> triplets;
-	AutoAdaLocThread worker(performance_log, &f_out, iter, ies_verbose, npar, nobs, par_indices, pe_diff, oe_diff, par_std, obs_std, par_names, obs_names, triplets,sigma_dist,listed_obs);
+	AutoAdaLocThread worker(performance_log, &f_out, iter, ies_verbose, par_indices, obs_indices, pe_ss, oe_ss, par_names, obs_names, triplets, sigma_dist, listed_obs);
 
 	int num_threads = pe.get_pest_scenario_ptr()->get_pestpp_options().get_ies_num_threads();
 
@@ -454,8 +469,9 @@ unordered_map<string, pair<vector<string>, vector<string>>> Localizer::get_local
 
 		}
 		performance_log->log_event("waiting to join threads");
-		//for (auto &t : threads)
-		//	t.join();
+		//join them all before rethrowing so no thread is left running
+		for (auto &t : threads)
+			t.join();
 		for (int i = 0; i < num_threads; ++i)
 		{
 			if (exception_ptrs[i])
@@ -471,9 +487,8 @@ unordered_map<string, pair<vector<string>, vector<string>>> Localizer::get_local
 					throw runtime_error(ss.str());
 				}
 			}
-			threads[i].join();
 		}
-		performance_log->log_event("threaded localized upgrade calculation done");
+		performance_log->log_event("autoadaloc threads done");
 
 	}
 
@@ -508,8 +523,8 @@ unordered_map<string, pair<vector<string>, vector<string>>> Localizer::get_local
 	}
 
 
-	//convert triplet values to 1's
-	//and check for pars and obs with zero entries
+	//only the nonzero pattern of the thresholded matrix localizes the upgrade - the |cc| values
+	//are kept for the report.  Also check for pars and obs with zero entries
 	map<int, int> par_count, obs_count;
 	for (int i = 0; i < par_names.size(); i++)
 		par_count[i] = 0;
@@ -548,7 +563,10 @@ unordered_map<string, pair<vector<string>, vector<string>>> Localizer::get_local
 	ss.str("");
 	ss << "autoadaloc matrix constructed with " << mat.e_ptr()->nonZeros() << " non-zero elements";
 	performance_log->log_event(ss.str());
-	process_mat(performance_log);
+	int n_changed = update_autoadaloc_map(obs_names, par_names);
+	ss.str("");
+	ss << "autoadaloc: " << n_changed << " of " << localizer_map.size() << " localizer parts rebuilt";
+	performance_log->log_event(ss.str());
 	cout << "automatic adaptive localization calculations done" << endl;
 	return localizer_map;
 	//cout << endl;
@@ -577,278 +595,275 @@ void aal_upgrade_thread_function(int id, AutoAdaLocThread &worker, exception_ptr
 
 
 
-AutoAdaLocThread::AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_f_out, int _iter, int _ies_verbose, int _npar, int _nobs, vector<int> &_par_indices,
-	Eigen::MatrixXd &_pe_diff, Eigen::MatrixXd &_oe_diff, Eigen::ArrayXd &_par_std, Eigen::ArrayXd &_obs_std, vector<string> &_par_names, vector<string> &_obs_names,
-	vector<Eigen::Triplet<double>> &_triplets, double _sigma_dist,map<string,set<string>> &_list_obs): pe_diff(_pe_diff), oe_diff(_oe_diff), par_indices(_par_indices), par_std(_par_std), obs_std(_obs_std),par_names(_par_names),
-	obs_names(_obs_names),triplets(_triplets), list_obs(_list_obs)
+const int AutoAdaLocThread::tile_size = 128;
+const int AutoAdaLocThread::max_bg_size = 2000000;
+
+AutoAdaLocThread::AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_f_out, int _iter, int _ies_verbose, vector<int> &_par_indices, vector<int> &_obs_indices,
+	Eigen::MatrixXd &_pe_ss, Eigen::MatrixXd &_oe_ss, vector<string> &_par_names, vector<string> &_obs_names,
+	vector<Eigen::Triplet<double>> &_triplets, double _sigma_dist, map<string,set<string>> &_list_obs): pe_ss(_pe_ss), oe_ss(_oe_ss), par_indices(_par_indices),
+	obs_indices(_obs_indices), par_names(_par_names), obs_names(_obs_names), triplets(_triplets), list_obs(_list_obs)
 {
 	iter = _iter;
-	npar = _npar;
-	nobs = _nobs;
 	ies_verbose = _ies_verbose;
 	performance_log = _performance_log;
 	f_out = _f_out;
 	sigma_dist = _sigma_dist;
-	
-	for (int i = 0; i < obs_names.size(); i++)
-		idx2obs[i] = obs_names[i];
 
+	//each tile holds nreals - 1 background correlation blocks, so the obs tile
+	//is narrowed for big ensembles to keep the per-thread storage bounded
+	int nreals = pe_ss.rows();
+	par_tile_size = tile_size;
+	obs_tile_size = max(1, min(tile_size, max_bg_size / (par_tile_size * max(1, nreals - 1))));
+	n_par_tiles = (par_indices.size() + par_tile_size - 1) / par_tile_size;
+	next_tile = 0;
 }
 
 void AutoAdaLocThread::work(int thread_id)
 {
-
+	//the correlations between a tile of pars and a tile of obs are one gemm, and the background
+	//correlations (against the circularly-shifted obs realizations) are one gemm per shift.
+	//The thresholding is done on the tile, so the full npar x nobs matrix is never formed
 	stringstream ss;
-	int jpar, pcount = 0, nreals = pe_diff.rows();
-	double cc, bg_cc, bg_mean, bg_std, thres, t;
-	double sign;
+	int nreals = pe_ss.rows(), nobs = obs_indices.size(), npar = par_indices.size();
+	int pcount = 0;
+	double cc, bg_mean, bg_std, thres, sign;
 	double scale = 1.0 / double(nreals - 1);
-	double pstd, ostd;
-	//vector<Eigen::Triplet<double>> triplets, ones;
-	Eigen::VectorXd par_ss, obs_ss, obs_ss_shift;
-
-	par_ss.resize(nreals);
-	obs_ss.resize(nreals);
-	obs_ss_shift.resize(nreals);
-	Eigen::ArrayXd bg_cc_vec(nreals - 1);
-	set<string> sobs;
-	unique_lock<mutex> par_indices_guard(par_indices_lock, defer_lock);
-	unique_lock<mutex> oe_diff_gaurd(oe_diff_lock, defer_lock);
-	unique_lock<mutex> f_out_guard(f_out_lock, defer_lock);
-	unique_lock<mutex> triplets_guard(triplets_lock, defer_lock);
-	unique_lock<mutex>pfm_guard(pfm_lock, defer_lock);
-	unique_lock<mutex>par_names_guard(par_names_lock, defer_lock);
+	Eigen::MatrixXd cc_tile, obs_shift;
+	vector<Eigen::MatrixXd> bg_tiles(max(0, nreals - 1));
+	Eigen::ArrayXd bg_cc_vec(max(0, nreals - 1));
+	vector<Eigen::Triplet<double>> tile_triplets;
+	vector<const set<string>*> sobs;
+	vector<bool> par_kept;
+	stringstream ss_out;
 	while (true)
 	{
-		while (true)
+		int itile = next_tile.fetch_add(1);
+		if (itile >= n_par_tiles)
+			break;
+		if (itile % 100 == 0)
 		{
-			if (par_indices_guard.try_lock())
-			{
-				if (par_indices.size() == 0)
-				{
-					ss.str("");
-					ss << "autoadaloc thread: " << thread_id << " processed " << pcount << " parameters ";
-					if (ies_verbose > 1)
-					{
-						cout << ss.str() << endl;
-					}
-					while (true)
-					{
-						if (pfm_guard.try_lock())
-						{
-							performance_log->log_event(ss.str());
-							pfm_guard.unlock();
-							break;
-						}
-					}
-					
-					return;
-				}
-				if (par_indices.size() % 10000 == 0)
-				{
-					ss.str("");
-					ss << "autoadaloc iter " << iter << " progress: " << par_indices.size() << " of " << npar << " parameters done";
-					while (true)
-					{
-						if (pfm_guard.try_lock())
-						{
-							performance_log->log_event(ss.str());
-							pfm_guard.unlock();
-							break;
-						}
-					}
-					if (ies_verbose > 1)
-						cout << ss.str() << endl;
-				}
-				
-				jpar = par_indices[par_indices.size() - 1];
-				par_indices.pop_back();
-				if (par_std[jpar] == 0.0)
-				{
-					par_indices_guard.unlock();
-					continue;
-				}
-				par_ss = pe_diff.col(jpar) * (1.0 / par_std[jpar]);
-				par_indices_guard.unlock();
-				if (list_obs.size() > 0)
-				{
-					sobs = list_obs[par_names[jpar]];
-				}
-				pcount++;
-				break;
-			}
+			ss.str("");
+			ss << "autoadaloc iter " << iter << " progress: " << itile * par_tile_size << " of " << npar << " parameters done";
+			lock_guard<mutex> pfm_guard(pfm_lock);
+			performance_log->log_event(ss.str());
+			if (ies_verbose > 1)
+				cout << ss.str() << endl;
 		}
-
-		
-		string oname;
-		bool no_obs = true;
-		for (int iobs = 0; iobs < nobs; iobs++)
+		int par_start = itile * par_tile_size;
+		int n_par = min(par_tile_size, npar - par_start);
+		auto par_tile = pe_ss.middleCols(par_start, n_par);
+		sobs.assign(n_par, nullptr);
+		par_kept.assign(n_par, false);
+		for (int jp = 0; jp < n_par; jp++)
 		{
-			while (true)
-			{
-				/*if (oe_diff_gaurd.try_lock())
-				{
-					if (obs_std[iobs] == 0.0)
-					{
-						oe_diff_gaurd.unlock();
-						continue;
-					}
-					string oname = obs_names[iobs];
-					if ((sobs.size() > 0) && (sobs.find(oname) == sobs.end()))
-					{
-						oe_diff_gaurd.unlock();
-						continue;
-					}
-					obs_ss = oe_diff.col(iobs) * (1.0 / obs_std[iobs]);
-					oe_diff_gaurd.unlock();
-					break;*/
-				if (oe_diff_gaurd.try_lock())
-				{
-					
-					obs_ss = oe_diff.col(iobs);
-					oname = obs_names[iobs];
-					oe_diff_gaurd.unlock();
-					break;
-				}
-
-			}
-			if (obs_std[iobs] == 0.0)
-			{
-				continue;
-			}
-			
-			if ((sobs.size() > 0) && (sobs.find(oname) == sobs.end()))
-			{
-				continue;
-			}
-			obs_ss = obs_ss * (1.0 / obs_std[iobs]);
-			cc = (par_ss.transpose() * obs_ss)[0] * scale;
-			obs_ss_shift = 1.0 * obs_ss; //force a copy
-			for (int ireal = 0; ireal < nreals - 1; ireal++)
+			map<string, set<string>>::const_iterator it = list_obs.find(par_names[par_indices[par_start + jp]]);
+			if ((it != list_obs.end()) && (it->second.size() > 0))
+				sobs[jp] = &it->second;
+		}
+		tile_triplets.clear();
+		ss_out.str("");
+		for (int obs_start = 0; obs_start < nobs; obs_start += obs_tile_size)
+		{
+			int n_obs = min(obs_tile_size, nobs - obs_start);
+			auto obs_tile = oe_ss.middleCols(obs_start, n_obs);
+			cc_tile.noalias() = par_tile.transpose() * obs_tile;
+			obs_shift.resize(nreals, n_obs);
+			for (int ishift = 1; ishift < nreals; ishift++)
 			{
-
-				//obs_ss_shift.transpose() = obs_ss_shift.transpose() * perm;
-				//circular shift
-				t = obs_ss_shift[nreals - 1];
-				for (int i = nreals - 1; i > 0; i--)
-					obs_ss_shift[i] = obs_ss_shift[i - 1];
-				obs_ss_shift[0] = t;
-
-				//bg_cc = (par_ss.transpose() * obs_ss_shift)[0] * scale;
-				bg_cc_vec[ireal] = (par_ss.transpose() * obs_ss_shift)[0] * scale;
-				//cout << ireal << " " << par_names[jpar] << " " << obs_names[iobs] << " " << cc << " " << bg_cc << endl;
+				//realization i of the shifted obs is realization i - ishift (wrapped around)
+				obs_shift.topRows(ishift) = obs_tile.bottomRows(ishift);
+				obs_shift.bottomRows(nreals - ishift) = obs_tile.topRows(nreals - ishift);
+				bg_tiles[ishift - 1].noalias() = par_tile.transpose() * obs_shift;
 			}
 
-			//cout << par_names[jpar] << " " << obs_names[iobs] << " " << cc << " " << bg_cc << endl; 
-			(cc < 0.0) ? sign = -1. : sign = 1.;
-
-			bg_mean = bg_cc_vec.mean();
-			bg_std = sqrt((bg_cc_vec - bg_mean).pow(2).sum() / (nreals - 1));
-			thres = bg_mean + (sign * sigma_dist * bg_std);
-			if (ies_verbose > 1)
+			for (int jp = 0; jp < n_par; jp++)
 			{
-				
-				while (true)
+				int jpar = par_indices[par_start + jp];
+				for (int jo = 0; jo < n_obs; jo++)
 				{
-					if (f_out_guard.try_lock())
+					int iobs = obs_indices[obs_start + jo];
+					if ((sobs[jp]) && (sobs[jp]->find(obs_names[iobs]) == sobs[jp]->end()))
+						continue;
+					cc = cc_tile(jp, jo) * scale;
+					for (int ireal = 0; ireal < nreals - 1; ireal++)
+						bg_cc_vec[ireal] = bg_tiles[ireal](jp, jo) * scale;
+					(cc < 0.0) ? sign = -1. : sign = 1.;
+
+					bg_mean = bg_cc_vec.mean();
+					bg_std = sqrt((bg_cc_vec - bg_mean).pow(2).sum() / (nreals - 1));
+					thres = bg_mean + (sign * sigma_dist * bg_std);
+					if (ies_verbose > 1)
 					{
-						*f_out << obs_names[iobs] << "," << par_names[jpar] << "," << cc << "," << bg_mean << "," << bg_std << "," << thres << "," << (((sign * cc) - (sign * thres)) > 0.0);
+						ss_out << obs_names[iobs] << "," << par_names[jpar] << "," << cc << "," << bg_mean << "," << bg_std << "," << thres << "," << (((sign * cc) - (sign * thres)) > 0.0);
 						for (int i = 0; i < nreals - 1; i++)
-							*f_out << "," << bg_cc_vec[i];
-						*f_out << endl;
-						f_out_guard.unlock();
-						break;
-
+							ss_out << "," << bg_cc_vec[i];
+						ss_out << endl;
 					}
-				}
-				
-			}
-			if (((sign * cc) - (sign * thres)) > 0.0)
-			{
-				//cout << par_names[jpar] << " " << obs_names[iobs] << " " << cc << " " << bg_mean << " " << bg_std << " " << thres << " kept " << endl;
-				while (true)
-				{
-					if (triplets_guard.try_lock())
+					if (((sign * cc) - (sign * thres)) > 0.0)
 					{
-						triplets.push_back(Eigen::Triplet<double>(iobs, jpar, cc));
-						triplets_guard.unlock();
-						break;
+						tile_triplets.push_back(Eigen::Triplet<double>(iobs, jpar, cc));
+						par_kept[jp] = true;
 					}
 				}
-				no_obs = false;
-				
 			}
-			
-
 		}
-		if (no_obs)
+		pcount += n_par;
+		if (tile_triplets.size() > 0)
 		{
-			string pname;
-			while (true)
-			{
-				if (par_names_guard.try_lock())
-				{
-					pname = par_names[jpar];
-					par_names_guard.unlock();
-					break;
-				}
-			}
+			lock_guard<mutex> triplets_guard(triplets_lock);
+			triplets.insert(triplets.end(), tile_triplets.begin(), tile_triplets.end());
+		}
+		if (ies_verbose > 1)
+		{
+			lock_guard<mutex> f_out_guard(f_out_lock);
+			*f_out << ss_out.str();
+		}
+		for (int jp = 0; jp < n_par; jp++)
+		{
+			if (par_kept[jp])
+				continue;
 			ss.str("");
-
-			ss << "autoadaloc warning: parameter " << pname << " is completely localized -it maps to no observations";
-			while (true)
-			{
-				if (pfm_guard.try_lock())
-				{
-					performance_log->log_event(ss.str());
-					pfm_guard.unlock();
-					break;
-				}
-			}
+			ss << "autoadaloc warning: parameter " << par_names[par_indices[par_start + jp]] << " is completely localized -it maps to no observations";
+			lock_guard<mutex> pfm_guard(pfm_lock);
+			performance_log->log_event(ss.str());
 		}
 	}
+	ss.str("");
+	ss << "autoadaloc thread: " << thread_id << " processed " << pcount << " parameters ";
+	if (ies_verbose > 1)
+	{
+		cout << ss.str() << endl;
+	}
+	lock_guard<mutex> pfm_guard(pfm_lock);
+	performance_log->log_event(ss.str());
 }
 
 
-Eigen::MatrixXd Localizer::get_localizing_obs_hadamard_matrix(int num_reals, string col_name, vector<string> &obs_names)
+unordered_map<string, pair<vector<int>, vector<int>>>& Localizer::get_localizer_index_map(const vector<string> &obs_names, const vector<string> &par_names)
 {
+	if ((obs_names != index_obs_names) || (par_names != index_par_names))
+	{
+		index_obs_names = obs_names;
+		index_par_names = par_names;
+		obs2idx_map.clear();
+		par2idx_map.clear();
+		for (int i = 0; i < obs_names.size(); i++)
+			obs2idx_map[obs_names[i]] = i;
+		for (int i = 0; i < par_names.size(); i++)
+			par2idx_map[par_names[i]] = i;
+		compile_parts();
+	}
+	return index_map;
+}
 
-	vector<double> values;
-	vector<string> mat_cols = mat.get_col_names();
-	vector<string>::iterator it = find(mat_cols.begin(), mat_cols.end(), col_name);
-	if (it == mat_cols.end())
-		throw runtime_error("Localizer::get_localizing_obs_hadamard_matrix() error: col_name not found in localizer matrix: " + col_name);
-	int idx = it - mat_cols.begin();
-	Eigen::VectorXd mat_vec = mat.e_ptr()->col(idx);
-	int col_idx;
-	Eigen::MatrixXd loc(obs_names.size(), num_reals);
-	for (int i=0;i<obs_names.size();i++)
-	{
-		col_idx = obs2row_map[obs_names[i]];
-		loc.row(i).setConstant(mat_vec[col_idx]);
-	}
-	return loc;
 
+void Localizer::compile_part(const string &key)
+{
+	//the localizer is used as a 0/1 pattern: each part is just the columns of its obs and pars
+	if ((index_obs_names.size() == 0) && (index_par_names.size() == 0))
+		return;
+	const pair<vector<string>, vector<string>> &p = localizer_map.at(key);
+	pair<vector<int>, vector<int>> &idxs = index_map[key];
+	idxs.first.clear();
+	idxs.second.clear();
+	idxs.first.reserve(p.first.size());
+	idxs.second.reserve(p.second.size());
+	unordered_map<string, int>::iterator it;
+	for (auto &name : p.first)
+	{
+		it = obs2idx_map.find(name);
+		if (it == obs2idx_map.end())
+			throw runtime_error("Localizer::compile_part() error: obs name not found in upgrade obs names: " + name);
+		idxs.first.push_back(it->second);
+	}
+	for (auto &name : p.second)
+	{
+		it = par2idx_map.find(name);
+		if (it == par2idx_map.end())
+			throw runtime_error("Localizer::compile_part() error: par name not found in upgrade par names: " + name);
+		idxs.second.push_back(it->second);
+	}
 }
 
 
-Eigen::MatrixXd Localizer::get_localizing_par_hadamard_matrix(int num_reals, string row_name, vector<string> &par_names)
+void Localizer::compile_parts()
 {
+	index_map.clear();
+	for (auto &part : localizer_map)
+		compile_part(part.first);
+}
+
 
-	vector<double> values;
-	vector<string> mat_rows = mat.get_row_names();
-	vector<string>::iterator it = find(mat_rows.begin(), mat_rows.end(), row_name);
-	if (it == mat_rows.end())
-		throw runtime_error("Localizer::get_localizing_par_hadamard_matrix() error: row_name not found in localizer matrix: " + row_name);
-	int idx = it - mat_rows.begin();
-	Eigen::VectorXd mat_vec = mat.e_ptr()->row(idx);
-	int col_idx;
-	Eigen::MatrixXd loc(par_names.size(), num_reals);
-	for (int i = 0; i<par_names.size(); i++)
+int Localizer::update_autoadaloc_map(const vector<string> &obs_names, const vector<string> &par_names)
+{
+	//the autoadaloc matrix is always nz obs by adj par, with one part per par (or per obs when
+	//localizing by observations, the same as process_mat()), so rather than reprocessing the whole
+	//matrix, only the parts whose names changed are replaced
+	if (!aal_map_built)
+	{
+		//the first pass replaces the parts from the localizer file, if any
+		localizer_map.clear();
+		index_map.clear();
+		obs2row_map.clear();
+		par2col_map.clear();
+		for (int i = 0; i < obs_names.size(); i++)
+			obs2row_map[obs_names[i]] = i;
+		for (int i = 0; i < par_names.size(); i++)
+			par2col_map[par_names[i]] = i;
+		aal_map_built = true;
+	}
+	const Eigen::SparseMatrix<double> *e = mat.e_ptr();
+	//the names of the nonzeros of each part, in the same order process_mat() uses
+	vector<vector<string>> part_names;
+	const vector<string> *keys;
+	if (how == How::OBSERVATIONS)
+	{
+		keys = &obs_names;
+		part_names.resize(obs_names.size());
+		for (int j = 0; j < e->outerSize(); ++j)
+			for (Eigen::SparseMatrix<double>::InnerIterator it(*e, j); it; ++it)
+				part_names[it.row()].push_back(par_names[j]);
+	}
+	else
 	{
-		col_idx = par2col_map[par_names[i]];
-		loc.row(i).setConstant(mat_vec[col_idx]);
+		keys = &par_names;
+		part_names.resize(par_names.size());
+		for (int j = 0; j < e->outerSize(); ++j)
+			for (Eigen::SparseMatrix<double>::InnerIterator it(*e, j); it; ++it)
+				part_names[j].push_back(obs_names[it.row()]);
 	}
-	return loc;
 
+	int n_changed = 0;
+	for (int k = 0; k < keys->size(); k++)
+	{
+		const string &key = keys->at(k);
+		vector<string> &names = part_names[k];
+		unordered_map<string, pair<vector<string>, vector<string>>>::iterator part = localizer_map.find(key);
+		if (names.size() == 0)
+		{
+			//nothing left in this part so it is not used
+			if (part != localizer_map.end())
+			{
+				localizer_map.erase(part);
+				index_map.erase(key);
+				n_changed++;
+			}
+			continue;
+		}
+		if (how == How::OBSERVATIONS)
+		{
+			if ((part != localizer_map.end()) && (part->second.second == names))
+				continue;
+			localizer_map[key] = pair<vector<string>, vector<string>>(vector<string>{ key }, names);
+		}
+		else
+		{
+			if ((part != localizer_map.end()) && (part->second.first == names))
+				continue;
+			localizer_map[key] = pair<vector<string>, vector<string>>(names, vector<string>{ key });
+		}
+		n_changed++;
+		compile_part(key);
+	}
+	return n_changed;
 }
\ No newline at end of file
@@ -3,6 +3,8 @@
 
 #include <map>
 #include <random>
+#include <atomic>
+#include <mutex>
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 #include "FileManager.h"
@@ -19,33 +21,30 @@ class AutoAdaLocThread
 {
 public:
 
-	AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_f_out, int _iter, int _ies_verbose, int _npar, int _nobs, vector<int> &_par_indices,
-		Eigen::MatrixXd &_pe_diff, Eigen::MatrixXd &_oe_diff, Eigen::ArrayXd &_par_std, Eigen::ArrayXd &_obs_std, vector<string> &_par_names, vector<string> &_obs_names,
+	//pe_ss and oe_ss hold the standardized (by the std dev) diffs of only the pars and obs
+	//with nonzero std dev, their columns aligned with par_indices and obs_indices
+	AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_f_out, int _iter, int _ies_verbose, vector<int> &_par_indices, vector<int> &_obs_indices,
+		Eigen::MatrixXd &_pe_ss, Eigen::MatrixXd &_oe_ss, vector<string> &_par_names, vector<string> &_obs_names,
 		vector<Eigen::Triplet<double>> &_triplets, double _sigma_dist, map<string,set<string>> &_list_obs);
 
-	//Eigen::DiagonalMatrix<double, Eigen::Dynamic> get_matrix_from_map(vector<string> &names, map<string, double> &dmap);	
-	//Eigen::MatrixXd get_matrix_from_map(int num_reals, vector<string> &names, map<string, Eigen::VectorXd> &emap);
-
-
 	void work(int thread_id);
 
 
 private:
-	int npar, nobs, ies_verbose, iter;
-	int nzero_par, nzero_obs;
+	static const int tile_size;
+	static const int max_bg_size;
+	int ies_verbose, iter;
+	int par_tile_size, obs_tile_size, n_par_tiles;
 	double sigma_dist;
-	Eigen::MatrixXd &pe_diff, &oe_diff;
-	vector<int> &par_indices;
-	Eigen::ArrayXd &par_std, &obs_std;
+	Eigen::MatrixXd &pe_ss, &oe_ss;
+	vector<int> &par_indices, &obs_indices;
 	vector<string> &par_names, &obs_names;
 	vector<Eigen::Triplet<double>> &triplets;
 	PerformanceLog *performance_log;
 	ofstream *f_out;
-	map<string, set<string>> list_obs;
-	map<int, string> idx2obs;
-	mutex pe_diff_lock, oe_diff_lock, par_indices_lock, pfm_lock;
-	mutex f_out_lock, par_names_lock, obs_names_lock;
-	mutex triplets_lock;
+	map<string, set<string>> &list_obs;
+	atomic<int> next_tile;
+	mutex f_out_lock, triplets_lock, pfm_lock;
 };
 
 
@@ -57,10 +56,12 @@ public:
 	Localizer() { ; }
 	Localizer(Pest *_pest_scenario_ptr) { pest_scenario_ptr = _pest_scenario_ptr; }
 	bool initialize(PerformanceLog *performance_log);
-	unordered_map<string, pair<vector<string>, vector<string>>> get_localizer_map(int iter, ObservationEnsemble &oe, ParameterEnsemble &pe, PerformanceLog *performance_log);// { return localizer_map; }
+	//the map is held across iterations - with autoadaloc only the parts whose obs changed are rebuilt
+	unordered_map<string, pair<vector<string>, vector<string>>>& get_localizer_map(int iter, ObservationEnsemble &oe, ParameterEnsemble &pe, PerformanceLog *performance_log);
+	//the parts of the map as (obs, par) column indices into obs_names and par_names.  The index lists are
+	//held with the map - only the parts that changed since the last call are recompiled
+	unordered_map<string, pair<vector<int>, vector<int>>>& get_localizer_index_map(const vector<string> &obs_names, const vector<string> &par_names);
 	void set_pest_scenario(Pest *_pest_scenario_ptr) { pest_scenario_ptr = _pest_scenario_ptr; }
-	Eigen::MatrixXd get_localizing_obs_hadamard_matrix(int num_reals,string col_name,vector<string> &obs_names);
-	Eigen::MatrixXd get_localizing_par_hadamard_matrix(int num_reals, string row_name, vector<string> &par_names);
 	How get_how() { return how; }
 	bool get_use() { return use; }
 	bool get_autoadaloc() { return autoadaloc; }
@@ -76,10 +77,17 @@ private:
 	Mat mat;
 	string filename;
 	unordered_map<string,pair<vector<string>, vector<string>>> localizer_map;
+	unordered_map<string, pair<vector<int>, vector<int>>> index_map;
+	vector<string> index_obs_names, index_par_names;
+	unordered_map<string, int> obs2idx_map, par2idx_map;
 	map<string, set<string>> listed_obs;
 	map<string, int> obs2row_map, par2col_map;
+	bool aal_map_built = false;
 
 	void process_mat(PerformanceLog *performance_log);	
+	void compile_part(const string &key);
+	void compile_parts();
+	int update_autoadaloc_map(const vector<string> &obs_names, const vector<string> &par_names);
 };
 
 void aal_upgrade_thread_function(int id, AutoAdaLocThread &worker, exception_ptr &eptr);
@@ -815,7 +815,13 @@ int Pest::process_ctl_file(ifstream &fin, string _pst_filename, ofstream &f_rec)
 	//pestpp_options.set_use_parcov_scaling(false);
 	pestpp_options.set_parcov_scale_fac(-999.0);
 	pestpp_options.set_jac_scale(true);
+	pestpp_options.set_jac_scale_single_svd(false);
+	pestpp_options.set_jac_drop_tol(0.0);
+	pestpp_options.set_jac_num_threads(0);
+	pestpp_options.set_jac_broyden_iters(0);
 	pestpp_options.set_upgrade_augment(true);
+	pestpp_options.set_lsqr_max_iter(0);
+	pestpp_options.set_lsqr_tol(1.0e-8);
 	pestpp_options.set_opt_obj_func("");
 	pestpp_options.set_opt_coin_log(true);
 	pestpp_options.set_opt_skip_final(false);
@@ -868,9 +874,18 @@ int Pest::process_ctl_file(ifstream &fin, string _pst_filename, ofstream &f_rec)
 	pestpp_options.set_ies_csv_by_reals(true);
 	pestpp_options.set_ies_autoadaloc(false);
 	pestpp_options.set_ies_autoadaloc_sigma_dist(1.0);
+	pestpp_options.set_ies_race_lambdas(false);
+	pestpp_options.set_ies_race_sigma(2.0);
+	pestpp_options.set_ies_ensemble_store(false);
+	pestpp_options.set_ies_save_dense(false);
 
 	pestpp_options.set_condor_submit_file(string());
 	pestpp_options.set_overdue_giveup_minutes(1.0e+30);
+	pestpp_options.set_panther_use_epoll(false);
+	pestpp_options.set_panther_compress_results(false);
+	pestpp_options.set_panther_max_batch_size(1);
+	pestpp_options.set_panther_speculative_runs(false);
+	pestpp_options.set_local_run_threads(1);
 
 	for(vector<string>::const_iterator b=pestpp_input.begin(),e=pestpp_input.end();
 		b!=e; ++b) {
@@ -48,6 +48,9 @@ SVDASolver::SVDASolver(Pest &_pest_scenario, FileManager &_file_manager, Objecti
 		 "super parameter solution", Covariance(), _phiredswh_flag, _splitswh_flag, false),
 		max_super_frz_iter(_pest_scenario.get_pestpp_options().get_max_super_frz_iter())
 {
+	// the super parameters are redefined whenever the jacobian is recomputed, so the super
+	// parameter jacobian is never Broyden-updated
+	broyden_iters = 0;
 }
 
 
@@ -134,6 +137,10 @@ void SVDASolver::calc_upgrade_vec(double i_lambda, Parameters &prev_frozen_activ
 	{
 		calc_lambda_upgrade = &SVDASolver::calc_lambda_upgrade_vecQ12J;
 	}
+	else if (mat_inv == MAT_INV::LSQR)
+	{
+		calc_lambda_upgrade = &SVDASolver::calc_lambda_upgrade_vec_lsqr;
+	}
 
 		// need to remove parameters frozen due to failed jacobian runs when calling calc_lambda_upgrade_vec
 		//Freeze Parameters at the boundary whose ugrade vector and gradient both head out of bounds
@@ -373,6 +380,8 @@ ModelRun SVDASolver::iteration_upgrd(RunManagerAbstract &run_manager, Terminatio
 {
 	ostream &os = file_manager.rec_ofstream();
 	ostream &fout_restart = file_manager.get_ofstream("rst");
+	// the upgrade factorizations from the last iteration are for the old jacobian
+	clear_upgrade_factors();
 
 	if (restart_runs)
 	{
@@ -470,6 +479,7 @@ ModelRun SVDASolver::iteration_upgrd(RunManagerAbstract &run_manager, Terminatio
 		file_manager.close_file("fpr");
 		RestartController::write_upgrade_runs_built(fout_restart);
 	}
+	clear_upgrade_factors();
 
 	cout << endl;
 
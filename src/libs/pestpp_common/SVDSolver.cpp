@@ -44,6 +44,7 @@ using namespace pest_utils;
 using namespace Eigen;
 
 const string SVDSolver::svd_solver_type_name = "svd_base_par";
+const int SVDSolver::max_upgrade_factors = 2;
 
 
 void MuPoint::set(double _mu, const PhiComponets &_phi_comp)
@@ -99,7 +100,10 @@ SVDSolver::SVDSolver(Pest &_pest_scenario, FileManager &_file_manager, Objective
 	regul_scheme_ptr(_pest_scenario.get_regul_scheme_ptr()), output_file_writer(_output_file_writer), mat_inv(_mat_inv), description(_description), best_lambda(20.0),
 	performance_log(_performance_log), base_lambda_vec(_pest_scenario.get_pestpp_options().get_base_lambda_vec()), lambda_scale_vec(_pest_scenario.get_pestpp_options().get_lambda_scale_vec()),
 	terminate_local_iteration(false), reg_frac(_pest_scenario.get_pestpp_options().get_reg_frac()),
-		parcov(_parcov),parcov_scale_fac(_pest_scenario.get_pestpp_options().get_parcov_scale_fac()),upgrade_augment(_pest_scenario.get_pestpp_options().get_upgrade_augment())
+		parcov(_parcov),parcov_scale_fac(_pest_scenario.get_pestpp_options().get_parcov_scale_fac()),upgrade_augment(_pest_scenario.get_pestpp_options().get_upgrade_augment()),
+		lsqr_max_iter(_pest_scenario.get_pestpp_options().get_lsqr_max_iter()), lsqr_tol(_pest_scenario.get_pestpp_options().get_lsqr_tol()),
+		broyden_iters(_pest_scenario.get_pestpp_options().get_jac_broyden_iters()),
+		jac_scale_single_svd(_pest_scenario.get_pestpp_options().get_jac_scale_single_svd())
 {
 	if (_pest_scenario.get_pestpp_options().get_jac_scale())
 	{
@@ -150,16 +154,26 @@ ModelRun SVDSolver::solve(RunManagerAbstract &run_manager, TerminationController
 	ModelRun best_upgrade_run(cur_run);
 	// Start Solution iterations
 	bool save_nextjac = false;
-	string matrix_inv = (mat_inv == MAT_INV::Q12J) ? "\"Q 1/2 J\"" : "\"Jt Q J\"";
+	string matrix_inv = (mat_inv == MAT_INV::Q12J) ? "\"Q 1/2 J\"" : (mat_inv == MAT_INV::LSQR) ? "\"LSQR\"" : "\"Jt Q J\"";
 	terminate_local_iteration = false;
 
 	bool calc_jacobian = calc_first_jacobian;
+	int n_broyden = 0;
+	//true while the jacobian in memory has been changed by a broyden update since it was last calculated
+	bool jacobian_is_broyden = false;
 
 	if (restart_controller.get_restart_option() == RestartController::RestartOption::RESUME_NEW_ITERATION)
 	{
 		restart_controller.get_restart_option() = RestartController::RestartOption::NONE;
 	}
 
+	// LSQR only uses the parcov diagonal as prior information, so a full parcov gives a different solution than JtQJ
+	if ((mat_inv == MAT_INV::LSQR) && (parcov.nrow() > 0) && (parcov.e_ptr()->nonZeros() > parcov.nrow()))
+	{
+		cout << endl << "WARNING: mat_inv(lsqr) only uses the diagonal of the parameter covariance matrix, the off-diagonal elements are ignored" << endl;
+		os << "WARNING: mat_inv(lsqr) only uses the diagonal of the parameter covariance matrix, the off-diagonal elements are ignored" << endl;
+	}
+
 	for (int iter_num = 1; iter_num <= max_iter && !terminate_local_iteration; ++iter_num)
 	{
 		//only processed when debugging is turned on
@@ -210,6 +224,7 @@ ModelRun SVDSolver::solve(RunManagerAbstract &run_manager, TerminationController
 			{
 				bool restart_runs = (restart_controller.get_restart_option() == RestartController::RestartOption::RESUME_JACOBIAN_RUNS);
 				iteration_jac(run_manager, termination_ctl, best_upgrade_run, false, restart_runs);
+				jacobian_is_broyden = false;
 				if (restart_runs) restart_controller.get_restart_option() = RestartController::RestartOption::NONE;
 			}
 
@@ -323,7 +338,10 @@ ModelRun SVDSolver::solve(RunManagerAbstract &run_manager, TerminationController
 		output_file_writer.write_par(file_manager.open_ofile_ext(filename.str()), best_upgrade_run.get_ctl_pars(), *(par_transform.get_offset_ptr()),
 			*(par_transform.get_scale_ptr()));
 		file_manager.close_file(filename.str());
-		if (save_nextjac) {
+		//the jco only ever holds a finite-difference jacobian
+		if (save_nextjac && jacobian_is_broyden)
+			os << "    jacobian is a broyden update, not saved to jco file" << endl;
+		else if (save_nextjac) {
 			if (description.find("base") != string::npos)
 				output_file_writer.write_jco(true, "jco",jacobian);
 			else
@@ -345,7 +363,12 @@ ModelRun SVDSolver::solve(RunManagerAbstract &run_manager, TerminationController
 				optimum_run.get_obs(), *(optimum_run.get_obj_func_ptr()),
 				optimum_run.get_ctl_pars());
 			file_manager.close_file("rei");
-			if (description.find("base") != string::npos)
+			if (jacobian_is_broyden)
+			{
+				if (!save_nextjac) //otherwise already reported above
+					os << "    jacobian is a broyden update, not saved to jco file" << endl;
+			}
+			else if (description.find("base") != string::npos)
 				output_file_writer.write_jco(true, "jco", jacobian);
 			else
 				output_file_writer.write_jco(false, "jco", jacobian);
@@ -354,6 +377,32 @@ ModelRun SVDSolver::solve(RunManagerAbstract &run_manager, TerminationController
 			// will be more accurate than the one caluculated at the begining of this iteration
 			save_nextjac = true;
 		}
+		// quasi-Newton mode: now that the jco for this iteration has been saved, update the jacobian along
+		// the accepted upgrade rather than recomputing it, unless phi stalled (same test as the switch to
+		// central derivatives) or the max number of consecutive updates has been reached.  phi must also
+		// have dropped, otherwise a phiredswh <= 0 would never trigger a full jacobian until the max
+		// number of updates
+		if ((broyden_iters > 0) && (n_broyden < broyden_iters) && (prev_phi != 0) && (best_new_phi < prev_phi) &&
+			((prev_phi - best_new_phi) / prev_phi >= ctl_info->phiredswh) && (!terminate_local_iteration))
+		{
+			performance_log->log_event("broyden update of jacobian");
+			int n_rows = jacobian.broyden_update(par_transform, prev_run, best_upgrade_run, *prior_info_ptr);
+			if (n_rows > 0)
+			{
+				calc_jacobian = false;
+				jacobian_is_broyden = true;
+				n_broyden++;
+				//keep the jcb consistent with the jacobian the next iteration uses, for restarts
+				output_file_writer.write_jco(true, "jcb", jacobian);
+				os << endl << "    Jacobian updated by Broyden rank-one update (" << n_rows << " rows) instead of being recomputed" << endl;
+				cout << endl << "    Jacobian updated by Broyden rank-one update instead of being recomputed" << endl;
+			}
+			else
+				n_broyden = 0;
+		}
+		else
+			n_broyden = 0;
+
 		os << endl;
 		iteration_update_and_report(os, prev_run, best_upgrade_run, termination_ctl, run_manager);
 
@@ -413,73 +462,26 @@ void SVDSolver::calc_lambda_upgrade_vec_JtQJ(const Jacobian &jacobian, const QSq
 	VectorXd corrected_residuals = Residuals + del_residuals;
 	VectorXd Sigma;
 	VectorXd Sigma_trunc;
-	Eigen::SparseMatrix<double> U;
-	Eigen::SparseMatrix<double> Vt;
-	// the last boolean arguement is an instruction to compute the square weights
-	Eigen::SparseMatrix<double> q_mat = Q_sqrt.get_sparse_matrix(obs_name_vec, regul, true);
-	// removed this line when true added to end of the previous call to get_sparce_matrix
-	//q_mat = (q_mat * q_mat).eval();
-	Eigen::SparseMatrix<double> jac = jacobian.get_matrix(obs_name_vec, numeric_par_names);
-	Eigen::SparseMatrix<double> ident;
-	ident.resize(jac.cols(), jac.cols());
-	ident.setIdentity();
-	performance_log->log_event("forming JtQJ matrix");
-	Eigen::SparseMatrix<double> JtQJ = jac.transpose() * q_mat * jac;
-
-	if (parcov.nrow() > 0)
-	//if (parcov_scale_fac > 0.0)
-	{
-		cout << parcov_scale_fac << endl;
-		performance_log->log_event("JtQJ plus parcov.inv");
-		JtQJ = JtQJ + (parcov_scale_fac * *parcov.get(numeric_par_names).inv().e_ptr());
-	}
+	// nothing but the last solve depends on lambda, so the rest is shared across the lambda search
+	UpgradeFactors &factors = get_upgrade_factors(jacobian, Q_sqrt, regul, obs_name_vec, numeric_par_names, marquardt_type, MAT_INV::JTQJ);
+	const Eigen::SparseMatrix<double> &q_mat = factors.q_mat;
+	const Eigen::SparseMatrix<double> &jac = factors.jac;
 
 	Eigen::VectorXd upgrade_vec;
-	if (marquardt_type == MarquardtMatrix::IDENT)
+	if ((marquardt_type == MarquardtMatrix::IDENT) && (!jac_scale_single_svd))
 	{
 		stringstream info_str;
-		bool recalc_js = false;
-		Eigen::SparseMatrix<double> S;
-
-		if (true)
-		{
-			//Compute Scaling Matrix Sii
-			performance_log->log_event("commencing to scale JtQJ matrix");
-			svd_package->solve_ip(JtQJ, Sigma, U, Vt, Sigma_trunc, 0.0);
-			VectorXd Sigma_inv_sqrt = Sigma.array().inverse().sqrt();
-			S = Vt.transpose() * Sigma_inv_sqrt.asDiagonal() * U.transpose();
-			VectorXd S_diag = S.diagonal();
-			MatrixXd S_tmp = S_diag.asDiagonal();
-			S = S_tmp.sparseView();
-			stringstream info_str1;
-			info_str1 << "S info: " << "rows = " << S.rows() << ": cols = " << S.cols() << ": size = " << S.size() << ": nonzeros = " << S.nonZeros();
-			performance_log->log_event(info_str1.str());
-			performance_log->log_event("JS");
-			JS = jac * S;
-			performance_log->log_event("JS.transpose() * q_mat * JS + lambda * S.transpose() * S");
-			JtQJ = JS.transpose() * q_mat * JS + lambda * S.transpose() * S;
-			info_str.str("");
-			info_str << "S info: " << "rows = " << S.rows() << ": cols = " << S.cols() << ": size = " << S.size() << ": nonzeros = " << S.nonZeros();
-			performance_log->log_event(info_str.str());
-			recalc_js = true;
-		}
-
-
+		Eigen::SparseMatrix<double> U;
+		Eigen::SparseMatrix<double> Vt;
+		const Eigen::SparseMatrix<double> &S = factors.S;
+		performance_log->log_event("JS.transpose() * q_mat * JS + lambda * S.transpose() * S");
+		Eigen::SparseMatrix<double> JtQJ = factors.JStQJS + lambda * S.transpose() * S;
 
 		// Returns truncated Sigma, U and Vt arrays with small singular parameters trimed off
 		performance_log->log_event("commencing SVD factorization");
 		svd_package->solve_ip(JtQJ, Sigma, U, Vt, Sigma_trunc);
 		performance_log->log_event("SVD factorization complete");
 
-		if (!recalc_js)
-		{
-			VectorXd Sigma_inv_sqrt = Sigma.array().inverse().sqrt();
-			S = Vt.transpose() * Sigma_inv_sqrt.asDiagonal() * U.transpose();
-			VectorXd S_diag = S.diagonal();
-			MatrixXd S_tmp = S_diag.asDiagonal();
-			S = S_tmp.sparseView();
-		}
-
 		output_file_writer.write_svd(Sigma, Vt, lambda, prev_frozen_active_ctl_pars, Sigma_trunc);
 
 		VectorXd Sigma_inv = Sigma.array().inverse();
@@ -493,29 +495,45 @@ void SVDSolver::calc_lambda_upgrade_vec_JtQJ(const Jacobian &jacobian, const QSq
 		info_str.str("");
 		info_str << "jac info: " << "rows = " << jac.rows() << ": cols = " << jac.cols() << ": size = " << jac.size() << ": nonzeros = " << jac.nonZeros();
 		performance_log->log_event(info_str.str());
-		upgrade_vec = S * (Vt.transpose() * (Sigma_inv.asDiagonal() * (U.transpose() * ((jac * S).transpose()* (q_mat  * (corrected_residuals))))));
+		upgrade_vec = S * (Vt.transpose() * (Sigma_inv.asDiagonal() * (U.transpose() * (factors.JS.transpose()* (q_mat  * (corrected_residuals))))));
+	}
+	else if (marquardt_type == MarquardtMatrix::IDENT)
+	{
+		// jac_scale_single_svd: the factorization is of JtQJ, and the projection of the residuals
+		// onto it is only formed again when the residuals change (the frozen pars differ)
+		if ((factors.resid.size() != corrected_residuals.size()) || (!(factors.resid.array() == corrected_residuals.array()).all()))
+		{
+			performance_log->log_event("forming the projected residual U' * Jt * q_mat * r");
+			factors.resid = corrected_residuals;
+			factors.proj_resid = factors.U.transpose() * (jac.transpose() * (q_mat * corrected_residuals));
+		}
+		Sigma = factors.Sigma.array() + lambda;
+		Sigma_trunc = factors.Sigma_trunc;
+		output_file_writer.write_svd(Sigma, factors.Vt, lambda, prev_frozen_active_ctl_pars, Sigma_trunc);
+		VectorXd Sigma_inv = Sigma.array().inverse();
+		performance_log->log_event("commencing linear algebra multiplication to compute ugrade");
+		upgrade_vec = factors.Vt.transpose() * Sigma_inv.cwiseProduct(factors.proj_resid);
 	}
 	else
 	{
-		performance_log->log_event("commencing SVD factorization");
-		svd_package->solve_ip(JtQJ, Sigma, U, Vt, Sigma_trunc);
-		performance_log->log_event("SVD factorization complete");
 		//Only add lambda to singular values above the threshhold
+		Sigma = factors.Sigma;
+		Sigma_trunc = factors.Sigma_trunc;
 		Sigma = Sigma.array() + (Sigma.cwiseProduct(Sigma).array() * lambda).sqrt();
-		output_file_writer.write_svd(Sigma, Vt, lambda, prev_frozen_active_ctl_pars, Sigma_trunc);
+		output_file_writer.write_svd(Sigma, factors.Vt, lambda, prev_frozen_active_ctl_pars, Sigma_trunc);
 		VectorXd Sigma_inv = Sigma.array().inverse();
 
 		performance_log->log_event("commencing linear algebra multiplication to compute ugrade");
 		stringstream info_str;
-		info_str << "Vt info: " << "rows = " << Vt.rows() << ": cols = " << Vt.cols() << ": size = " << Vt.size() << ": nonzeros = " << Vt.nonZeros();
+		info_str << "Vt info: " << "rows = " << factors.Vt.rows() << ": cols = " << factors.Vt.cols() << ": size = " << factors.Vt.size() << ": nonzeros = " << factors.Vt.nonZeros();
 		performance_log->log_event(info_str.str());
 		info_str.str("");
-		info_str << "U info: " << "rows = " << U.rows() << ": cols = " << U.cols() << ": size = " << U.size() << ": nonzeros = " << U.nonZeros();
+		info_str << "U info: " << "rows = " << factors.U.rows() << ": cols = " << factors.U.cols() << ": size = " << factors.U.size() << ": nonzeros = " << factors.U.nonZeros();
 		performance_log->log_event(info_str.str());
 		info_str.str("");
 		info_str << "jac info: " << "rows = " << jac.rows() << ": cols = " << jac.cols() << ": size = " << jac.size() << ": nonzeros = " << jac.nonZeros();
 		performance_log->log_event(info_str.str());
-		upgrade_vec = Vt.transpose() * (Sigma_inv.asDiagonal() * (U.transpose() * (jac.transpose() * (q_mat  * corrected_residuals))));
+		upgrade_vec = factors.Vt.transpose() * (Sigma_inv.asDiagonal() * (factors.U.transpose() * (jac.transpose() * (q_mat  * corrected_residuals))));
 	}
 
 	// scale the upgrade vector using the technique described in the PEST manual
@@ -596,15 +614,12 @@ void SVDSolver::calc_lambda_upgrade_vecQ12J(const Jacobian &jacobian, const QSqr
 
 	VectorXd Sigma;
 	VectorXd Sigma_trunc;
-	Eigen::SparseMatrix<double> U;
-	Eigen::SparseMatrix<double> Vt;
-	Eigen::SparseMatrix<double> q_sqrt = Q_sqrt.get_sparse_matrix(obs_name_vec, regul);
-	Eigen::SparseMatrix<double> jac = jacobian.get_matrix(obs_name_vec, numeric_par_names);
-	Eigen::SparseMatrix<double> SqrtQ_J = q_sqrt * jac;
-	// Returns truncated Sigma, U and Vt arrays with small singular parameters trimed off
-	performance_log->log_event("commencing SVD factorization");
-	svd_package->solve_ip(SqrtQ_J, Sigma, U, Vt, Sigma_trunc);
-	performance_log->log_event("SVD factorization complete");
+	// the factorization of Q^1/2 J does not depend on lambda, so it is shared across the lambda search
+	UpgradeFactors &factors = get_upgrade_factors(jacobian, Q_sqrt, regul, obs_name_vec, numeric_par_names, marquardt_type, MAT_INV::Q12J);
+	const Eigen::SparseMatrix<double> &q_sqrt = factors.q_mat;
+	const Eigen::SparseMatrix<double> &jac = factors.jac;
+	Sigma = factors.Sigma;
+	Sigma_trunc = factors.Sigma_trunc;
 	//Only add lambda to singular values above the threshhold
 	if (marquardt_type == MarquardtMatrix::IDENT)
 	{
@@ -615,20 +630,191 @@ void SVDSolver::calc_lambda_upgrade_vecQ12J(const Jacobian &jacobian, const QSqr
 		//this needs checking
 		Sigma = Sigma.array() + (Sigma.cwiseProduct(Sigma).array() * lambda).sqrt();
 	}
-	output_file_writer.write_svd(Sigma, Vt, lambda, prev_frozen_active_ctl_pars, Sigma_trunc);
+	output_file_writer.write_svd(Sigma, factors.Vt, lambda, prev_frozen_active_ctl_pars, Sigma_trunc);
 	VectorXd Sigma_inv = Sigma.array().inverse();
 
 	performance_log->log_event("commencing linear algebra multiplication to compute ugrade");
 	stringstream info_str;
-	info_str << "Vt info: " << "rows = " << Vt.rows() << ": cols = " << Vt.cols() << ": size = " << Vt.size() << ": nonzeros = " << Vt.nonZeros();
+	info_str << "Vt info: " << "rows = " << factors.Vt.rows() << ": cols = " << factors.Vt.cols() << ": size = " << factors.Vt.size() << ": nonzeros = " << factors.Vt.nonZeros();
 	performance_log->log_event(info_str.str());
 	info_str.str("");
-	info_str << "U info: " << "rows = " << U.rows() << ": cols = " << U.cols() << ": size = " << U.size() << ": nonzeros = " << U.nonZeros();
+	info_str << "U info: " << "rows = " << factors.U.rows() << ": cols = " << factors.U.cols() << ": size = " << factors.U.size() << ": nonzeros = " << factors.U.nonZeros();
 	performance_log->log_event(info_str.str());
 	Eigen::VectorXd upgrade_vec;
-	upgrade_vec = Vt.transpose() * (Sigma_inv.asDiagonal() * (U.transpose() * (q_sqrt  * corrected_residuals)));
+	upgrade_vec = factors.Vt.transpose() * (Sigma_inv.asDiagonal() * (factors.U.transpose() * (q_sqrt  * corrected_residuals)));
+
+
+
+	// scale the upgrade vector using the technique described in the PEST manual
+	if (scale_upgrade)
+	{
+		double beta = 1.0;
+		Eigen::VectorXd gama = jac * upgrade_vec;
+		Eigen::SparseMatrix<double> Q_diag = get_diag_matrix(q_sqrt);
+		Q_diag = (Q_diag * Q_diag).eval();
+		double top = corrected_residuals.transpose() * Q_diag * gama;
+		double bot = gama.transpose() * Q_diag * gama;
+		if (bot != 0)
+		{
+			beta = top / bot;
+		}
+		upgrade_vec *= beta;
+	}
+
+
+	Eigen::VectorXd grad_vec;
+	grad_vec = -2.0 * (jac.transpose() * (q_sqrt * (q_sqrt * Residuals)));
+	performance_log->log_event("linear algebra multiplication to compute ugrade complete");
+
+	//tranfere newly computed componets of the ugrade vector to upgrade.svd_uvec
+	upgrade_active_ctl_del_pars.clear();
+	grad_active_ctl_del_pars.clear();
+
+	string *name_ptr;
+	auto it_nf_end = pars_nf.end();
+	for (size_t i = 0; i < numeric_par_names.size(); ++i)
+	{
+		name_ptr = &(numeric_par_names[i]);
+		upgrade_active_ctl_del_pars[*name_ptr] = upgrade_vec(i);
+		grad_active_ctl_del_pars[*name_ptr] = grad_vec(i);
+		auto it_nf = pars_nf.find(*name_ptr);
+		if (it_nf != it_nf_end)
+		{
+			it_nf->second += upgrade_vec(i);
+		}
+	}
+	// Transform upgrade_pars back to ctl parameters
+	active_ctl_upgrade_pars = par_transform.numeric2active_ctl_cp(pars_nf);
+	Parameters tmp_pars(base_numeric_pars);
+	par_transform.del_numeric_2_del_active_ctl_ip(upgrade_active_ctl_del_pars, tmp_pars);
+	tmp_pars = base_numeric_pars;
+	par_transform.del_numeric_2_del_active_ctl_ip(grad_active_ctl_del_pars, tmp_pars);
+
+	//tranfere previously frozen componets of the ugrade vector to upgrade.svd_uvec
+	for (auto &ipar : prev_frozen_active_ctl_pars)
+	{
+		active_ctl_upgrade_pars[ipar.first] = ipar.second;
+	}
+}
+
+
+
+int SVDSolver::lsqr(const UpgradeFactors &factors, const Eigen::VectorXd &damp, const Eigen::VectorXd &rhs, Eigen::VectorXd &x, int &itn)
+{
+	//Paige and Saunders LSQR for the damped, column-scaled least squares problem
+	//	min || [Q^1/2 J D; diag(damp)] y - [rhs; 0] ||
+	//where D is factors.col_scale.  Only products with J and Jt are needed, so neither JtQJ
+	//nor a factorization is ever formed.  Returns the LSQR istop flag (0 = trivial solution,
+	//1 = residual small enough, 2 = least squares solution found, 7 = iteration limit)
+	const Eigen::SparseMatrix<double> &q_mat = factors.q_mat;
+	const Eigen::SparseMatrix<double> &jac = factors.jac;
+	const Eigen::VectorXd &D = factors.col_scale;
+	int nobs = jac.rows(), npar = jac.cols();
+	int max_iter = (lsqr_max_iter > 0) ? lsqr_max_iter : max(10, 2 * npar);
+	double atol = lsqr_tol, btol = lsqr_tol;
+
+	x = Eigen::VectorXd::Zero(npar);
+	itn = 0;
+	Eigen::VectorXd u(nobs + npar);
+	u.head(nobs) = rhs;
+	u.tail(npar).setZero();
+	double beta = u.norm();
+	if (beta == 0.0)
+		return 0;
+	u /= beta;
+	Eigen::VectorXd v = D.cwiseProduct(jac.transpose() * (q_mat * u.head(nobs))) + damp.cwiseProduct(u.tail(npar));
+	double alpha = v.norm();
+	if (alpha == 0.0)
+		return 0;
+	v /= alpha;
+	Eigen::VectorXd w = v;
+	double phibar = beta, rhobar = alpha, bnorm = beta, anorm = 0.0;
+	double rho, c, s, theta, phi, rnorm, arnorm;
+	while (itn < max_iter)
+	{
+		itn++;
+		u.head(nobs) = q_mat * (jac * D.cwiseProduct(v)) - alpha * u.head(nobs);
+		u.tail(npar) = damp.cwiseProduct(v) - alpha * u.tail(npar);
+		beta = u.norm();
+		if (beta > 0.0)
+			u /= beta;
+		anorm = sqrt(anorm * anorm + alpha * alpha + beta * beta);
+		v = D.cwiseProduct(jac.transpose() * (q_mat * u.head(nobs))) + damp.cwiseProduct(u.tail(npar)) - beta * v;
+		alpha = v.norm();
+		if (alpha > 0.0)
+			v /= alpha;
+
+		rho = sqrt(rhobar * rhobar + beta * beta);
+		c = rhobar / rho;
+		s = beta / rho;
+		theta = s * alpha;
+		rhobar = -c * alpha;
+		phi = c * phibar;
+		phibar = s * phibar;
+		x += (phi / rho) * w;
+		w = v - (theta / rho) * w;
+
+		rnorm = phibar;
+		arnorm = alpha * abs(c) * phibar;
+		if (rnorm <= btol * bnorm + atol * anorm * x.norm())
+			return 1;
+		if ((rnorm == 0.0) || (arnorm <= atol * anorm * rnorm))
+			return 2;
+	}
+	return 7;
+}
+
+void SVDSolver::calc_lambda_upgrade_vec_lsqr(const Jacobian &jacobian, const QSqrtMatrix &Q_sqrt, const DynamicRegularization &regul,
+	const Eigen::VectorXd &Residuals, const vector<string> &obs_name_vec,
+	const Parameters &base_active_ctl_pars, const Parameters &prev_frozen_active_ctl_pars,
+	double lambda, Parameters &active_ctl_upgrade_pars, Parameters &upgrade_active_ctl_del_pars,
+	Parameters &grad_active_ctl_del_pars, MarquardtMatrix marquardt_type, bool scale_upgrade)
+{
+	Parameters base_numeric_pars = par_transform.active_ctl2numeric_cp(base_active_ctl_pars);
+	//Create a set of Ctl Parameters which does not include the frozen Parameters
+	Parameters pars_nf = base_active_ctl_pars;
+	pars_nf.erase(prev_frozen_active_ctl_pars);
+	//Transform these parameters to numeric parameters
+	par_transform.active_ctl2numeric_ip(pars_nf);
+	vector<string> numeric_par_names = pars_nf.get_keys();
 
+	//Compute effect of frozen parameters on the residuals vector
+	Parameters delta_freeze_pars = prev_frozen_active_ctl_pars;
+	Parameters base_freeze_pars(base_active_ctl_pars, delta_freeze_pars.get_keys());
+	par_transform.active_ctl2numeric_ip(delta_freeze_pars);
+	par_transform.active_ctl2numeric_ip(base_freeze_pars);
+	delta_freeze_pars -= base_freeze_pars;
+	VectorXd del_residuals = calc_residual_corrections(jacobian, delta_freeze_pars, obs_name_vec);
+	VectorXd corrected_residuals = Residuals + del_residuals;
 
+	UpgradeFactors &factors = get_upgrade_factors(jacobian, Q_sqrt, regul, obs_name_vec, numeric_par_names, marquardt_type, MAT_INV::LSQR);
+	const Eigen::SparseMatrix<double> &q_sqrt = factors.q_mat;
+	const Eigen::SparseMatrix<double> &jac = factors.jac;
+
+	//the Marquardt term is lambda * I for IDENT and lambda * diag(JtQJ) otherwise.  The parcov
+	//enters as prior information through its diagonal only
+	int npar = numeric_par_names.size();
+	VectorXd damp(npar);
+	for (int j = 0; j < npar; j++)
+	{
+		double lam_j = lambda;
+		if (marquardt_type != MarquardtMatrix::IDENT)
+			lam_j *= factors.jtqj_diag[j];
+		double prior_j = factors.prior_damp[j];
+		damp[j] = sqrt(lam_j + prior_j * prior_j) * factors.col_scale[j];
+	}
+
+	performance_log->log_event("commencing LSQR solution for upgrade");
+	VectorXd y;
+	int itn;
+	int istop = lsqr(factors, damp, q_sqrt * corrected_residuals, y, itn);
+	stringstream info_str;
+	info_str << "LSQR finished after " << itn << " iterations with istop = " << istop;
+	performance_log->log_event(info_str.str());
+	info_str.str("");
+	info_str << "jac info: " << "rows = " << jac.rows() << ": cols = " << jac.cols() << ": size = " << jac.size() << ": nonzeros = " << jac.nonZeros();
+	performance_log->log_event(info_str.str());
+	Eigen::VectorXd upgrade_vec = factors.col_scale.cwiseProduct(y);
 
 	// scale the upgrade vector using the technique described in the PEST manual
 	if (scale_upgrade)
@@ -682,7 +868,133 @@ void SVDSolver::calc_lambda_upgrade_vecQ12J(const Jacobian &jacobian, const QSqr
 	}
 }
 
+SVDSolver::UpgradeFactors& SVDSolver::get_upgrade_factors(const Jacobian &jacobian, const QSqrtMatrix &Q_sqrt, const DynamicRegularization &regul,
+	const vector<string> &obs_name_vec, const vector<string> &numeric_par_names, MarquardtMatrix marquardt_type, MAT_INV solution)
+{
+	// the JtQJ solution uses the squared weights, the Q^1/2 J and LSQR solutions the weights themselves.
+	// The weights are cheap to form and change with the regularization weight, so they are part of the key
+	Eigen::SparseMatrix<double> q_mat = Q_sqrt.get_sparse_matrix(obs_name_vec, regul, solution == MAT_INV::JTQJ);
+	Eigen::VectorXd q_diag = q_mat.diagonal();
+	for (auto it = upgrade_factors.begin(); it != upgrade_factors.end(); ++it)
+	{
+		if ((it->jacobian_ptr == &jacobian) && (it->solution == solution) && (it->marquardt_type == marquardt_type) &&
+			(it->par_names == numeric_par_names) && (it->obs_names == obs_name_vec) &&
+			((it->q_diag.array() == q_diag.array()).all()))
+		{
+			performance_log->log_event("reusing the upgrade factorization from a previous lambda");
+			upgrade_factors.splice(upgrade_factors.begin(), upgrade_factors, it);
+			return upgrade_factors.front();
+		}
+	}
+
+	UpgradeFactors factors;
+	factors.jacobian_ptr = &jacobian;
+	factors.solution = solution;
+	factors.marquardt_type = marquardt_type;
+	factors.obs_names = obs_name_vec;
+	factors.par_names = numeric_par_names;
+	factors.q_diag = q_diag;
+	factors.q_mat = q_mat;
+	factors.jac = jacobian.get_matrix(obs_name_vec, numeric_par_names);
+	if (solution == MAT_INV::LSQR)
+	{
+		// LSQR only needs products with J and Jt.  The columns of Q^1/2 J are scaled by the prior
+		// std dev when there is a parcov, otherwise to unit length
+		int npar = numeric_par_names.size();
+		factors.col_scale = VectorXd::Ones(npar);
+		factors.prior_damp = VectorXd::Zero(npar);
+		factors.jtqj_diag.resize(npar);
+		for (int j = 0; j < npar; j++)
+			factors.jtqj_diag[j] = (factors.q_mat * factors.jac.col(j)).squaredNorm();
+		if (parcov.nrow() > 0)
+		{
+			// only the diagonal of the parcov is used so nothing dense is formed - solve() warns
+			// when the parcov has off-diagonal elements
+			VectorXd var = parcov.get(numeric_par_names).e_ptr()->diagonal();
+			for (int j = 0; j < npar; j++)
+			{
+				if (var[j] <= 0.0)
+					continue;
+				factors.col_scale[j] = sqrt(var[j]);
+				factors.prior_damp[j] = sqrt(parcov_scale_fac / var[j]);
+			}
+		}
+		else
+		{
+			for (int j = 0; j < npar; j++)
+			{
+				if (factors.jtqj_diag[j] > 0.0)
+					factors.col_scale[j] = 1.0 / sqrt(factors.jtqj_diag[j]);
+			}
+		}
+	}
+	else if (solution == MAT_INV::Q12J)
+	{
+		Eigen::SparseMatrix<double> SqrtQ_J = factors.q_mat * factors.jac;
+		// Returns truncated Sigma, U and Vt arrays with small singular parameters trimed off
+		performance_log->log_event("commencing SVD factorization");
+		svd_package->solve_ip(SqrtQ_J, factors.Sigma, factors.U, factors.Vt, factors.Sigma_trunc);
+		performance_log->log_event("SVD factorization complete");
+	}
+	else
+	{
+		performance_log->log_event("forming JtQJ matrix");
+		Eigen::SparseMatrix<double> JtQJ = factors.jac.transpose() * factors.q_mat * factors.jac;
+
+		if ((parcov.nrow() > 0) && ((marquardt_type != MarquardtMatrix::IDENT) || (!jac_scale_single_svd)))
+		{
+			stringstream info_str;
+			info_str << "JtQJ plus parcov.inv, parcov_scale_fac = " << parcov_scale_fac;
+			performance_log->log_event(info_str.str());
+			JtQJ = JtQJ + (parcov_scale_fac * *parcov.get(numeric_par_names).inv().e_ptr());
+		}
+		if ((marquardt_type == MarquardtMatrix::IDENT) && (jac_scale_single_svd))
+		{
+			// the lambda system is S(JtQJ + lambda*I)S with S the diagonal scaling, so S cancels out of
+			// the solution and the upgrade for each lambda is Vt'(Sigma + lambda)^-1 U'JtQr, with one
+			// truncated factorization of JtQJ.  The parcov only enters through S, so it takes no part
+			// here, and maxsing/eigthresh truncate the spectrum of JtQJ rather than that of each
+			// scaled, lambda-augmented matrix
+			performance_log->log_event("commencing SVD factorization");
+			svd_package->solve_ip(JtQJ, factors.Sigma, factors.U, factors.Vt, factors.Sigma_trunc);
+			performance_log->log_event("SVD factorization complete");
+		}
+		else if (marquardt_type == MarquardtMatrix::IDENT)
+		{
+			//Compute Scaling Matrix Sii
+			VectorXd Sigma;
+			VectorXd Sigma_trunc;
+			Eigen::SparseMatrix<double> U;
+			Eigen::SparseMatrix<double> Vt;
+			performance_log->log_event("commencing to scale JtQJ matrix");
+			svd_package->solve_ip(JtQJ, Sigma, U, Vt, Sigma_trunc, 0.0);
+			VectorXd Sigma_inv_sqrt = Sigma.array().inverse().sqrt();
+			Eigen::SparseMatrix<double> S = Vt.transpose() * Sigma_inv_sqrt.asDiagonal() * U.transpose();
+			VectorXd S_diag = S.diagonal();
+			MatrixXd S_tmp = S_diag.asDiagonal();
+			factors.S = S_tmp.sparseView();
+			stringstream info_str;
+			info_str << "S info: " << "rows = " << factors.S.rows() << ": cols = " << factors.S.cols() << ": size = " << factors.S.size() << ": nonzeros = " << factors.S.nonZeros();
+			performance_log->log_event(info_str.str());
+			performance_log->log_event("JS");
+			factors.JS = factors.jac * factors.S;
+			performance_log->log_event("JS.transpose() * q_mat * JS");
+			factors.JStQJS = factors.JS.transpose() * factors.q_mat * factors.JS;
+		}
+		else
+		{
+			// Returns truncated Sigma, U and Vt arrays with small singular parameters trimed off
+			performance_log->log_event("commencing SVD factorization");
+			svd_package->solve_ip(JtQJ, factors.Sigma, factors.U, factors.Vt, factors.Sigma_trunc);
+			performance_log->log_event("SVD factorization complete");
+		}
+	}
 
+	upgrade_factors.push_front(move(factors));
+	while (upgrade_factors.size() > max_upgrade_factors)
+		upgrade_factors.pop_back();
+	return upgrade_factors.front();
+}
 
 void SVDSolver::calc_upgrade_vec(double i_lambda, Parameters &prev_frozen_active_ctl_pars, QSqrtMatrix &Q_sqrt,
 	const DynamicRegularization &regul, VectorXd &residuals_vec, vector<string> &obs_names_vec,
@@ -709,6 +1021,10 @@ void SVDSolver::calc_upgrade_vec(double i_lambda, Parameters &prev_frozen_active
 	{
 		calc_lambda_upgrade = &SVDSolver::calc_lambda_upgrade_vecQ12J;
 	}
+	else if (mat_inv == MAT_INV::LSQR)
+	{
+		calc_lambda_upgrade = &SVDSolver::calc_lambda_upgrade_vec_lsqr;
+	}
 
 	// need to remove parameters frozen due to failed jacobian runs when calling calc_lambda_upgrade_vec
 	//Freeze Parameters at the boundary whose ugrade vector and gradient both head out of bounds
@@ -799,6 +1115,10 @@ void SVDSolver::calc_upgrade_vec_freeze(double i_lambda, Parameters &prev_frozen
 	{
 		calc_lambda_upgrade = &SVDSolver::calc_lambda_upgrade_vecQ12J;
 	}
+	else if (mat_inv == MAT_INV::LSQR)
+	{
+		calc_lambda_upgrade = &SVDSolver::calc_lambda_upgrade_vec_lsqr;
+	}
 
 	// need to remove parameters frozen due to failed jacobian runs when calling calc_lambda_upgrade_vec
 	//Freeze Parameters at the boundary whose ugrade vector and gradient both head out of bounds
@@ -1009,6 +1329,8 @@ ModelRun SVDSolver::iteration_upgrd(RunManagerAbstract &run_manager, Termination
 {
 	ostream &os = file_manager.rec_ofstream();
 	ostream &fout_restart = file_manager.get_ofstream("rst");
+	// the upgrade factorizations from the last iteration are for the old jacobian
+	clear_upgrade_factors();
 
 	if (restart_runs)
 	{
@@ -1169,6 +1491,7 @@ ModelRun SVDSolver::iteration_upgrd(RunManagerAbstract &run_manager, Termination
 		file_manager.close_file("fpr");
 		RestartController::write_upgrade_runs_built(fout_restart);
 	}
+	clear_upgrade_factors();
 
 	cout << endl;
 	performance_log->add_indent(-1);
@@ -1667,6 +1990,10 @@ PhiComponets SVDSolver::phi_estimate(const ModelRun &base_run, const Jacobian &j
 	{
 		calc_lambda_upgrade = &SVDSolver::calc_lambda_upgrade_vecQ12J;
 	}
+	else if (mat_inv == MAT_INV::LSQR)
+	{
+		calc_lambda_upgrade = &SVDSolver::calc_lambda_upgrade_vec_lsqr;
+	}
 
 	(*this.*calc_lambda_upgrade)(jacobian, Q_sqrt, regul, residuals_vec, obs_names_vec,
 		base_run_active_ctl_par, freeze_active_ctl_pars, 0, new_pars, upgrade_ctl_del_pars,
@@ -21,6 +21,7 @@
 
 #include <map>
 #include <set>
+#include <list>
 #include <iomanip>
 #include <Eigen/Dense>
 #include "Transformable.h"
@@ -62,7 +63,7 @@ public:
 class SVDSolver
 {
 public:
-	enum class MAT_INV{ Q12J, JTQJ };
+	enum class MAT_INV{ Q12J, JTQJ, LSQR };
 protected:
 	enum class LimitType {NONE, LBND, UBND, REL, FACT};
 	enum class MarquardtMatrix {IDENT, JTQJ};
@@ -97,6 +98,37 @@ protected:
 		vector<string> par_name_vec;
 		Parameters frozen_numeric_pars;
 	};
+	//the lambda-independent parts of an upgrade calculation: the weights, the jacobian and the
+	//factorization of JtQJ (or Q^1/2 J).  These are shared by all the lambdas of an iteration
+	//and are only reused for the same jacobian, obs, unfrozen pars and weights
+	class UpgradeFactors {
+	public:
+		const Jacobian *jacobian_ptr;
+		MAT_INV solution;
+		MarquardtMatrix marquardt_type;
+		vector<string> obs_names;
+		vector<string> par_names;
+		Eigen::VectorXd q_diag;
+		Eigen::SparseMatrix<double> q_mat;
+		Eigen::SparseMatrix<double> jac;
+		//the Marquardt IDENT scaling matrix, J*S and (JS)tQ(JS)
+		Eigen::SparseMatrix<double> S;
+		Eigen::SparseMatrix<double> JS;
+		Eigen::SparseMatrix<double> JStQJS;
+		//the factorization, for the solutions where lambda only shifts the singular values
+		Eigen::VectorXd Sigma;
+		Eigen::VectorXd Sigma_trunc;
+		Eigen::SparseMatrix<double> U;
+		Eigen::SparseMatrix<double> Vt;
+		//the residuals the projected residual U'JtQr was last formed for (jac_scale_single_svd)
+		Eigen::VectorXd resid;
+		Eigen::VectorXd proj_resid;
+		//the LSQR column scaling and the prior information (parcov) damping of each par
+		Eigen::VectorXd col_scale;
+		Eigen::VectorXd prior_damp;
+		//diag(JtQJ), the Marquardt scaling for the LSQR damping
+		Eigen::VectorXd jtqj_diag;
+	};
 
 	const static string svd_solver_type_name;
 	SVDPackage *svd_package;
@@ -130,7 +162,12 @@ protected:
 	double reg_frac;
 	Covariance parcov;
 	double parcov_scale_fac;
-	Eigen::SparseMatrix<double> JS;
+	int lsqr_max_iter;
+	double lsqr_tol;
+	int broyden_iters;  //max number of consecutive iterations that use a Broyden-updated jacobian
+	bool jac_scale_single_svd;  //one truncated SVD of JtQJ per iteration for the jac_scale lambda search
+	static const int max_upgrade_factors;
+	list<UpgradeFactors> upgrade_factors;
 	virtual void limit_parameters_ip(const Parameters &init_active_ctl_pars, Parameters &upgrade_active_ctl_pars,
 		LimitType &limit_type, const Parameters &frozen_ative_ctl_pars);
 	virtual Parameters limit_parameters_freeze_all_ip(const Parameters &init_active_ctl_pars,
@@ -145,6 +182,15 @@ protected:
 	void calc_upgrade_vec_freeze(double i_lambda, Parameters &frozen_ctl_pars, QSqrtMatrix &Q_sqrt, const DynamicRegularization &regul,
 		Eigen::VectorXd &residuals_vec, vector<string> &obs_names_vec, const Parameters &base_run_ctl_pars,
 		Parameters &new_ctl_pars, MarquardtMatrix marquardt_type, bool scale_upgrade = false);
+	UpgradeFactors& get_upgrade_factors(const Jacobian &jacobian, const QSqrtMatrix &Q_sqrt, const DynamicRegularization &regul,
+		const vector<string> &obs_name_vec, const vector<string> &numeric_par_names, MarquardtMatrix marquardt_type, MAT_INV solution);
+	void clear_upgrade_factors() { upgrade_factors.clear(); }
+	int lsqr(const UpgradeFactors &factors, const Eigen::VectorXd &damp, const Eigen::VectorXd &rhs, Eigen::VectorXd &x, int &itn);
+	void calc_lambda_upgrade_vec_lsqr(const Jacobian &jacobian, const QSqrtMatrix &Q_sqrt, const DynamicRegularization &regul,
+		const Eigen::VectorXd &Residuals, const vector<string> &obs_name_vec,
+		const Parameters &base_active_ctl_pars, const Parameters &freeze_active_ctl_pars,
+		double lambda, Parameters &active_ctl_upgrade_pars, Parameters &upgrade_active_ctl_del_pars,
+		Parameters &grad_active_ctl_del_pars, MarquardtMatrix marquardt_type, bool scale_upgrade);
 	void calc_lambda_upgrade_vecQ12J(const Jacobian &jacobian, const QSqrtMatrix &Q_sqrt, const DynamicRegularization &regul,
 		const Eigen::VectorXd &Residuals, const vector<string> &obs_name_vec,
 		const Parameters &base_active_ctl_pars, const Parameters &freeze_active_ctl_pars,
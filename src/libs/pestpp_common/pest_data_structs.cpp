@@ -300,6 +300,11 @@ ostream& operator<< (ostream &os, const PestppOptions& val)
 	os << "    super relparmax = " << left << setw(20) << val.get_super_relparmax() << endl;
 	os << "    max super frz iter = " << left << setw(20) << val.get_max_super_frz_iter() << endl;
 	os << "    mat inv = " << left << setw(20) << val.get_mat_inv() << endl;
+	if (val.get_mat_inv() == PestppOptions::LSQR)
+	{
+		os << "    lsqr max iter = " << left << setw(20) << val.get_lsqr_max_iter() << endl;
+		os << "    lsqr tol = " << left << setw(20) << val.get_lsqr_tol() << endl;
+	}
 	os << "    max run fail = " << left << setw(20) << val.get_max_run_fail() << endl;
 	os << "    max reg iter = " << left << setw(20) << val.get_max_reg_iter() << endl;
 	os << "    use jacobian scaling a la PEST? = ";
@@ -307,6 +312,14 @@ ostream& operator<< (ostream &os, const PestppOptions& val)
 		os << " yes" << endl;
 	else
 		os << " no" << endl;
+	if ((val.get_jac_scale()) && (val.get_jac_scale_single_svd()))
+		os << "    one SVD of JtQJ per iteration for the jacobian scaling (jac_scale_single_svd) = yes" << endl;
+	if (val.get_jac_broyden_iters() > 0)
+		os << "    max broyden jacobian updates between full jacobians = " << left << setw(20) << val.get_jac_broyden_iters() << endl;
+	if (val.get_jac_drop_tol() > 0.0)
+		os << "    jacobian drop tolerance = " << left << setw(20) << val.get_jac_drop_tol() << endl;
+	if (val.get_jac_num_threads() > 0)
+		os << "    jacobian derivative threads = " << left << setw(20) << val.get_jac_num_threads() << endl;
 	if (val.get_reg_frac() > 0.0)
 		os << "    regularization fraction of total phi = " << left << setw(10) << val.get_reg_frac() << endl;
 	os << "    lambdas = " << endl;
@@ -442,6 +455,7 @@ void PestppOptions::parce_line(const string &line)
 		}
 		else if (key == "MAT_INV"){
 			if (value == "Q1/2J") mat_inv = Q12J;
+			else if (value == "LSQR") mat_inv = LSQR;
 		}
 		else if (key == "MAX_RUN_FAIL"){
 			convert_ip(value, max_run_fail);
@@ -545,6 +559,32 @@ void PestppOptions::parce_line(const string &line)
 		{
 			convert_ip(value, overdue_giveup_minutes);
 		}
+		else if (key == "PANTHER_USE_EPOLL")
+		{
+			transform(value.begin(), value.end(), value.begin(), ::tolower);
+			istringstream is(value);
+			is >> boolalpha >> panther_use_epoll;
+		}
+		else if (key == "PANTHER_COMPRESS_RESULTS")
+		{
+			transform(value.begin(), value.end(), value.begin(), ::tolower);
+			istringstream is(value);
+			is >> boolalpha >> panther_compress_results;
+		}
+		else if (key == "PANTHER_MAX_BATCH_SIZE")
+		{
+			convert_ip(value, panther_max_batch_size);
+		}
+		else if (key == "PANTHER_SPECULATIVE_RUNS")
+		{
+			transform(value.begin(), value.end(), value.begin(), ::tolower);
+			istringstream is(value);
+			is >> boolalpha >> panther_speculative_runs;
+		}
+		else if (key == "LOCAL_RUN_THREADS")
+		{
+			convert_ip(value, local_run_threads);
+		}
 		else if (key == "CONDOR_SUBMIT_FILE")
 		{
 			//convert_ip(value, condor_submit_file);
@@ -604,6 +644,14 @@ void PestppOptions::parce_line(const string &line)
 		{
 			convert_ip(value, parcov_scale_fac);
 		}
+		else if (key == "LSQR_MAX_ITER")
+		{
+			convert_ip(value, lsqr_max_iter);
+		}
+		else if (key == "LSQR_TOL")
+		{
+			convert_ip(value, lsqr_tol);
+		}
 		else if (key == "JAC_SCALE")
 		{
 			transform(value.begin(), value.end(), value.begin(), ::tolower);
@@ -611,6 +659,24 @@ void PestppOptions::parce_line(const string &line)
 			is >> boolalpha >> jac_scale;
 
 		}
+		else if (key == "JAC_SCALE_SINGLE_SVD")
+		{
+			transform(value.begin(), value.end(), value.begin(), ::tolower);
+			istringstream is(value);
+			is >> boolalpha >> jac_scale_single_svd;
+		}
+		else if (key == "JAC_DROP_TOL")
+		{
+			convert_ip(value, jac_drop_tol);
+		}
+		else if (key == "JAC_NUM_THREADS")
+		{
+			convert_ip(value, jac_num_threads);
+		}
+		else if (key == "JAC_BROYDEN_ITERS")
+		{
+			convert_ip(value, jac_broyden_iters);
+		}
 
 		else if (key == "UPGRADE_AUGMENT")
 		{
@@ -891,6 +957,9 @@ void PestppOptions::parce_line(const string &line)
 		else if (key == "YAMR_POLL_INTERVAL") {
 			//doesn't apply here
 		}
+		else if (key == "PANTHER_AGENT_SLOTS") {
+			//doesn't apply here
+		}
 		else if (key == "IES_LOCALIZER")
 		{
 			//convert_ip(value, ies_localizer);
@@ -974,6 +1043,28 @@ void PestppOptions::parce_line(const string &line)
 		{
 			convert_ip(value, ies_autoadaloc_sigma_dist);
 		}
+		else if (key == "IES_RACE_LAMBDAS")
+		{
+			transform(value.begin(), value.end(), value.begin(), ::tolower);
+			istringstream is(value);
+			is >> boolalpha >> ies_race_lambdas;
+		}
+		else if (key == "IES_RACE_SIGMA")
+		{
+			convert_ip(value, ies_race_sigma);
+		}
+		else if (key == "IES_ENSEMBLE_STORE")
+		{
+			transform(value.begin(), value.end(), value.begin(), ::tolower);
+			istringstream is(value);
+			is >> boolalpha >> ies_ensemble_store;
+		}
+		else if (key == "IES_SAVE_DENSE")
+		{
+			transform(value.begin(), value.end(), value.begin(), ::tolower);
+			istringstream is(value);
+			is >> boolalpha >> ies_save_dense;
+		}
 
 		else {
 
@@ -214,7 +214,7 @@ public:
 class PestppOptions {
 public:
 	enum SVD_PACK { EIGEN, PROPACK, REDSVD };
-	enum MAT_INV { Q12J, JTQJ };
+	enum MAT_INV { Q12J, JTQJ, LSQR };
 	enum GLOBAL_OPT { NONE, OPT_DE };
 	PestppOptions(int _n_iter_base = 50, int _n_iter_super = 0, int _max_n_super = 50,
 		double _super_eigthres = 1.0E-6, SVD_PACK _svd_pack = PestppOptions::REDSVD,
@@ -293,10 +293,23 @@ public:
 	void set_parcov_scale_fac(double _fac) { parcov_scale_fac = _fac; }
 	bool get_jac_scale()const { return jac_scale; }
 	void set_jac_scale(bool _jac_scale) { jac_scale = _jac_scale; }
+	bool get_jac_scale_single_svd()const { return jac_scale_single_svd; }
+	void set_jac_scale_single_svd(bool _single_svd) { jac_scale_single_svd = _single_svd; }
+	double get_jac_drop_tol() const { return jac_drop_tol; }
+	void set_jac_drop_tol(double _tol) { jac_drop_tol = _tol; }
+	int get_jac_num_threads() const { return jac_num_threads; }
+	void set_jac_num_threads(int _threads) { jac_num_threads = _threads; }
 
 	bool get_upgrade_augment()const { return upgrade_augment; }
 	void set_upgrade_augment(bool _upgrade_augment) { upgrade_augment = _upgrade_augment; }
 
+	int get_lsqr_max_iter() const { return lsqr_max_iter; }
+	void set_lsqr_max_iter(int _max_iter) { lsqr_max_iter = _max_iter; }
+	double get_lsqr_tol() const { return lsqr_tol; }
+	void set_lsqr_tol(double _tol) { lsqr_tol = _tol; }
+	int get_jac_broyden_iters() const { return jac_broyden_iters; }
+	void set_jac_broyden_iters(int _iters) { jac_broyden_iters = _iters; }
+
 	void set_hotstart_resfile(string _res_file) { hotstart_resfile = _res_file; }
 	string get_hotstart_resfile() const { return hotstart_resfile; }
 
@@ -399,6 +412,16 @@ public:
 
 	double get_overdue_giveup_minutes() const { return overdue_giveup_minutes; }
 	void set_overdue_giveup_minutes(double overdue_minutes) { overdue_giveup_minutes = overdue_minutes; }
+	bool get_panther_use_epoll() const { return panther_use_epoll; }
+	void set_panther_use_epoll(bool _flag) { panther_use_epoll = _flag; }
+	bool get_panther_compress_results() const { return panther_compress_results; }
+	void set_panther_compress_results(bool _flag) { panther_compress_results = _flag; }
+	int get_panther_max_batch_size() const { return panther_max_batch_size; }
+	void set_panther_max_batch_size(int _size) { panther_max_batch_size = _size; }
+	bool get_panther_speculative_runs() const { return panther_speculative_runs; }
+	void set_panther_speculative_runs(bool _flag) { panther_speculative_runs = _flag; }
+	int get_local_run_threads() const { return local_run_threads; }
+	void set_local_run_threads(int _threads) { local_run_threads = _threads; }
 
 	int get_ies_num_threads() const { return ies_num_threads; }
 	void set_ies_num_threads(int _threads) { ies_num_threads = _threads; }
@@ -417,6 +440,14 @@ public:
 	void set_ies_autoadaloc(bool _flag) { ies_autoadaloc = _flag; }
 	double get_ies_autoadaloc_sigma_dist() const { return ies_autoadaloc_sigma_dist; }
 	void set_ies_autoadaloc_sigma_dist(double _dist) { ies_autoadaloc_sigma_dist = _dist; }
+	bool get_ies_race_lambdas() const { return ies_race_lambdas; }
+	void set_ies_race_lambdas(bool _flag) { ies_race_lambdas = _flag; }
+	double get_ies_race_sigma() const { return ies_race_sigma; }
+	void set_ies_race_sigma(double _sigma) { ies_race_sigma = _sigma; }
+	bool get_ies_ensemble_store() const { return ies_ensemble_store; }
+	void set_ies_ensemble_store(bool _flag) { ies_ensemble_store = _flag; }
+	bool get_ies_save_dense() const { return ies_save_dense; }
+	void set_ies_save_dense(bool _flag) { ies_save_dense = _flag; }
 	
 
 
@@ -448,6 +479,11 @@ private:
 	double overdue_giveup_fac;
 	double overdue_giveup_minutes;
 	string condor_submit_file;
+	bool panther_use_epoll;
+	bool panther_compress_results;
+	int panther_max_batch_size;
+	bool panther_speculative_runs;
+	int local_run_threads;
 	double reg_frac;
 
 	string sweep_parameter_csv_file;
@@ -458,7 +494,13 @@ private:
 	//bool use_parcov_scaling;
 	double parcov_scale_fac;
 	bool jac_scale;
+	bool jac_scale_single_svd;
+	double jac_drop_tol;
+	int jac_num_threads;
 	bool upgrade_augment;
+	int lsqr_max_iter;
+	double lsqr_tol;
+	int jac_broyden_iters;
 	string upgrade_bounds;
 	string hotstart_resfile;
 
@@ -525,6 +567,10 @@ private:
 	bool ies_csv_by_reals;
 	bool ies_autoadaloc;
 	double ies_autoadaloc_sigma_dist;
+	bool ies_race_lambdas;
+	double ies_race_sigma;
+	bool ies_ensemble_store;
+	bool ies_save_dense;
 };
 
 ostream& operator<< (ostream &os, const PestppOptions& val);
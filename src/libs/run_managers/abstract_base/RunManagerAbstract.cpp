@@ -24,6 +24,7 @@
 #include <iterator>
 #include <cassert>
 #include <cstring>
+#include <unordered_map>
 #include "Transformable.h"
 #include "utilities.h"
 
@@ -47,11 +48,13 @@ RunManagerAbstract::RunManagerAbstract(const vector<string> _comline_vec,
 void RunManagerAbstract::initialize(const Parameters &model_pars, const Observations &obs, const string &_filename)
 {
 	file_stor.reset(model_pars.get_keys(), obs.get_keys(), _filename);
+	clear_completed_runs();
 }
 
 void RunManagerAbstract::initialize(const std::vector<std::string> &par_names, std::vector<std::string> &obs_names, const string &_filename)
 {
 	file_stor.reset(par_names, obs_names, _filename);
+	clear_completed_runs();
 }
 
 void RunManagerAbstract::reinitialize(const string &_filename)
@@ -59,12 +62,14 @@ void RunManagerAbstract::reinitialize(const string &_filename)
 	vector<string> par_names = get_par_name_vec();
 	vector<string> obs_names = get_obs_name_vec();
 	file_stor.reset(par_names, obs_names, _filename);
+	clear_completed_runs();
 }
 
 void RunManagerAbstract::initialize_restart(const std::string &_filename)
 {
 
 	file_stor.init_restart(_filename);
+	clear_completed_runs();
 }
 
 int RunManagerAbstract::add_run(const vector<double> &model_pars, const string &info_txt, double info_value)
@@ -164,6 +169,66 @@ bool  RunManagerAbstract::get_run(int run_id, double *pars, size_t npars, double
 	return get_run(run_id, pars, npars, obs, nobs, info_txt, info_value);
 }
 
+void RunManagerAbstract::get_runs(const vector<int> &run_ids, const vector<string> &obs_names, Eigen::MatrixXd &obs_mat, vector<bool> &failed_mask)
+{
+	//fill one row of obs_mat per run id, with the columns ordered as obs_names.  Rows of
+	//unsuccessful runs are filled with no_data and flagged in failed_mask
+	const vector<string> &stor_obs_names = file_stor.get_obs_name_vec();
+	size_t n_stor_obs = stor_obs_names.size();
+	vector<size_t> col_idx;
+	bool same_order = (obs_names == stor_obs_names);
+	if (!same_order)
+	{
+		unordered_map<string, size_t> stor_idx;
+		for (size_t i = 0; i < n_stor_obs; ++i)
+			stor_idx[stor_obs_names[i]] = i;
+		col_idx.reserve(obs_names.size());
+		for (auto &oname : obs_names)
+		{
+			auto it = stor_idx.find(oname);
+			if (it == stor_idx.end())
+				throw PestError("RunManagerAbstract::get_runs(): observation '" + oname + "' not found in run storage");
+			col_idx.push_back(it->second);
+		}
+	}
+
+	size_t n_runs = run_ids.size();
+	obs_mat.resize(n_runs, obs_names.size());
+	failed_mask.assign(n_runs, false);
+	//read the storage in chunks to bound the size of the temporary buffer
+	size_t chunk_size = max(size_t(1), size_t(8000000) / max(n_stor_obs, size_t(1)));
+	vector<double> block;
+	vector<int> run_status;
+	typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMatrix;
+	for (size_t start = 0; start < n_runs; start += chunk_size)
+	{
+		size_t n_chunk = min(chunk_size, n_runs - start);
+		vector<int> chunk_ids(run_ids.begin() + start, run_ids.begin() + start + n_chunk);
+		block.resize(n_chunk * n_stor_obs);
+		file_stor.get_observations_block(chunk_ids, block.data(), run_status);
+		if (same_order)
+		{
+			obs_mat.middleRows(start, n_chunk) = Eigen::Map<RowMatrix>(block.data(), n_chunk, n_stor_obs);
+		}
+		else
+		{
+			for (size_t i = 0; i < n_chunk; ++i)
+			{
+				const double *rec = block.data() + i * n_stor_obs;
+				for (size_t j = 0; j < col_idx.size(); ++j)
+					obs_mat(start + i, j) = rec[col_idx[j]];
+			}
+		}
+		for (size_t i = 0; i < n_chunk; ++i)
+		{
+			if (run_status[i] <= 0)
+			{
+				failed_mask[start + i] = true;
+				obs_mat.row(start + i).setConstant(RunStorage::no_data);
+			}
+		}
+	}
+}
 
 void  RunManagerAbstract::free_memory()
 {
@@ -255,7 +320,7 @@ bool RunManagerAbstract::get_observations_vec(int run_id, vector<double> &data_v
  {
 	 bool ret_val;
 	 int istatus = file_stor.get_run_status(run_id);
-	 if (istatus <=0 && istatus > -max_n_failure)
+	 if (istatus <=0 && istatus > -max_n_failure && istatus != RunStorage::canceled_status)
 	 {
 		 ret_val = true;
 	 }
@@ -293,5 +358,54 @@ bool RunManagerAbstract::get_observations_vec(int run_id, vector<double> &data_v
  RunManagerAbstract::RUN_UNTIL_COND RunManagerAbstract::run_until(RUN_UNTIL_COND condition, int n_nops, double sec)
  {
 	 run();
+	 report_completed_runs();
 	 return RUN_UNTIL_COND::NORMAL;
  }
+
+ void RunManagerAbstract::cancel_run(int run_id)
+ {
+	 if (!run_requried(run_id))
+		 return;
+	 file_stor.update_run_canceled(run_id);
+	 report_completed_run(run_id);
+ }
+
+ bool RunManagerAbstract::run_canceled(int run_id)
+ {
+	 return file_stor.get_run_status(run_id) == RunStorage::canceled_status;
+ }
+
+ vector<int> RunManagerAbstract::pop_completed_runs()
+ {
+	 //runs that have finished (or have used up all their attempts) since the last call.
+	 //Use with run_until() to process results while the rest of the runs are still going
+	 vector<int> run_ids(completed_runs.begin(), completed_runs.end());
+	 completed_runs.clear();
+	 return run_ids;
+ }
+
+ void RunManagerAbstract::report_completed_run(int run_id)
+ {
+	 if (!reported_runs.insert(run_id).second)
+		 return;
+	 completed_runs.push_back(run_id);
+	 if (run_complete_callback)
+		 run_complete_callback(run_id, file_stor.get_run_status(run_id) > 0);
+ }
+
+ void RunManagerAbstract::report_completed_runs()
+ {
+	 //sweep the run storage for completed runs that have not been reported yet
+	 int n_runs = file_stor.get_nruns();
+	 for (int id = 0; id < n_runs; ++id)
+	 {
+		 if (!run_requried(id))
+			 report_completed_run(id);
+	 }
+ }
+
+ void RunManagerAbstract::clear_completed_runs()
+ {
+	 completed_runs.clear();
+	 reported_runs.clear();
+ }
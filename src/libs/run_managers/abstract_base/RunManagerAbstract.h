@@ -22,6 +22,8 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <deque>
+#include <functional>
 #include "RunStorage.h"
 #include <Eigen/Dense>
 #include <chrono>
@@ -36,6 +38,8 @@ class RunManagerAbstract
 {
 public:
 	enum class RUN_UNTIL_COND { NORMAL, NO_OPS, TIME, NO_OPS_OR_TIME };
+	// called once for each run that has finished or has permanently failed
+	typedef std::function<void(int run_id, bool success)> RunCompleteCallback;
 	RunManagerAbstract(const std::vector<std::string> _comline_vec,
 		const std::vector<std::string> _tplfile_vec, const std::vector<std::string> _inpfile_vec,
 		const std::vector<std::string> _insfile_vec, const std::vector<std::string> _outfile_vec,
@@ -51,6 +55,11 @@ public:
 	virtual void update_run(int run_id, const Parameters &pars, const Observations &obs);
 	virtual void run() = 0;
 	virtual RunManagerAbstract::RUN_UNTIL_COND run_until(RUN_UNTIL_COND condition, int n_nops = 0, double sec = 0.0);
+	virtual std::vector<int> pop_completed_runs();
+	//the run is no longer needed.  If it has not finished it is not started (or is stopped if it is
+	//already going) and it is reported as completed, without results, by pop_completed_runs()
+	virtual void cancel_run(int run_id);
+	virtual void set_run_complete_callback(RunCompleteCallback _callback) { run_complete_callback = _callback; }
 	virtual const std::vector<std::string> &get_par_name_vec() const;
 	virtual const std::vector<std::string> &get_obs_name_vec() const;
 	virtual void get_info(int run_id, int &run_status, std::string &info_txt, double &info_value);
@@ -61,6 +70,7 @@ public:
 	virtual bool get_run(int run_id, double *pars, size_t npars, double *obs, size_t nobs);
 	virtual bool get_run(int run_id, std::vector<double> &pars_vec, std::vector<double> &obs_vec, std::string &info_txt, double &info_value);
 	virtual bool get_run(int run_id, std::vector<double> &pars_vec, std::vector<double> &obs_vec);
+	virtual void get_runs(const std::vector<int> &run_ids, const std::vector<std::string> &obs_names, Eigen::MatrixXd &obs_mat, std::vector<bool> &failed_mask);
 	virtual const std::set<int> get_failed_run_ids();
 	virtual bool get_model_parameters(int run_num, Parameters &pars);
 	virtual bool get_observations_vec(int run_id, std::vector<double> &data_vec);
@@ -88,7 +98,14 @@ protected:
 	std::vector<std::string> inpfile_vec;
 	std::vector<std::string> insfile_vec;
 	std::vector<std::string> outfile_vec;
+	std::deque<int> completed_runs; // finished and failed runs that have not been returned by pop_completed_runs() yet
+	std::set<int> reported_runs; // every run that has been put in completed_runs since the last (re)initialize
+	RunCompleteCallback run_complete_callback;
 	bool run_requried(int run_id);
+	bool run_canceled(int run_id);
+	void report_completed_run(int run_id);
+	void report_completed_runs();
+	void clear_completed_runs();
 	//Observations init_run_obs;
 	std::vector<double> init_sim;
 	virtual void update_run_failed(int run_id);
@@ -24,18 +24,27 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cstring>
+#include "config_os.h"
 #include "RunStorage.h"
 #include "Serialization.h"
 #include "Transformable.h"
 #include <limits>
+#ifdef OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 using std::numeric_limits;
 
 using namespace std;
 
 const double RunStorage::no_data = -9999.0;
+const int RunStorage::canceled_status = -100;
 
-RunStorage::RunStorage(const string &_filename) :filename(_filename), run_byte_size(0)
+RunStorage::RunStorage(const string &_filename) :filename(_filename), run_byte_size(0), map_ptr(nullptr), map_size(0)
 {
 }
 
@@ -50,6 +59,7 @@ void RunStorage::reset(const vector<string> &_par_names, const vector<string> &_
 	{
 		filename = _filename;
 	}
+	unmap();
 	if (buf_stream.is_open())
 	{
 		buf_stream.close();
@@ -100,6 +110,7 @@ void RunStorage::init_restart(const std::string &_filename)
 	par_names.clear();
 	obs_names.clear();
 
+	unmap();
 	if (buf_stream.is_open())
 	{
 		buf_stream.close();
@@ -283,6 +294,7 @@ int RunStorage::add_run(const Parameters &pars, const string &info_txt, double i
 
 void RunStorage::copy(const RunStorage &rhs_rs)
 {
+	unmap();
 	if (buf_stream.is_open())
 	{
 		buf_stream.close();
@@ -427,7 +439,8 @@ void RunStorage::update_run(int run_id, const vector<char> serial_data)
 void RunStorage::update_run_failed(int run_id)
 {
 	std::int8_t r_status = get_run_status_native(run_id);
-	if (r_status < 1)
+	//a canceled run that is abandoned by the run manager is not counted as a failure
+	if (r_status < 1 && r_status > canceled_status)
 	{
 		--r_status;
 		check_rec_id(run_id);
@@ -438,6 +451,16 @@ void RunStorage::update_run_failed(int run_id)
 	}
 }
 
+void RunStorage::update_run_canceled(int run_id)
+{
+	std::int8_t r_status = canceled_status;
+	check_rec_id(run_id);
+	//update run status flag
+	buf_stream.seekp(get_stream_pos(run_id), ios_base::beg);
+	buf_stream.write(reinterpret_cast<char*>(&r_status), sizeof(r_status));
+	buf_stream.flush();
+}
+
 void RunStorage::set_run_nfailed(int run_id, int nfail)
 {
 	std::int8_t r_status = -nfail;
@@ -661,8 +684,150 @@ int  RunStorage::get_observations_vec(int run_id, vector<double> &obs_data)
 	return status;
 }
 
+void RunStorage::get_parameters_block(const vector<int> &run_ids, double *par_data, vector<int> &run_status)
+{
+	read_block(run_ids, 0, par_names.size(), par_data, run_status);
+}
+
+void RunStorage::get_observations_block(const vector<int> &run_ids, double *obs_data, vector<int> &run_status)
+{
+	read_block(run_ids, run_par_byte_size, obs_names.size(), obs_data, run_status);
+}
+
+void RunStorage::get_runs_block(const vector<int> &run_ids, double *par_data, double *obs_data, vector<int> &run_status)
+{
+	read_block(run_ids, 0, par_names.size(), par_data, run_status);
+	read_block(run_ids, run_par_byte_size, obs_names.size(), obs_data, run_status);
+}
+
+void RunStorage::update_runs(const vector<int> &run_ids, const double *par_data, const double *obs_data)
+{
+	// The per-run double buffer used by update_run() is not needed here.  All of the
+	// data is written and flushed before any status flag is set, so an interrupted block
+	// update leaves the affected runs flagged as incomplete and they are simply rerun.
+	if (run_ids.empty())
+	{
+		return;
+	}
+	check_rec_id(*max_element(run_ids.begin(), run_ids.end()));
+	size_t n_par = par_names.size();
+	size_t n_obs = obs_names.size();
+	streamoff data_skip = sizeof(std::int8_t) + sizeof(char)*info_txt_length + sizeof(double);
+	for (size_t i = 0; i < run_ids.size(); ++i)
+	{
+		buf_stream.seekp(get_stream_pos(run_ids[i]) + data_skip, ios_base::beg);
+		if (par_data != nullptr)
+		{
+			buf_stream.write(reinterpret_cast<const char*>(par_data + i * n_par), n_par * sizeof(double));
+		}
+		else
+		{
+			buf_stream.seekp(n_par * sizeof(double), ios_base::cur);
+		}
+		buf_stream.write(reinterpret_cast<const char*>(obs_data + i * n_obs), n_obs * sizeof(double));
+	}
+	buf_stream.flush();
+	std::int8_t r_status = 1;
+	for (int run_id : run_ids)
+	{
+		buf_stream.seekp(get_stream_pos(run_id), ios_base::beg);
+		buf_stream.write(reinterpret_cast<char*>(&r_status), sizeof(r_status));
+	}
+	buf_stream.flush();
+}
+
+void RunStorage::read_block(const vector<int> &run_ids, streamoff data_offset, size_t n_vals, double *data, vector<int> &run_status)
+{
+	run_status.resize(run_ids.size());
+	if (run_ids.empty())
+	{
+		return;
+	}
+	int max_id = *max_element(run_ids.begin(), run_ids.end());
+	check_rec_id(max_id);
+	buf_stream.flush();
+	streamoff data_skip = sizeof(std::int8_t) + sizeof(char)*info_txt_length + sizeof(double) + data_offset;
+	size_t n_bytes = n_vals * sizeof(double);
+	//map the file out to the last requested record once, rather than once per run
+	bool use_map = (get_mapped_record(max_id) != nullptr);
+	for (size_t i = 0; i < run_ids.size(); ++i)
+	{
+		int run_id = run_ids[i];
+		if (run_id < 0)
+		{
+			throw PestIndexError("RunStorage::read_block(): negative run id");
+		}
+		double *dest = data + i * n_vals;
+		if (use_map)
+		{
+			// records are not aligned on double boundaries, so copy rather than cast
+			const char *rec = map_ptr + get_stream_pos(run_id);
+			run_status[i] = *reinterpret_cast<const std::int8_t*>(rec);
+			memcpy(dest, rec + data_skip, n_bytes);
+		}
+		else
+		{
+			std::int8_t r_status;
+			buf_stream.seekg(get_stream_pos(run_id), ios_base::beg);
+			buf_stream.read(reinterpret_cast<char*>(&r_status), sizeof(r_status));
+			buf_stream.seekg(data_skip - sizeof(r_status), ios_base::cur);
+			buf_stream.read(reinterpret_cast<char*>(dest), n_bytes);
+			run_status[i] = r_status;
+		}
+	}
+}
+
+const char* RunStorage::get_mapped_record(int run_id)
+{
+#ifdef OS_LINUX
+	size_t rec_end = get_stream_pos(run_id) + sizeof(std::int8_t) + sizeof(char)*info_txt_length
+		+ sizeof(double) + run_data_byte_size;
+	if (map_ptr == nullptr || rec_end > map_size)
+	{
+		//the file has grown since it was last mapped
+		unmap();
+		buf_stream.flush();
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return nullptr;
+		}
+		struct stat f_stat;
+		if (fstat(fd, &f_stat) != 0 || size_t(f_stat.st_size) < rec_end)
+		{
+			close(fd);
+			return nullptr;
+		}
+		void *ptr = mmap(nullptr, f_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (ptr == MAP_FAILED)
+		{
+			return nullptr;
+		}
+		map_ptr = static_cast<char*>(ptr);
+		map_size = f_stat.st_size;
+	}
+	return map_ptr + get_stream_pos(run_id);
+#else
+	return nullptr;
+#endif
+}
+
+void RunStorage::unmap()
+{
+#ifdef OS_LINUX
+	if (map_ptr != nullptr)
+	{
+		munmap(map_ptr, map_size);
+	}
+#endif
+	map_ptr = nullptr;
+	map_size = 0;
+}
+
 void RunStorage::free_memory()
 {
+	unmap();
 	if (buf_stream.is_open()) {
 		buf_stream.close();
 		remove(filename.c_str());
@@ -793,5 +958,6 @@ void RunStorage::export_diff_to_text_file(const std::string &in1_filename, const
 
 RunStorage::~RunStorage()
 {
+  unmap();
   //free_memory();
 }
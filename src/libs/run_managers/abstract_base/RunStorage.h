@@ -49,9 +49,14 @@ class RunStorage {
 	//                   depends on the type of model run being stored  )
 	//       parameter_values  (parameters values for model runs)                     double*number of parameters
 	//       observationn_values( observations results produced by the model run)     double*number of observations
+	//
+	//   On Linux and OSX the file is also mapped read-only into memory so that blocks of runs can be
+	//   copied out with memcpy instead of a seekg/read pair per record.  All writes still go through
+	//   buf_stream and are flushed before the mapping is used, so both views of the file stay coherent.
 
 public:
 	static const double no_data;
+	static const int canceled_status;
 	RunStorage(const std::string &_filename);
 	void reset(const std::vector<std::string> &par_names, const std::vector<std::string> &obs_names, const std::string &_filename = std::string(""));
 	void init_restart(const std::string &_filename);
@@ -63,6 +68,7 @@ public:
 	void update_run(int run_id, const Observations &obs);
 	void update_run(int run_id, const std::vector<char> serial_data);
 	void update_run_failed(int run_id);
+	void update_run_canceled(int run_id);
 	void set_run_nfailed(int run_id, int nfail);
 	int get_nruns();
 	int get_num_good_runs();
@@ -82,6 +88,11 @@ public:
 	std::vector<char> get_serial_pars(int run_id);
 	int get_observations_vec(int run_id, std::vector<double> &data_vec);
 	int get_observations(int run_id, Observations &obs);
+	//block access:  run k of run_ids is stored contiguously starting at data + k * (number of pars or obs)
+	void get_parameters_block(const std::vector<int> &run_ids, double *par_data, std::vector<int> &run_status);
+	void get_observations_block(const std::vector<int> &run_ids, double *obs_data, std::vector<int> &run_status);
+	void get_runs_block(const std::vector<int> &run_ids, double *par_data, double *obs_data, std::vector<int> &run_status);
+	void update_runs(const std::vector<int> &run_ids, const double *par_data, const double *obs_data);
 	static void export_diff_to_text_file(const std::string &in1_filename, const std::string &in2_filename, const std::string &out_filename);
 	void free_memory();
 	std::string get_filename() { return filename; }
@@ -97,6 +108,11 @@ private:
 	std::streamoff run_data_byte_size;
 	std::vector<std::string> par_names;
 	std::vector<std::string> obs_names;
+	char *map_ptr;
+	std::size_t map_size;
+	const char* get_mapped_record(int run_id);
+	void unmap();
+	void read_block(const std::vector<int> &run_ids, std::streamoff data_offset, std::size_t n_vals, double *data, std::vector<int> &run_status);
 	void check_rec_size(const std::vector<char> &serial_data) const;
 	void check_rec_id(int run_id);
 	std::int8_t get_run_status_native(int run_id);
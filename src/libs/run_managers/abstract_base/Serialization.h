@@ -37,6 +37,7 @@ public:
 	static std::vector<int8_t> serialize(const std::vector<Transformable*> &tr_vec);
 	static std::vector<int8_t> serialize(const Parameters &pars, const Observations &obs);
 	static std::vector<int8_t> serialize(const Parameters &pars, const std::vector<std::string> &par_names_vec, const Observations &obs, const std::vector<std::string> &obs_names_vec, double run_time);
+	static std::vector<int8_t> serialize(const std::vector<double> &par_vals, const std::vector<double> &obs_vals, double run_time);
 	static std::vector<int8_t> serialize(const std::vector<std::string> &string_vec);
 	static std::vector<int8_t> serialize(const std::vector<std::vector<std::string> const*> &string_vec_vec);
 	static unsigned long unserialize(const std::vector<int8_t> &ser_data, int64_t &data, unsigned long start_loc = 0);
@@ -46,6 +47,9 @@ public:
 	static unsigned long unserialize(const std::vector<int8_t> &ser_data, std::vector<std::string> &string_vec, unsigned long start_loc = 0, unsigned long max_read_bytes = ULONG_MAX);
 	static unsigned long unserialize(const std::vector<int8_t> &ser_data, Transformable &items, const std::vector<std::string> &names_vec, unsigned long start_loc = 0);
 	static unsigned long unserialize(const std::vector<int8_t> &ser_data, Parameters &pars, const std::vector<std::string> &par_names, Observations &obs, const std::vector<std::string> &obs_names, double &run_time);
+	//lossless compression of a packed double buffer (each value xor'ed with the previous one, zero bytes dropped)
+	static std::vector<int8_t> compress_doubles(const std::vector<int8_t> &raw_data);
+	static std::vector<int8_t> uncompress_doubles(const std::vector<int8_t> &comp_data);
 private:
 };
 
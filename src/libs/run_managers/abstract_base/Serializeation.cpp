@@ -22,6 +22,8 @@
 #include <sstream>
 #include <memory>
 #include <cassert>
+#include <cstring>
+#include <stdexcept>
 #include "Serialization.h"
 #include "Transformable.h"
 #include "utilities.h"
@@ -147,6 +149,21 @@ vector<int8_t> Serialization::serialize(const Parameters &pars, const vector<str
 	return serial_data;
 }
 
+vector<int8_t> Serialization::serialize(const vector<double> &par_vals, const vector<double> &obs_vals, double run_time)
+{
+	//same layout as serialize(pars, par_names_vec, obs, obs_names_vec, run_time) but without the name lookups
+	size_t par_buf_sz = par_vals.size() * sizeof(double);
+	size_t obs_buf_sz = obs_vals.size() * sizeof(double);
+	size_t run_time_sz = sizeof(double);
+	vector<int8_t> serial_data(par_buf_sz + obs_buf_sz + run_time_sz);
+
+	int8_t *buf = &serial_data[0];
+	if (par_buf_sz > 0) w_memcpy_s(buf, par_buf_sz, par_vals.data(), par_buf_sz);
+	if (obs_buf_sz > 0) w_memcpy_s(buf + par_buf_sz, obs_buf_sz, obs_vals.data(), obs_buf_sz);
+	w_memcpy_s(buf + par_buf_sz + obs_buf_sz, run_time_sz, &run_time, sizeof(double));
+	return serial_data;
+}
+
 vector<int8_t> Serialization::serialize(const vector<string> &string_vec)
 {
 	vector<int8_t> serial_data;
@@ -278,3 +295,92 @@ unsigned long Serialization::unserialize(const vector<int8_t> &ser_data, Paramet
 	w_memcpy_s(&run_time, sizeof(double), ser_data.data() + bytes_read, sizeof(double));
 	return bytes_read;
 }
+
+vector<int8_t> Serialization::compress_doubles(const vector<int8_t> &raw_data)
+{
+	// Layout: int64 length of the raw data followed by one record per 8 byte word.  Each word is
+	// xor'ed with the previous word so repeated and slowly varying values leave mostly zero bytes.
+	// A record is a control byte with bit k set if byte k of the xor'ed word is non-zero, followed
+	// by the non-zero bytes. Any trailing bytes that do not fill a word are copied as is.
+	int64_t raw_sz = raw_data.size();
+	size_t n_words = raw_data.size() / sizeof(uint64_t);
+	vector<int8_t> comp_data;
+	comp_data.reserve(sizeof(raw_sz) + n_words * 3 + sizeof(uint64_t));
+	comp_data.resize(sizeof(raw_sz));
+	w_memcpy_s(&comp_data[0], sizeof(raw_sz), &raw_sz, sizeof(raw_sz));
+	uint64_t prev = 0;
+	uint64_t cur;
+	uint8_t bytes[sizeof(uint64_t)];
+	for (size_t i = 0; i < n_words; ++i)
+	{
+		memcpy(&cur, raw_data.data() + i * sizeof(uint64_t), sizeof(uint64_t));
+		uint64_t x = cur ^ prev;
+		prev = cur;
+		uint8_t ctrl = 0;
+		int n_bytes = 0;
+		for (int k = 0; k < 8; ++k)
+		{
+			uint8_t b = (uint8_t)(x >> (8 * k));
+			if (b != 0)
+			{
+				ctrl |= (uint8_t)(1 << k);
+				bytes[n_bytes++] = b;
+			}
+		}
+		comp_data.push_back((int8_t)ctrl);
+		comp_data.insert(comp_data.end(), (int8_t*)bytes, (int8_t*)bytes + n_bytes);
+	}
+	comp_data.insert(comp_data.end(), raw_data.begin() + n_words * sizeof(uint64_t), raw_data.end());
+	return comp_data;
+}
+
+vector<int8_t> Serialization::uncompress_doubles(const vector<int8_t> &comp_data)
+{
+	int64_t raw_sz;
+	if (comp_data.size() < sizeof(raw_sz))
+	{
+		throw runtime_error("Serialization::uncompress_doubles(): compressed buffer is too short");
+	}
+	w_memcpy_s(&raw_sz, sizeof(raw_sz), comp_data.data(), sizeof(raw_sz));
+	if (raw_sz < 0)
+	{
+		throw runtime_error("Serialization::uncompress_doubles(): invalid uncompressed size");
+	}
+	vector<int8_t> raw_data(raw_sz);
+	size_t n_words = raw_data.size() / sizeof(uint64_t);
+	size_t i_comp = sizeof(raw_sz);
+	size_t comp_sz = comp_data.size();
+	uint64_t prev = 0;
+	for (size_t i = 0; i < n_words; ++i)
+	{
+		if (i_comp >= comp_sz)
+		{
+			throw runtime_error("Serialization::uncompress_doubles(): compressed buffer is truncated");
+		}
+		uint8_t ctrl = (uint8_t)comp_data[i_comp++];
+		uint64_t x = 0;
+		for (int k = 0; k < 8; ++k)
+		{
+			if (ctrl & (1 << k))
+			{
+				if (i_comp >= comp_sz)
+				{
+					throw runtime_error("Serialization::uncompress_doubles(): compressed buffer is truncated");
+				}
+				x |= ((uint64_t)(uint8_t)comp_data[i_comp++]) << (8 * k);
+			}
+		}
+		prev ^= x;
+		memcpy(raw_data.data() + i * sizeof(uint64_t), &prev, sizeof(uint64_t));
+	}
+	size_t n_tail = raw_data.size() - n_words * sizeof(uint64_t);
+	if (comp_sz - i_comp != n_tail)
+	{
+		throw runtime_error("Serialization::uncompress_doubles(): compressed buffer size mismatch");
+	}
+	if (n_tail > 0)
+	{
+		w_memcpy_s(raw_data.data() + n_words * sizeof(uint64_t), n_tail, comp_data.data() + i_comp, n_tail);
+	}
+	return raw_data;
+}
@@ -12,90 +12,11 @@
 
 using namespace std;
 
-extern "C"
-{
-	void mio_initialise_w_(int *, int *, int *, int *, int *);
-	void mio_put_file_w_(int *, int *, int *, char *, long *);
-	void mio_get_file_w_(int *, int *, int *, char *);
-	void mio_store_instruction_set_w_(int *);
-	void mio_process_template_files_w_(int *, int *, char *);
-	void mio_delete_output_files_w_(int *, char *);
-	void mio_write_model_input_files_w_(int *, int *, char *, double *);
-	void mio_read_model_output_files_w_(int *, int *, char *, double *);
-	void mio_finalise_w_(int *);
-	void mio_get_status_w_(int *, int *);
-	void mio_get_dimensions_w_(int *, int *);
-	void mio_get_message_string_w_(int *, int *, char *);
-
-}
-
-
-void ModelInterface::throw_mio_error(string base_message)
-{
-	int mess_len = 500;
-	char message[500];
-	int nerr_len = 500;
-	char err_instruct[500];
-	for (int i = 0; i < 500; i++)
-		err_instruct[i] = ' ';
-	//cout << endl << endl << " MODEL INTERFACE ERROR:" << endl;
-	mio_get_message_string_w_(&ifail, &mess_len, message);
-	string err = string(message);
-	auto s_end = err.find_last_not_of(" \t", 500);
-	err = err.substr(0, s_end);
-	throw runtime_error("model input/output error:" + base_message + "\n" + err);
-}
-
+const int ModelInterface::MAX_PAR_WIDTH = 1000;
 
-void ModelInterface::set_files()
+void ModelInterface::throw_model_io_error(const string &base_message, const string &detail)
 {
-	//put template files
-	int inum = 1;
-	int itype = 1;
-	for (auto &file : tplfile_vec)
-	{
-		long f_name_len = 180;
-		vector<char> f_name = pest_utils::string_as_fortran_char_ptr(file, f_name_len);
-		mio_put_file_w_(&ifail, &itype, &inum, f_name.data(), &f_name_len);
-		if (ifail != 0) throw_mio_error("putting template file" + file);
-		inum++;
-	}
-
-	//put model in files
-	inum = 1;
-	itype = 2;
-	for (auto &file : inpfile_vec)
-	{
-		long f_name_len = 180;
-		vector<char> f_name = pest_utils::string_as_fortran_char_ptr(file, f_name_len);
-		mio_put_file_w_(&ifail, &itype, &inum, f_name.data(), &f_name_len);
-		if (ifail != 0) throw_mio_error("putting model input file" + file);
-		inum++;
-	}
-
-	//put instructions files
-	inum = 1;
-	itype = 3;
-	for (auto &file : insfile_vec)
-	{
-		long f_name_len = 180;
-		vector<char> f_name = pest_utils::string_as_fortran_char_ptr(file, f_name_len);
-		mio_put_file_w_(&ifail, &itype, &inum, f_name.data(), &f_name_len);
-		if (ifail != 0) throw_mio_error("putting instruction file" + file);
-		inum++;
-	}
-
-	//put model out files
-	inum = 1;
-	itype = 4;
-	for (auto &file : outfile_vec)
-	{
-		long f_name_len = 180;
-		vector<char> f_name = pest_utils::string_as_fortran_char_ptr(file, f_name_len);
-		mio_put_file_w_(&ifail, &itype, &inum, f_name.data(), &f_name_len);
-		if (ifail != 0) throw_mio_error("putting model output file" + file);
-		inum++;
-	}
+	throw runtime_error("model input/output error:" + base_message + "\n" + detail);
 }
 
 ModelInterface::ModelInterface()
@@ -143,18 +64,65 @@ void ModelInterface::initialize(vector<string> &_par_name_vec, vector<string> &_
 	if (nins <= 0)
 		throw runtime_error("number of instructino files <=0");
 
-	mio_initialise_w_(&ifail, &ntpl, &nins, &npar, &nobs);
-	if (ifail != 0) throw_mio_error("initializing mio module");
-
-	set_files();
+	//parse the template and instruction files once.  Names are matched without regard to case
+	unordered_map<string, int> par_index;
+	for (int i = 0; i < npar; ++i)
+	{
+		par_index[pest_utils::lower_cp(par_name_vec[i])] = i;
+	}
+	unordered_map<string, int> obs_index;
+	for (int i = 0; i < nobs; ++i)
+	{
+		obs_index[pest_utils::lower_cp(obs_name_vec[i])] = i;
+	}
 
-	//check template files
-	mio_process_template_files_w_(&ifail, &npar, pest_utils::StringvecFortranCharArray(par_name_vec, 200, pest_utils::TO_LOWER).get_prt());
-	if (ifail != 0)throw_mio_error("error in template files");
+	tpl_files.clear();
+	par_widths.assign(npar, MAX_PAR_WIDTH);
+	for (int i = 0; i < ntpl; ++i)
+	{
+		tpl_files.push_back(TemplateFile(tplfile_vec[i], inpfile_vec[i]));
+		try
+		{
+			tpl_files.back().compile(par_index, par_widths);
+		}
+		catch (exception &e)
+		{
+			throw_model_io_error("error in template files", e.what());
+		}
+	}
+	for (int i = 0; i < npar; ++i)
+	{
+		if (par_widths[i] == MAX_PAR_WIDTH)
+		{
+			throw_model_io_error("error in template files", "Parameter \"" + pest_utils::lower_cp(par_name_vec[i]) + "\" is not cited on any template file.");
+		}
+	}
 
-	////build instruction set
-	mio_store_instruction_set_w_(&ifail);
-	if (ifail != 0) throw_mio_error("error building instruction set");
+	ins_files.clear();
+	vector<int> obs_cited(nobs, 0);
+	for (int i = 0; i < nins; ++i)
+	{
+		ins_files.push_back(InstructionFile(insfile_vec[i], outfile_vec[i]));
+		try
+		{
+			ins_files.back().compile(obs_index, obs_cited);
+		}
+		catch (exception &e)
+		{
+			throw_model_io_error("error building instruction set", e.what());
+		}
+	}
+	for (int i = 0; i < nobs; ++i)
+	{
+		if (obs_cited[i] == 0)
+		{
+			throw_model_io_error("error building instruction set", "observation \"" + pest_utils::lower_cp(obs_name_vec[i]) + "\" not referenced in the user-supplied instruction set.");
+		}
+		if (obs_cited[i] > 1)
+		{
+			throw_model_io_error("error building instruction set", "observation \"" + pest_utils::lower_cp(obs_name_vec[i]) + "\" already cited in instruction set.");
+		}
+	}
 
 	initialized = true;
 
@@ -162,8 +130,9 @@ void ModelInterface::initialize(vector<string> &_par_name_vec, vector<string> &_
 
 void ModelInterface::finalize()
 {
-	mio_finalise_w_(&ifail);
-	if (ifail != 0) ModelInterface::throw_mio_error("error finalizing model interface");
+	tpl_files.clear();
+	ins_files.clear();
+	par_widths.clear();
 	initialized = false;
 }
 
@@ -204,11 +173,67 @@ void ModelInterface::run(pest_utils::thread_flag* terminate, pest_utils::thread_
 		vector<string> onames = obs->get_keys();
 		initialize(pnames, onames);
 	}
-	//get par vals that are aligned with this::par_name_vec since the mio module was initialized with this::par_name_vec order
+	//get par vals that are aligned with this::par_name_vec since the template files were compiled with this::par_name_vec order
 	par_vals = pars->get_data_vec(par_name_vec);
 
 	try
 	{
+		if (!run_model_files(terminate, finished, shared_execptions, par_vals, obs_vals, string())) return;
+
+		pars->update(par_name_vec, par_vals);
+		obs->update(obs_name_vec, obs_vals);
+
+		//set the finished flag for the listener thread
+		finished->set(true);
+	}
+	catch (...)
+	{
+		shared_execptions->add(current_exception());
+	}
+	return;
+
+}
+
+void ModelInterface::run(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished, pest_utils::thread_exceptions *shared_execptions,
+	vector<string> &_par_name_vec, vector<double> &par_values,
+	vector<string> &_obs_name_vec, vector<double> &obs_vec, const string &run_dir)
+{
+	//values are passed in the order of the name vectors, which must match the order
+	//the interface was initialized with, so no name lookups are needed
+	if (!initialized)
+	{
+		initialize(_par_name_vec, _obs_name_vec);
+	}
+
+	try
+	{
+		if (par_values.size() != par_name_vec.size())
+		{
+			throw PestError("model interface error: number of parameter values does not match the number of parameters");
+		}
+		if ((&_par_name_vec != &par_name_vec && _par_name_vec != par_name_vec) ||
+			(&_obs_name_vec != &obs_name_vec && _obs_name_vec != obs_name_vec))
+		{
+			throw PestError("model interface error: parameter or observation names do not match the order used to initialize the interface");
+		}
+		if (!run_model_files(terminate, finished, shared_execptions, par_values, obs_vec, run_dir)) return;
+
+		//set the finished flag for the listener thread
+		finished->set(true);
+	}
+	catch (...)
+	{
+		shared_execptions->add(current_exception());
+	}
+	return;
+}
+
+bool ModelInterface::run_model_files(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished, pest_utils::thread_exceptions *shared_execptions,
+	vector<double> &pvals, vector<double> &ovals, const string &run_dir)
+{
+	try
+	{
+		string prefix = run_dir.empty() ? "" : run_dir + OperSys::DIR_SEP;
 		//first delete any existing input and output files
 		// This outer loop is a work around for a bug in windows.  Window can fail to release a file
 		// handle quick enough when the external run executes very quickly
@@ -218,16 +243,18 @@ void ModelInterface::run(pest_utils::thread_flag* terminate, pest_utils::thread_
 		{
 			vector<string> failed_file_vec;
 			failed_file_op = false;
-			for (auto &out_file : outfile_vec)
+			for (auto &out_file_name : outfile_vec)
 			{
+				string out_file = prefix + out_file_name;
 				if ((pest_utils::check_exist_out(out_file)) && (remove(out_file.c_str()) != 0))
 				{
 					failed_file_vec.push_back(out_file);
 					failed_file_op = true;
 				}
 			}
-			for (auto &in_file : inpfile_vec)
+			for (auto &in_file_name : inpfile_vec)
 			{
+				string in_file = prefix + in_file_name;
 				if ((pest_utils::check_exist_out(in_file)) && (remove(in_file.c_str()) != 0))
 				{
 					failed_file_vec.push_back(in_file);
@@ -281,19 +308,32 @@ void ModelInterface::run(pest_utils::thread_flag* terminate, pest_utils::thread_
 		// 	throw PestError(ss.str());
 		// }
 
-		int npar = par_vals.size();
-		try
+		//each parameter value is formatted once and then written to every parameter space it occupies.
+		//pvals is updated to the values actually written
+		int npar = pvals.size();
+		vector<string> par_words(npar);
+		for (int i = 0; i < npar; ++i)
 		{
-			mio_write_model_input_files_w_(&ifail, &npar,
-				pest_utils::StringvecFortranCharArray(par_name_vec, 200, pest_utils::TO_LOWER).get_prt(),
-				&par_vals[0]);
+			double tval;
+			int jfail = TemplateFile::format_value(pvals[i], par_widths[i], par_words[i], tval);
+			if (jfail != 0)
+			{
+				throw_model_io_error("error writing model input files from template files",
+					TemplateFile::format_error_message(jfail, pest_utils::lower_cp(par_name_vec[i])));
+			}
+			pvals[i] = tval;
 		}
-		catch (exception &e)
+		for (auto &tpl_file : tpl_files)
 		{
-			string emess = e.what();
-			throw_mio_error("uncaught error writing model input files from template files:" + emess);
+			try
+			{
+				tpl_file.write(par_words, run_dir);
+			}
+			catch (exception &e)
+			{
+				throw_model_io_error("error writing model input files from template files", e.what());
+			}
 		}
-		if (ifail != 0) throw_mio_error("error writing model input files from template files");
 
 
 #ifdef OS_WIN
@@ -314,7 +354,7 @@ void ModelInterface::run(pest_utils::thread_flag* terminate, pest_utils::thread_
 			PROCESS_INFORMATION pi;
 			try
 			{
-				pi = start(cmd_string);
+				pi = start(cmd_string, run_dir);
 			}
 			catch (...)
 			{
@@ -369,7 +409,7 @@ void ModelInterface::run(pest_utils::thread_flag* terminate, pest_utils::thread_
 		for (auto &cmd_string : comline_vec)
 		{
 			//start the command
-			int command_pid = start(cmd_string);
+			int command_pid = start(cmd_string, run_dir);
 			while (true)
 			{
 				//sleep
@@ -408,35 +448,21 @@ void ModelInterface::run(pest_utils::thread_flag* terminate, pest_utils::thread_
 		}
 #endif
 
-		if (term_break) return;
+		if (term_break) return false;
 
 		// process instruction files
-		int nins = insfile_vec.size();
 		int nobs = obs_name_vec.size();
-		obs_vals.resize(nobs, -9999.00);
-		/*int nerr_len = 500;
-		char err_instruct[500];
-		for (int i = 0; i < 500; i++)
-			err_instruct[i] = '|';*/
-		try {
-			mio_read_model_output_files_w_(&ifail, &nobs,
-				pest_utils::StringvecFortranCharArray(obs_name_vec, 200, pest_utils::TO_LOWER).get_prt(),
-				&obs_vals[0]);
-		}
-		catch (exception &e)
-		{
-			string emess = e.what();
-			throw_mio_error("uncaught error processing model output files:" + emess);
-		}
-		if (ifail != 0)
+		ovals.assign(nobs, InstructionFile::NOT_READ);
+		for (auto &ins_file : ins_files)
 		{
-			/*int jfail;
-			mio_get_message_string_w_(&jfail, &nerr_len, err_instruct);
-			string err = string(err_instruct);
-			auto s_end = err.find_last_not_of(' ',500);
-			err = err.substr(0, s_end);*/
-
-			throw_mio_error("error processing model output files");
+			try
+			{
+				ins_file.read(ovals, run_dir);
+			}
+			catch (exception &e)
+			{
+				throw_model_io_error("error processing model output files", e.what());
+			}
 		}
 
 		// invalid.clear();
@@ -468,19 +494,13 @@ void ModelInterface::run(pest_utils::thread_flag* terminate, pest_utils::thread_
 		// 	throw PestError(ss.str());
 		// }
 
-		pars->update(par_name_vec, par_vals);
-		obs->update(obs_name_vec, obs_vals);
-
-
-		//set the finished flag for the listener thread
-		finished->set(true);
-
+		return true;
 	}
 	catch (...)
 	{
 		shared_execptions->add(current_exception());
 	}
-	return;
+	return false;
 
 }
 
@@ -3,8 +3,11 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <unordered_map>
 #include "Transformable.h"
 #include "utilities.h"
+#include "template_instruction.h"
 
 using namespace std;
 
@@ -12,12 +15,12 @@ class ModelInterface{
 public:
 	ModelInterface();
 	ModelInterface(vector<string> _tplfile_vec,vector<string> _inpfile_vec, vector<string> _insfile_vec, vector<string> _outfile_vec,vector<string> _comline_vec);
-	void throw_mio_error(string base_message);
+	void throw_model_io_error(const string &base_message, const string &detail);
 	void run(Parameters* pars, Observations* obs);
 	void run(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished,
 		pest_utils::thread_exceptions *shared_execptions,
 		vector<string> &par_name_vec, vector<double> &par_values,
-		vector<string> &obs_name_vec, vector<double> &obs_vec);
+		vector<string> &obs_name_vec, vector<double> &obs_vec, const string &run_dir = string());
 	void run(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished,
 		pest_utils::thread_exceptions *shared_execptions,
 		Parameters* par, Observations* obs);
@@ -32,11 +35,12 @@ public:
 	bool get_initialized(){ return initialized; }
 private:
 
-	void set_files();
 	void check();
+	//false if the run was terminated or failed, the error is added to shared_execptions
+	bool run_model_files(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished, pest_utils::thread_exceptions *shared_execptions,
+		vector<double> &pvals, vector<double> &ovals, const string &run_dir);
 
 	bool initialized;
-	int ifail;
 	vector<string> par_name_vec;
 	vector<string> obs_name_vec;
 	vector<string> tplfile_vec;
@@ -47,6 +51,12 @@ private:
 
 	vector<double> par_vals;
 	vector<double> obs_vals;
+	//widest parameter space allowed.  The actual width of each parameter is the narrowest
+	//space it occupies in the template files
+	static const int MAX_PAR_WIDTH;
+	vector<TemplateFile> tpl_files;
+	vector<InstructionFile> ins_files;
+	vector<int> par_widths;
 
 };
 
@@ -0,0 +1,1169 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include "template_instruction.h"
+#include "utilities.h"
+#include "system_variables.h"
+#include "network_wrapper.h"
+
+using namespace std;
+
+const double InstructionFile::NOT_READ = -1.1e270;
+
+namespace
+{
+	const string TPL_ERRSUB = "Error writing parameters to model input file(s):";
+	const string INS_ERRSUB = "Error reading model output file(s):";
+
+	//read a whole file into buf.  Returns false if the file can not be opened
+	bool read_file(const string &filename, string &buf)
+	{
+		ifstream fin(filename, ios::binary);
+		if (!fin.good())
+		{
+			return false;
+		}
+		fin.seekg(0, ios::end);
+		streamoff len = fin.tellg();
+		fin.seekg(0, ios::beg);
+		buf.resize(len > 0 ? size_t(len) : 0);
+		if (len > 0)
+		{
+			fin.read(&buf[0], len);
+		}
+		return !fin.bad();
+	}
+
+	//split buf into records the way fortran formatted reads do: records end at "\n", "\r\n" or "\r"
+	class RecordReader
+	{
+	public:
+		RecordReader(const string &_buf) : buf(_buf), pos(0) {}
+		bool next(string &line)
+		{
+			if (pos >= buf.size())
+			{
+				return false;
+			}
+			size_t end = buf.find_first_of("\r\n", pos);
+			if (end == string::npos)
+			{
+				line.assign(buf, pos, string::npos);
+				pos = buf.size();
+				return true;
+			}
+			line.assign(buf, pos, end - pos);
+			pos = end + 1;
+			if (buf[end] == '\r' && pos < buf.size() && buf[pos] == '\n')
+			{
+				++pos;
+			}
+			return true;
+		}
+		bool skip()
+		{
+			if (pos >= buf.size())
+			{
+				return false;
+			}
+			size_t end = buf.find_first_of("\r\n", pos);
+			if (end == string::npos)
+			{
+				pos = buf.size();
+				return true;
+			}
+			pos = end + 1;
+			if (buf[end] == '\r' && pos < buf.size() && buf[pos] == '\n')
+			{
+				++pos;
+			}
+			return true;
+		}
+	private:
+		const string &buf;
+		size_t pos;
+	};
+
+	//1-based position of the last non-blank character
+	int len_trim(const string &s)
+	{
+		size_t n = s.find_last_not_of(' ');
+		return (n == string::npos) ? 0 : int(n) + 1;
+	}
+
+	//replace tabs by blanks up to the next 8 column tab stop
+	void expand_tabs(string &line)
+	{
+		if (line.find('\t') == string::npos)
+		{
+			return;
+		}
+		string expanded;
+		expanded.reserve(line.size() + 64);
+		for (char c : line)
+		{
+			if (c == '\t')
+			{
+				expanded.append(8 - expanded.size() % 8, ' ');
+			}
+			else
+			{
+				expanded.push_back(c);
+			}
+		}
+		line.swap(expanded);
+	}
+
+	//fortran "(iN)" read: blanks are ignored and a sign is allowed
+	bool read_fortran_int(const string &s, int &val)
+	{
+		string digits;
+		for (char c : s)
+		{
+			if (c != ' ')
+			{
+				digits.push_back(c);
+			}
+		}
+		if (digits.empty())
+		{
+			return false;
+		}
+		size_t i = 0;
+		if (digits[0] == '+' || digits[0] == '-')
+		{
+			++i;
+		}
+		if (i == digits.size())
+		{
+			return false;
+		}
+		for (size_t j = i; j < digits.size(); ++j)
+		{
+			if (!isdigit(static_cast<unsigned char>(digits[j])))
+			{
+				return false;
+			}
+		}
+		val = atoi(digits.c_str());
+		return true;
+	}
+
+	//fortran "(fW.0)" read of s[first, last) (0-based):  blanks are ignored, the exponent may be
+	//introduced by e, d or q or by its sign alone, and an all blank field is zero
+	bool read_fortran_real(const string &s, size_t first, size_t last, double &val)
+	{
+		char buf[128];
+		size_t n = 0;
+		size_t i = first;
+		while (i < last && s[i] == ' ')
+		{
+			++i;
+		}
+		if (i == last)
+		{
+			val = 0.0;
+			return true;
+		}
+		if (s[i] == '+' || s[i] == '-')
+		{
+			buf[n++] = s[i++];
+		}
+		while (i < last && s[i] == ' ')
+		{
+			++i;
+		}
+		//infinity and nan
+		if (i < last && (s[i] == 'i' || s[i] == 'I' || s[i] == 'n' || s[i] == 'N'))
+		{
+			string word = pest_utils::lower_cp(pest_utils::strip_cp(s.substr(i, last - i)));
+			if (word == "inf" || word == "infinity")
+			{
+				val = (n > 0 && buf[0] == '-') ? -HUGE_VAL : HUGE_VAL;
+				return true;
+			}
+			if (word.compare(0, 3, "nan") == 0)
+			{
+				val = nan("");
+				return true;
+			}
+			return false;
+		}
+		int n_digit = 0;
+		bool point = false;
+		for (; i < last; ++i)
+		{
+			char c = s[i];
+			if (c == ' ')
+			{
+				continue;
+			}
+			if (isdigit(static_cast<unsigned char>(c)))
+			{
+				++n_digit;
+			}
+			else if (c == '.' && !point)
+			{
+				point = true;
+			}
+			else
+			{
+				break;
+			}
+			if (n >= sizeof(buf) - 8) return false;
+			buf[n++] = c;
+		}
+		if (i < last)
+		{
+			char c = s[i];
+			if (c == 'e' || c == 'E' || c == 'd' || c == 'D' || c == 'q' || c == 'Q')
+			{
+				++i;
+				while (i < last && s[i] == ' ')
+				{
+					++i;
+				}
+			}
+			else if (c != '+' && c != '-')
+			{
+				return false;
+			}
+			if (n >= sizeof(buf) - 8) return false;
+			buf[n++] = 'e';
+			if (i < last && (s[i] == '+' || s[i] == '-'))
+			{
+				buf[n++] = s[i++];
+			}
+			int n_exp_digit = 0;
+			for (; i < last; ++i)
+			{
+				char c = s[i];
+				if (c == ' ')
+				{
+					continue;
+				}
+				if (!isdigit(static_cast<unsigned char>(c)))
+				{
+					return false;
+				}
+				if (n >= sizeof(buf) - 1) return false;
+				buf[n++] = c;
+				++n_exp_digit;
+			}
+			if (n_exp_digit == 0)
+			{
+				return false;
+			}
+		}
+		if (n_digit == 0)
+		{
+			//a sign and/or decimal point without digits
+			val = 0.0;
+			return true;
+		}
+		buf[n] = '\0';
+		val = strtod(buf, nullptr);
+		return true;
+	}
+
+	//fortran kPEw.dE3 edit descriptor as written by gfortran.  Returns false for an invalid scale factor
+	bool fortran_e_format(double val, int k, int w, int d, string &out)
+	{
+		int nsig = (k > 0) ? d + 1 : d;
+		if (k < 0 || k > d + 1 || nsig <= 0)
+		{
+			return false;
+		}
+		char buf[64];
+		snprintf(buf, sizeof(buf), "%.*e", nsig - 1, fabs(val));
+		string digits;
+		char *p = buf;
+		for (; *p != 'e' && *p != '\0'; ++p)
+		{
+			if (*p != '.')
+			{
+				digits.push_back(*p);
+			}
+		}
+		int exp10 = (*p == 'e') ? atoi(p + 1) : 0;
+		int e = 0;
+		if (val != 0.0)
+		{
+			e = (k > 0) ? exp10 - k + 1 : exp10 + 1;
+		}
+		out.clear();
+		if (val < 0.0)
+		{
+			out.push_back('-');
+		}
+		if (k > 0)
+		{
+			out.append(digits, 0, k);
+			out.push_back('.');
+			out.append(digits, k, string::npos);
+		}
+		else
+		{
+			out.push_back('.');
+			out.append(digits);
+		}
+		char ebuf[16];
+		snprintf(ebuf, sizeof(ebuf), "E%c%03d", e < 0 ? '-' : '+', abs(e));
+		out.append(ebuf);
+		if (abs(e) > 999)
+		{
+			out.assign(w, '*');
+			return true;
+		}
+		//the optional leading zero is written if there is room for it
+		if (k == 0 && int(out.size()) < w)
+		{
+			out.insert(val < 0.0 ? 1 : 0, 1, '0');
+		}
+		if (int(out.size()) > w)
+		{
+			out.assign(w, '*');
+		}
+		else
+		{
+			out.insert(0, w - out.size(), ' ');
+		}
+		return true;
+	}
+
+	//fortran Fw.d edit descriptor as written by gfortran
+	void fortran_f_format(double val, int w, int d, string &out)
+	{
+		char buf[512];
+		snprintf(buf, sizeof(buf), "%#.*f", d, fabs(val));
+		out.clear();
+		if (val < 0.0)
+		{
+			out.push_back('-');
+		}
+		const char *p = buf;
+		//the optional leading zero is written if there is room for it
+		if (p[0] == '0' && p[1] == '.' && int(strlen(buf)) + int(out.size()) > w)
+		{
+			++p;
+		}
+		out.append(p);
+		if (int(out.size()) > w)
+		{
+			out.assign(w, '*');
+		}
+		else
+		{
+			out.insert(0, w - out.size(), ' ');
+		}
+	}
+}
+
+TemplateFile::TemplateFile(const string &_tpl_filename, const string &_in_filename)
+	: tpl_filename(_tpl_filename), in_filename(_in_filename)
+{
+}
+
+void TemplateFile::compile(const unordered_map<string, int> &par_index, vector<int> &par_widths)
+{
+	text.clear();
+	slots.clear();
+	string buf;
+	if (!read_file(tpl_filename, buf))
+	{
+		throw runtime_error("Cannot open template file " + tpl_filename + ".");
+	}
+	RecordReader reader(buf);
+	string dline;
+	if (!reader.next(dline) || dline.size() < 5 ||
+		(pest_utils::lower_cp(dline.substr(0, 3)) != "ptf" && pest_utils::lower_cp(dline.substr(0, 3)) != "jtf") ||
+		dline[4] == ' ')
+	{
+		throw runtime_error("\"ptf\" or \"jtf\" header, followed by space, followed by parameter delimiter expected on first line of template file " + tpl_filename + ".");
+	}
+	char pardel = dline[4];
+	int iline = 1;
+	text.reserve(buf.size());
+	while (reader.next(dline))
+	{
+		++iline;
+		size_t nblc = len_trim(dline);
+		size_t j2 = 0;
+		while (j2 < nblc)
+		{
+			size_t j1 = dline.find(pardel, j2);
+			if (j1 == string::npos || j1 >= nblc)
+			{
+				break;
+			}
+			size_t j_end = dline.find(pardel, j1 + 1);
+			if (j_end == string::npos || j_end >= nblc)
+			{
+				throw runtime_error("Unbalanced parameter delimiters at line " + to_string(iline) + " of template file " + tpl_filename + ".");
+			}
+			if (j_end - j1 <= 1)
+			{
+				throw runtime_error("Parameter space less than three characters wide at line " + to_string(iline) + " of file " + tpl_filename + ".");
+			}
+			size_t i_name = dline.find_first_not_of(' ', j1 + 1);
+			if (i_name >= j_end)
+			{
+				throw runtime_error("Blank parameter space at line " + to_string(iline) + " of file " + tpl_filename + ".");
+			}
+			string tpar = dline.substr(i_name, j_end - i_name);
+			pest_utils::strip_ip(tpar, "back");
+			pest_utils::lower_ip(tpar);
+			auto it = par_index.find(tpar);
+			if (it == par_index.end())
+			{
+				throw runtime_error("Parameter \"" + tpar + "\" cited on line " + to_string(iline) + " of template file " + tpl_filename + " has not been supplied with a value.");
+			}
+			int width = j_end - j1 + 1;
+			text.append(dline, j2, j1 - j2);
+			ParSlot slot;
+			slot.offset = text.size();
+			slot.ipar = it->second;
+			slot.width = width;
+			slots.push_back(slot);
+			par_widths[it->second] = min(par_widths[it->second], width);
+			j2 = j_end + 1;
+		}
+		text.append(dline, j2, nblc - j2);
+		text.push_back('\n');
+	}
+}
+
+void TemplateFile::write(const vector<string> &par_words, const string &run_dir) const
+{
+	string buf;
+	buf.reserve(text.size() + slots.size() * 24);
+	size_t pos = 0;
+	for (const auto &slot : slots)
+	{
+		buf.append(text, pos, slot.offset - pos);
+		const string &word = par_words[slot.ipar];
+		//the parameter value is right justified in the parameter space
+		buf.append(slot.width - word.size(), ' ');
+		buf.append(word);
+		pos = slot.offset;
+	}
+	buf.append(text, pos, string::npos);
+
+	string filename = run_dir.empty() ? in_filename : run_dir + OperSys::DIR_SEP + in_filename;
+	ofstream fout(filename);
+	if (!fout.good())
+	{
+		throw runtime_error(TPL_ERRSUB + " cannot open model input file " + filename + " to write updated parameter values prior to running model.");
+	}
+	fout.write(buf.data(), buf.size());
+	fout.close();
+	if (fout.fail())
+	{
+		throw runtime_error(TPL_ERRSUB + " cannot write to model input file " + filename + ".");
+	}
+}
+
+int TemplateFile::format_value(double val, int nw, string &word, double &tval)
+{
+	//port of mio_wrtsig() for double precision numbers with a decimal point
+	if (val != val || fabs(val) == HUGE_VAL)
+	{
+		return -1;
+	}
+	if (val == 0.0)
+	{
+		//mio fails on negative zero
+		val = 0.0;
+	}
+	int pos = (val < 0.0) ? 0 : 1;
+	char ebuf[64];
+	snprintf(ebuf, sizeof(ebuf), "%.15e", val);
+	int jexp = atoi(strchr(ebuf, 'e') + 1);
+	int epos = (jexp < 0) ? 0 : 1;
+	int lw = min(23, nw);
+	int lexp = 0;
+	int iflag = 0;
+	int d, p, k;
+	string tword;
+
+	if (abs(jexp) > 275)
+	{
+		return 2;
+	}
+	if (pos == 1 && lw >= 22)
+	{
+		fortran_e_format(val, 1, 22, 15, word);
+		//pad wide parameter spaces with leading zeros
+		if (nw >= 23)
+		{
+			word.insert(0, nw - 22, '0');
+		}
+		goto check;
+	}
+	if (pos == 0 && lw >= 23)
+	{
+		fortran_e_format(val, 1, 23, 15, word);
+		if (nw > lw)
+		{
+			fortran_e_format(fabs(val), 1, 22, 15, tword);
+			word = "-" + string(nw - 23, '0') + tword;
+		}
+		goto check;
+	}
+
+	//try fixed point notation first
+	d = min(lw - 2 + pos, lw - jexp - 3 + pos);
+	while (true)
+	{
+		if (d < 0)
+		{
+			goto exponent;
+		}
+		fortran_f_format(val, lw, d, word);
+		if (word.find('*') == string::npos)
+		{
+			break;
+		}
+		--d;
+	}
+	k = word.find('.') + 1;
+	if (k == 0)
+	{
+		return -1;
+	}
+	if ((k == 1) || ((pos == 0) && (k == 2)))
+	{
+		//small numbers need a significant figure in the first three decimal places
+		for (int j = 1; j <= 3; ++j)
+		{
+			if (k + j > lw)
+			{
+				return 3;
+			}
+			if (word[k + j - 1] != '0')
+			{
+				goto check;
+			}
+		}
+		goto exponent;
+	}
+	goto check;
+
+exponent:
+	{
+		d = lw - 7;
+		if (pos == 1) ++d;
+		if (epos == 1) ++d;
+		if (abs(jexp) < 100) ++d;
+		if (abs(jexp) < 10) ++d;
+		p = 1;
+		if ((jexp >= 100) && (jexp - (d - 1) < 100))
+		{
+			p = 1 + (jexp - 99);
+			++d;
+			lexp = 99;
+		}
+		else if ((jexp >= 10) && (jexp - (d - 1) < 10))
+		{
+			p = 1 + (jexp - 9);
+			++d;
+			lexp = 9;
+		}
+		else if ((jexp == -10) || (jexp == -100))
+		{
+			iflag = 1;
+			++d;
+		}
+		int inc = 0;
+		while (true)
+		{
+			if (d <= 0)
+			{
+				return 3;
+			}
+			bool ok = (iflag == 0) ? fortran_e_format(val, p, d + 7, d - 1, tword) :
+				fortran_e_format(val, 0, d + 8, d, tword);
+			if (!ok)
+			{
+				return -2;
+			}
+			if (iflag == 1)
+			{
+				break;
+			}
+			int kexp;
+			if (!read_fortran_int(tword.substr(d + 3, 4), kexp))
+			{
+				return -2;
+			}
+			//rounding added a digit to the exponent
+			if ((((kexp == 10) && ((jexp == 9) || (lexp == 9))) ||
+				((kexp == 100) && ((jexp == 99) || (lexp == 99)))) && (inc == 0))
+			{
+				if (lexp == 0)
+				{
+					if (d - 1 == 0)
+						--d;
+					else
+						++p;
+				}
+				else if (lexp == 9)
+				{
+					if (jexp - (d - 2) < 10)
+						++p;
+					else
+						--d;
+				}
+				else if (lexp == 99)
+				{
+					if (jexp - (d - 2) < 100)
+						++p;
+					else
+						--d;
+				}
+				++inc;
+				continue;
+			}
+			break;
+		}
+		//drop the blank in front of positive numbers, the "+" and the leading zeros of the exponent
+		size_t j = tword.find('E');
+		size_t kk = (pos == 0) ? 0 : 1;
+		word.assign(tword, kk, j - kk);
+		word.push_back('E');
+		if (tword[j + 1] == '-')
+		{
+			word.push_back('-');
+		}
+		if (tword[j + 2] != '0')
+		{
+			word.append(tword, j + 2, 2);
+		}
+		else if (tword[j + 3] != '0')
+		{
+			word.push_back(tword[j + 3]);
+		}
+		word.push_back(tword[j + 4]);
+		if (iflag == 1)
+		{
+			//drop the zero in front of the decimal point
+			word.erase((pos == 1) ? 0 : 1, 1);
+		}
+	}
+
+check:
+	pest_utils::strip_ip(word, "back");
+	if (int(word.size()) > nw)
+	{
+		return -2;
+	}
+	if (!read_fortran_real(word, 0, word.size(), tval))
+	{
+		return -3;
+	}
+	return 0;
+}
+
+string TemplateFile::format_error_message(int ifail, const string &par_name)
+{
+	if (ifail < 0)
+	{
+		return "Internal error condition has arisen while attempting to write current value of parameter \"" + par_name + "\" to model input file.";
+	}
+	else if (ifail == 2)
+	{
+		return TPL_ERRSUB + " exponent of parameter \"" + par_name + "\" is too large or too small for double precision protocol.";
+	}
+	return TPL_ERRSUB + " field width of parameter \"" + par_name + "\" on at least one template file is too small to represent current parameter value. The number is too large to fit, or too small to be represented with any precision.";
+}
+
+InstructionFile::InstructionFile(const string &_ins_filename, const string &_out_filename)
+	: ins_filename(_ins_filename), out_filename(_out_filename), marker(' ')
+{
+}
+
+void InstructionFile::throw_error(const string &message) const
+{
+	throw runtime_error(message + " (instruction file " + ins_filename + ")");
+}
+
+void InstructionFile::compile(const unordered_map<string, int> &obs_index, vector<int> &obs_cited)
+{
+	ins_lines.clear();
+	string buf;
+	if (!read_file(ins_filename, buf))
+	{
+		throw runtime_error("Cannot open instruction file " + ins_filename + ".");
+	}
+	RecordReader reader(buf);
+	string dline;
+	if (reader.next(dline))
+	{
+		dline.erase(remove(dline.begin(), dline.end(), '\t'), dline.end());
+	}
+	if (dline.size() < 5 ||
+		(pest_utils::lower_cp(dline.substr(0, 3)) != "pif" && pest_utils::lower_cp(dline.substr(0, 3)) != "jif") ||
+		dline[4] == ' ')
+	{
+		throw runtime_error("Header of \"pif\" or \"jif\" followed by space, followed by marker delimiter expected on first line of instruction file " + ins_filename + ".");
+	}
+	marker = dline[4];
+	while (reader.next(dline))
+	{
+		dline.erase(remove(dline.begin(), dline.end(), '\t'), dline.end());
+		int nblb = len_trim(dline);
+		if (nblb == 0)
+		{
+			continue;
+		}
+		vector<Instruction> items;
+		int n2 = 0;
+		while (true)
+		{
+			//split off the next instruction (see mio_getint)
+			int n1 = n2;
+			while (n1 < nblb && dline[n1] == ' ')
+			{
+				++n1;
+			}
+			if (n1 >= nblb)
+			{
+				break;
+			}
+			if (dline[n1] != marker)
+			{
+				size_t i = dline.find(' ', n1);
+				n2 = (i == string::npos || int(i) > nblb) ? nblb : int(i);
+			}
+			else
+			{
+				size_t i = dline.find(marker, n1 + 1);
+				if (i == string::npos || int(i) >= nblb)
+				{
+					throw_error(INS_ERRSUB + " missing marker delimiter in user-supplied instruction.");
+				}
+				n2 = int(i) + 1;
+			}
+			//the instruction is dline[n1, n2)
+			string ins = dline.substr(n1, n2 - n1);
+			Instruction item;
+			item.num1 = 0;
+			item.num2 = 0;
+			item.iobs = -1;
+			char c = ins[0];
+			if (c == 'l' || c == 'L')
+			{
+				item.type = InsType::LINE_ADVANCE;
+				if (ins.size() < 2 || !read_fortran_int(ins.substr(1), item.num1))
+				{
+					throw_error(INS_ERRSUB + " cannot read line advance item from user-supplied instruction.");
+				}
+			}
+			else if (c == marker)
+			{
+				item.type = InsType::MARKER;
+				item.text = ins.substr(1, ins.size() - 2);
+			}
+			else if (c == '&')
+			{
+				if (!items.empty())
+				{
+					throw_error(INS_ERRSUB + " if present, continuation character must be first instruction on an instruction line.");
+				}
+				if (ins_lines.empty())
+				{
+					throw_error(INS_ERRSUB + " first instruction line in instruction file cannot start with continuation character.");
+				}
+				item.type = InsType::CONTINUATION;
+			}
+			else if (c == 'w' || c == 'W')
+			{
+				item.type = InsType::WHITESPACE;
+			}
+			else if (c == 't' || c == 'T')
+			{
+				item.type = InsType::TAB;
+				if (ins.size() < 2 || !read_fortran_int(ins.substr(1), item.num1))
+				{
+					throw_error(INS_ERRSUB + " cannot read tab position from user-supplied instruction.");
+				}
+			}
+			else if (c == '[' || c == '(')
+			{
+				item.type = (c == '[') ? InsType::FIXED : InsType::SEMI_FIXED;
+				size_t n3 = ins.find((c == '[') ? ']' : ')');
+				if (n3 == string::npos)
+				{
+					throw_error(INS_ERRSUB + " missing \"]\" or \")\" character in instruction.");
+				}
+				item.text = pest_utils::lower_cp(ins.substr(1, n3 - 1));
+				auto it = obs_index.find(item.text);
+				if (it == obs_index.end())
+				{
+					throw_error(INS_ERRSUB + " observation name \"" + item.text + "\" from user-supplied instruction set is not cited in main program input file.");
+				}
+				item.iobs = it->second;
+				size_t i_colon = ins.find(':', n3 + 1);
+				if (i_colon == string::npos || i_colon == n3 + 1 || i_colon + 1 >= ins.size() ||
+					!read_fortran_int(ins.substr(n3 + 1, i_colon - n3 - 1), item.num1) ||
+					!read_fortran_int(ins.substr(i_colon + 1), item.num2))
+				{
+					throw_error(INS_ERRSUB + " cannot interpret user-supplied instruction for reading model output file.");
+				}
+			}
+			else if (c == '!')
+			{
+				item.text = pest_utils::lower_cp(ins.substr(1, ins.size() - 2));
+				if (ins.size() == 5 && item.text == "dum")
+				{
+					item.type = InsType::DUMMY;
+				}
+				else
+				{
+					item.type = InsType::NON_FIXED;
+					auto it = obs_index.find(item.text);
+					if (it == obs_index.end())
+					{
+						throw_error(INS_ERRSUB + " observation name \"" + item.text + "\" from user-supplied instruction set is not cited in main program input file.");
+					}
+					item.iobs = it->second;
+				}
+			}
+			else
+			{
+				throw_error(INS_ERRSUB + " cannot interpret user-supplied instruction for reading model output file.");
+			}
+			if (item.iobs >= 0)
+			{
+				++obs_cited[item.iobs];
+			}
+			items.push_back(item);
+		}
+		ins_lines.push_back(items);
+	}
+}
+
+void InstructionFile::read(vector<double> &obs_vals, const string &run_dir) const
+{
+	string filename = run_dir.empty() ? out_filename : run_dir + OperSys::DIR_SEP + out_filename;
+	string buf;
+	bool opened = false;
+	for (int i_try = 0; i_try < 4; ++i_try)
+	{
+		if (read_file(filename, buf))
+		{
+			opened = true;
+			break;
+		}
+		w_sleep(1000);
+	}
+	if (!opened)
+	{
+		throw runtime_error(INS_ERRSUB + " cannot open model output file " + filename + ".");
+	}
+	RecordReader reader(buf);
+	string dline;
+	int cil = 0; // current line of the model output file
+	int nblc = 0;
+	int j1 = 0; // 1-based position of the last character processed on dline
+	int mrktyp = 0;
+	int almark = 0;
+	int begins = 0;
+	int il = 0;
+	int ilstart = 0;
+
+	auto throw_at_line = [&](const string &message)
+	{
+		throw runtime_error(INS_ERRSUB + " " + message + " line " + to_string(cil) + " of model output file " + filename + ".");
+	};
+	auto next_line = [&]()
+	{
+		if (!reader.next(dline))
+		{
+			throw runtime_error(INS_ERRSUB + " unexpected end to model output file " + filename + ".");
+		}
+		expand_tabs(dline);
+		++cil;
+	};
+	auto set_obs = [&](const Instruction &item, double val)
+	{
+		if (obs_vals[item.iobs] != NOT_READ)
+		{
+			throw runtime_error(INS_ERRSUB + " observation \"" + item.text + "\" already cited in instruction set.");
+		}
+		obs_vals[item.iobs] = val;
+	};
+	//1-based position of text in dline[j1+1:nblc], or 0
+	auto find_in_line = [&](const string &text, int start)
+	{
+		size_t i = dline.find(text, start);
+		if (i == string::npos || int(i + text.size()) > nblc)
+		{
+			return 0;
+		}
+		return int(i) + 1;
+	};
+
+	size_t ins = 0;
+	while (ins < ins_lines.size())
+	{
+		const vector<Instruction> &items = ins_lines[ins];
+		bool restart = false;
+		bool back = false;
+		for (size_t k = 0; k < items.size(); ++k)
+		{
+			const Instruction &item = items[k];
+			if (k == 0)
+			{
+				if (item.type != InsType::CONTINUATION)
+				{
+					mrktyp = 0;
+					almark = 1;
+					begins = 0;
+					ilstart = il;
+				}
+				else if (begins == 1)
+				{
+					back = true;
+					break;
+				}
+			}
+			switch (item.type)
+			{
+			case InsType::LINE_ADVANCE:
+				if (il != ilstart)
+				{
+					throw_error(INS_ERRSUB + " line advance item can only occur at the beginning of an instruction line.");
+				}
+				almark = 0;
+				++il;
+				for (int i = 1; i < item.num1; ++i)
+				{
+					if (!reader.skip())
+					{
+						throw runtime_error(INS_ERRSUB + " unexpected end to model output file " + filename + ".");
+					}
+					++cil;
+				}
+				next_line();
+				nblc = len_trim(dline);
+				mrktyp = 1;
+				j1 = 0;
+				break;
+			case InsType::MARKER:
+				if (mrktyp == 0)
+				{
+					//primary marker: search forward through the file
+					while (true)
+					{
+						next_line();
+						size_t i = dline.find(item.text);
+						if (i == string::npos && len_trim(item.text) < int(item.text.size()))
+						{
+							//markers ending in blanks can match the end of the line
+							i = (dline + string(item.text.size(), ' ')).find(item.text);
+						}
+						if (i != string::npos)
+						{
+							j1 = int(i + item.text.size());
+							break;
+						}
+					}
+					nblc = len_trim(dline);
+					mrktyp = 1;
+				}
+				else
+				{
+					//secondary marker: search the rest of the current line
+					int j2 = (j1 >= nblc) ? 0 : find_in_line(item.text, j1);
+					if (j2 == 0)
+					{
+						if (almark == 1)
+						{
+							//look for the primary marker again further down the file
+							begins = 1;
+							restart = true;
+							break;
+						}
+						throw_at_line("unable to find secondary marker on");
+					}
+					j1 = j2 + int(item.text.size()) - 1;
+				}
+				break;
+			case InsType::CONTINUATION:
+				break;
+			case InsType::WHITESPACE:
+			{
+				almark = 0;
+				if (j1 >= nblc)
+				{
+					throw_at_line("unable to find requested whitespace, or whitespace precedes end of line at");
+				}
+				size_t i = dline.find(' ', j1);
+				if (i == string::npos || int(i) >= nblc)
+				{
+					throw_at_line("unable to find requested whitespace, or whitespace precedes end of line at");
+				}
+				size_t inb = dline.find_first_not_of(' ', i);
+				j1 = (inb == string::npos || int(inb) >= nblc) ? nblc : int(inb);
+				break;
+			}
+			case InsType::TAB:
+				almark = 0;
+				if (item.num1 < j1)
+				{
+					throw_at_line("backwards move to tab position not allowed on");
+				}
+				j1 = item.num1;
+				if (j1 > nblc)
+				{
+					throw_at_line("tab position beyond end of line at");
+				}
+				break;
+			case InsType::FIXED:
+			case InsType::SEMI_FIXED:
+			{
+				almark = 0;
+				int num1 = item.num1;
+				int num2 = item.num2;
+				if (item.type == InsType::SEMI_FIXED)
+				{
+					//widen or narrow the columns to the number that covers them (see mio_gettot)
+					bool found = true;
+					if (num1 > nblc)
+					{
+						found = false;
+					}
+					else
+					{
+						num2 = min(num2, nblc);
+						if (dline[num2 - 1] == ' ')
+						{
+							found = false;
+							for (int i = num2; i >= num1; --i)
+							{
+								if (dline[i - 1] != ' ')
+								{
+									num2 = i;
+									found = true;
+									break;
+								}
+							}
+						}
+						else if (num2 != nblc)
+						{
+							size_t i = dline.find(' ', num2 - 1);
+							num2 = (i == string::npos || int(i) >= nblc) ? nblc : int(i);
+						}
+						if (found && num1 != 1)
+						{
+							size_t i = dline.find_last_of(' ', num1 - 1);
+							num1 = (i == string::npos) ? 1 : int(i) + 2;
+						}
+					}
+					if (!found)
+					{
+						throw_at_line("cannot find observation \"" + item.text + "\" on");
+					}
+				}
+				else
+				{
+					if (num1 > nblc)
+					{
+						throw_at_line("cannot find observation \"" + item.text + "\" on");
+					}
+					num2 = min(num2, nblc);
+					if (num2 < num1 || dline.find_first_not_of(' ', num1 - 1) >= size_t(num2))
+					{
+						throw_at_line("cannot find observation \"" + item.text + "\" on");
+					}
+				}
+				double val;
+				if (!read_fortran_real(dline, num1 - 1, num2, val))
+				{
+					throw_at_line("cannot read observation \"" + item.text + "\" from");
+				}
+				set_obs(item, val);
+				j1 = num2;
+				break;
+			}
+			case InsType::NON_FIXED:
+			case InsType::DUMMY:
+			{
+				almark = 0;
+				string obs_name = (item.type == InsType::DUMMY) ? string("dum") : item.text;
+				size_t inb = dline.find_first_not_of(' ', j1);
+				if (j1 >= nblc || inb == string::npos || int(inb) >= nblc)
+				{
+					throw_at_line("cannot find observation \"" + obs_name + "\" on");
+				}
+				int num1 = int(inb) + 1;
+				size_t ib = dline.find(' ', num1 - 1);
+				int num2 = (ib == string::npos || int(ib) >= nblc) ? nblc : int(ib);
+				double val;
+				if (!read_fortran_real(dline, num1 - 1, num2, val))
+				{
+					//the number may run into the next marker, as in "1.0e+01,2.0e+01"
+					if (k + 1 >= items.size() || items[k + 1].type != InsType::MARKER)
+					{
+						throw_at_line("cannot read observation \"" + obs_name + "\" from");
+					}
+					int j2 = find_in_line(items[k + 1].text, j1);
+					if (j2 == 0)
+					{
+						throw_at_line("cannot read observation \"" + obs_name + "\" from");
+					}
+					num2 = j2 - 1;
+					if (num2 < num1 || !read_fortran_real(dline, num1 - 1, num2, val))
+					{
+						throw_at_line("cannot read observation \"" + obs_name + "\" from");
+					}
+				}
+				if (item.type == InsType::NON_FIXED)
+				{
+					set_obs(item, val);
+				}
+				j1 = num2;
+				break;
+			}
+			}
+			if (restart)
+			{
+				break;
+			}
+		}
+		if (back)
+		{
+			--ins;
+		}
+		else if (!restart)
+		{
+			++ins;
+		}
+	}
+}
@@ -0,0 +1,94 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEMPLATE_INSTRUCTION_H_
+#define TEMPLATE_INSTRUCTION_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+//Template and instruction file processing for the model interface.  This follows the rules of the
+//fortran mio module (the numbers written to model input files and the values read from model output
+//files are the same), but the files are parsed once when the interface is initialized so a model
+//run only has to fill in the parameter spaces and execute the stored instructions.  Both classes are
+//read-only after compile(), so one instance can serve several concurrent runs in different directories
+
+class TemplateFile
+{
+public:
+	TemplateFile(const std::string &_tpl_filename, const std::string &_in_filename);
+	//parse the template file.  par_index maps lower case parameter names to their position in the
+	//parameter vector and par_widths is lowered to the narrowest parameter space found for each parameter
+	void compile(const std::unordered_map<std::string, int> &par_index, std::vector<int> &par_widths);
+	//write the model input file.  par_words are the parameter values as returned by format_value()
+	void write(const std::vector<std::string> &par_words, const std::string &run_dir = std::string()) const;
+	const std::string &get_tpl_filename() const { return tpl_filename; }
+	const std::string &get_in_filename() const { return in_filename; }
+	//write val into a field nw characters wide with as many significant figures as possible.  tval is the
+	//value of the number actually written.  Returns 0 on success or the mio_wrtsig failure code
+	static int format_value(double val, int nw, std::string &word, double &tval);
+	static std::string format_error_message(int ifail, const std::string &par_name);
+private:
+	class ParSlot
+	{
+	public:
+		size_t offset; // position in text where the parameter space starts
+		int ipar;
+		int width;
+	};
+	std::string tpl_filename;
+	std::string in_filename;
+	std::string text; // model input file contents with the parameter spaces removed
+	std::vector<ParSlot> slots;
+};
+
+class InstructionFile
+{
+public:
+	InstructionFile(const std::string &_ins_filename, const std::string &_out_filename);
+	//parse the instruction file.  obs_index maps lower case observation names to their position in the
+	//observation vector and obs_cited is incremented for every observation the file reads
+	void compile(const std::unordered_map<std::string, int> &obs_index, std::vector<int> &obs_cited);
+	//read the model output file.  Only the entries of obs_vals cited in this file are set.  Entries that
+	//are read must hold NOT_READ on entry so repeated reads of one observation are detected
+	void read(std::vector<double> &obs_vals, const std::string &run_dir = std::string()) const;
+	const std::string &get_ins_filename() const { return ins_filename; }
+	const std::string &get_out_filename() const { return out_filename; }
+	static const double NOT_READ;
+private:
+	enum class InsType { LINE_ADVANCE, MARKER, CONTINUATION, WHITESPACE, TAB, FIXED, SEMI_FIXED, NON_FIXED, DUMMY };
+	class Instruction
+	{
+	public:
+		InsType type;
+		int num1; // line advance count, tab position or first column
+		int num2; // last column
+		int iobs;
+		std::string text; // marker text or lower case observation name
+	};
+	std::string ins_filename;
+	std::string out_filename;
+	char marker;
+	std::vector<std::vector<Instruction>> ins_lines;
+
+	void throw_error(const std::string &message) const;
+};
+
+#endif /* TEMPLATE_INSTRUCTION_H_ */
@@ -26,6 +26,7 @@
 #include <cstring>
 #include <map>
 #include <algorithm>
+#include <chrono>
 #include "system_variables.h"
 #include "Transformable.h"
 #include "utilities.h"
@@ -41,7 +42,7 @@ RunManagerSerial::RunManagerSerial(const vector<string> _comline_vec,
 	const string &stor_filename, const string &_run_dir, int _max_run_fail)
 	: RunManagerAbstract(_comline_vec, _tplfile_vec, _inpfile_vec,
 	_insfile_vec, _outfile_vec, stor_filename, _max_run_fail),
-	run_dir(_run_dir), mi(_tplfile_vec,_inpfile_vec,_insfile_vec,_outfile_vec, _comline_vec)
+	run_dir(_run_dir), run_in_progress(false), n_session_runs(0), n_success_runs(0), mi(_tplfile_vec,_inpfile_vec,_insfile_vec,_outfile_vec, _comline_vec)
 {
 
 	cout << "              starting serial run manager ..." << endl << endl;
@@ -49,68 +50,42 @@ RunManagerSerial::RunManagerSerial(const vector<string> _comline_vec,
 
 void RunManagerSerial::run()
 {
-	int success_runs = 0;
-	int prev_sucess_runs = 0;
-	const vector<string> &par_name_vec = file_stor.get_par_name_vec();
-	const vector<string> &obs_name_vec = file_stor.get_obs_name_vec();
+	run_until(RUN_UNTIL_COND::NORMAL);
+}
 
+RunManagerAbstract::RUN_UNTIL_COND RunManagerSerial::run_until(RUN_UNTIL_COND condition, int n_nops, double sec)
+{
+	//model runs block, so the time limit is only checked between runs and there are never any no-ops
 	stringstream message;
-	std::vector<double> obs_vec;
+	if (!run_in_progress)
+	{
+		n_session_runs = get_outstanding_run_ids().size();
+		n_success_runs = 0;
+		progress_message.clear();
+		run_in_progress = true;
+	}
+	std::chrono::system_clock::time_point start_time = std::chrono::system_clock::now();
 	vector<int> run_id_vec;
-	int nruns = get_outstanding_run_ids().size();
 	while (!(run_id_vec = get_outstanding_run_ids()).empty())
 	{
 		for (int i_run : run_id_vec)
 		{
-			try
+			run_model(i_run);
+			if ((condition == RUN_UNTIL_COND::TIME || condition == RUN_UNTIL_COND::NO_OPS_OR_TIME) &&
+				std::chrono::duration<double>(std::chrono::system_clock::now() - start_time).count() >= sec)
 			{
-				Observations obs;
-				vector<double> par_values;
-				Parameters pars;
-				file_stor.get_parameters(i_run, pars);
-				obs_vec.resize(obs_name_vec.size(), RunStorage::no_data);
-				obs.clear();
-				obs.insert(obs_name_vec, obs_vec);
-				mi.run(&pars, &obs);
-				
-				OperSys::chdir(run_dir.c_str());
-				success_runs += 1;
-				std::cout << string(message.str().size(), '\b');
-				message.str("");
-				message << "(" << success_runs << "/" << nruns << " runs complete)";
-				std::cout << message.str();
-				file_stor.update_run(i_run, pars, obs);
-
-			}
-			catch (const std::exception& ex)
-			{
-				update_run_failed(i_run);
-				cerr << endl;
-				cerr << "  " << ex.what() << endl;
-				cerr << "  Aborting model run" << endl << endl;
-			}
-			catch (...)
-			{
-				update_run_failed(i_run);
-				cerr << endl;
-				cerr << "  Error running model" << endl;
-				cerr << "  Aborting model run" << endl << endl;
+				return RUN_UNTIL_COND::TIME;
 			}
 		}
 	}
-	total_runs += success_runs;
-	std::cout << string(message.str().size(), '\b');
-	message.str("");
-	message << "(" << success_runs << "/" << nruns << " runs complete";
-	if (prev_sucess_runs > 0)
-	{
-		message << " and " << prev_sucess_runs << " additional run completed previously";
-	}
-	message << ")";
+	run_in_progress = false;
+	total_runs += n_success_runs;
+	std::cout << string(progress_message.size(), '\b');
+	message << "(" << n_success_runs << "/" << n_session_runs << " runs complete)";
 	std::cout << message.str();
-	if (success_runs < nruns)
+	if (n_success_runs < n_session_runs)
 	{			cout << endl << endl;
-		cout << "WARNING: " << nruns - success_runs << " out of " << nruns << " runs failed" << endl << endl;
+		cout << "WARNING: " << n_session_runs - n_success_runs << " out of " << n_session_runs << " runs failed" << endl << endl;
 	}
 	std::cout << endl << endl;
 	if (init_sim.size() == 0)
@@ -118,6 +93,56 @@ void RunManagerSerial::run()
 		vector<double> pars;
 		int status = file_stor.get_run(0, pars, init_sim);
 	}
+	return RUN_UNTIL_COND::NORMAL;
+}
+
+void RunManagerSerial::cancel_run(int run_id)
+{
+	//model runs block, so the run can only be waiting to start
+	if (!run_requried(run_id))
+		return;
+	RunManagerAbstract::cancel_run(run_id);
+	if (run_in_progress)
+		--n_session_runs;
+}
+
+void RunManagerSerial::run_model(int i_run)
+{
+	const vector<string> &obs_name_vec = file_stor.get_obs_name_vec();
+	try
+	{
+		Observations obs;
+		Parameters pars;
+		file_stor.get_parameters(i_run, pars);
+		std::vector<double> obs_vec(obs_name_vec.size(), RunStorage::no_data);
+		obs.insert(obs_name_vec, obs_vec);
+		mi.run(&pars, &obs);
+
+		OperSys::chdir(run_dir.c_str());
+		n_success_runs += 1;
+		std::cout << string(progress_message.size(), '\b');
+		stringstream message;
+		message << "(" << n_success_runs << "/" << n_session_runs << " runs complete)";
+		progress_message = message.str();
+		std::cout << progress_message;
+		file_stor.update_run(i_run, pars, obs);
+	}
+	catch (const std::exception& ex)
+	{
+		update_run_failed(i_run);
+		cerr << endl;
+		cerr << "  " << ex.what() << endl;
+		cerr << "  Aborting model run" << endl << endl;
+	}
+	catch (...)
+	{
+		update_run_failed(i_run);
+		cerr << endl;
+		cerr << "  Error running model" << endl;
+		cerr << "  Aborting model run" << endl << endl;
+	}
+	if (!run_requried(i_run))
+		report_completed_run(i_run);
 }
 
 
@@ -31,12 +31,19 @@ public:
 		const std::vector<std::string> _insfile_vec, const std::vector<std::string> _outfile_vec,
 		const std::string &stor_filename, const std::string &run_dir, int _max_run_fail=1);
 	virtual void run();
+	virtual RunManagerAbstract::RUN_UNTIL_COND run_until(RUN_UNTIL_COND condition, int n_nops = 0, double sec = 0.0);
+	virtual void cancel_run(int run_id);
 	void throw_mio_error(std::string base_message);
 	~RunManagerSerial(void);
 private:
 	ModelInterface mi;
 
 	std::string run_dir;
+	bool run_in_progress; // run_until() returned early and the current set of runs has not finished
+	int n_session_runs;
+	int n_success_runs;
+	std::string progress_message;
+	void run_model(int run_id);
 	static std::string tpl_err_msg(int i);
 	static std::string ins_err_msg(int i);
 };
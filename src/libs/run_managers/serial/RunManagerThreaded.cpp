@@ -0,0 +1,273 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+#include "RunManagerThreaded.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <set>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include "system_variables.h"
+#include "Transformable.h"
+#include "utilities.h"
+#include "model_interface.h"
+
+using namespace std;
+using namespace pest_utils;
+
+const string RunManagerThreaded::WORKER_DIR_PREFIX = "pestpp_worker_";
+const int RunManagerThreaded::WAIT_MILLISEC = 100;
+
+RunManagerThreaded::RunManagerThreaded(const vector<string> _comline_vec,
+	const vector<string> _tplfile_vec, const vector<string> _inpfile_vec,
+	const vector<string> _insfile_vec, const vector<string> _outfile_vec,
+	const string &stor_filename, const string &_run_dir, int _max_run_fail, int _num_workers)
+	: RunManagerAbstract(_comline_vec, _tplfile_vec, _inpfile_vec,
+	_insfile_vec, _outfile_vec, stor_filename, _max_run_fail),
+	mi(_tplfile_vec, _inpfile_vec, _insfile_vec, _outfile_vec, _comline_vec), run_dir(_run_dir),
+	num_workers(max(1, _num_workers)), run_in_progress(false), n_session_runs(0), n_success_runs(0), n_done(0)
+{
+	cout << "              starting threaded run manager (" << num_workers << " workers) ..." << endl << endl;
+	init_workers(stor_filename, _tplfile_vec, _inpfile_vec, _insfile_vec, _outfile_vec);
+}
+
+void RunManagerThreaded::init_workers(const string &stor_filename, const vector<string> &tplfile_vec,
+	const vector<string> &inpfile_vec, const vector<string> &insfile_vec, const vector<string> &outfile_vec)
+{
+	//each worker after the first runs the model in a copy of run_dir.  The files written by
+	//PEST++ itself (all named <case>.*, including the run storage) are left out of the copies,
+	//unless they are also one of the model interface files
+	string case_prefix = get_filename(stor_filename);
+	size_t dot = case_prefix.find_last_of('.');
+	case_prefix = (dot == string::npos) ? case_prefix + "." : case_prefix.substr(0, dot + 1);
+	set<string> model_files;
+	for (auto files : { &tplfile_vec, &inpfile_vec, &insfile_vec, &outfile_vec })
+		for (auto &f : *files)
+			model_files.insert(get_filename(f));
+	auto skip_case_file = [&](const string &name)
+	{
+		return (name.compare(0, case_prefix.size(), case_prefix) == 0) && (model_files.find(name) == model_files.end());
+	};
+	workers.clear();
+	for (int i_worker = 0; i_worker < num_workers; ++i_worker)
+	{
+		unique_ptr<Worker> worker(new Worker());
+		if (i_worker > 0)
+		{
+			worker->run_dir = WORKER_DIR_PREFIX + to_string(i_worker);
+			cout << "copying " << run_dir << " to worker directory " << worker->run_dir << endl;
+			copy_dir(run_dir, run_dir + OperSys::DIR_SEP + worker->run_dir, WORKER_DIR_PREFIX, skip_case_file);
+		}
+		worker->run_id = -1;
+		worker->busy = false;
+		workers.push_back(move(worker));
+	}
+	cout << endl;
+}
+
+void RunManagerThreaded::run()
+{
+	run_until(RUN_UNTIL_COND::NORMAL);
+}
+
+RunManagerAbstract::RUN_UNTIL_COND RunManagerThreaded::run_until(RUN_UNTIL_COND condition, int n_nops, double sec)
+{
+	//model runs keep going in the background after an early return; n_nops is not used
+	stringstream message;
+	if (!run_in_progress)
+	{
+		par_name_vec = file_stor.get_par_name_vec();
+		obs_name_vec = file_stor.get_obs_name_vec();
+		if (!mi.get_initialized())
+		{
+			//the template and instruction files are parsed once, before the run threads share them
+			mi.initialize(par_name_vec, obs_name_vec);
+		}
+		vector<int> run_id_vec = get_outstanding_run_ids();
+		waiting_runs.assign(run_id_vec.begin(), run_id_vec.end());
+		n_session_runs = run_id_vec.size();
+		n_success_runs = 0;
+		progress_message.clear();
+		run_in_progress = true;
+	}
+	std::chrono::system_clock::time_point start_time = std::chrono::system_clock::now();
+	while (true)
+	{
+		bool any_busy = false;
+		for (auto &worker : workers)
+		{
+			if (worker->busy && worker->f_finished->get())
+			{
+				finish_run(*worker);
+			}
+			if ((!worker->busy) && (!waiting_runs.empty()))
+			{
+				int run_id = waiting_runs.front();
+				waiting_runs.pop_front();
+				start_run(*worker, run_id);
+			}
+			any_busy = any_busy || worker->busy;
+		}
+		if (!any_busy)
+		{
+			break;
+		}
+		if ((condition == RUN_UNTIL_COND::TIME || condition == RUN_UNTIL_COND::NO_OPS_OR_TIME) &&
+			std::chrono::duration<double>(std::chrono::system_clock::now() - start_time).count() >= sec)
+		{
+			return RUN_UNTIL_COND::TIME;
+		}
+		unique_lock<mutex> done_lock(done_mutex);
+		done_cv.wait_for(done_lock, std::chrono::milliseconds(WAIT_MILLISEC), [this]() { return n_done > 0; });
+		n_done = 0;
+	}
+	run_in_progress = false;
+	total_runs += n_success_runs;
+	std::cout << string(progress_message.size(), '\b');
+	message << "(" << n_success_runs << "/" << n_session_runs << " runs complete)";
+	std::cout << message.str();
+	if (n_success_runs < n_session_runs)
+	{
+		cout << endl << endl;
+		cout << "WARNING: " << n_session_runs - n_success_runs << " out of " << n_session_runs << " runs failed" << endl << endl;
+	}
+	std::cout << endl << endl;
+	if (init_sim.size() == 0)
+	{
+		vector<double> pars;
+		int status = file_stor.get_run(0, pars, init_sim);
+	}
+	return RUN_UNTIL_COND::NORMAL;
+}
+
+void RunManagerThreaded::cancel_run(int run_id)
+{
+	if (!run_requried(run_id))
+		return;
+	RunManagerAbstract::cancel_run(run_id);
+	if (run_in_progress)
+		--n_session_runs;
+	waiting_runs.erase(remove(waiting_runs.begin(), waiting_runs.end(), run_id), waiting_runs.end());
+	//a model run that is already going is stopped, finish_run() discards whatever it produced
+	for (auto &worker : workers)
+	{
+		if (worker->busy && worker->run_id == run_id)
+		{
+			worker->f_terminate->set(true);
+		}
+	}
+}
+
+void RunManagerThreaded::start_run(Worker &worker, int run_id)
+{
+	worker.run_id = run_id;
+	file_stor.get_run(run_id, worker.par_values, worker.obs_values);
+	worker.f_terminate.reset(new thread_flag(false));
+	worker.f_finished.reset(new thread_flag(false));
+	worker.shared_execptions.reset(new thread_exceptions());
+	worker.busy = true;
+	worker.run_thread = thread(&RunManagerThreaded::run_async, this, worker.f_terminate.get(), worker.f_finished.get(),
+		worker.shared_execptions.get(), &worker.par_values, &worker.obs_values, worker.run_dir);
+}
+
+void RunManagerThreaded::finish_run(Worker &worker)
+{
+	worker.run_thread.join();
+	worker.busy = false;
+	int run_id = worker.run_id;
+	if (run_canceled(run_id))
+	{
+		return;
+	}
+	if (worker.shared_execptions->size() > 0)
+	{
+		update_run_failed(run_id);
+		try
+		{
+			worker.shared_execptions->rethrow();
+		}
+		catch (const std::exception& ex)
+		{
+			cerr << endl;
+			cerr << "  " << ex.what() << endl;
+			cerr << "  Aborting model run" << endl << endl;
+		}
+		catch (...)
+		{
+			cerr << endl;
+			cerr << "  Error running model" << endl;
+			cerr << "  Aborting model run" << endl << endl;
+		}
+		if (run_requried(run_id))
+		{
+			waiting_runs.push_back(run_id);
+		}
+		else
+		{
+			report_completed_run(run_id);
+		}
+		return;
+	}
+	//the parameter values are updated with the values written to the model input files
+	file_stor.update_runs(vector<int>{ run_id }, worker.par_values.data(), worker.obs_values.data());
+	n_success_runs += 1;
+	std::cout << string(progress_message.size(), '\b');
+	stringstream message;
+	message << "(" << n_success_runs << "/" << n_session_runs << " runs complete)";
+	progress_message = message.str();
+	std::cout << progress_message;
+	report_completed_run(run_id);
+}
+
+void RunManagerThreaded::run_async(thread_flag* terminate, thread_flag* finished, thread_exceptions *shared_execptions,
+	vector<double>* par_values, vector<double>* obs_values, string run_dir)
+{
+	mi.run(terminate, finished, shared_execptions, par_name_vec, *par_values, obs_name_vec, *obs_values, run_dir);
+	//failed runs do not set the finished flag, but the manager needs to know the thread is done
+	finished->set(true);
+	lock_guard<mutex> done_lock(done_mutex);
+	++n_done;
+	done_cv.notify_one();
+}
+
+void RunManagerThreaded::terminate_workers()
+{
+	for (auto &worker : workers)
+	{
+		if (worker->busy)
+		{
+			worker->f_terminate->set(true);
+			worker->run_thread.join();
+			worker->busy = false;
+		}
+	}
+}
+
+RunManagerThreaded::~RunManagerThreaded(void)
+{
+	terminate_workers();
+	for (auto &worker : workers)
+	{
+		if (worker->run_dir.empty())
+			continue;
+		if (!remove_dir(run_dir + OperSys::DIR_SEP + worker->run_dir))
+			cerr << "warning: unable to remove worker directory " << worker->run_dir << endl;
+	}
+}
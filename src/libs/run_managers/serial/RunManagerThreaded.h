@@ -0,0 +1,91 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+#ifndef RUNMANAGERTHREADED_H
+#define RUNMANAGERTHREADED_H
+
+#include "RunManagerAbstract.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "model_interface.h"
+#include "utilities.h"
+
+//Runs several instances of the model at once on the local machine, each in its own
+//copy of the run directory.  Model runs are handed out to the workers as they become free
+class RunManagerThreaded : public RunManagerAbstract
+{
+public:
+	RunManagerThreaded(const std::vector<std::string> _comline_vec,
+		const std::vector<std::string> _tplfile_vec, const std::vector<std::string> _inpfile_vec,
+		const std::vector<std::string> _insfile_vec, const std::vector<std::string> _outfile_vec,
+		const std::string &stor_filename, const std::string &run_dir, int _max_run_fail=1, int _num_workers=2);
+	virtual void run();
+	virtual RunManagerAbstract::RUN_UNTIL_COND run_until(RUN_UNTIL_COND condition, int n_nops = 0, double sec = 0.0);
+	virtual void cancel_run(int run_id);
+	~RunManagerThreaded(void);
+private:
+	//one model run directory.  Worker 0 runs the model in run_dir, the others in copies of it
+	class Worker
+	{
+	public:
+		std::string run_dir;
+		int run_id;
+		std::vector<double> par_values;
+		std::vector<double> obs_values;
+		std::thread run_thread;
+		std::unique_ptr<pest_utils::thread_flag> f_terminate;
+		std::unique_ptr<pest_utils::thread_flag> f_finished;
+		std::unique_ptr<pest_utils::thread_exceptions> shared_execptions;
+		bool busy;
+	};
+	static const std::string WORKER_DIR_PREFIX;
+	static const int WAIT_MILLISEC;
+
+	ModelInterface mi;
+	std::string run_dir;
+	int num_workers;
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::string> par_name_vec;
+	std::vector<std::string> obs_name_vec;
+	std::deque<int> waiting_runs;
+	bool run_in_progress; // run_until() returned early and the current set of runs has not finished
+	int n_session_runs;
+	int n_success_runs;
+	std::string progress_message;
+	//signalled by the run threads when a model run ends
+	std::mutex done_mutex;
+	std::condition_variable done_cv;
+	int n_done;
+
+	void init_workers(const std::string &stor_filename, const std::vector<std::string> &tplfile_vec,
+		const std::vector<std::string> &inpfile_vec, const std::vector<std::string> &insfile_vec,
+		const std::vector<std::string> &outfile_vec);
+	void start_run(Worker &worker, int run_id);
+	void finish_run(Worker &worker);
+	void terminate_workers();
+	void run_async(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished,
+		pest_utils::thread_exceptions *shared_execptions,
+		std::vector<double>* par_values, std::vector<double>* obs_values, std::string run_dir);
+};
+
+#endif /* RUNMANAGERTHREADED_H */
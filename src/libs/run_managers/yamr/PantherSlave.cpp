@@ -9,12 +9,13 @@
 #include "system_variables.h"
 #include "utilities.h"
 #include <regex>
+#include <set>
 
 using namespace pest_utils;
 
 int  linpack_wrap(void);
 
-PANTHERSlave::PANTHERSlave() :mi()
+PANTHERSlave::PANTHERSlave() :mi(), compress_results(false), n_slots(1)
 {
 
 }
@@ -68,6 +69,15 @@ PANTHERSlave::~PANTHERSlave()
 {
 	w_close(sockfd);
 	w_cleanup();
+	//the slot threads have been joined by terminate_slots()
+	string cwd = OperSys::getcwd();
+	for (auto &slot_ptr : slots)
+	{
+		if (slot_ptr->run_dir.empty())
+			continue;
+		if (!remove_dir(cwd + OperSys::DIR_SEP + slot_ptr->run_dir))
+			cerr << "warning: unable to remove slot directory " << slot_ptr->run_dir << endl;
+	}
 }
 
 
@@ -85,6 +95,8 @@ void PANTHERSlave::process_ctl_file(const string &ctl_filename)
 	int num_par;
 	int num_tpl_file;
 
+	case_prefix = get_filename(ctl_filename);
+	case_prefix = case_prefix.substr(0, case_prefix.find_last_of('.')) + ".";
 	comline_vec.clear();
 	tplfile_vec.clear();
 	inpfile_vec.clear();
@@ -170,6 +182,7 @@ void PANTHERSlave::process_ctl_file(const string &ctl_filename)
 	fin.close();
 
 	poll_interval_seconds = 1;
+	n_slots = 1;
 	for (auto &line : pestpp_lines)
 	{
 		string key;
@@ -197,6 +210,10 @@ void PANTHERSlave::process_ctl_file(const string &ctl_filename)
 				convert_ip(value, poll_interval_seconds);
 
 			}
+			else if (key == "PANTHER_AGENT_SLOTS") {
+				convert_ip(value, n_slots);
+				n_slots = max(n_slots, 1);
+			}
 		}
 	}
 }
@@ -216,6 +233,8 @@ void PANTHERSlave::process_panther_ctl_file(const string &ctl_filename)
 
 	int i_tpl_ins = 0, n_tpl_file = 0;
 
+	case_prefix = get_filename(ctl_filename);
+	case_prefix = case_prefix.substr(0, case_prefix.find_last_of('.')) + ".";
 	comline_vec.clear();
 	tplfile_vec.clear();
 	inpfile_vec.clear();
@@ -298,6 +317,7 @@ void PANTHERSlave::process_panther_ctl_file(const string &ctl_filename)
 
 	fin.close();
 	poll_interval_seconds = 1;
+	n_slots = 1;
 	for (auto &line : pestpp_lines)
 	{
 		string key;
@@ -325,6 +345,10 @@ void PANTHERSlave::process_panther_ctl_file(const string &ctl_filename)
 				convert_ip(value, poll_interval_seconds);
 
 			}
+			else if (key == "PANTHER_AGENT_SLOTS") {
+				convert_ip(value, n_slots);
+				n_slots = max(n_slots, 1);
+			}
 		}
 	}
 
@@ -432,7 +456,7 @@ int PANTHERSlave::send_message(NetPackage &net_pack, const void *data, unsigned
 }
 
 
-NetPackage::PackType PANTHERSlave::run_model(Parameters &pars, Observations &obs, NetPackage &net_pack)
+NetPackage::PackType PANTHERSlave::run_model(vector<double> &par_values, vector<double> &obs_values, NetPackage &net_pack, bool cleanup_pause)
 {
 	NetPackage::PackType final_run_status = NetPackage::PackType::RUN_FAILED;
 	bool done = false;
@@ -450,17 +474,8 @@ NetPackage::PackType PANTHERSlave::run_model(Parameters &pars, Observations &obs
 	thread_exceptions shared_execptions;
 	try
 	{
-		vector<string> par_name_vec;
-		vector<double> par_values;
-		for (auto &i : pars)
-		{
-			par_name_vec.push_back(i.first);
-			par_values.push_back(i.second);
-		}
-
-		vector<double> obs_vec;
 		thread run_thread(&PANTHERSlave::run_async, this, &f_terminate, &f_finished, &shared_execptions,
-		   &pars, &obs);
+		   &par_values, &obs_values, string());
 		pest_utils::thread_RAII raii(run_thread);
 
 		while (true)
@@ -553,15 +568,246 @@ NetPackage::PackType PANTHERSlave::run_model(Parameters &pars, Observations &obs
 	}
 
 	//sleep here just to give the os a chance to cleanup any remaining file handles
-	w_sleep(poll_interval_seconds * 1000);
+	//(skipped between the runs of a batch)
+	if (cleanup_pause)
+	{
+		w_sleep(poll_interval_seconds * 1000);
+	}
 	return final_run_status;
 }
 
 
+void PANTHERSlave::send_run_result(NetPackage::PackType final_run_status, int group_id, int run_id, double run_time,
+	const vector<double> &par_values, const vector<double> &obs_values, const string &slot_tag)
+{
+	NetPackage net_pack;
+	vector<int8_t> serialized_data;
+	int err;
+	if (final_run_status == NetPackage::PackType::RUN_FINISHED)
+	{
+		//send model results back
+		cout << "run complete" << endl;
+		cout << "sending results to master (group id = " << group_id << ", run id = " << run_id << ")..." << endl;
+		cout << "results sent" << endl << endl;
+		serialized_data = Serialization::serialize(par_values, obs_values, run_time);
+		NetPackage::PackType result_type = NetPackage::PackType::RUN_FINISHED;
+		if (compress_results)
+		{
+			vector<int8_t> comp_data = Serialization::compress_doubles(serialized_data);
+			//fall back to the uncompressed package if compression does not help
+			if (comp_data.size() < serialized_data.size())
+			{
+				serialized_data.swap(comp_data);
+				result_type = NetPackage::PackType::RUN_FINISHED_COMPRESSED;
+			}
+		}
+		net_pack.reset(result_type, group_id, run_id, slot_tag);
+		err = send_message(net_pack, serialized_data.data(), serialized_data.size());
+		if (err != 1)
+		{
+			exit(-1);
+		}
+	}
+	else if (final_run_status == NetPackage::PackType::RUN_FAILED)
+	{
+		cout << "run failed" << endl;
+		net_pack.reset(NetPackage::PackType::RUN_FAILED, group_id, run_id, slot_tag);
+		char data;
+		err = send_message(net_pack, &data, 0);
+		if (err != 1)
+		{
+			exit(-1);
+		}
+	}
+	else if (final_run_status == NetPackage::PackType::RUN_KILLED)
+	{
+		cout << "run killed" << endl;
+		net_pack.reset(NetPackage::PackType::RUN_KILLED, group_id, run_id, slot_tag);
+		char data;
+		err = send_message(net_pack, &data, 0);
+		if (err != 1)
+		{
+			exit(-1);
+		}
+	}
+	else if (final_run_status == NetPackage::PackType::TERMINATE)
+	{
+		cout << "run preempted by termination requested" << endl;
+		terminate = true;
+	}
+}
+
 void PANTHERSlave::run_async(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished, pest_utils::thread_exceptions *shared_execptions,
-	Parameters* pars, Observations* obs)
+	vector<double>* par_values, vector<double>* obs_values, string run_dir)
+{
+	mi.run(terminate, finished, shared_execptions, par_name_vec, *par_values, obs_name_vec, *obs_values, run_dir);
+	//killed and failed runs do not set the finished flag, but the slots need to know the thread is done
+	finished->set(true);
+}
+
+void PANTHERSlave::init_slots()
+{
+	slots.clear();
+	if (n_slots <= 1)
+	{
+		return;
+	}
+	//each extra slot runs the model in a copy of the current directory.  The files written by
+	//PEST++ (all named <case>.*) and the model output files of earlier runs are left out of the
+	//copies, unless they are also one of the template, instruction or model input files
+	string cwd = OperSys::getcwd();
+	set<string> model_files, output_files;
+	for (auto files : { &tplfile_vec, &inpfile_vec, &insfile_vec })
+		for (auto &f : *files)
+			model_files.insert(get_filename(f));
+	for (auto &f : outfile_vec)
+		output_files.insert(get_filename(f));
+	auto skip_file = [&](const string &name)
+	{
+		if (model_files.find(name) != model_files.end())
+			return false;
+		return (name.compare(0, case_prefix.size(), case_prefix) == 0) || (output_files.find(name) != output_files.end());
+	};
+	for (int i_slot = 0; i_slot < n_slots; ++i_slot)
+	{
+		unique_ptr<RunSlot> slot(new RunSlot());
+		if (i_slot > 0)
+		{
+			slot->run_dir = "panther_slot_" + to_string(i_slot);
+			slot->tag = to_string(i_slot);
+			cout << "copying " << cwd << " to slot directory " << slot->run_dir << endl;
+			copy_dir(cwd, cwd + OperSys::DIR_SEP + slot->run_dir, "panther_slot_", skip_file);
+		}
+		slot->group_id = -1;
+		slot->run_id = -1;
+		slot->busy = false;
+		slot->killed = false;
+		slot->ready_pending = false;
+		slots.push_back(move(slot));
+	}
+	cout << "running " << n_slots << " model slots" << endl << endl;
+}
+
+PANTHERSlave::RunSlot* PANTHERSlave::get_slot(const NetPackage &net_pack)
+{
+	//messages for slot 0 are not tagged
+	string tag = net_pack.get_desc();
+	int i_slot = tag.empty() ? 0 : atoi(tag.c_str());
+	if (i_slot < 0 || i_slot >= int(slots.size()))
+	{
+		throw PestError("received message for unknown model slot: " + tag);
+	}
+	return slots[i_slot].get();
+}
+
+void PANTHERSlave::start_slot_run(RunSlot &slot)
+{
+	if (!mi.get_initialized())
+	{
+		//initialize the model interface
+		mi.initialize(tplfile_vec, inpfile_vec, insfile_vec,
+			outfile_vec, comline_vec, par_name_vec, obs_name_vec);
+	}
+	slot.run_id = slot.queued_runs.front().first;
+	slot.par_values.swap(slot.queued_runs.front().second);
+	slot.queued_runs.pop_front();
+	slot.f_terminate.reset(new thread_flag(false));
+	slot.f_finished.reset(new thread_flag(false));
+	slot.shared_execptions.reset(new thread_exceptions());
+	slot.busy = true;
+	slot.killed = false;
+	slot.ready_pending = false;
+	slot.start_time = chrono::system_clock::now();
+	cout << "starting model run in slot " << (slot.tag.empty() ? "0" : slot.tag) << " (group id = " << slot.group_id << ", run id = " << slot.run_id << ")..." << endl;
+	slot.run_thread = thread(&PANTHERSlave::run_async, this, slot.f_terminate.get(), slot.f_finished.get(),
+		slot.shared_execptions.get(), &slot.par_values, &slot.obs_values, slot.run_dir);
+}
+
+void PANTHERSlave::process_slots()
+{
+	for (auto &slot_ptr : slots)
+	{
+		RunSlot &slot = *slot_ptr;
+		if (slot.busy && slot.f_finished->get())
+		{
+			slot.run_thread.join();
+			slot.busy = false;
+			NetPackage::PackType final_run_status = NetPackage::PackType::RUN_FINISHED;
+			if (slot.killed)
+			{
+				final_run_status = NetPackage::PackType::RUN_KILLED;
+			}
+			else if (slot.shared_execptions->size() > 0)
+			{
+				final_run_status = NetPackage::PackType::RUN_FAILED;
+				try
+				{
+					slot.shared_execptions->rethrow();
+				}
+				catch (const std::exception& ex)
+				{
+					cerr << endl;
+					cerr << "   " << ex.what() << endl;
+					cerr << "   Aborting model run" << endl << endl;
+				}
+				catch (...)
+				{
+					cerr << "   Error running model" << endl;
+					cerr << "   Aborting model run" << endl;
+				}
+			}
+			send_run_result(final_run_status, slot.group_id, slot.run_id, pest_utils::get_duration_sec(slot.start_time),
+				slot.par_values, slot.obs_values, slot.tag);
+			if (final_run_status == NetPackage::PackType::RUN_KILLED)
+			{
+				//the master requeues the rest of the batch when it kills a run
+				slot.queued_runs.clear();
+			}
+			slot.killed = false;
+			if (slot.queued_runs.empty())
+			{
+				//give the os a chance to cleanup any remaining file handles before the slot is reused
+				slot.ready_pending = true;
+				slot.ready_time = chrono::system_clock::now() + chrono::seconds(poll_interval_seconds);
+			}
+		}
+		if (!slot.busy && !slot.queued_runs.empty())
+		{
+			start_slot_run(slot);
+		}
+		else if (!slot.busy && slot.ready_pending && chrono::system_clock::now() >= slot.ready_time)
+		{
+			cout << "sending ready signal to master for slot " << (slot.tag.empty() ? "0" : slot.tag) << endl;
+			NetPackage net_pack(NetPackage::PackType::READY, 0, 0, slot.tag);
+			char data;
+			int err = send_message(net_pack, &data, 0);
+			if (err != 1)
+			{
+				exit(-1);
+			}
+			slot.ready_pending = false;
+		}
+	}
+}
+
+void PANTHERSlave::terminate_slots()
 {
-	mi.run(terminate,finished,shared_execptions, pars, obs);
+	for (auto &slot_ptr : slots)
+	{
+		if (slot_ptr->busy)
+		{
+			slot_ptr->f_terminate->set(true);
+		}
+	}
+	for (auto &slot_ptr : slots)
+	{
+		if (slot_ptr->busy)
+		{
+			slot_ptr->run_thread.join();
+			slot_ptr->busy = false;
+		}
+		slot_ptr->queued_runs.clear();
+	}
 }
 
 
@@ -589,19 +835,30 @@ void PANTHERSlave::check_io()
 void PANTHERSlave::start(const string &host, const string &port)
 {
 	NetPackage net_pack;
-	Observations obs;
-	Parameters pars;
-	vector<int8_t> serialized_data;
+	vector<double> par_values;
+	vector<double> obs_values;
 	int err;
 
 
 	//class attribute - can be modified in run_model()
 	terminate = false;
+	init_slots();
 	init_network(host, port);
 	while (!terminate)
 	{
-		//get message from master
-		err = recv_message(net_pack);
+		if (n_slots > 1)
+		{
+			//model runs carry on in the slot threads while waiting for messages from the master
+			process_slots();
+			err = recv_message(net_pack, 0, 100000);
+			//timeout on recv
+			if (err == 2) continue;
+		}
+		else
+		{
+			//get message from master
+			err = recv_message(net_pack);
+		}
 		if (err < 0)
 		{
 			cout << "error receiving message from master, terminating" << endl;
@@ -618,6 +875,22 @@ void PANTHERSlave::start(const string &host, const string &port)
 			{
 				exit(-1);
 			}
+			if (n_slots > 1)
+			{
+				// the master tracks each slot as a separate slave sharing this connection
+				vector<string> slot_dirs;
+				for (auto &slot : slots)
+				{
+					slot_dirs.push_back(slot->run_dir.empty() ? cwd : cwd + OperSys::DIR_SEP + slot->run_dir);
+				}
+				vector<int8_t> data = Serialization::serialize(slot_dirs);
+				net_pack.reset(NetPackage::PackType::SLOTS, 0, 0, "");
+				err = send_message(net_pack, data.data(), data.size());
+				if (err != 1)
+				{
+					exit(-1);
+				}
+			}
 		}
 		else if (net_pack.get_type() == NetPackage::PackType::PAR_NAMES)
 		{
@@ -660,37 +933,52 @@ void PANTHERSlave::start(const string &host, const string &port)
 				exit(-1);
 			}
 		}
+		else if (net_pack.get_type() == NetPackage::PackType::REQ_COMPRESSION)
+		{
+			cout << "master requested compressed model results" << endl;
+			compress_results = true;
+		}
 		else if(net_pack.get_type() == NetPackage::PackType::START_RUN)
 		{
-			Serialization::unserialize(net_pack.get_data(), pars, par_name_vec);
+			// parameter values are sent as packed doubles in the order of par_name_vec
+			const vector<int8_t> &par_data = net_pack.get_data();
+			if (par_data.size() < par_name_vec.size() * sizeof(double))
+			{
+				cerr << "received corrupt parameter value packet from master" << endl;
+				cerr << "terminating execution ..." << endl << endl;
+				net_pack.reset(NetPackage::PackType::CORRUPT_MESG, 0, 0, "");
+				char data;
+				int np_err = send_message(net_pack, &data, 0);
+				exit(-1);
+			}
+			par_values.resize(par_name_vec.size());
+			if (!par_values.empty())
+			{
+				w_memcpy_s(par_values.data(), par_values.size() * sizeof(double), par_data.data(), par_values.size() * sizeof(double));
+			}
 			// run model
 			int group_id = net_pack.get_group_id();
 			int run_id = net_pack.get_run_id();
 			
 			cout << "received parameters (group id = " << group_id << ", run id = " << run_id << ")" << endl;
+			if (n_slots > 1)
+			{
+				RunSlot *slot = get_slot(net_pack);
+				slot->group_id = group_id;
+				slot->queued_runs.push_back(make_pair(run_id, par_values));
+				process_slots();
+				continue;
+			}
 			cout << "starting model run..." << endl;
 
 			std::chrono::system_clock::time_point start_time = chrono::system_clock::now();
-			NetPackage::PackType final_run_status = run_model(pars, obs, net_pack);
-			if (final_run_status == NetPackage::PackType::RUN_FINISHED)
-			{
-				double run_time = pest_utils::get_duration_sec(start_time);
-				//send model results back
-				cout << "run complete" << endl;
-				cout << "sending results to master (group id = " << group_id << ", run id = " << run_id << ")..." << endl;
-				cout << "results sent" << endl << endl;
-				serialized_data = Serialization::serialize(pars, par_name_vec, obs, obs_name_vec, run_time);
-				net_pack.reset(NetPackage::PackType::RUN_FINISHED, group_id, run_id, "");
-				err = send_message(net_pack, serialized_data.data(), serialized_data.size());
-				if (err != 1)
-				{
-					exit(-1);
-				}
-			}
-			else if (final_run_status == NetPackage::PackType::RUN_FAILED)
+			NetPackage::PackType final_run_status = run_model(par_values, obs_values, net_pack);
+			send_run_result(final_run_status, group_id, run_id, pest_utils::get_duration_sec(start_time), par_values, obs_values);
+			if (!terminate)
 			{
-				cout << "run failed" << endl;
-				net_pack.reset(NetPackage::PackType::RUN_FAILED, group_id, run_id, "");
+				// Send READY Message to master
+				cout << "sending ready signal to master" << endl;
+				net_pack.reset(NetPackage::PackType::READY, 0, 0, "");
 				char data;
 				err = send_message(net_pack, &data, 0);
 				if (err != 1)
@@ -698,26 +986,79 @@ void PANTHERSlave::start(const string &host, const string &port)
 					exit(-1);
 				}
 			}
-			else if (final_run_status == NetPackage::PackType::RUN_KILLED)
+		}
+		else if (net_pack.get_type() == NetPackage::PackType::REQ_BATCH_RUNS)
+		{
+			net_pack.reset(NetPackage::PackType::BATCH_RUNS_OK, 0, 0, "");
+			char data;
+			err = send_message(net_pack, &data, 0);
+			if (err != 1)
+			{
+				exit(-1);
+			}
+		}
+		else if (net_pack.get_type() == NetPackage::PackType::START_RUNS)
+		{
+			// data: number of runs, the run ids and then the parameter values of each run
+			vector<int8_t> batch_data = net_pack.get_data();
+			int group_id = net_pack.get_group_id();
+			int64_t n_runs = 0;
+			size_t npar = par_name_vec.size();
+			if (batch_data.size() >= sizeof(int64_t))
 			{
-				cout << "run killed" << endl;
-				net_pack.reset(NetPackage::PackType::RUN_KILLED, group_id, run_id, "");
+				w_memcpy_s(&n_runs, sizeof(int64_t), batch_data.data(), sizeof(int64_t));
+			}
+			if (n_runs <= 0 || batch_data.size() != sizeof(int64_t) * (n_runs + 1) + n_runs * npar * sizeof(double))
+			{
+				cerr << "received corrupt batch of parameter values from master" << endl;
+				cerr << "terminating execution ..." << endl << endl;
+				net_pack.reset(NetPackage::PackType::CORRUPT_MESG, 0, 0, "");
 				char data;
-				err = send_message(net_pack, &data, 0);
-				if (err != 1)
+				int np_err = send_message(net_pack, &data, 0);
+				exit(-1);
+			}
+			vector<int64_t> run_ids(n_runs);
+			w_memcpy_s(run_ids.data(), n_runs * sizeof(int64_t), batch_data.data() + sizeof(int64_t), n_runs * sizeof(int64_t));
+			const int8_t *par_data = batch_data.data() + sizeof(int64_t) * (n_runs + 1);
+			cout << "received batch of " << n_runs << " runs (group id = " << group_id << ")" << endl;
+			par_values.resize(npar);
+			if (n_slots > 1)
+			{
+				RunSlot *slot = get_slot(net_pack);
+				slot->group_id = group_id;
+				for (int64_t i_run = 0; i_run < n_runs; ++i_run)
 				{
-					exit(-1);
+					if (npar > 0)
+					{
+						w_memcpy_s(par_values.data(), npar * sizeof(double), par_data + i_run * npar * sizeof(double), npar * sizeof(double));
+					}
+					slot->queued_runs.push_back(make_pair(int(run_ids[i_run]), par_values));
 				}
+				process_slots();
+				continue;
 			}
-			else if (final_run_status == NetPackage::PackType::TERMINATE)
+			for (int64_t i_run = 0; i_run < n_runs && !terminate; ++i_run)
 			{
-				cout << "run preempted by termination requested" << endl;
-				terminate = true;
+				int run_id = run_ids[i_run];
+				if (npar > 0)
+				{
+					w_memcpy_s(par_values.data(), npar * sizeof(double), par_data + i_run * npar * sizeof(double), npar * sizeof(double));
+				}
+				cout << "starting model run (group id = " << group_id << ", run id = " << run_id << ")..." << endl;
+				std::chrono::system_clock::time_point start_time = chrono::system_clock::now();
+				//results are sent as each run finishes. The file cleanup pause is only needed after the last run
+				NetPackage::PackType final_run_status = run_model(par_values, obs_values, net_pack, i_run == n_runs - 1);
+				send_run_result(final_run_status, group_id, run_id, pest_utils::get_duration_sec(start_time), par_values, obs_values);
+				if (final_run_status == NetPackage::PackType::RUN_KILLED)
+				{
+					//the master requeues the rest of the batch when it kills a run
+					cout << "abandoning remaining " << n_runs - i_run - 1 << " runs in batch" << endl;
+					break;
+				}
 			}
 
 			if (!terminate)
 			{
-				// Send READY Message to master
 				cout << "sending ready signal to master" << endl;
 				net_pack.reset(NetPackage::PackType::READY, 0, 0, "");
 				char data;
@@ -735,7 +1076,18 @@ void PANTHERSlave::start(const string &host, const string &port)
 		}
 		else if (net_pack.get_type() == NetPackage::PackType::REQ_KILL)
 		{
-			cout << "received kill request from master. run already finished" << endl;
+			RunSlot *slot = (n_slots > 1) ? get_slot(net_pack) : nullptr;
+			if (slot != nullptr && slot->busy)
+			{
+				cout << "received kill request from master for slot " << (slot->tag.empty() ? "0" : slot->tag) << endl;
+				slot->killed = true;
+				slot->f_terminate->set(true);
+				slot->queued_runs.clear();
+			}
+			else
+			{
+				cout << "received kill request from master. run already finished" << endl;
+			}
 		}
 		else if (net_pack.get_type() == NetPackage::PackType::PING)
 		{
@@ -754,7 +1106,12 @@ void PANTHERSlave::start(const string &host, const string &port)
 			cout << "received unsupported messaged type: " << int(net_pack.get_type()) << endl;
 		}
 		//w_sleep(100);
-		this_thread::sleep_for(chrono::milliseconds(100));
+		//(slots already wait on the receive timeout)
+		if (n_slots <= 1)
+		{
+			this_thread::sleep_for(chrono::milliseconds(100));
+		}
 	}
+	terminate_slots();
 }
 
@@ -26,6 +26,9 @@
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <deque>
+#include <thread>
+#include <chrono>
 #include "utilities.h"
 #include "pest_error.h"
 #include "network_package.h"
@@ -42,7 +45,9 @@ public:
 	int recv_message(NetPackage &net_pack, struct timeval *tv=NULL);
 	int recv_message(NetPackage &net_pack, long  timeout_seconds, long  timeout_microsecs = 0);
 	int send_message(NetPackage &net_pack, const void *data=NULL, unsigned long data_len=0);
-	NetPackage::PackType run_model(Parameters &pars, Observations &obs, NetPackage &net_pack);
+	NetPackage::PackType run_model(std::vector<double> &par_values, std::vector<double> &obs_values, NetPackage &net_pack, bool cleanup_pause = true);
+	void send_run_result(NetPackage::PackType final_run_status, int group_id, int run_id, double run_time,
+		const std::vector<double> &par_values, const std::vector<double> &obs_values, const std::string &slot_tag = std::string());
 	//int run_model(Parameters &pars, Observations &obs);
 	std::string tpl_err_msg(int i);
 	std::string ins_err_msg(int i);
@@ -73,11 +78,45 @@ private:
 	std::vector<std::string> outfile_vec;
 	std::vector<std::string> obs_name_vec;
 	std::vector<std::string> par_name_vec;
+	//<case>. of the control file - these files are not copied into the slot directories
+	std::string case_prefix;
+	//send results using NetPackage::PackType::RUN_FINISHED_COMPRESSED (requested by the master)
+	bool compress_results;
+	//number of model runs this slave carries out at once, each in its own directory (++panther_agent_slots)
+	int n_slots;
+
+	//one model run directory of a slave with several slots.  Slot 0 is the current directory
+	class RunSlot
+	{
+	public:
+		std::string run_dir;
+		std::string tag;
+		std::deque<std::pair<int, std::vector<double>>> queued_runs;
+		int group_id;
+		int run_id;
+		std::vector<double> par_values;
+		std::vector<double> obs_values;
+		std::thread run_thread;
+		std::unique_ptr<pest_utils::thread_flag> f_terminate;
+		std::unique_ptr<pest_utils::thread_flag> f_finished;
+		std::unique_ptr<pest_utils::thread_exceptions> shared_execptions;
+		std::chrono::system_clock::time_point start_time;
+		std::chrono::system_clock::time_point ready_time;
+		bool busy;
+		bool killed;
+		bool ready_pending;
+	};
+	std::vector<std::unique_ptr<RunSlot>> slots;
 
 	ModelInterface mi;
 	void run_async(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished,
 		pest_utils::thread_exceptions *shared_execptions,
-		Parameters* pars, Observations* obs);
+		std::vector<double>* par_values, std::vector<double>* obs_values, std::string run_dir);
+	void init_slots();
+	RunSlot* get_slot(const NetPackage &net_pack);
+	void start_slot_run(RunSlot &slot);
+	void process_slots();
+	void terminate_slots();
 
 };
 
@@ -34,11 +34,18 @@
 #include <deque>
 #include <utility>
 #include <algorithm>
+#include <functional>
 #include "network_wrapper.h"
 #include "network_package.h"
 #include "Transformable.h"
 #include "utilities.h"
 #include "Serialization.h"
+#ifdef PANTHER_EPOLL
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <cerrno>
+#endif
 
 
 using namespace std;
@@ -49,6 +56,9 @@ const int RunManagerPanther::MAX_FAILED_PINGS = 60;
 const int RunManagerPanther::N_PINGS_UNRESPONSIVE = 3;
 const int RunManagerPanther::PING_INTERVAL_SECS = 60;
 const int RunManagerPanther::MAX_CONCURRENT_RUNS_LOWER_LIMIT = 1;
+const int RunManagerPanther::EPOLL_MAX_EVENTS = 256;
+const int RunManagerPanther::BATCH_TARGET_SECS = 10;
+const double RunManagerPanther::SPECULATIVE_PRIORITY_OVERDUE = 1.0E+10;
 
 
 SlaveInfoRec::SlaveInfoRec(int _socket_fd)
@@ -65,6 +75,8 @@ SlaveInfoRec::SlaveInfoRec(int _socket_fd)
 	last_ping_time = std::chrono::system_clock::now();
 	ping = false;
 	failed_pings = 0;
+	batch_capable = false;
+	slot = 0;
 }
 
 bool SlaveInfoRec::CompareTimes::operator() (const SlaveInfoRec &a, const SlaveInfoRec &b)
@@ -256,13 +268,42 @@ int SlaveInfoRec::seconds_since_last_ping_time() const
 		(chrono::system_clock::now() - last_ping_time).count();
 }
 
+void SlaveInfoRec::queue_batch_runs(const std::vector<int> &run_ids)
+{
+	batch_runs.insert(batch_runs.end(), run_ids.begin(), run_ids.end());
+}
+
+int SlaveInfoRec::next_batch_run()
+{
+	int next_run_id = batch_runs.front();
+	batch_runs.pop_front();
+	return next_run_id;
+}
+
+std::vector<int> SlaveInfoRec::clear_batch_runs()
+{
+	std::vector<int> run_ids(batch_runs.begin(), batch_runs.end());
+	batch_runs.clear();
+	return run_ids;
+}
+
+string SlaveInfoRec::get_slot_tag() const
+{
+	//messages for the first slot are not tagged so slaves without slots see the usual protocol
+	if (slot == 0) return string();
+	return to_string(slot);
+}
+
 
 RunManagerPanther::RunManagerPanther(const string &stor_filename, const string &_port, ofstream &_f_rmr, int _max_n_failure,
-	double _overdue_reched_fac, double _overdue_giveup_fac, double _overdue_giveup_minutes)
+	double _overdue_reched_fac, double _overdue_giveup_fac, double _overdue_giveup_minutes, bool _use_epoll, bool _compress_results, int _max_batch_size, bool _speculative_runs)
 	: RunManagerAbstract(vector<string>(), vector<string>(), vector<string>(),
 	vector<string>(), vector<string>(), stor_filename, _max_n_failure),
 	overdue_reched_fac(_overdue_reched_fac), overdue_giveup_fac(_overdue_giveup_fac),
-	port(_port), f_rmr(_f_rmr), n_no_ops(0), overdue_giveup_minutes(_overdue_giveup_minutes)
+	port(_port), f_rmr(_f_rmr), n_no_ops(0), overdue_giveup_minutes(_overdue_giveup_minutes),
+	use_epoll(_use_epoll), compress_results(_compress_results), max_batch_size(_max_batch_size),
+	speculative_runs(_speculative_runs), runtime_per_linpack(0.0), global_runtime_sec(0.0), epoll_fd(-1),
+	run_in_progress(false)
 {
 	max_concurrent_runs = max(MAX_CONCURRENT_RUNS_LOWER_LIMIT, _max_n_failure);
 	w_init();
@@ -299,10 +340,87 @@ RunManagerPanther::RunManagerPanther(const string &stor_filename, const string &
 	freeaddrinfo(servinfo);
 	fdmax = listener;
 	FD_ZERO(&master);
-	FD_SET(listener, &master);
+#ifdef PANTHER_EPOLL
+	if (use_epoll)
+	{
+		//raise the soft limit on open files so that more than ~1000 slaves can connect
+		struct rlimit rl;
+		if ((getrlimit(RLIMIT_NOFILE, &rl) == 0) && (rl.rlim_cur < rl.rlim_max))
+		{
+			rl.rlim_cur = rl.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &rl);
+		}
+		epoll_fd = epoll_create1(0);
+		if (epoll_fd == -1)
+		{
+			throw(PestError("Error: unable to create epoll instance for PANTHER master"));
+		}
+		//the listener is edge triggered, so new connections are accepted until it would block
+		fcntl(listener, F_SETFL, fcntl(listener, F_GETFL, 0) | O_NONBLOCK);
+		cout << "PANTHER master using epoll event loop" << endl;
+		f_rmr << "PANTHER master using epoll event loop" << endl;
+	}
+#else
+	if (use_epoll)
+	{
+		cout << "epoll event loop not available on this platform, using select()" << endl;
+		f_rmr << "epoll event loop not available on this platform, using select()" << endl;
+		use_epoll = false;
+	}
+#endif
+	watch_socket(listener);
+	last_housekeeping_time = std::chrono::system_clock::now();
 	return;
 }
 
+void RunManagerPanther::watch_socket(int sock_id)
+{
+#ifdef PANTHER_EPOLL
+	if (use_epoll)
+	{
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLET;
+		if (sock_id != listener)
+			ev.events |= EPOLLRDHUP;
+		ev.data.fd = sock_id;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock_id, &ev) == -1)
+		{
+			stringstream ss;
+			ss << "epoll_ctl() failed to add socket " << sock_id << ": " << strerror(errno);
+			report(ss.str(), true);
+		}
+		return;
+	}
+#endif
+	FD_SET(sock_id, &master);
+	if (sock_id > fdmax) { // keep track of the max
+		fdmax = sock_id;
+	}
+}
+
+void RunManagerPanther::unwatch_socket(int sock_id)
+{
+#ifdef PANTHER_EPOLL
+	if (use_epoll)
+	{
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sock_id, nullptr);
+		init_pending.erase(sock_id);
+		return;
+	}
+#endif
+	FD_CLR(sock_id, &master);
+}
+
+bool RunManagerPanther::is_watched(int sock_id)
+{
+	if (use_epoll)
+	{
+		return (sock_id == listener) || (socket_to_iter_map.find(sock_id) != socket_to_iter_map.end());
+	}
+	return FD_ISSET(sock_id, &master);
+}
+
 int RunManagerPanther::get_n_concurrent(int run_id)
 {
 	auto range_pair = active_runid_to_iterset_map.equal_range(run_id);
@@ -362,6 +480,9 @@ void  RunManagerPanther::free_memory()
 	model_runs_done = 0;
 	failure_map.clear();
 	active_runid_to_iterset_map.clear();
+	completion_candidates.clear();
+	clear_completed_runs();
+	run_in_progress = false;
 }
 
 int RunManagerPanther::add_run(const Parameters &model_pars, const string &info_txt, double info_value)
@@ -405,6 +526,16 @@ void RunManagerPanther::update_run(int run_id, const Parameters &pars, const Obs
 	kill_runs(run_id, false, "run not required");
 }
 
+void RunManagerPanther::cancel_run(int run_id)
+{
+	if (!run_requried(run_id))
+		return;
+	RunManagerAbstract::cancel_run(run_id);
+	waiting_runs.erase(remove(waiting_runs.begin(), waiting_runs.end(), run_id), waiting_runs.end());
+	// runs already handed to a slave as part of a batch are left to finish, their results are not needed
+	kill_runs(run_id, false, "run canceled");
+}
+
 void RunManagerPanther::run()
 {
 	run_until(RUN_UNTIL_COND::NORMAL);
@@ -416,41 +547,54 @@ RunManagerAbstract::RUN_UNTIL_COND RunManagerPanther::run_until(RUN_UNTIL_COND c
 	stringstream message;
 	NetPackage net_pack;
 
-	model_runs_done = 0;
-	model_runs_failed = 0;
-	model_runs_timed_out = 0;
-	failure_map.clear();
-	active_runid_to_iterset_map.clear();
-	int num_runs = waiting_runs.size();
-	cout << "    running model " << num_runs << " times" << endl;
-	f_rmr << "running model " << num_runs << " times" << endl;
-	if (slave_info_set.size() == 0) // first entry is the listener, slave apears after this
+	//a call that follows an early return (NO_OPS or TIME) picks up the current set of runs where it left off
+	if (!run_in_progress)
 	{
-		cout << endl << "      waiting for slaves to appear..." << endl << endl;
-		f_rmr << endl << "    waiting for slaves to appear..." << endl << endl;
-	}
-	else
-	{
-		for (auto &si : slave_info_set)
-			si.reset_runtime();
-	}
-	cout << endl;
-	f_rmr << endl;
+		model_runs_done = 0;
+		model_runs_failed = 0;
+		model_runs_timed_out = 0;
+		failure_map.clear();
+		active_runid_to_iterset_map.clear();
+		int num_runs = waiting_runs.size();
+		cout << "    running model " << num_runs << " times" << endl;
+		f_rmr << "running model " << num_runs << " times" << endl;
+		if (slave_info_set.size() == 0) // first entry is the listener, slave apears after this
+		{
+			cout << endl << "      waiting for slaves to appear..." << endl << endl;
+			f_rmr << endl << "    waiting for slaves to appear..." << endl << endl;
+		}
+		else
+		{
+			for (auto &si : slave_info_set)
+				si.reset_runtime();
+		}
+		cout << endl;
+		f_rmr << endl;
 
-	cout << "PANTHER progress" << endl;
-	cout << "   runs(C = completed | F = failed | T = timed out)" << endl;
-	cout << "   slaves(R = running | W = waiting | U = unavailable)" << endl;
-	cout << "------------------------------------------------------------------------------" << endl;
+		cout << "PANTHER progress" << endl;
+		cout << "   runs(C = completed | F = failed | T = timed out)" << endl;
+		cout << "   slaves(R = running | W = waiting | U = unavailable)" << endl;
+		cout << "------------------------------------------------------------------------------" << endl;
+		run_in_progress = true;
+	}
 
 	std::chrono::system_clock::time_point start_time = std::chrono::system_clock::now();
 	double run_time_sec = 0.0;
 	while (!all_runs_complete() && terminate_reason == RUN_UNTIL_COND::NORMAL)
 	{
-		echo();
+		//with the epoll event loop, the O(n) passes over all the slaves are only made once a second
+		bool housekeeping = (!use_epoll) || (get_duration_sec(last_housekeeping_time) >= 1.0);
+		if (housekeeping)
+		{
+			echo();
+		}
 		init_slaves();
 		//schedule runs on available nodes
 		schedule_runs();
-		echo();
+		if (!use_epoll)
+		{
+			echo();
+		}
 		// get and process incomming messages
 		if (listen() == false)
 		{
@@ -460,10 +604,15 @@ RunManagerAbstract::RUN_UNTIL_COND RunManagerPanther::run_until(RUN_UNTIL_COND c
 		{
 			n_no_ops = 0;
 		}
-		if (ping())
+		if (housekeeping)
 		{
-			n_no_ops = 0;
+			if (ping())
+			{
+				n_no_ops = 0;
+			}
+			last_housekeeping_time = std::chrono::system_clock::now();
 		}
+		report_candidate_runs();
 
 		if ((condition == RUN_UNTIL_COND::NO_OPS || condition == RUN_UNTIL_COND::NO_OPS_OR_TIME) && n_no_ops >= max_no_ops)
 		{
@@ -508,6 +657,8 @@ RunManagerAbstract::RUN_UNTIL_COND RunManagerPanther::run_until(RUN_UNTIL_COND c
 			vector<double> pars;
 			int status = file_stor.get_run(0, pars, init_sim);
 		}
+		report_completed_runs();
+		run_in_progress = false;
 	}
 	return terminate_reason;
 }
@@ -539,9 +690,8 @@ bool RunManagerPanther::ping(int i_sock)
 	}
 
 	string sock_hostname = slave_info_iter->get_hostname();
-	fd_set read_fds = master;
 	//if the slave hasn't communicated since the last ping request
-	if ((!FD_ISSET(i_sock, &read_fds)) && slave_info_iter->get_ping())
+	if ((!is_watched(i_sock)) && slave_info_iter->get_ping())
 	{
 		int fails = slave_info_iter->add_failed_ping();
 		report("failed to receive ping response from slave: " + sock_hostname + "$" + slave_info_iter->get_work_dir(), false);
@@ -584,6 +734,10 @@ bool RunManagerPanther::ping(int i_sock)
 
 bool RunManagerPanther::listen()
 {
+	if (use_epoll)
+	{
+		return listen_epoll();
+	}
 	bool got_message = false;
 	struct sockaddr_storage remote_addr;
 	fd_set read_fds; // temp file descriptor list for select()
@@ -625,6 +779,63 @@ bool RunManagerPanther::listen()
 	return got_message;
 }
 
+bool RunManagerPanther::listen_epoll()
+{
+	bool got_message = false;
+#ifdef PANTHER_EPOLL
+	vector<struct epoll_event> events(EPOLL_MAX_EVENTS);
+	int n_events = epoll_wait(epoll_fd, events.data(), EPOLL_MAX_EVENTS, 1000);
+	if (n_events == -1)
+	{
+		// interupted by a signal - treat the same as a failed select() call
+		got_message = true;
+		return got_message;
+	}
+	for (int i = 0; i < n_events; ++i)
+	{
+		got_message = true;
+		int sock_id = events[i].data.fd;
+		if (sock_id == listener)  // handle new connections
+		{
+			while (true)
+			{
+				struct sockaddr_storage remote_addr;
+				socklen_t addr_len = sizeof remote_addr;
+				int newfd = accept(listener, (struct sockaddr *)&remote_addr, &addr_len);
+				if (newfd == -1)
+				{
+					break;
+				}
+				add_slave(newfd);
+			}
+		}
+		else  // handle data from a client
+		{
+			// edge triggered - keep processing messages until the socket has been drained
+			while (socket_to_iter_map.find(sock_id) != socket_to_iter_map.end())
+			{
+				//set the ping flag since the slave sent something back
+				socket_to_iter_map.at(sock_id)->set_ping(false);
+				process_message(sock_id);
+				if (socket_to_iter_map.find(sock_id) == socket_to_iter_map.end())
+				{
+					break;
+				}
+				char c;
+				int n = recv(sock_id, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+				if ((n < 0) && (errno == EAGAIN || errno == EWOULDBLOCK))
+				{
+					break;
+				}
+				// otherwise more data, a closed connection or an error is waiting and
+				// process_message() will deal with it
+			}
+		}
+	}
+#endif
+	return got_message;
+}
+
 void RunManagerPanther::close_slaves()
 {
 	/*for (int i = 0; i <= fdmax; i++)
@@ -655,23 +866,34 @@ void RunManagerPanther::close_slave(int i_sock)
 void RunManagerPanther::close_slave(list<SlaveInfoRec>::iterator slave_info_iter)
 {
 	int i_sock = slave_info_iter->get_socket_fd();
-	int run_id = slave_info_iter->get_run_id();
-	SlaveInfoRec::State state = slave_info_iter->get_state();
 
 	string socket_name = slave_info_iter->get_socket_name();
+	unwatch_socket(i_sock); // remove from master set
 	w_close(i_sock); // bye!
-	FD_CLR(i_sock, &master); // remove from master set
-	// remove run from active_runid_to_iterset_map
-	unschedule_run(slave_info_iter);
 
-	// check if this run needs to be returned to the waiting queue
-	int n_concurr = get_n_concurrent(run_id);
-	if (run_id != SlaveInfoRec::UNKNOWN_ID &&  slave_info_iter->get_state() == SlaveInfoRec::State::ACTIVE && n_concurr == 0)
+	// all the slots of a slave share its connection
+	vector<list<SlaveInfoRec>::iterator> slot_iters(1, socket_to_iter_map.at(i_sock));
+	auto slots_iter = socket_to_slots_map.find(i_sock);
+	if (slots_iter != socket_to_slots_map.end())
 	{
-		waiting_runs.push_front(run_id);
+		slot_iters = slots_iter->second;
+		socket_to_slots_map.erase(slots_iter);
 	}
+	for (auto &slot_iter : slot_iters)
+	{
+		int run_id = slot_iter->get_run_id();
+		// remove run from active_runid_to_iterset_map
+		unschedule_run(slot_iter);
 
-	slave_info_set.erase(slave_info_iter);
+		// check if this run needs to be returned to the waiting queue
+		int n_concurr = get_n_concurrent(run_id);
+		if (run_id != SlaveInfoRec::UNKNOWN_ID && slot_iter->get_state() == SlaveInfoRec::State::ACTIVE && n_concurr == 0)
+		{
+			waiting_runs.push_front(run_id);
+		}
+		requeue_batch_runs(slot_iter);
+		slave_info_set.erase(slot_iter);
+	}
 	socket_to_iter_map.erase(i_sock);
 
 	stringstream ss;
@@ -683,23 +905,36 @@ void RunManagerPanther::close_slave(list<SlaveInfoRec>::iterator slave_info_iter
 void RunManagerPanther::schedule_runs()
 {
 	NetPackage net_pack;
+	//nothing to schedule and the overdue checks are only made when no messages are coming in
+	if (waiting_runs.empty() && n_no_ops == 0 && !speculative_runs)
+	{
+		return;
+	}
 
+	update_runtime_model();
 	std::list<list<SlaveInfoRec>::iterator> free_slave_list = get_free_slave_list();
 	int n_responsive_slaves = get_n_responsive_slaves();
-	//first try to schedule waiting runs
-	for (auto it_run = waiting_runs.begin(); !free_slave_list.empty() && it_run != waiting_runs.end();)
+	//first try to schedule waiting runs.  schedule_run() can take additional runs from
+	//further down the queue to fill a batch, so an index is used to walk the queue
+	for (size_t i_run = 0; !free_slave_list.empty() && i_run < waiting_runs.size();)
 	{
-		int success = schedule_run(*it_run, free_slave_list, n_responsive_slaves);
+		int success = schedule_run(waiting_runs[i_run], free_slave_list, n_responsive_slaves, i_run + 1);
 		if (success >= 0)
 		{
-			it_run = waiting_runs.erase(it_run);
+			waiting_runs.erase(waiting_runs.begin() + i_run);
 		}
 		else
 		{
-			++it_run;
+			++i_run;
 		}
 	}
 
+	//the queue has drained, so use the idle slaves to race the runs that are still going
+	if (speculative_runs && waiting_runs.empty() && !free_slave_list.empty())
+	{
+		schedule_speculative_runs(free_slave_list, n_responsive_slaves);
+	}
+
 	//check for overdue runs if there are no runs waiting to be processed
 	if (n_no_ops > 0)
 	{
@@ -722,7 +957,7 @@ void RunManagerPanther::schedule_runs()
 					int n_concur = get_n_concurrent(run_id);
 
 					duration = it_slave->get_duration_minute();
-					avg_runtime = it_slave->get_runtime_minute();
+					avg_runtime = get_expected_runtime_sec(*it_slave) / 60.0;
 					if (avg_runtime <= 0) avg_runtime = global_avg_runtime;
 					if (avg_runtime <= 0) avg_runtime = 1.0E+10;
 					vector<int> overdue_kill_runs_vec = get_overdue_runs_over_kill_threshold(run_id);
@@ -809,15 +1044,15 @@ void RunManagerPanther::schedule_runs()
 	}
 }
 
-int RunManagerPanther::schedule_run(int run_id, std::list<list<SlaveInfoRec>::iterator> &free_slave_list, int n_responsive_slaves)
+int RunManagerPanther::schedule_run(int run_id, std::list<list<SlaveInfoRec>::iterator> &free_slave_list, int n_responsive_slaves, int batch_start)
 {
 	int scheduled = -1;
 	auto it_slave = free_slave_list.end(); // iterator to current socket
 	int n_concurrent = get_n_concurrent(run_id);
 
-	if (run_finished(run_id))
+	if (run_finished(run_id) || run_canceled(run_id))
 	{
-		// run already completed on different node.  Do nothing
+		// run already completed on different node or is no longer needed.  Do nothing
 		scheduled = 0;
 	}
 	else if (failure_map.count(run_id) >= max_n_failure)
@@ -861,10 +1096,67 @@ int RunManagerPanther::schedule_run(int run_id, std::list<list<SlaveInfoRec>::it
 	if (it_slave != free_slave_list.end())
 	{
 		int socket_fd = (*it_slave)->get_socket_fd();
-		vector<char> data = file_stor.get_serial_pars(run_id);
 		string host_name = (*it_slave)->get_hostname();
-		NetPackage net_pack(NetPackage::PackType::START_RUN, cur_group_id, run_id, "");
-		int err = net_pack.send(socket_fd, &data[0], data.size());
+		//fill a batch with runs from further down the waiting queue that have not been tried yet
+		vector<int> batch_run_ids(1, run_id);
+		if (batch_start >= 0)
+		{
+			int n_batch = get_batch_size(**it_slave, free_slave_list.size());
+			for (auto it_run = waiting_runs.begin() + batch_start;
+				batch_run_ids.size() < size_t(n_batch) && it_run != waiting_runs.end();)
+			{
+				int i_run_id = *it_run;
+				if (failure_map.count(i_run_id) == 0 && get_n_concurrent(i_run_id) == 0 && !run_finished(i_run_id) && !run_canceled(i_run_id))
+				{
+					batch_run_ids.push_back(i_run_id);
+					it_run = waiting_runs.erase(it_run);
+				}
+				else
+				{
+					++it_run;
+				}
+			}
+		}
+		int err;
+		if (batch_run_ids.size() == 1)
+		{
+			vector<char> data = file_stor.get_serial_pars(run_id);
+			NetPackage net_pack(NetPackage::PackType::START_RUN, cur_group_id, run_id, (*it_slave)->get_slot_tag());
+			err = net_pack.send(socket_fd, &data[0], data.size());
+		}
+		else
+		{
+			// START_RUNS data: number of runs, the run ids and then the parameter values of each run
+			int64_t n_runs = batch_run_ids.size();
+			size_t npar = file_stor.get_par_name_vec().size();
+			vector<int8_t> data(sizeof(int64_t) * (n_runs + 1) + n_runs * npar * sizeof(double));
+			int8_t *buf = data.data();
+			w_memcpy_s(buf, sizeof(int64_t), &n_runs, sizeof(int64_t));
+			buf += sizeof(int64_t);
+			for (int i_run_id : batch_run_ids)
+			{
+				int64_t id = i_run_id;
+				w_memcpy_s(buf, sizeof(int64_t), &id, sizeof(int64_t));
+				buf += sizeof(int64_t);
+			}
+			for (int i_run_id : batch_run_ids)
+			{
+				vector<char> par_data = file_stor.get_serial_pars(i_run_id);
+				w_memcpy_s(buf, npar * sizeof(double), par_data.data(), par_data.size());
+				buf += npar * sizeof(double);
+			}
+			NetPackage net_pack(NetPackage::PackType::START_RUNS, cur_group_id, run_id, (*it_slave)->get_slot_tag());
+			err = net_pack.send(socket_fd, data.data(), data.size());
+			if (err > 0)
+			{
+				(*it_slave)->queue_batch_runs(vector<int>(batch_run_ids.begin() + 1, batch_run_ids.end()));
+			}
+			else
+			{
+				//put the extra runs back at the front of the queue in their original order
+				waiting_runs.insert(waiting_runs.begin() + batch_start, batch_run_ids.begin() + 1, batch_run_ids.end());
+			}
+		}
 		if (err > 0)
 		{
 			(*it_slave)->set_state(SlaveInfoRec::State::ACTIVE, run_id, cur_group_id);
@@ -876,6 +1168,10 @@ int RunManagerPanther::schedule_run(int run_id, std::list<list<SlaveInfoRec>::it
 			stringstream ss;
 			ss << "Sending run " << run_id << " to: " << host_name << "$" << (*it_slave)->get_work_dir() <<
 				"  (group id:" << cur_group_id << ", run id:" << run_id << ", concurrent runs:" << get_n_concurrent(run_id) << ")";
+			if (batch_run_ids.size() > 1)
+			{
+				ss << " with " << batch_run_ids.size() - 1 << " batched runs";
+			}
 			report(ss.str(), false);
 			free_slave_list.erase(it_slave);
 			scheduled = 1;
@@ -884,6 +1180,169 @@ int RunManagerPanther::schedule_run(int run_id, std::list<list<SlaveInfoRec>::it
 	return scheduled;  // 1 = run scheduled; -1 failed to schedule run; 0 run not needed
 }
 
+int RunManagerPanther::get_batch_size(const SlaveInfoRec &slave_info, int n_free_slaves)
+{
+	if (max_batch_size <= 1 || !slave_info.get_batch_capable())
+	{
+		return 1;
+	}
+	double run_secs = get_expected_runtime_sec(slave_info);
+	//single runs until there is a run time to go on
+	if (run_secs <= 0)
+	{
+		return 1;
+	}
+	//enough runs to keep the slave busy for about BATCH_TARGET_SECS, but leave a
+	//share of the waiting runs for each of the other free slaves
+	int n_batch = max(1, int(BATCH_TARGET_SECS / run_secs));
+	int n_share = (waiting_runs.size() + n_free_slaves - 1) / max(1, n_free_slaves);
+	n_batch = min(n_batch, n_share);
+	n_batch = min(n_batch, max_batch_size);
+	return max(n_batch, 1);
+}
+
+void RunManagerPanther::schedule_speculative_runs(std::list<list<SlaveInfoRec>::iterator> &free_slave_list, int n_responsive_slaves)
+{
+	// free_slave_list is sorted fastest first, so this is the best time a duplicate run can be expected to take
+	double free_runtime = get_expected_runtime_sec(*free_slave_list.front());
+	if (free_runtime <= 0)
+	{
+		return;
+	}
+	// rank the active runs by how long they are expected to hold up the run group.  Runs that are
+	// already slower than their slave normally takes come first, then the ones with the most time left
+	map<int, double> run_priority_map;
+	for (auto &i_active : active_runid_to_iterset_map)
+	{
+		list<SlaveInfoRec>::iterator slave_info_iter = i_active.second;
+		if (slave_info_iter->get_state() != SlaveInfoRec::State::ACTIVE) continue;
+		double expected = get_expected_runtime_sec(*slave_info_iter);
+		if (expected <= 0) continue;
+		double duration = slave_info_iter->get_duration_sec();
+		double priority;
+		if (duration > expected)
+		{
+			priority = SPECULATIVE_PRIORITY_OVERDUE + duration / expected;
+		}
+		else if (expected - duration > free_runtime)
+		{
+			priority = expected - duration;
+		}
+		else
+		{
+			// a duplicate would not finish sooner
+			priority = 0;
+		}
+		// a run going on several slaves is only as late as its fastest copy
+		auto it_priority = run_priority_map.find(i_active.first);
+		if (it_priority == run_priority_map.end() || priority < it_priority->second)
+		{
+			run_priority_map[i_active.first] = priority;
+		}
+	}
+	vector<pair<double, int>> priority_vec;
+	for (auto &i_priority : run_priority_map)
+	{
+		if (i_priority.second > 0)
+		{
+			priority_vec.push_back(make_pair(i_priority.second, i_priority.first));
+		}
+	}
+	sort(priority_vec.begin(), priority_vec.end(), std::greater<pair<double, int>>());
+	//asking for speculative runs allows at least one duplicate of each run
+	int max_speculative_runs = max(2, max_concurrent_runs);
+	for (auto &i_priority : priority_vec)
+	{
+		if (free_slave_list.empty()) break;
+		int run_id = i_priority.second;
+		if (get_n_concurrent(run_id) >= max_speculative_runs) continue;
+		if (schedule_run(run_id, free_slave_list, n_responsive_slaves) > 0)
+		{
+			stringstream ss;
+			ss << "started speculative duplicate of run " << run_id << " (expected run time on the fastest idle slave: " << free_runtime << " sec)";
+			report(ss.str(), false);
+		}
+	}
+}
+
+void RunManagerPanther::update_runtime_model()
+{
+	double sum_runtime = 0;
+	double sum_linpack = 0;
+	// the run time of only the slaves with a linpack time, so the ratio is over the same slaves
+	double sum_linpack_runtime = 0;
+	int n_runtime = 0;
+	for (auto &si : slave_info_set)
+	{
+		double runtime = si.get_runtime_sec();
+		if (runtime <= 0) continue;
+		sum_runtime += runtime;
+		++n_runtime;
+		double linpack = si.get_linpack_time();
+		if (linpack > 0)
+		{
+			sum_linpack_runtime += runtime;
+			sum_linpack += linpack;
+		}
+	}
+	global_runtime_sec = (n_runtime > 0) ? sum_runtime / n_runtime : 0.0;
+	runtime_per_linpack = (sum_linpack > 0) ? sum_linpack_runtime / sum_linpack : 0.0;
+}
+
+double RunManagerPanther::get_expected_runtime_sec(const SlaveInfoRec &slave_info) const
+{
+	// the slave's own average run time when it has one, otherwise the average run time
+	// of the other slaves scaled by how this slave's linpack benchmark compares with theirs
+	double runtime = slave_info.get_runtime_sec();
+	if (runtime > 0)
+	{
+		return runtime;
+	}
+	double linpack = slave_info.get_linpack_time();
+	if (linpack > 0 && runtime_per_linpack > 0)
+	{
+		return linpack * runtime_per_linpack;
+	}
+	return global_runtime_sec;
+}
+
+void RunManagerPanther::start_next_batch_run(list<SlaveInfoRec>::iterator slave_info_iter)
+{
+	SlaveInfoRec::State state = slave_info_iter->get_state();
+	if (!slave_info_iter->has_batch_runs() || state == SlaveInfoRec::State::KILLED
+		|| state == SlaveInfoRec::State::KILLED_FAILED)
+	{
+		return;
+	}
+	// the slave moves on to the next run of the batch without waiting for the master
+	int run_id = slave_info_iter->next_batch_run();
+	slave_info_iter->set_state(SlaveInfoRec::State::ACTIVE, run_id, cur_group_id);
+	slave_info_iter->start_timer();
+	slave_info_iter->reset_last_ping_time();
+	active_runid_to_iterset_map.insert(make_pair(run_id, slave_info_iter));
+	stringstream ss;
+	ss << "Starting batched run " << run_id << " on: " << slave_info_iter->get_hostname() << "$" << slave_info_iter->get_work_dir() <<
+		"  (group id:" << cur_group_id << ", run id:" << run_id << ", concurrent runs:" << get_n_concurrent(run_id) << ")";
+	report(ss.str(), false);
+}
+
+void RunManagerPanther::requeue_batch_runs(list<SlaveInfoRec>::iterator slave_info_iter)
+{
+	// runs that were queued on the slave, but not started, go back to the front of the waiting queue
+	vector<int> run_ids = slave_info_iter->clear_batch_runs();
+	if (slave_info_iter->get_group_id() != cur_group_id)
+	{
+		return;
+	}
+	for (auto it = run_ids.rbegin(); it != run_ids.rend(); ++it)
+	{
+		if (!run_finished(*it) && get_n_concurrent(*it) == 0)
+		{
+			waiting_runs.push_front(*it);
+		}
+	}
+}
+
 
 
 void RunManagerPanther::echo()
@@ -942,7 +1401,13 @@ void RunManagerPanther::process_message(int i_sock)
 	string port_name = slave_info_iter->get_port();
 	string socket_name = slave_info_iter->get_socket_name();
 
-	if(( err=net_pack.recv(i_sock)) <=0) // error or lost connection
+	err = net_pack.recv(i_sock);
+	if (err > 0)
+	{
+		// run messages from a slave with several slots are tagged with the slot number
+		slave_info_iter = get_slot_iter(i_sock, net_pack);
+	}
+	if (err <= 0) // error or lost connection
 	{
 		if (err  == -2) {
 			report("received corrupt message from slave: " + host_name + "$" + slave_info_iter->get_work_dir() + " - terminating slave", false);
@@ -971,6 +1436,7 @@ void RunManagerPanther::process_message(int i_sock)
 			report(ss.str(), false);
 			slave_info_iter->set_work_dir(work_dir);
 			slave_info_iter->set_state(SlaveInfoRec::State::CWD_RCV);
+			if (use_epoll) init_pending.insert(i_sock);
 		}
 		else
 		{
@@ -978,21 +1444,61 @@ void RunManagerPanther::process_message(int i_sock)
 			close_slave(i_sock);
 		}
 	}
+	else if (net_pack.get_type() == NetPackage::PackType::SLOTS)
+	{
+		bool good_slot_dirs = NetPackage::check_string(net_pack.get_data(), 0, net_pack.get_data().size());
+		if (good_slot_dirs)
+		{
+			vector<string> slot_dirs;
+			Serialization::unserialize(net_pack.get_data(), slot_dirs);
+			add_slots(slave_info_iter, slot_dirs);
+		}
+		else
+		{
+			report("received corrupt slot directories from slave: " + host_name + " - terminating slave", false);
+			close_slave(i_sock);
+		}
+	}
 	else if (net_pack.get_type() == NetPackage::PackType::LINPACK)
 	{
 		slave_info_iter->end_linpack();
 		slave_info_iter->set_state(SlaveInfoRec::State::LINPACK_RCV);
+		// the benchmark is only run once on a slave, so the other slots are ready straight away
+		auto slots_iter = socket_to_slots_map.find(i_sock);
+		if (slots_iter != socket_to_slots_map.end())
+		{
+			for (auto &slot_iter : slots_iter->second)
+			{
+				if (slot_iter == slave_info_iter) continue;
+				slot_iter->end_linpack();
+				slot_iter->set_state(SlaveInfoRec::State::WAITING);
+			}
+		}
+		if (use_epoll) init_pending.insert(i_sock);
 		stringstream ss;
 		ss << "new slave ready: " << socket_name;
 		report(ss.str(), false);
 	}
+	else if (net_pack.get_type() == NetPackage::PackType::BATCH_RUNS_OK)
+	{
+		slave_info_iter->set_batch_capable(true);
+		auto slots_iter = socket_to_slots_map.find(i_sock);
+		if (slots_iter != socket_to_slots_map.end())
+		{
+			for (auto &slot_iter : slots_iter->second)
+				slot_iter->set_batch_capable(true);
+		}
+	}
 	else if (net_pack.get_type() == NetPackage::PackType::READY)
 	{
 		// ready message received from slave
+		// any runs left in the batch were abandoned by the slave
+		requeue_batch_runs(slave_info_iter);
 		slave_info_iter->set_state(SlaveInfoRec::State::WAITING);
 	}
 
 	else if ( (net_pack.get_type() == NetPackage::PackType::RUN_FINISHED
+		|| net_pack.get_type() == NetPackage::PackType::RUN_FINISHED_COMPRESSED
 		|| net_pack.get_type() == NetPackage::PackType::RUN_FAILED
 		|| net_pack.get_type() == NetPackage::PackType::RUN_KILLED)
 			&& net_pack.get_group_id() != cur_group_id)
@@ -1005,7 +1511,8 @@ void RunManagerPanther::process_message(int i_sock)
 		//ss << "run " << run_id << " received from unexpected group id: " << group_id << ", should be group: " << cur_group_id;
 		//throw PestError(ss.str());
 	}
-	else if (net_pack.get_type() == NetPackage::PackType::RUN_FINISHED)
+	else if (net_pack.get_type() == NetPackage::PackType::RUN_FINISHED
+		|| net_pack.get_type() == NetPackage::PackType::RUN_FINISHED_COMPRESSED)
 	{
 		int run_id = net_pack.get_run_id();
 		int group_id = net_pack.get_group_id();
@@ -1018,6 +1525,7 @@ void RunManagerPanther::process_message(int i_sock)
 				"  (run time:" << slave_info_iter->get_runtime_minute() << " min, group id:" << group_id <<
 				", run id:" << run_id << " concurrent:" << get_n_concurrent(run_id) << ")";
 			report(ss.str(), false);
+			unschedule_run(slave_info_iter);
 		}
 		else
 		{
@@ -1028,11 +1536,9 @@ void RunManagerPanther::process_message(int i_sock)
 				"  (run time:" << slave_info_iter->get_runtime_minute() << " min, avg run time:" << get_global_runtime_minute() << " min, group id:" << group_id <<
 				", run id: " << run_id << " concurrent:" << get_n_concurrent(run_id) << ")";
 			report(ss.str(), false);
-			process_model_run(i_sock, net_pack);
+			process_model_run(slave_info_iter, net_pack);
 		}
-
-
-
+		start_next_batch_run(slave_info_iter);
 	}
 	else if (net_pack.get_type() == NetPackage::PackType::RUN_FAILED)
 	{
@@ -1047,8 +1553,7 @@ void RunManagerPanther::process_message(int i_sock)
 			report(ss.str(), false);
 			model_runs_failed++;
 			update_run_failed(run_id, i_sock);
-			auto it = get_active_run_iter(i_sock);
-			unschedule_run(it);
+			unschedule_run(slave_info_iter);
 			n_concur = get_n_concurrent(run_id);
 			if (n_concur == 0 && (failure_map.count(run_id) < max_n_failure))
 			{
@@ -1056,14 +1561,14 @@ void RunManagerPanther::process_message(int i_sock)
 				waiting_runs.push_front(run_id);
 			}
 		}
+		start_next_batch_run(slave_info_iter);
 	}
 	else if (net_pack.get_type() == NetPackage::PackType::RUN_KILLED)
 	{
 		int run_id = net_pack.get_run_id();
 		int group_id = net_pack.get_group_id();
 		int n_concur = get_n_concurrent(run_id);
-		auto it = get_active_run_iter(i_sock);
-		unschedule_run(it);
+		unschedule_run(slave_info_iter);
 		stringstream ss;
 		ss << "Run " << run_id << " killed on slave: " << host_name << "$" << slave_info_iter->get_work_dir() << ", run id:" << run_id << " concurrent: " << n_concur;
 		report(ss.str(), false);
@@ -1088,20 +1593,34 @@ void RunManagerPanther::process_message(int i_sock)
 	}
 }
 
-bool RunManagerPanther::process_model_run(int sock_id, NetPackage &net_pack)
+bool RunManagerPanther::process_model_run(list<SlaveInfoRec>::iterator slave_info_iter, NetPackage &net_pack)
 {
-	list<SlaveInfoRec>::iterator slave_info_iter = socket_to_iter_map.at(sock_id);
 	bool use_run = false;
 	int run_id = net_pack.get_run_id();
 
-	//check if another instance of this model run has already completed
-	if (!run_finished(run_id))
+	//check if another instance of this model run has already completed, or if the run was
+	//canceled after it was sent to this slave
+	if ((!run_finished(run_id)) && (!run_canceled(run_id)))
 	{
-		Parameters pars;
-		Observations obs;
-		double run_time = 0;
-		Serialization::unserialize(net_pack.get_data(), pars, get_par_name_vec(), obs, get_obs_name_vec(), run_time);
-		file_stor.update_run(run_id, pars, obs);
+		// results are packed doubles (parameters, observations, run time) in run storage order,
+		// so they are written straight to storage without building Parameters and Observations
+		vector<int8_t> uncomp_data;
+		const vector<int8_t> *ser_data = &net_pack.get_data();
+		if (net_pack.get_type() == NetPackage::PackType::RUN_FINISHED_COMPRESSED)
+		{
+			uncomp_data = Serialization::uncompress_doubles(net_pack.get_data());
+			ser_data = &uncomp_data;
+		}
+		size_t npar = file_stor.get_par_name_vec().size();
+		size_t nobs = file_stor.get_obs_name_vec().size();
+		if (ser_data->size() < (npar + nobs) * sizeof(double))
+		{
+			stringstream ss;
+			ss << "run " << run_id << " results from slave are incomplete: expected " << (npar + nobs) * sizeof(double)
+				<< " bytes, received " << ser_data->size();
+			throw PestError(ss.str());
+		}
+		file_stor.update_run(run_id, vector<char>(ser_data->begin(), ser_data->begin() + (npar + nobs) * sizeof(double)));
 		slave_info_iter->set_state(SlaveInfoRec::State::COMPLETE);
 		//slave_info_iter->set_state(SlaveInfoRec::State::WAITING);
 		use_run = true;
@@ -1109,8 +1628,7 @@ bool RunManagerPanther::process_model_run(int sock_id, NetPackage &net_pack)
 
 	}
 	// remove currently completed run from the active list
-	auto it = get_active_run_iter(sock_id);
-	unschedule_run(it);
+	unschedule_run(slave_info_iter);
 	kill_runs(run_id, false, "completed on alternative node");
 	return use_run;
 }
@@ -1130,9 +1648,11 @@ void RunManagerPanther::kill_run(list<SlaveInfoRec>::iterator slave_info_iter, c
 		ss << "sending kill request. reason: " << reason << ", run id:" << run_id;
 		ss<< ",  num previous fails:" << failure_map.count(run_id) << ", slave: " << host_name << "$" << slave_info_iter->get_work_dir();
 		report(ss.str(), false);
-		NetPackage net_pack(NetPackage::PackType::REQ_KILL, 0, 0, "");
+		NetPackage net_pack(NetPackage::PackType::REQ_KILL, 0, 0, slave_info_iter->get_slot_tag());
 		char data = '\0';
 		int err = net_pack.send(socket_id, &data, sizeof(data));
+		//the slave abandons the rest of its batch when a run is killed
+		requeue_batch_runs(slave_info_iter);
 		if (err == 1)
 		{
 			slave_info_iter->set_state(SlaveInfoRec::State::KILLED);
@@ -1192,57 +1712,100 @@ void RunManagerPanther::kill_all_active_runs()
 
  void RunManagerPanther::init_slaves()
  {
+	 if (use_epoll)
+	 {
+		 //only visit the slaves that are part way through the handshake
+		 vector<int> pending_socks(init_pending.begin(), init_pending.end());
+		 for (int i_sock : pending_socks)
+		 {
+			 auto iter = socket_to_iter_map.find(i_sock);
+			 if (iter == socket_to_iter_map.end())
+			 {
+				 init_pending.erase(i_sock);
+				 continue;
+			 }
+			 init_slave(*(iter->second));
+			 SlaveInfoRec::State cur_state = iter->second->get_state();
+			 if (cur_state != SlaveInfoRec::State::NEW
+				 && cur_state != SlaveInfoRec::State::CWD_RCV
+				 && cur_state != SlaveInfoRec::State::NAMES_SENT
+				 && cur_state != SlaveInfoRec::State::LINPACK_RCV)
+			 {
+				 init_pending.erase(i_sock);
+			 }
+		 }
+		 return;
+	 }
 	 for (auto &i_slv : slave_info_set)
 	 {
-		int i_sock = i_slv.get_socket_fd();
-		SlaveInfoRec::State cur_state = i_slv.get_state();
-		if (cur_state == SlaveInfoRec::State::NEW)
+		 init_slave(i_slv);
+	 }
+ }
+
+ void RunManagerPanther::init_slave(SlaveInfoRec &slave_info)
+ {
+	int i_sock = slave_info.get_socket_fd();
+	SlaveInfoRec::State cur_state = slave_info.get_state();
+	if (cur_state == SlaveInfoRec::State::NEW)
+	{
+		NetPackage net_pack(NetPackage::PackType::REQ_RUNDIR, 0, 0, "");
+		char data = '\0';
+		int err = net_pack.send(i_sock, &data, sizeof(data));
+		if (err > 0)
 		{
-			NetPackage net_pack(NetPackage::PackType::REQ_RUNDIR, 0, 0, "");
-			char data = '\0';
-			int err = net_pack.send(i_sock, &data, sizeof(data));
-			if (err > 0)
-			{
-				i_slv.set_state(SlaveInfoRec::State::CWD_REQ);
-			}
+			slave_info.set_state(SlaveInfoRec::State::CWD_REQ);
 		}
-		else if (cur_state == SlaveInfoRec::State::CWD_RCV)
-		{
-			// send parameter and observation names
-			NetPackage net_pack(NetPackage::PackType::PAR_NAMES, 0, 0, "");
-			vector<int8_t> data;
-			vector<string> tmp_vec;
-			// send parameter names
-			tmp_vec = file_stor.get_par_name_vec();
-			data = Serialization::serialize(tmp_vec);
-			int err_par = net_pack.send(i_sock, &data[0], data.size());
-			//send observation names
-			net_pack = NetPackage(NetPackage::PackType::OBS_NAMES, 0, 0, "");
-			tmp_vec = file_stor.get_obs_name_vec();
-			data = Serialization::serialize(tmp_vec);
-			int err_obs = net_pack.send(i_sock, &data[0], data.size());
-
-			if (err_par > 0 && err_obs > 0)
-			{
-				i_slv.set_state(SlaveInfoRec::State::NAMES_SENT);
-			}
+	}
+	else if (cur_state == SlaveInfoRec::State::CWD_RCV)
+	{
+		// send parameter and observation names
+		NetPackage net_pack(NetPackage::PackType::PAR_NAMES, 0, 0, "");
+		vector<int8_t> data;
+		vector<string> tmp_vec;
+		// send parameter names
+		tmp_vec = file_stor.get_par_name_vec();
+		data = Serialization::serialize(tmp_vec);
+		int err_par = net_pack.send(i_sock, &data[0], data.size());
+		//send observation names
+		net_pack = NetPackage(NetPackage::PackType::OBS_NAMES, 0, 0, "");
+		tmp_vec = file_stor.get_obs_name_vec();
+		data = Serialization::serialize(tmp_vec);
+		int err_obs = net_pack.send(i_sock, &data[0], data.size());
+		if (compress_results)
+		{
+			//slaves that do not support compression ignore this request and keep sending RUN_FINISHED
+			net_pack = NetPackage(NetPackage::PackType::REQ_COMPRESSION, 0, 0, "");
+			char no_data = '\0';
+			net_pack.send(i_sock, &no_data, sizeof(no_data));
 		}
-		else if (cur_state == SlaveInfoRec::State::NAMES_SENT)
+		if (max_batch_size > 1)
 		{
-			NetPackage net_pack(NetPackage::PackType::REQ_LINPACK, 0, 0, "");
-			char data = '\0';
-			int err = net_pack.send(i_sock, &data, sizeof(data));
-			if (err  > 0)
-			{
-				i_slv.set_state(SlaveInfoRec::State::LINPACK_REQ);
-				i_slv.start_timer();
-			}
+			//slaves that support START_RUNS reply with BATCH_RUNS_OK
+			net_pack = NetPackage(NetPackage::PackType::REQ_BATCH_RUNS, 0, 0, "");
+			char no_data = '\0';
+			net_pack.send(i_sock, &no_data, sizeof(no_data));
 		}
-		else if (cur_state == SlaveInfoRec::State::LINPACK_RCV)
+
+		if (err_par > 0 && err_obs > 0)
 		{
-			i_slv.set_state(SlaveInfoRec::State::WAITING);
+			slave_info.set_state(SlaveInfoRec::State::NAMES_SENT);
 		}
 	}
+	else if (cur_state == SlaveInfoRec::State::NAMES_SENT)
+	{
+		NetPackage net_pack(NetPackage::PackType::REQ_LINPACK, 0, 0, "");
+		char data = '\0';
+		int err = net_pack.send(i_sock, &data, sizeof(data));
+		if (err  > 0)
+		{
+			slave_info.set_state(SlaveInfoRec::State::LINPACK_REQ);
+			slave_info.start_timer();
+		}
+	}
+	else if (cur_state == SlaveInfoRec::State::LINPACK_RCV)
+	{
+		slave_info.set_state(SlaveInfoRec::State::WAITING);
+	}
  }
 
  vector<int> RunManagerPanther::get_overdue_runs_over_kill_threshold(int run_id)
@@ -1255,8 +1818,8 @@ void RunManagerPanther::kill_all_active_runs()
 	 {
 		 if (i->second->get_state() == SlaveInfoRec::State::ACTIVE)
 		 {
-			 double avg_runtime = i->second->get_runtime_minute();
-			 if (avg_runtime <= 0) avg_runtime = get_global_runtime_minute();;
+			 double avg_runtime = get_expected_runtime_sec(*(i->second)) / 60.0;
+			 if (avg_runtime <= 0) avg_runtime = get_global_runtime_minute();
 			 if (avg_runtime <= 0) avg_runtime = 1.0E+10;
 			 duration = i->second->get_duration_minute();
 			 if ((duration > overdue_giveup_minutes) || (duration >= avg_runtime*overdue_giveup_fac))
@@ -1292,10 +1855,8 @@ void RunManagerPanther::kill_all_active_runs()
 	 stringstream ss;
 	 ss << "new connection from: " << w_getnameinfo_string(sock_id);
 	 report(ss.str(), false);
-	 FD_SET(sock_id, &master); // add to master set
-	 if (sock_id > fdmax) { // keep track of the max
-		 fdmax = sock_id;
-	 }
+	 watch_socket(sock_id); // add to master set
+	 if (use_epoll) init_pending.insert(sock_id);
 
 	 //list<SlaveInfoRec>::iterator
 	slave_info_set.push_back(SlaveInfoRec(sock_id));
@@ -1304,6 +1865,49 @@ void RunManagerPanther::kill_all_active_runs()
 	return iter;
  }
 
+ void RunManagerPanther::add_slots(list<SlaveInfoRec>::iterator slave_info_iter, const vector<string> &slot_dirs)
+ {
+	 // slot 0 is the slave itself, every other slot gets its own record so it is scheduled like a separate slave
+	 int sock_id = slave_info_iter->get_socket_fd();
+	 if (slave_info_iter->get_slot() != 0 || socket_to_slots_map.count(sock_id) > 0 || slot_dirs.size() < 2)
+	 {
+		 return;
+	 }
+	 vector<list<SlaveInfoRec>::iterator> &slot_iters = socket_to_slots_map[sock_id];
+	 slot_iters.push_back(slave_info_iter);
+	 for (size_t i_slot = 1; i_slot < slot_dirs.size(); ++i_slot)
+	 {
+		 SlaveInfoRec slot_info(sock_id);
+		 slot_info.set_slot(i_slot);
+		 slot_info.set_work_dir(slot_dirs[i_slot]);
+		 slot_info.set_batch_capable(slave_info_iter->get_batch_capable());
+		 slot_info.set_state(SlaveInfoRec::State::LINPACK_REQ);
+		 slot_info.start_timer();
+		 slave_info_set.push_back(slot_info);
+		 slot_iters.push_back(std::prev(slave_info_set.end()));
+	 }
+	 stringstream ss;
+	 ss << "slave " << slave_info_iter->get_socket_name() << " is running " << slot_dirs.size() << " model slots";
+	 report(ss.str(), false);
+ }
+
+ list<SlaveInfoRec>::iterator RunManagerPanther::get_slot_iter(int sock_id, const NetPackage &net_pack)
+ {
+	 list<SlaveInfoRec>::iterator slave_info_iter = socket_to_iter_map.at(sock_id);
+	 string slot_tag = net_pack.get_desc();
+	 auto slots_iter = socket_to_slots_map.find(sock_id);
+	 if (slot_tag.empty() || slots_iter == socket_to_slots_map.end())
+	 {
+		 return slave_info_iter;
+	 }
+	 int slot = atoi(slot_tag.c_str());
+	 if (slot > 0 && size_t(slot) < slots_iter->second.size())
+	 {
+		 return slots_iter->second[slot];
+	 }
+	 return slave_info_iter;
+ }
+
  double RunManagerPanther::get_global_runtime_minute() const
  {
 	 double global_runtime = 0;
@@ -1326,6 +1930,7 @@ void RunManagerPanther::kill_all_active_runs()
  void RunManagerPanther::unschedule_run(list<SlaveInfoRec>::iterator slave_info_iter)
  {
 	 int run_id = slave_info_iter->get_run_id();
+	 completion_candidates.insert(run_id);
 	 auto range_pair = active_runid_to_iterset_map.equal_range(run_id);
 
 	 for (auto iter = range_pair.first; iter != range_pair.second;)
@@ -1355,6 +1960,14 @@ void RunManagerPanther::kill_all_active_runs()
 			 iter_list.push_back(iter_b);
 		 }
 	 }
+	 //fastest slaves first.  Slaves without an expected run time yet go last
+	 iter_list.sort([this](const list<SlaveInfoRec>::iterator &a, const list<SlaveInfoRec>::iterator &b)
+	 {
+		 double t_a = get_expected_runtime_sec(*a);
+		 double t_b = get_expected_runtime_sec(*b);
+		 if (t_a <= 0 || t_b <= 0) return (t_a > 0 && t_b <= 0);
+		 return t_a < t_b;
+	 });
 	 return iter_list;
  }
 
@@ -1414,6 +2027,24 @@ void RunManagerPanther::kill_all_active_runs()
  {
 	 file_stor.update_run_failed(run_id);
 	 failure_map.insert(make_pair(run_id, socket_fd));
+	 completion_candidates.insert(run_id);
+ }
+
+ void RunManagerPanther::report_candidate_runs()
+ {
+	 //a run is complete once it has finished on any slave, or once it has used up
+	 //its attempts and no copies of it are still going
+	 int n_runs = file_stor.get_nruns();
+	 for (int run_id : completion_candidates)
+	 {
+		 if ((run_id < 0) || (run_id >= n_runs))
+			 continue;
+		 if (run_finished(run_id))
+			 report_completed_run(run_id);
+		 else if ((failure_map.count(run_id) >= max_n_failure) && (get_n_concurrent(run_id) == 0))
+			 report_completed_run(run_id);
+	 }
+	 completion_candidates.clear();
  }
 
  void RunManagerPanther::update_run_failed(int run_id)
@@ -1427,26 +2058,34 @@ RunManagerPanther::~RunManagerPanther(void)
 	//close sockets and cleanup
 	int err;
 	err = w_close(listener);
-	FD_CLR(listener, &master);
+	//the fd_set is only used (and only safe for sockets < FD_SETSIZE) in select mode
+	if (!use_epoll)
+		FD_CLR(listener, &master);
 	// this is needed to ensure that the first slave closes properly
 	w_sleep(2000);
-	for(int i = 0; i <= fdmax; i++) {
-		if (FD_ISSET(i, &master))
-		{
-			NetPackage netpack(NetPackage::PackType::TERMINATE, 0, 0,"");
-			char data;
-			netpack.send(i, &data, 0);
-			err = w_close(i);
+	for (auto &si : socket_to_iter_map)
+	{
+		int i = si.first;
+		NetPackage netpack(NetPackage::PackType::TERMINATE, 0, 0,"");
+		char data;
+		netpack.send(i, &data, 0);
+		err = w_close(i);
+		if (!use_epoll)
 			FD_CLR(i, &master);
-		}
 	}
+#ifdef PANTHER_EPOLL
+	if (epoll_fd != -1)
+	{
+		close(epoll_fd);
+	}
+#endif
 	w_cleanup();
 }
 
 RunManagerYAMRCondor::RunManagerYAMRCondor(const std::string & stor_filename,
 	const std::string & port, std::ofstream & _f_rmr, int _max_n_failure,
-	double overdue_reched_fac, double overdue_giveup_fac, double overdue_giveup_minutes, string _condor_submit_file): RunManagerPanther(stor_filename,
-		port,_f_rmr,_max_n_failure,overdue_reched_fac,overdue_giveup_fac, overdue_giveup_minutes)
+	double overdue_reched_fac, double overdue_giveup_fac, double overdue_giveup_minutes, string _condor_submit_file, bool _use_epoll, bool _compress_results, int _max_batch_size, bool _speculative_runs): RunManagerPanther(stor_filename,
+		port,_f_rmr,_max_n_failure,overdue_reched_fac,overdue_giveup_fac, overdue_giveup_minutes, _use_epoll, _compress_results, _max_batch_size, _speculative_runs)
 {
 	submit_file = _condor_submit_file;
 	parse_submit_file();
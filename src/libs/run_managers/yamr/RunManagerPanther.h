@@ -30,6 +30,11 @@
 #include "RunManagerAbstract.h"
 #include "RunStorage.h"
 
+#if defined(__linux__)
+//epoll is only available on linux (OS_LINUX is also defined for OSX)
+#define PANTHER_EPOLL
+#endif
+
 class SlaveInfoRec {
 public:
 	static const int UNKNOWN_ID = -9999;
@@ -66,6 +71,15 @@ public:
 	void reset_last_ping_time();
 	void reset_runtime() { run_time = std::chrono::system_clock::duration::zero(); }
 	int seconds_since_last_ping_time() const;
+	bool get_batch_capable() const { return batch_capable; }
+	void set_batch_capable(bool _flag) { batch_capable = _flag; }
+	void queue_batch_runs(const std::vector<int> &run_ids);
+	bool has_batch_runs() const { return !batch_runs.empty(); }
+	int next_batch_run();
+	std::vector<int> clear_batch_runs();
+	int get_slot() const { return slot; }
+	void set_slot(int _slot) { slot = _slot; }
+	std::string get_slot_tag() const;
 	~SlaveInfoRec(){}
 private:
 	int socket_fd;
@@ -80,6 +94,9 @@ private:
 	std::chrono::system_clock::time_point last_ping_time;
 	std::string work_dir;
 	std::vector<string> name_info_vec;
+	bool batch_capable;
+	int slot; // model slot on a slave that runs several models at once (0 for the connection itself)
+	std::deque<int> batch_runs; // runs sent with START_RUNS that are queued behind run_id on the slave
 public:
 	class CompareTimes
 	{
@@ -93,7 +110,8 @@ class RunManagerPanther : public RunManagerAbstract
 {
 public:
 	RunManagerPanther(const std::string &stor_filename, const std::string &port, std::ofstream &_f_rmr, int _max_n_failure,
-		double overdue_reched_fac, double overdue_giveup_fac, double overdue_giveup_minutes);
+		double overdue_reched_fac, double overdue_giveup_fac, double overdue_giveup_minutes, bool _use_epoll=false,
+		bool _compress_results=false, int _max_batch_size=1, bool _speculative_runs=false);
 	virtual void initialize(const Parameters &model_pars, const Observations &obs, const std::string &_filename = std::string(""));
 	virtual void initialize_restart(const std::string &_filename);
 	virtual void reinitialize(const std::string &_filename = std::string(""));
@@ -102,6 +120,7 @@ public:
 	virtual int add_run(const std::vector<double> &model_pars, const std::string &info_txt="", double info_valuee=RunStorage::no_data);
 	virtual int add_run(const Eigen::VectorXd &model_pars, const std::string &info_txt="", double info_valuee=RunStorage::no_data);
 	virtual void update_run(int run_id, const Parameters &pars, const Observations &obs);
+	virtual void cancel_run(int run_id);
 	virtual void run();
 	virtual RunManagerAbstract::RUN_UNTIL_COND run_until(RUN_UNTIL_COND condition, int n_nops = 0, double sec = 0.0);
 	~RunManagerPanther(void);
@@ -117,6 +136,9 @@ private:
 	static const int N_PINGS_UNRESPONSIVE;
 	static const int PING_INTERVAL_SECS;
 	static const int MAX_CONCURRENT_RUNS_LOWER_LIMIT;
+	static const int EPOLL_MAX_EVENTS;
+	static const int BATCH_TARGET_SECS;
+	static const double SPECULATIVE_PRIORITY_OVERDUE;
 
 	double overdue_reched_fac;
 	double overdue_giveup_fac;
@@ -128,15 +150,34 @@ private:
 	int model_runs_done;
 	int model_runs_failed;
 	int model_runs_timed_out;
-	fd_set master; // master file descriptor list
+	fd_set master; // master file descriptor list (select() event loop only)
+	bool use_epoll;
+	bool compress_results; // ask slaves to send model results as NetPackage::PackType::RUN_FINISHED_COMPRESSED
+	int max_batch_size; // maximum number of runs sent to a slave in one START_RUNS message
+	bool speculative_runs; // start duplicates of slow runs on idle slaves once the waiting queue is empty
+	double runtime_per_linpack; // average ratio of model run time to linpack time over the slaves that have completed runs
+	double global_runtime_sec; // average model run time over all slaves
+	int epoll_fd;
+	std::set<int> init_pending; // sockets of slaves that are waiting on the next handshake message (epoll event loop only)
+	std::chrono::system_clock::time_point last_housekeeping_time;
 	list<SlaveInfoRec> slave_info_set;
 	map<int, list<SlaveInfoRec>::iterator> socket_to_iter_map;
+	map<int, vector<list<SlaveInfoRec>::iterator>> socket_to_slots_map; // all slots of slaves with more than one slot
 	multimap<int, list<SlaveInfoRec>::iterator> active_runid_to_iterset_map;
 	std::deque<int> waiting_runs;
 	std::unordered_multimap<int, int> failure_map;
-
-	int schedule_run(int run_id, std::list<list<SlaveInfoRec>::iterator> &free_slave_list, int n_responsive_slaves);
+	bool run_in_progress; // run_until() returned early and the current set of runs has not finished
+	std::set<int> completion_candidates; // runs that have stopped on a slave since the completed runs were last reported
+
+	int schedule_run(int run_id, std::list<list<SlaveInfoRec>::iterator> &free_slave_list, int n_responsive_slaves, int batch_start = -1);
+	int get_batch_size(const SlaveInfoRec &slave_info, int n_free_slaves);
+	void schedule_speculative_runs(std::list<list<SlaveInfoRec>::iterator> &free_slave_list, int n_responsive_slaves);
+	void update_runtime_model();
+	double get_expected_runtime_sec(const SlaveInfoRec &slave_info) const;
+	void start_next_batch_run(list<SlaveInfoRec>::iterator slave_info_iter);
+	void requeue_batch_runs(list<SlaveInfoRec>::iterator slave_info_iter);
 	void unschedule_run(list<SlaveInfoRec>::iterator slave_info_iter);
+	void report_candidate_runs();
 	void kill_run(list<SlaveInfoRec>::iterator slave_info_iter, const std::string &reason="UNKNOWN");
 	void kill_runs(int run_id, bool update_failure_map, const std::string &reason = "UNKNOWN");
 	void kill_all_active_runs();
@@ -145,11 +186,18 @@ private:
 
 	std::ofstream &f_rmr;
 	bool listen();
-	bool process_model_run(int sock_id, NetPackage &net_pack);
+	bool listen_epoll();
+	void watch_socket(int sock_id);
+	void unwatch_socket(int sock_id);
+	bool is_watched(int sock_id);
+	bool process_model_run(list<SlaveInfoRec>::iterator slave_info_iter, NetPackage &net_pack);
 	void process_message(int i);
 	void schedule_runs();
 	void init_slaves();
+	void init_slave(SlaveInfoRec &slave_info);
 	list<SlaveInfoRec>::iterator add_slave(int sock_id);
+	void add_slots(list<SlaveInfoRec>::iterator slave_info_iter, const vector<string> &slot_dirs);
+	list<SlaveInfoRec>::iterator get_slot_iter(int sock_id, const NetPackage &net_pack);
 	void erase_slave(int sock_id);
 	bool ping(int i_sock);
 	bool ping();
@@ -174,7 +222,8 @@ class RunManagerYAMRCondor : public RunManagerPanther
 {
 public:
 	RunManagerYAMRCondor(const std::string &stor_filename, const std::string &port, std::ofstream &_f_rmr, int _max_n_failure,
-		double overdue_reched_fac, double overdue_giveup_fac, double overdue_giveup_minutes, string _condor_submit_file);
+		double overdue_reched_fac, double overdue_giveup_fac, double overdue_giveup_minutes, string _condor_submit_file, bool _use_epoll=false,
+		bool _compress_results=false, int _max_batch_size=1, bool _speculative_runs=false);
 	virtual void run();
 
 private:
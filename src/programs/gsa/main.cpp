@@ -36,6 +36,7 @@
 #include "FileManager.h"
 #include "RunManagerGenie.h"
 #include "RunManagerSerial.h"
+#include "RunManagerThreaded.h"
 #include "OutputFileWriter.h"
 #include "PantherSlave.h"
 #include "Serialization.h"
@@ -231,7 +232,11 @@ int main(int argc, char* argv[])
 			pest_scenario.get_pestpp_options().get_max_run_fail(),
 			pest_scenario.get_pestpp_options().get_overdue_reched_fac(),
 			pest_scenario.get_pestpp_options().get_overdue_giveup_fac(),
-			pest_scenario.get_pestpp_options().get_overdue_giveup_minutes());
+			pest_scenario.get_pestpp_options().get_overdue_giveup_minutes(),
+			pest_scenario.get_pestpp_options().get_panther_use_epoll(),
+			pest_scenario.get_pestpp_options().get_panther_compress_results(),
+			pest_scenario.get_pestpp_options().get_panther_max_batch_size(),
+			pest_scenario.get_pestpp_options().get_panther_speculative_runs());
 	}
 	else if (run_manager_type == RunManagerType::GENIE)
 	{
@@ -245,9 +250,20 @@ int main(int argc, char* argv[])
 	else
 	{
 		const ModelExecInfo &exi = pest_scenario.get_model_exec_info();
-		run_manager_ptr = new RunManagerSerial(exi.comline_vec,
-		exi.tplfile_vec, exi.inpfile_vec, exi.insfile_vec, exi.outfile_vec,
-		file_manager.build_filename("rns"), pathname);
+		if (pest_scenario.get_pestpp_options().get_local_run_threads() > 1)
+		{
+			run_manager_ptr = new RunManagerThreaded(exi.comline_vec,
+				exi.tplfile_vec, exi.inpfile_vec, exi.insfile_vec, exi.outfile_vec,
+				file_manager.build_filename("rns"), pathname,
+				pest_scenario.get_pestpp_options().get_max_run_fail(),
+				pest_scenario.get_pestpp_options().get_local_run_threads());
+		}
+		else
+		{
+			run_manager_ptr = new RunManagerSerial(exi.comline_vec,
+				exi.tplfile_vec, exi.inpfile_vec, exi.insfile_vec, exi.outfile_vec,
+				file_manager.build_filename("rns"), pathname);
+		}
 	}
 
 	cout << endl;
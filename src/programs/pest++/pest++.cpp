@@ -36,6 +36,7 @@
 #include "TerminationController.h"
 #include "RunManagerGenie.h"
 #include "RunManagerSerial.h"
+#include "RunManagerThreaded.h"
 #include "RunManagerExternal.h"
 #include "SVD_PROPACK.h"
 #include "OutputFileWriter.h"
@@ -327,7 +328,11 @@ int main(int argc, char* argv[])
 					pest_scenario.get_pestpp_options().get_overdue_reched_fac(),
 					pest_scenario.get_pestpp_options().get_overdue_giveup_fac(),
 					pest_scenario.get_pestpp_options().get_overdue_giveup_minutes(),
-					csf);
+					csf,
+					pest_scenario.get_pestpp_options().get_panther_use_epoll(),
+					pest_scenario.get_pestpp_options().get_panther_compress_results(),
+					pest_scenario.get_pestpp_options().get_panther_max_batch_size(),
+					pest_scenario.get_pestpp_options().get_panther_speculative_runs());
 			}
 			else
 			{
@@ -337,7 +342,11 @@ int main(int argc, char* argv[])
 					pest_scenario.get_pestpp_options().get_max_run_fail(),
 					pest_scenario.get_pestpp_options().get_overdue_reched_fac(),
 					pest_scenario.get_pestpp_options().get_overdue_giveup_fac(),
-					pest_scenario.get_pestpp_options().get_overdue_giveup_minutes());
+					pest_scenario.get_pestpp_options().get_overdue_giveup_minutes(),
+					pest_scenario.get_pestpp_options().get_panther_use_epoll(),
+					pest_scenario.get_pestpp_options().get_panther_compress_results(),
+					pest_scenario.get_pestpp_options().get_panther_max_batch_size(),
+					pest_scenario.get_pestpp_options().get_panther_speculative_runs());
 			}
 		}
 		else if (run_manager_type == RunManagerType::GENIE)
@@ -365,10 +374,21 @@ int main(int argc, char* argv[])
 			performance_log.log_event("finished basic model IO error checking");
 			cout << "done" << endl;
 			const ModelExecInfo &exi = pest_scenario.get_model_exec_info();
-			run_manager_ptr = new RunManagerSerial(exi.comline_vec,
-				exi.tplfile_vec, exi.inpfile_vec, exi.insfile_vec, exi.outfile_vec,
-				file_manager.build_filename("rns"), pathname,
-				pest_scenario.get_pestpp_options().get_max_run_fail());
+			if (pest_scenario.get_pestpp_options().get_local_run_threads() > 1)
+			{
+				run_manager_ptr = new RunManagerThreaded(exi.comline_vec,
+					exi.tplfile_vec, exi.inpfile_vec, exi.insfile_vec, exi.outfile_vec,
+					file_manager.build_filename("rns"), pathname,
+					pest_scenario.get_pestpp_options().get_max_run_fail(),
+					pest_scenario.get_pestpp_options().get_local_run_threads());
+			}
+			else
+			{
+				run_manager_ptr = new RunManagerSerial(exi.comline_vec,
+					exi.tplfile_vec, exi.inpfile_vec, exi.insfile_vec, exi.outfile_vec,
+					file_manager.build_filename("rns"), pathname,
+					pest_scenario.get_pestpp_options().get_max_run_fail());
+			}
 		}
 
 		//setup the parcov, if needed
@@ -383,6 +403,8 @@ int main(int argc, char* argv[])
 
 		ObjectiveFunc obj_func(&(pest_scenario.get_ctl_observations()), &(pest_scenario.get_ctl_observation_info()), &(pest_scenario.get_prior_info()));
 		Jacobian *base_jacobian_ptr = new Jacobian_1to1(file_manager,output_file_writer);
+		base_jacobian_ptr->set_drop_tol(pest_scenario.get_pestpp_options().get_jac_drop_tol());
+		base_jacobian_ptr->set_num_threads(pest_scenario.get_pestpp_options().get_jac_num_threads());
 
 		TerminationController termination_ctl(pest_scenario.get_control_info().noptmax, pest_scenario.get_control_info().phiredstp,
 			pest_scenario.get_control_info().nphistp, pest_scenario.get_control_info().nphinored, pest_scenario.get_control_info().relparstp,
@@ -397,12 +419,15 @@ int main(int argc, char* argv[])
 
 		SVDSolver::MAT_INV mat_inv = SVDSolver::MAT_INV::JTQJ;
 		if (pest_scenario.get_pestpp_options().get_mat_inv() == PestppOptions::Q12J) mat_inv = SVDSolver::MAT_INV::Q12J;
+		else if (pest_scenario.get_pestpp_options().get_mat_inv() == PestppOptions::LSQR) mat_inv = SVDSolver::MAT_INV::LSQR;
 		SVDSolver base_svd(pest_scenario, file_manager, &obj_func, base_trans_seq,
 			*base_jacobian_ptr, output_file_writer, mat_inv, &performance_log, "base parameter solution",parcov);
 
 		base_svd.set_svd_package(pest_scenario.get_pestpp_options().get_svd_pack());
 		//Build Super-Parameter problem
 		Jacobian *super_jacobian_ptr = new Jacobian(file_manager);
+		super_jacobian_ptr->set_drop_tol(pest_scenario.get_pestpp_options().get_jac_drop_tol());
+		super_jacobian_ptr->set_num_threads(pest_scenario.get_pestpp_options().get_jac_num_threads());
 		ParamTransformSeq trans_svda;
 		// method must be involked as pointer as the transformation sequence it is added to will
 		// take responsibility for destroying it
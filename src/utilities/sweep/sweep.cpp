@@ -33,6 +33,7 @@ along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
 #include "ModelRunPP.h"
 #include "FileManager.h"
 #include "RunManagerSerial.h"
+#include "RunManagerThreaded.h"
 #include "OutputFileWriter.h"
 #include "PantherSlave.h"
 #include "Serialization.h"
@@ -216,6 +217,12 @@ void process_sweep_runs(ofstream &csv, Pest &pest_scenario, RunManagerAbstract*
 	double fail_val = -1.0E+10;
 	int run_id;
 	string listed_run_id;
+	const vector<string> &obs_names = pest_scenario.get_ctl_ordered_obs_names();
+	//pull all of the simulated values out of the run storage in one pass
+	Eigen::MatrixXd obs_mat;
+	vector<bool> failed_mask;
+	run_manager_ptr->get_runs(run_ids, obs_names, obs_mat, failed_mask);
+	vector<double> obs_vec(obs_names.size());
 	//for (auto &run_id : run_ids)
 	for (int i = 0;i <run_ids.size();++i)
 	{
@@ -224,8 +231,11 @@ void process_sweep_runs(ofstream &csv, Pest &pest_scenario, RunManagerAbstract*
 		csv << run_id + total_runs_done;
 		csv << ',' << listed_run_id;
 		// if the run was successful
-		if (run_manager_ptr->get_run(run_id, pars, obs))
+		if (!failed_mask[i])
 		{
+			run_manager_ptr->get_model_parameters(run_id, pars);
+			Eigen::VectorXd::Map(obs_vec.data(), obs_vec.size()) = obs_mat.row(i);
+			obs.update_without_clear(obs_names, obs_vec);
 			PhiData phi_data = obj_func.phi_report(obs, pars, *(pest_scenario.get_regul_scheme_ptr()));
 			csv << ",0";
 
@@ -236,9 +246,9 @@ void process_sweep_runs(ofstream &csv, Pest &pest_scenario, RunManagerAbstract*
 			{
 				csv << ',' << phi_data.group_phi.at(obs_grp);
 			}
-			for (auto oname : pest_scenario.get_ctl_ordered_obs_names())
+			for (size_t j = 0; j < obs_vec.size(); j++)
 			{
-				csv << ',' << obs[oname];
+				csv << ',' << obs_vec[j];
 			}
 			csv << endl;
 		}
@@ -523,7 +533,11 @@ int main(int argc, char* argv[])
 				pest_scenario.get_pestpp_options().get_max_run_fail(),
 				pest_scenario.get_pestpp_options().get_overdue_reched_fac(),
 				pest_scenario.get_pestpp_options().get_overdue_giveup_fac(),
-				pest_scenario.get_pestpp_options().get_overdue_giveup_minutes());
+				pest_scenario.get_pestpp_options().get_overdue_giveup_minutes(),
+				pest_scenario.get_pestpp_options().get_panther_use_epoll(),
+				pest_scenario.get_pestpp_options().get_panther_compress_results(),
+				pest_scenario.get_pestpp_options().get_panther_max_batch_size(),
+				pest_scenario.get_pestpp_options().get_panther_speculative_runs());
 		}
 		else
 		{
@@ -534,10 +548,21 @@ int main(int argc, char* argv[])
 			performance_log.log_event("finished basic model IO error checking");
 			cout << "done" << endl;
 			const ModelExecInfo &exi = pest_scenario.get_model_exec_info();
-			run_manager_ptr = new RunManagerSerial(exi.comline_vec,
-				exi.tplfile_vec, exi.inpfile_vec, exi.insfile_vec, exi.outfile_vec,
-				file_manager.build_filename("rns"), pathname,
-				pest_scenario.get_pestpp_options().get_max_run_fail());
+			if (pest_scenario.get_pestpp_options().get_local_run_threads() > 1)
+			{
+				run_manager_ptr = new RunManagerThreaded(exi.comline_vec,
+					exi.tplfile_vec, exi.inpfile_vec, exi.insfile_vec, exi.outfile_vec,
+					file_manager.build_filename("rns"), pathname,
+					pest_scenario.get_pestpp_options().get_max_run_fail(),
+					pest_scenario.get_pestpp_options().get_local_run_threads());
+			}
+			else
+			{
+				run_manager_ptr = new RunManagerSerial(exi.comline_vec,
+					exi.tplfile_vec, exi.inpfile_vec, exi.insfile_vec, exi.outfile_vec,
+					file_manager.build_filename("rns"), pathname,
+					pest_scenario.get_pestpp_options().get_max_run_fail());
+			}
 		}
 
 
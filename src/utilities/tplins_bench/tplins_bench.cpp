@@ -0,0 +1,415 @@
+/*
+
+
+This file is part of PEST++.
+
+PEST++ is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+PEST++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <cstdio>
+#include <cmath>
+#include "utilities.h"
+#include "template_instruction.h"
+
+using namespace std;
+
+extern "C"
+{
+	void mio_initialise_w_(int *, int *, int *, int *, int *);
+	void mio_put_file_w_(int *, int *, int *, char *, long);	//last argument is the hidden fortran length of the file name, passed by value
+	void mio_store_instruction_set_w_(int *);
+	void mio_process_template_files_w_(int *, int *, char *);
+	void mio_write_model_input_files_w_(int *, int *, char *, double *);
+	void mio_read_model_output_files_w_(int *, int *, char *, double *);
+	void mio_finalise_w_(int *);
+	void mio_get_message_string_w_(int *, int *, char *);
+}
+
+const string TPL_FILE = "tplins_bench.tpl";
+const string INS_FILE = "tplins_bench.ins";
+const string OUT_FILE = "tplins_bench.out";
+const string MIO_IN_FILE = "tplins_bench_mio.in";
+const string NATIVE_IN_FILE = "tplins_bench_native.in";
+
+
+void usage(ostream &fout)
+{
+	fout << "--------------------------------------------------------" << endl;
+	fout << "usage:" << endl << endl;
+	fout << "  tplins_bench.exe [npar] [nobs] [nruns]" << endl << endl;
+	fout << " where:" << endl;
+	fout << "  npar:   number of parameters in the generated template" << endl;
+	fout << "          file (default 2000)" << endl;
+	fout << "  nobs:   number of observations in the generated" << endl;
+	fout << "          instruction file (default 5000)" << endl;
+	fout << "  nruns:  number of model input files written and model" << endl;
+	fout << "          output files read by each method (default 200)" << endl;
+	fout << endl;
+	fout << " Compares the native template and instruction file" << endl;
+	fout << " processing of the model interface with the fortran mio" << endl;
+	fout << " module: the model input files written and observation" << endl;
+	fout << " values read must be identical.  The time taken by each" << endl;
+	fout << " method is reported.  Scratch files named tplins_bench*" << endl;
+	fout << " are written to the current directory." << endl;
+	fout << "--------------------------------------------------------" << endl;
+}
+
+void throw_mio_error(int ifail, const string &base_message)
+{
+	int mess_len = 500;
+	char message[500];
+	mio_get_message_string_w_(&ifail, &mess_len, message);
+	string err = string(message, 500);
+	err = err.substr(0, err.find_last_not_of(" \t") + 1);
+	throw runtime_error("mio error: " + base_message + "\n" + err);
+}
+
+string read_file(const string &filename)
+{
+	ifstream fin(filename, ios::binary);
+	stringstream ss;
+	ss << fin.rdbuf();
+	return ss.str();
+}
+
+//parameter names and the widths of their parameter spaces.  Every parameter is cited twice so the
+//narrowest space sets the width. The one letter parameters test the narrowest spaces allowed
+void write_template(int npar, vector<string> &par_names, vector<int> &par_widths, mt19937 &gen)
+{
+	uniform_int_distribution<int> width_dist(0, 24);
+	par_names.clear();
+	par_widths.clear();
+	for (char c = 'a'; c <= 'h'; ++c)
+	{
+		par_names.push_back(string(1, c));
+		par_widths.push_back(3 + (c - 'a'));
+	}
+	for (int i = par_names.size(); i < npar; ++i)
+	{
+		string name = "par" + to_string(i);
+		par_names.push_back(name);
+		par_widths.push_back(name.size() + 2 + width_dist(gen));
+	}
+	ofstream fout(TPL_FILE);
+	fout << "ptf ~" << endl;
+	for (int i_cite = 0; i_cite < 2; ++i_cite)
+	{
+		for (size_t i = 0; i < par_names.size(); ++i)
+		{
+			int width = par_widths[i] + i_cite * 3;
+			string space = "~" + par_names[i];
+			space.append(width - 1 - space.size(), ' ');
+			space.push_back('~');
+			if (i % 3 == 0)
+			{
+				fout << "  value " << i << "   ";
+			}
+			fout << space;
+			fout << ((i % 3 == 2) ? "\n" : "   ");
+		}
+		fout << endl;
+	}
+}
+
+//an output file and instruction set that use all the instruction types
+void write_output_and_instructions(int nobs, vector<string> &obs_names, mt19937 &gen)
+{
+	uniform_real_distribution<double> exp_dist(-30.0, 30.0);
+	uniform_real_distribution<double> uni(-1.0, 1.0);
+	ofstream fout(OUT_FILE);
+	ofstream fins(INS_FILE);
+	fins << "pif ~" << endl;
+	obs_names.clear();
+	char buf[200];
+	for (int i = 0; i < nobs; ++i)
+	{
+		string name = "obs" + to_string(i);
+		obs_names.push_back(name);
+		double val = uni(gen) * pow(10.0, exp_dist(gen));
+		switch (i % 8)
+		{
+		case 0:
+			snprintf(buf, sizeof(buf), "  result %d  %.10e  kg", i, val);
+			fins << "l1 w w !" << name << "!" << endl;
+			break;
+		case 1:
+			snprintf(buf, sizeof(buf), "%-10s%15.7e", "fixed", val);
+			fins << "l1 [" << name << "]11:25" << endl;
+			break;
+		case 2:
+			snprintf(buf, sizeof(buf), "semi %12.5f end", val);
+			fins << "l1 (" << name << ")8:14" << endl;
+			break;
+		case 3:
+			fout << "block " << i << endl;
+			snprintf(buf, sizeof(buf), "   %g", val);
+			fins << "~block " << i << "~" << endl << "l1 !" << name << "!" << endl;
+			break;
+		case 4:
+			snprintf(buf, sizeof(buf), "\ttab\t%.8e", val);
+			fins << "l1 ~tab~ !" << name << "!" << endl;
+			break;
+		case 5:
+			snprintf(buf, sizeof(buf), "x=%.9e,y=1.0", val);
+			fins << "l1 ~x=~ !" << name << "! ~,y~" << endl;
+			break;
+		case 6:
+			snprintf(buf, sizeof(buf), "%.6e %.12E", uni(gen), val);
+			fins << "l1 !dum! !" << name << "!" << endl;
+			break;
+		default:
+			{
+				//a fortran double precision exponent
+				snprintf(buf, sizeof(buf), "%.7e", val);
+				string s = buf;
+				s[s.find('e')] = 'D';
+				snprintf(buf, sizeof(buf), "   %s", s.c_str());
+				fout << "skipped line" << endl;
+				fins << "l2 t3 !" << name << "!" << endl;
+			}
+			break;
+		}
+		fout << buf << endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && (string(argv[1]) == "-h" || string(argv[1]) == "--help"))
+	{
+		usage(cout);
+		return 0;
+	}
+	int npar = (argc > 1) ? atoi(argv[1]) : 2000;
+	int nobs = (argc > 2) ? atoi(argv[2]) : 5000;
+	int nruns = (argc > 3) ? atoi(argv[3]) : 200;
+	if (npar < 8 || nobs < 1 || nruns < 1)
+	{
+		usage(cout);
+		return 1;
+	}
+	mt19937 gen(1234);
+	vector<string> par_names;
+	vector<int> widths;
+	vector<string> obs_names;
+	write_template(npar, par_names, widths, gen);
+	write_output_and_instructions(nobs, obs_names, gen);
+
+	//parameter values for each run: the narrow spaces get numbers that fit in them
+	uniform_real_distribution<double> uni(-1.0, 1.0);
+	uniform_real_distribution<double> exp_dist(-270.0, 270.0);
+	uniform_real_distribution<double> small_exp_dist(-2.0, 2.0);
+	vector<vector<double>> run_pars(nruns, vector<double>(npar));
+	for (auto &pars : run_pars)
+	{
+		for (int i = 0; i < npar; ++i)
+		{
+			int choice = uniform_int_distribution<int>(0, 9)(gen);
+			if (widths[i] < 10)
+				pars[i] = floor(uni(gen) * pow(10.0, widths[i] - 3)) / 10.0;
+			else if (choice == 0)
+				pars[i] = 0.0;
+			else if (choice == 1)
+				pars[i] = (uni(gen) > 0 ? 1.0 : -1.0) * (pow(10.0, floor(exp_dist(gen) / 10.0)) - 1.0e-12);
+			else if (choice < 5)
+				pars[i] = uni(gen) * pow(10.0, small_exp_dist(gen));
+			else
+				pars[i] = uni(gen) * pow(10.0, exp_dist(gen));
+			//mio can not write negative zero
+			if (pars[i] == 0.0)
+				pars[i] = 0.0;
+		}
+	}
+
+	//mio module setup
+	int ifail;
+	int ntpl = 1;
+	int nins = 1;
+	mio_initialise_w_(&ifail, &ntpl, &nins, &npar, &nobs);
+	if (ifail != 0) throw_mio_error(ifail, "initializing mio module");
+	vector<pair<int, string>> files = { { 1, TPL_FILE }, { 2, MIO_IN_FILE }, { 3, INS_FILE }, { 4, OUT_FILE } };
+	for (auto &f : files)
+	{
+		long f_name_len = 180;
+		int inum = 1;
+		vector<char> f_name = pest_utils::string_as_fortran_char_ptr(f.second, f_name_len);
+		mio_put_file_w_(&ifail, &f.first, &inum, f_name.data(), f_name_len);
+		if (ifail != 0) throw_mio_error(ifail, "putting file " + f.second);
+	}
+	pest_utils::StringvecFortranCharArray fort_par_names(par_names, 200, pest_utils::TO_LOWER);
+	pest_utils::StringvecFortranCharArray fort_obs_names(obs_names, 200, pest_utils::TO_LOWER);
+	mio_process_template_files_w_(&ifail, &npar, fort_par_names.get_prt());
+	if (ifail != 0) throw_mio_error(ifail, "error in template files");
+	mio_store_instruction_set_w_(&ifail);
+	if (ifail != 0) throw_mio_error(ifail, "error building instruction set");
+
+	//native setup
+	unordered_map<string, int> par_index;
+	for (int i = 0; i < npar; ++i)
+		par_index[par_names[i]] = i;
+	unordered_map<string, int> obs_index;
+	for (int i = 0; i < nobs; ++i)
+		obs_index[obs_names[i]] = i;
+	TemplateFile tpl(TPL_FILE, NATIVE_IN_FILE);
+	InstructionFile ins(INS_FILE, OUT_FILE);
+	vector<int> par_widths(npar, 1000);
+	vector<int> obs_cited(nobs, 0);
+	tpl.compile(par_index, par_widths);
+	ins.compile(obs_index, obs_cited);
+
+	//compare the model input files written and the values read back
+	int n_file_diff = 0;
+	int n_par_diff = 0;
+	int n_obs_diff = 0;
+	vector<double> mio_obs(nobs);
+	vector<double> native_obs(nobs);
+	vector<string> par_words(npar);
+	for (int irun = 0; irun < nruns; ++irun)
+	{
+		vector<double> mio_pars = run_pars[irun];
+		mio_write_model_input_files_w_(&ifail, &npar, fort_par_names.get_prt(), mio_pars.data());
+		string mio_error;
+		if (ifail != 0)
+		{
+			try
+			{
+				throw_mio_error(ifail, "error writing model input files");
+			}
+			catch (exception &e)
+			{
+				mio_error = e.what();
+				mio_error = mio_error.substr(mio_error.find('\n') + 1);
+			}
+		}
+		vector<double> native_pars = run_pars[irun];
+		string native_error;
+		for (int i = 0; i < npar; ++i)
+		{
+			int jfail = TemplateFile::format_value(native_pars[i], par_widths[i], par_words[i], native_pars[i]);
+			if (jfail != 0)
+			{
+				native_error = TemplateFile::format_error_message(jfail, par_names[i]);
+				break;
+			}
+		}
+		//values that can not be written must be rejected by both
+		if (!mio_error.empty() || !native_error.empty())
+		{
+			if (mio_error != native_error)
+			{
+				cout << "error difference:" << endl << "  mio:    " << mio_error << endl << "  native: " << native_error << endl;
+				for (int i = 0; i < npar; ++i)
+				{
+					if (mio_error.find("\"" + par_names[i] + "\"") != string::npos)
+						cout << "  value: " << setprecision(17) << run_pars[irun][i] << ", width: " << par_widths[i] << endl;
+				}
+				++n_file_diff;
+			}
+			run_pars[irun] = run_pars[0];
+			continue;
+		}
+		tpl.write(par_words);
+		for (int i = 0; i < npar; ++i)
+		{
+			if (mio_pars[i] != native_pars[i])
+			{
+				if (n_par_diff < 10)
+					cout << "parameter value difference: " << par_names[i] << " " << run_pars[irun][i] << " mio: " << mio_pars[i] << " native: " << native_pars[i] << endl;
+				++n_par_diff;
+			}
+		}
+		string mio_in = read_file(MIO_IN_FILE);
+		string native_in = read_file(NATIVE_IN_FILE);
+		if (mio_in != native_in)
+		{
+			if (n_file_diff < 3)
+			{
+				stringstream mss(mio_in), nss(native_in);
+				string mline, nline;
+				while (getline(mss, mline) && getline(nss, nline))
+				{
+					if (mline != nline)
+					{
+						cout << "model input file difference:" << endl << "  mio:    " << mline << endl << "  native: " << nline << endl;
+						break;
+					}
+				}
+			}
+			++n_file_diff;
+		}
+	}
+	mio_read_model_output_files_w_(&ifail, &nobs, fort_obs_names.get_prt(), mio_obs.data());
+	if (ifail != 0) throw_mio_error(ifail, "error processing model output files");
+	native_obs.assign(nobs, InstructionFile::NOT_READ);
+	ins.read(native_obs);
+	for (int i = 0; i < nobs; ++i)
+	{
+		if (mio_obs[i] != native_obs[i])
+		{
+			if (n_obs_diff < 10)
+				cout << "observation value difference: " << obs_names[i] << " mio: " << mio_obs[i] << " native: " << native_obs[i] << endl;
+			++n_obs_diff;
+		}
+	}
+
+	//timing
+	auto time_it = [&](function<void(int)> f)
+	{
+		auto start = chrono::steady_clock::now();
+		for (int irun = 0; irun < nruns; ++irun)
+			f(irun);
+		return chrono::duration<double>(chrono::steady_clock::now() - start).count() / nruns;
+	};
+	double mio_write = time_it([&](int irun)
+	{
+		vector<double> pars = run_pars[irun];
+		mio_write_model_input_files_w_(&ifail, &npar, fort_par_names.get_prt(), pars.data());
+	});
+	double native_write = time_it([&](int irun)
+	{
+		vector<double> pars = run_pars[irun];
+		for (int i = 0; i < npar; ++i)
+			TemplateFile::format_value(pars[i], par_widths[i], par_words[i], pars[i]);
+		tpl.write(par_words);
+	});
+	double mio_read = time_it([&](int irun)
+	{
+		mio_read_model_output_files_w_(&ifail, &nobs, fort_obs_names.get_prt(), mio_obs.data());
+	});
+	double native_read = time_it([&](int irun)
+	{
+		native_obs.assign(nobs, InstructionFile::NOT_READ);
+		ins.read(native_obs);
+	});
+	mio_finalise_w_(&ifail);
+
+	cout << endl << npar << " parameters, " << nobs << " observations, " << nruns << " runs" << endl;
+	cout << "model input files that differ:     " << n_file_diff << endl;
+	cout << "parameter values that differ:      " << n_par_diff << endl;
+	cout << "observation values that differ:    " << n_obs_diff << endl << endl;
+	cout << "milliseconds per run        mio     native   speedup" << endl;
+	printf("  write model input file  %8.3f  %8.3f  %7.1f\n", mio_write * 1000.0, native_write * 1000.0, mio_write / native_write);
+	printf("  read model output file  %8.3f  %8.3f  %7.1f\n", mio_read * 1000.0, native_read * 1000.0, mio_read / native_read);
+	return (n_file_diff + n_par_diff + n_obs_diff == 0) ? 0 : 1;
+}